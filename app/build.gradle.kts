@@ -32,6 +32,9 @@ android {
             }
         }
 
+        // Signature delta endpoint; empty disables updates
+        buildConfigField("String", "SIGNATURE_UPDATE_URL", "\"\"")
+
         // VirusTotal API Key
         buildConfigField("String", "VIRUSTOTAL_API_KEY", "\"dd0bb75b40a994607a4946bd3360e8d43842f3caccfe90dd603fd7d6a59053da\"")
     }
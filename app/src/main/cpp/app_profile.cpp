@@ -0,0 +1,139 @@
+#include "app_profile.h"
+#include "score_table.h"
+#include <algorithm>
+#include <cctype>
+#include <string_view>
+
+namespace {
+
+// Runtime permissions with user data or sensors behind them
+constexpr std::string_view kDangerousPermissions[] = {
+    "android.permission.SEND_SMS",
+    "android.permission.RECEIVE_SMS",
+    "android.permission.READ_SMS",
+    "android.permission.WRITE_SMS",
+    "android.permission.RECEIVE_WAP_PUSH",
+    "android.permission.RECEIVE_MMS",
+    "android.permission.READ_CALL_LOG",
+    "android.permission.WRITE_CALL_LOG",
+    "android.permission.PROCESS_OUTGOING_CALLS",
+    "android.permission.READ_CONTACTS",
+    "android.permission.WRITE_CONTACTS",
+    "android.permission.GET_ACCOUNTS",
+    "android.permission.ACCESS_FINE_LOCATION",
+    "android.permission.ACCESS_COARSE_LOCATION",
+    "android.permission.ACCESS_BACKGROUND_LOCATION",
+    "android.permission.RECORD_AUDIO",
+    "android.permission.CAMERA",
+    "android.permission.READ_PHONE_STATE",
+    "android.permission.CALL_PHONE",
+    "android.permission.READ_PHONE_NUMBERS",
+    "android.permission.ANSWER_PHONE_CALLS",
+    "android.permission.BODY_SENSORS",
+    "android.permission.ACTIVITY_RECOGNITION",
+    "android.permission.READ_CALENDAR",
+    "android.permission.WRITE_CALENDAR",
+    "android.permission.READ_EXTERNAL_STORAGE",
+    "android.permission.WRITE_EXTERNAL_STORAGE",
+    "android.permission.MANAGE_EXTERNAL_STORAGE"
+};
+
+// Rarely needed by a legitimate app: SMS, call interception, screen
+// reading, device admin, overlays and package installs
+constexpr std::string_view kHighRiskPermissions[] = {
+    "android.permission.SEND_SMS",
+    "android.permission.RECEIVE_SMS",
+    "android.permission.READ_SMS",
+    "android.permission.PROCESS_OUTGOING_CALLS",
+    "android.permission.BIND_ACCESSIBILITY_SERVICE",
+    "android.permission.BIND_DEVICE_ADMIN",
+    "android.permission.SYSTEM_ALERT_WINDOW",
+    "android.permission.REQUEST_INSTALL_PACKAGES",
+    "android.permission.INSTALL_PACKAGES",
+    "android.permission.DELETE_PACKAGES"
+};
+
+// Package names posing as the platform or its vendors
+constexpr std::string_view kImpersonatedPrefixes[] = {
+    "com.android.",
+    "com.google.android.",
+    "com.samsung."
+};
+
+// Name parts advertising a pirated or tampered app
+constexpr std::string_view kTamperedMarkers[] = {
+    ".free.",
+    ".hack",
+    ".crack",
+    ".mod."
+};
+
+template <size_t N>
+bool isListed(const std::string_view (&list)[N], std::string_view value) {
+    return std::find(std::begin(list), std::end(list), value) != std::end(list);
+}
+
+bool endsWith(std::string_view name, std::string_view suffix) {
+    return name.size() >= suffix.size() && name.substr(name.size() - suffix.size()) == suffix;
+}
+
+} // namespace
+
+void profileManifest(const ManifestInfo& manifest, AppProfile& profile) {
+    for (const std::string& permission : manifest.permissions) {
+        if (isListed(kDangerousPermissions, permission)) {
+            profile.dangerousPermissions.push_back(permission);
+        }
+        if (isListed(kHighRiskPermissions, permission)) {
+            profile.highRiskPermissions.push_back(permission);
+        }
+    }
+
+    std::string name(manifest.packageName);
+    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+    std::string_view packageName(name);
+    for (std::string_view prefix : kImpersonatedPrefixes) {
+        profile.suspiciousPackageName = profile.suspiciousPackageName ||
+                                        packageName.substr(0, prefix.size()) == prefix;
+    }
+    for (std::string_view marker : kTamperedMarkers) {
+        profile.suspiciousPackageName = profile.suspiciousPackageName ||
+                                        packageName.find(marker) != std::string_view::npos;
+    }
+}
+
+void profileEntries(const ZipArchive& apk, AppProfile& profile) {
+    for (const ZipEntry& entry : apk.entries()) {
+        std::string_view name = entry.name;
+        if (name == "AndroidManifest.xml") {
+            profile.hasManifest = true;
+        } else if (endsWith(name, ".dex")) {
+            profile.hasDex = true;
+            profile.dexCount++;
+            // The runtime only loads classes*.dex at the top level; others
+            // are loaded by the app's own code
+            if (name.substr(0, 7) != "classes" || name.find('/') != std::string_view::npos) {
+                profile.suspiciousFiles.push_back("Hidden DEX: " + std::string(name));
+            }
+        } else if (name.substr(0, 4) == "lib/" && endsWith(name, ".so")) {
+            profile.hasNativeLibraries = true;
+        } else if (endsWith(name, ".apk")) {
+            profile.suspiciousFiles.push_back("Embedded APK: " + std::string(name));
+        } else if (endsWith(name, ".jar")) {
+            profile.suspiciousFiles.push_back("Embedded JAR: " + std::string(name));
+        }
+    }
+}
+
+int appRiskScore(const AppProfile& profile) {
+    AppFeatures features;
+    features.add(AppFeature::HighRiskPermission,
+                 static_cast<uint32_t>(profile.highRiskPermissions.size()));
+    features.add(AppFeature::DangerousPermission,
+                 static_cast<uint32_t>(profile.dangerousPermissions.size()));
+    features.add(AppFeature::SuspiciousPackageName, profile.suspiciousPackageName ? 1 : 0);
+    features.add(AppFeature::InvalidStructure, profile.hasInvalidStructure() ? 1 : 0);
+    features.add(AppFeature::ExcessiveDex, profile.hasExcessiveDex() ? 1 : 0);
+    features.add(AppFeature::SuspiciousFile, static_cast<uint32_t>(profile.suspiciousFiles.size()));
+    return features.score(kAppScoreTable);
+}
@@ -0,0 +1,17 @@
+#ifndef WHATSZAP_APP_PROFILE_H
+#define WHATSZAP_APP_PROFILE_H
+
+#include "scan_result.h"
+#include "zip_reader.h"
+
+// Sort the manifest's permissions by risk and check its package name
+void profileManifest(const ManifestInfo& manifest, AppProfile& profile);
+
+// Count what one APK is built from; for a bundle, call once per split.
+// Reads the central directory only.
+void profileEntries(const ZipArchive& apk, AppProfile& profile);
+
+// 0-100 from what the profile holds, by the rules of kAppRules
+int appRiskScore(const AppProfile& profile);
+
+#endif // WHATSZAP_APP_PROFILE_H
@@ -0,0 +1,179 @@
+#include "archive_probe.h"
+#include "scan_arena.h"
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <strings.h>
+#include <algorithm>
+#include <string_view>
+
+namespace {
+
+// Record layouts as in zip_reader.cpp
+constexpr uint32_t kLocalHeaderSig = 0x04034b50;
+constexpr uint32_t kCentralHeaderSig = 0x02014b50;
+constexpr uint32_t kEndOfCentralDirSig = 0x06054b50;
+constexpr uint32_t kZip64EndOfCentralDirSig = 0x06064b50;
+constexpr uint32_t kZip64LocatorSig = 0x07064b50;
+
+constexpr size_t kLocalHeaderSize = 30;
+constexpr size_t kCentralHeaderSize = 46;
+constexpr size_t kEndOfCentralDirSize = 22;
+constexpr size_t kZip64LocatorSize = 20;
+constexpr size_t kZip64EndOfCentralDirSize = 56;
+
+// A central directory outside the tail is read up to this much; past it
+// only the entries read so far count
+constexpr uint64_t kMaxCentralDirectoryRead = 8 * 1024 * 1024;
+
+constexpr std::string_view kManifestName = "AndroidManifest.xml";
+
+inline uint16_t readU16(const uint8_t* p) {
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+inline uint32_t readU32(const uint8_t* p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+inline uint64_t readU64(const uint8_t* p) {
+    return static_cast<uint64_t>(readU32(p)) | (static_cast<uint64_t>(readU32(p + 4)) << 32);
+}
+
+bool readFully(int fd, uint8_t* out, size_t length, uint64_t offset) {
+    while (length > 0) {
+        ssize_t got = pread(fd, out, length, static_cast<off_t>(offset));
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return false;
+        }
+        out += got;
+        length -= static_cast<size_t>(got);
+        offset += static_cast<uint64_t>(got);
+    }
+    return true;
+}
+
+bool isApkName(std::string_view name) {
+    return name.size() > 4 && strncasecmp(name.data() + name.size() - 4, ".apk", 4) == 0;
+}
+
+ArchiveKind classifyCentralDirectory(const uint8_t* pos, const uint8_t* end) {
+    bool hasApk = false;
+    while (end - pos >= static_cast<ptrdiff_t>(kCentralHeaderSize) &&
+           readU32(pos) == kCentralHeaderSig) {
+        uint16_t nameLength = readU16(pos + 28);
+        size_t recordSize = kCentralHeaderSize + nameLength + readU16(pos + 30) + readU16(pos + 32);
+        if (static_cast<size_t>(end - pos) < kCentralHeaderSize + nameLength) {
+            break;
+        }
+        std::string_view name(reinterpret_cast<const char*>(pos + kCentralHeaderSize), nameLength);
+        if (name == kManifestName) {
+            return ArchiveKind::Apk;
+        }
+        hasApk = hasApk || isApkName(name);
+        if (static_cast<size_t>(end - pos) < recordSize) {
+            break;
+        }
+        pos += recordSize;
+    }
+    return hasApk ? ArchiveKind::ApkBundle : ArchiveKind::Zip;
+}
+
+} // namespace
+
+ArchiveKind probeArchive(int fd, uint64_t size) {
+    if (size < kEndOfCentralDirSize) {
+        return ArchiveKind::NotArchive;
+    }
+    ScanArena& arena = ScanArena::local();
+    ArenaScope scope(arena);
+
+    size_t headLength = static_cast<size_t>(std::min<uint64_t>(size, kProbeHeadSize));
+    uint8_t* head = arena.allocateArray<uint8_t>(headLength);
+    if (!readFully(fd, head, headLength, 0)) {
+        return ArchiveKind::NotArchive;
+    }
+    uint64_t tailStart = size > kProbeTailSize ? size - kProbeTailSize : 0;
+    size_t tailLength = static_cast<size_t>(size - tailStart);
+    const uint8_t* tail = head;
+    if (tailLength > headLength || tailStart != 0) {
+        uint8_t* buffer = arena.allocateArray<uint8_t>(tailLength);
+        if (!readFully(fd, buffer, tailLength, tailStart)) {
+            return ArchiveKind::NotArchive;
+        }
+        tail = buffer;
+    }
+
+    // Last EOCD signature in the tail, as zip_reader finds it
+    size_t eocd = SIZE_MAX;
+    for (size_t pos = tailLength - kEndOfCentralDirSize + 1; pos-- > 0;) {
+        if (readU32(tail + pos) == kEndOfCentralDirSig) {
+            eocd = pos;
+            break;
+        }
+    }
+    if (eocd == SIZE_MAX) {
+        return ArchiveKind::NotArchive;
+    }
+    const uint8_t* record = tail + eocd;
+    uint64_t entryCount = readU16(record + 10);
+    uint64_t cdSize = readU32(record + 12);
+    uint64_t cdOffset = readU32(record + 16);
+
+    if ((cdOffset == 0xFFFFFFFF || cdSize == 0xFFFFFFFF || entryCount == 0xFFFF) &&
+        eocd >= kZip64LocatorSize && readU32(record - kZip64LocatorSize) == kZip64LocatorSig) {
+        uint64_t zip64Offset = readU64(record - kZip64LocatorSize + 8);
+        uint8_t zip64[kZip64EndOfCentralDirSize];
+        if (size >= kZip64EndOfCentralDirSize && zip64Offset <= size - kZip64EndOfCentralDirSize &&
+            readFully(fd, zip64, sizeof(zip64), zip64Offset) &&
+            readU32(zip64) == kZip64EndOfCentralDirSig) {
+            cdSize = readU64(zip64 + 40);
+            cdOffset = readU64(zip64 + 48);
+        }
+    }
+    if (cdOffset > size || cdSize > size - cdOffset) {
+        return ArchiveKind::NotArchive;
+    }
+
+    // Most APKs start with the manifest's local header
+    if (headLength >= kLocalHeaderSize + kManifestName.size() && readU32(head) == kLocalHeaderSig &&
+        readU16(head + 26) == kManifestName.size() &&
+        memcmp(head + kLocalHeaderSize, kManifestName.data(), kManifestName.size()) == 0) {
+        return ArchiveKind::Apk;
+    }
+
+    if (cdOffset >= tailStart) {
+        const uint8_t* cd = tail + (cdOffset - tailStart);
+        return classifyCentralDirectory(cd, cd + cdSize);
+    }
+    size_t readLength = static_cast<size_t>(std::min(cdSize, kMaxCentralDirectoryRead));
+    uint8_t* cd = arena.allocateArray<uint8_t>(readLength);
+    if (!readFully(fd, cd, readLength, cdOffset)) {
+        return ArchiveKind::Zip;
+    }
+    return classifyCentralDirectory(cd, cd + readLength);
+}
+
+ArchiveKind probeArchive(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return ArchiveKind::NotArchive;
+    }
+    struct stat fileStat;
+    ArchiveKind kind = ArchiveKind::NotArchive;
+    if (fstat(fd, &fileStat) == 0 && S_ISREG(fileStat.st_mode)) {
+        kind = probeArchive(fd, static_cast<uint64_t>(fileStat.st_size));
+    }
+    close(fd);
+    return kind;
+}
+
+bool startsWithZipHeader(const uint8_t* data, size_t length) {
+    return length >= 4 && readU32(data) == kLocalHeaderSig;
+}
@@ -0,0 +1,37 @@
+#ifndef WHATSZAP_ARCHIVE_PROBE_H
+#define WHATSZAP_ARCHIVE_PROBE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+enum class ArchiveKind : int {
+    NotArchive = 0,
+    Zip = 1,            // a ZIP with neither a manifest nor APKs inside
+    Apk = 2,            // AndroidManifest.xml at the top level
+    ApkBundle = 3       // split APKs inside: XAPK, APKS, APKM
+};
+
+// Classifies a file by its content instead of its name, so a renamed APK
+// (".apk.pdf", no extension) is still recognized. Reads the first
+// kProbeHeadSize bytes and the last kProbeTailSize, which hold the End of
+// Central Directory record wherever its comment puts it, with one pread
+// each. The central directory usually lies in the tail too; when it does
+// not, it alone is read, never the entry data. The file does not have to
+// start with a local header, since Android's own parser goes by the EOCD.
+ArchiveKind probeArchive(int fd, uint64_t size);
+ArchiveKind probeArchive(const std::string& path);
+
+// Whether the first bytes of a file are a ZIP local header, for deciding
+// from a partial download whether it is worth streaming
+bool startsWithZipHeader(const uint8_t* data, size_t length);
+
+inline bool isApkArchive(ArchiveKind kind) {
+    return kind == ArchiveKind::Apk || kind == ArchiveKind::ApkBundle;
+}
+
+constexpr size_t kProbeHeadSize = 4 * 1024;
+// EOCD record plus the longest comment
+constexpr size_t kProbeTailSize = 22 + 0xFFFF;
+
+#endif // WHATSZAP_ARCHIVE_PROBE_H
@@ -0,0 +1,410 @@
+#include "axml_parser.h"
+#include <cstdlib>
+
+namespace {
+
+constexpr uint16_t RES_STRING_POOL_TYPE = 0x0001;
+constexpr uint16_t RES_XML_TYPE = 0x0003;
+constexpr uint16_t RES_XML_START_ELEMENT_TYPE = 0x0102;
+constexpr uint16_t RES_XML_END_ELEMENT_TYPE = 0x0103;
+constexpr uint16_t RES_XML_RESOURCE_MAP_TYPE = 0x0180;
+
+constexpr uint32_t UTF8_FLAG = 1 << 8;
+
+constexpr uint8_t TYPE_STRING = 0x03;
+constexpr uint8_t TYPE_FIRST_INT = 0x10;
+constexpr uint8_t TYPE_LAST_INT = 0x1f;
+
+// android.R.attr IDs of the attributes we read
+constexpr uint32_t ATTR_LABEL = 0x01010001;
+constexpr uint32_t ATTR_NAME = 0x01010003;
+constexpr uint32_t ATTR_PERMISSION = 0x01010006;
+constexpr uint32_t ATTR_MIN_SDK_VERSION = 0x0101020c;
+constexpr uint32_t ATTR_VERSION_CODE = 0x0101021b;
+constexpr uint32_t ATTR_VERSION_NAME = 0x0101021c;
+constexpr uint32_t ATTR_TARGET_SDK_VERSION = 0x01010270;
+
+constexpr size_t kChunkHeaderSize = 8;
+constexpr size_t kStringPoolHeaderSize = 28;
+constexpr size_t kTreeNodeHeaderSize = 16;
+constexpr size_t kAttrExtSize = 20;
+constexpr size_t kAttributeSize = 20;
+
+inline uint16_t readU16(const uint8_t* p) {
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+inline uint32_t readU32(const uint8_t* p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+constexpr uint32_t kReplacementCharacter = 0xFFFD;
+
+// Decoded strings are modified UTF-8, as NewStringUTF takes them: NUL is
+// C0 80 and each UTF-16 unit, surrogates included, is encoded alone
+void appendModifiedUtf8(std::string& out, uint32_t unit) {
+    if (unit != 0 && unit < 0x80) {
+        out.push_back(static_cast<char>(unit));
+    } else if (unit < 0x800) {
+        out.push_back(static_cast<char>(0xC0 | (unit >> 6)));
+        out.push_back(static_cast<char>(0x80 | (unit & 0x3F)));
+    } else {
+        out.push_back(static_cast<char>(0xE0 | (unit >> 12)));
+        out.push_back(static_cast<char>(0x80 | ((unit >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (unit & 0x3F)));
+    }
+}
+
+// A supplementary character becomes its surrogate pair
+void appendCodePoint(std::string& out, uint32_t codePoint) {
+    if (codePoint >= 0x10000) {
+        codePoint -= 0x10000;
+        appendModifiedUtf8(out, 0xD800 + (codePoint >> 10));
+        appendModifiedUtf8(out, 0xDC00 + (codePoint & 0x3FF));
+    } else {
+        appendModifiedUtf8(out, codePoint);
+    }
+}
+
+// Decode one well-formed UTF-8 sequence; returns its length, or 0 for an
+// overlong, truncated or surrogate sequence or a stray byte
+size_t decodeUtf8(const uint8_t* p, size_t available, uint32_t& codePoint) {
+    uint8_t lead = p[0];
+    if (lead < 0x80) {
+        codePoint = lead;
+        return 1;
+    }
+    size_t length;
+    uint8_t low = 0x80;
+    uint8_t high = 0xBF;
+    if (lead >= 0xC2 && lead <= 0xDF) {
+        length = 2;
+        codePoint = lead & 0x1F;
+    } else if (lead >= 0xE0 && lead <= 0xEF) {
+        length = 3;
+        codePoint = lead & 0x0F;
+        low = lead == 0xE0 ? 0xA0 : 0x80;
+        high = lead == 0xED ? 0x9F : 0xBF;
+    } else if (lead >= 0xF0 && lead <= 0xF4) {
+        length = 4;
+        codePoint = lead & 0x07;
+        low = lead == 0xF0 ? 0x90 : 0x80;
+        high = lead == 0xF4 ? 0x8F : 0xBF;
+    } else {
+        return 0;
+    }
+    if (length > available) {
+        return 0;
+    }
+    for (size_t i = 1; i < length; i++) {
+        uint8_t next = p[i];
+        if (next < (i == 1 ? low : 0x80) || next > (i == 1 ? high : 0xBF)) {
+            return 0;
+        }
+        codePoint = (codePoint << 6) | (next & 0x3F);
+    }
+    return length;
+}
+
+// Read a UTF-8 pool length prefix (one byte, or two with the high bit set)
+bool readLength8(const uint8_t* pool, size_t poolSize, size_t& pos, size_t& length) {
+    if (pos >= poolSize) {
+        return false;
+    }
+    length = pool[pos];
+    if (length & 0x80) {
+        if (pos + 1 >= poolSize) {
+            return false;
+        }
+        length = ((length & 0x7F) << 8) | pool[pos + 1];
+        pos += 2;
+    } else {
+        pos += 1;
+    }
+    return true;
+}
+
+// Decode every string of a RES_STRING_POOL chunk to UTF-8
+bool decodeStringPool(const uint8_t* chunk, size_t chunkSize, std::vector<std::string>& strings) {
+    if (chunkSize < kStringPoolHeaderSize) {
+        return false;
+    }
+    uint16_t headerSize = readU16(chunk + 2);
+    uint32_t stringCount = readU32(chunk + 8);
+    uint32_t flags = readU32(chunk + 16);
+    uint32_t stringsStart = readU32(chunk + 20);
+    if (headerSize < kStringPoolHeaderSize || headerSize > chunkSize ||
+        stringCount > (chunkSize - headerSize) / 4 || stringsStart > chunkSize) {
+        return false;
+    }
+
+    bool isUtf8 = (flags & UTF8_FLAG) != 0;
+    const uint8_t* offsets = chunk + headerSize;
+    const uint8_t* pool = chunk + stringsStart;
+    size_t poolSize = chunkSize - stringsStart;
+
+    strings.clear();
+    strings.resize(stringCount);
+    for (uint32_t i = 0; i < stringCount; i++) {
+        size_t pos = readU32(offsets + i * 4);
+        std::string& out = strings[i];
+
+        if (isUtf8) {
+            // UTF-16 length then UTF-8 length, each one or two bytes
+            size_t utf16Length = 0;
+            size_t length = 0;
+            if (!readLength8(pool, poolSize, pos, utf16Length) ||
+                !readLength8(pool, poolSize, pos, length) || length > poolSize - pos) {
+                continue;
+            }
+            // Pool bytes are untrusted; malformed ones become U+FFFD
+            out.reserve(length);
+            const uint8_t* bytes = pool + pos;
+            for (size_t b = 0; b < length;) {
+                uint32_t codePoint;
+                size_t consumed = decodeUtf8(bytes + b, length - b, codePoint);
+                if (consumed == 0) {
+                    codePoint = kReplacementCharacter;
+                    consumed = 1;
+                }
+                appendCodePoint(out, codePoint);
+                b += consumed;
+            }
+        } else {
+            if (pos + 2 > poolSize) {
+                continue;
+            }
+            size_t length = readU16(pool + pos);
+            pos += 2;
+            if (length & 0x8000) {
+                if (pos + 2 > poolSize) {
+                    continue;
+                }
+                length = ((length & 0x7FFF) << 16) | readU16(pool + pos);
+                pos += 2;
+            }
+            if (length > (poolSize - pos) / 2) {
+                continue;
+            }
+            out.reserve(length);
+            for (size_t c = 0; c < length; c++) {
+                uint32_t unit = readU16(pool + pos + c * 2);
+                if (unit >= 0xD800 && unit <= 0xDBFF && c + 1 < length) {
+                    uint32_t low = readU16(pool + pos + (c + 1) * 2);
+                    if (low >= 0xDC00 && low <= 0xDFFF) {
+                        // A pair stays two units in modified UTF-8
+                        appendModifiedUtf8(out, unit);
+                        appendModifiedUtf8(out, low);
+                        c++;
+                        continue;
+                    }
+                }
+                if (unit >= 0xD800 && unit <= 0xDFFF) {
+                    unit = kReplacementCharacter;
+                }
+                appendModifiedUtf8(out, unit);
+            }
+        }
+    }
+    return true;
+}
+
+struct Attribute {
+    uint32_t resourceId;
+    const std::string* name;
+    const std::string* stringValue;
+    uint8_t dataType;
+    uint32_t data;
+};
+
+class ManifestBuilder {
+public:
+    explicit ManifestBuilder(ManifestInfo& info) : info_(info), depth_(0), componentDepth_(-1) {}
+
+    bool parse(const uint8_t* data, size_t size) {
+        if (size < kChunkHeaderSize || readU16(data) != RES_XML_TYPE) {
+            return false;
+        }
+        size_t xmlSize = readU32(data + 4);
+        size_t pos = readU16(data + 2);
+        if (xmlSize > size) {
+            xmlSize = size;
+        }
+
+        bool sawElement = false;
+        while (pos + kChunkHeaderSize <= xmlSize) {
+            const uint8_t* chunk = data + pos;
+            uint16_t type = readU16(chunk);
+            size_t chunkSize = readU32(chunk + 4);
+            if (chunkSize < kChunkHeaderSize || chunkSize > xmlSize - pos) {
+                break;
+            }
+
+            switch (type) {
+                case RES_STRING_POOL_TYPE:
+                    if (!decodeStringPool(chunk, chunkSize, strings_)) {
+                        return false;
+                    }
+                    break;
+                case RES_XML_RESOURCE_MAP_TYPE: {
+                    size_t headerSize = readU16(chunk + 2);
+                    for (size_t off = headerSize; off + 4 <= chunkSize; off += 4) {
+                        resourceIds_.push_back(readU32(chunk + off));
+                    }
+                    break;
+                }
+                case RES_XML_START_ELEMENT_TYPE:
+                    startElement(chunk, chunkSize);
+                    sawElement = true;
+                    break;
+                case RES_XML_END_ELEMENT_TYPE:
+                    endElement();
+                    break;
+                default:
+                    break;
+            }
+            pos += chunkSize;
+        }
+        return sawElement && !strings_.empty();
+    }
+
+private:
+    const std::string* stringAt(uint32_t index) const {
+        return index < strings_.size() ? &strings_[index] : nullptr;
+    }
+
+    void startElement(const uint8_t* chunk, size_t chunkSize) {
+        size_t headerSize = readU16(chunk + 2);
+        if (headerSize < kTreeNodeHeaderSize || headerSize + kAttrExtSize > chunkSize) {
+            depth_++;
+            return;
+        }
+        const uint8_t* ext = chunk + headerSize;
+        const std::string* element = stringAt(readU32(ext + 4));
+        uint16_t attributeStart = readU16(ext + 8);
+        uint16_t attributeSize = readU16(ext + 10);
+        uint16_t attributeCount = readU16(ext + 12);
+
+        attributes_.clear();
+        if (attributeSize >= kAttributeSize) {
+            for (uint16_t i = 0; i < attributeCount; i++) {
+                size_t off = headerSize + attributeStart + static_cast<size_t>(i) * attributeSize;
+                if (off + kAttributeSize > chunkSize) {
+                    break;
+                }
+                const uint8_t* raw = chunk + off;
+                uint32_t nameIndex = readU32(raw + 4);
+                Attribute attr;
+                attr.resourceId = nameIndex < resourceIds_.size() ? resourceIds_[nameIndex] : 0;
+                attr.name = stringAt(nameIndex);
+                attr.stringValue = stringAt(readU32(raw + 8));
+                attr.dataType = raw[15];
+                attr.data = readU32(raw + 16);
+                if (attr.dataType == TYPE_STRING && attr.stringValue == nullptr) {
+                    attr.stringValue = stringAt(attr.data);
+                }
+                attributes_.push_back(attr);
+            }
+        }
+
+        if (element != nullptr) {
+            handleElement(*element);
+        }
+        depth_++;
+    }
+
+    void endElement() {
+        depth_--;
+        if (depth_ == componentDepth_) {
+            componentDepth_ = -1;
+        }
+    }
+
+    const Attribute* findAttribute(uint32_t resourceId, const char* name) const {
+        for (const auto& attr : attributes_) {
+            if (attr.resourceId != 0 ? attr.resourceId == resourceId
+                                     : (attr.name != nullptr && *attr.name == name)) {
+                return &attr;
+            }
+        }
+        return nullptr;
+    }
+
+    std::string stringValue(uint32_t resourceId, const char* name) const {
+        const Attribute* attr = findAttribute(resourceId, name);
+        return attr != nullptr && attr->stringValue != nullptr ? *attr->stringValue : std::string();
+    }
+
+    long long intValue(uint32_t resourceId, const char* name) const {
+        const Attribute* attr = findAttribute(resourceId, name);
+        if (attr == nullptr) {
+            return 0;
+        }
+        if (attr->dataType >= TYPE_FIRST_INT && attr->dataType <= TYPE_LAST_INT) {
+            return static_cast<int32_t>(attr->data);
+        }
+        // Some packers store numbers as strings
+        if (attr->stringValue != nullptr) {
+            return strtoll(attr->stringValue->c_str(), nullptr, 10);
+        }
+        return 0;
+    }
+
+    void handleElement(const std::string& element) {
+        if (element == "manifest") {
+            // "package" has no resource ID, match it by name only
+            for (const auto& attr : attributes_) {
+                if (attr.name != nullptr && *attr.name == "package" && attr.stringValue != nullptr) {
+                    info_.packageName = *attr.stringValue;
+                }
+            }
+            info_.versionCode = intValue(ATTR_VERSION_CODE, "versionCode");
+            info_.versionName = stringValue(ATTR_VERSION_NAME, "versionName");
+        } else if (element == "uses-sdk") {
+            info_.minSdkVersion = static_cast<int>(intValue(ATTR_MIN_SDK_VERSION, "minSdkVersion"));
+            info_.targetSdkVersion = static_cast<int>(intValue(ATTR_TARGET_SDK_VERSION, "targetSdkVersion"));
+        } else if (element == "uses-permission" || element == "uses-permission-sdk-23") {
+            std::string permission = stringValue(ATTR_NAME, "name");
+            if (!permission.empty()) {
+                info_.permissions.push_back(permission);
+            }
+        } else if (element == "application") {
+            info_.label = stringValue(ATTR_LABEL, "label");
+        } else if (element == "activity" || element == "activity-alias" ||
+                   element == "service" || element == "receiver" || element == "provider") {
+            ManifestComponent component;
+            if (element == "service") {
+                component.kind = ManifestComponent::Kind::Service;
+            } else if (element == "receiver") {
+                component.kind = ManifestComponent::Kind::Receiver;
+            } else if (element == "provider") {
+                component.kind = ManifestComponent::Kind::Provider;
+            }
+            component.name = stringValue(ATTR_NAME, "name");
+            component.permission = stringValue(ATTR_PERMISSION, "permission");
+            info_.components.push_back(std::move(component));
+            componentDepth_ = depth_;
+        } else if (element == "action" && componentDepth_ >= 0 && !info_.components.empty()) {
+            std::string action = stringValue(ATTR_NAME, "name");
+            if (!action.empty()) {
+                info_.components.back().actions.push_back(action);
+            }
+        }
+    }
+
+    ManifestInfo& info_;
+    std::vector<std::string> strings_;
+    std::vector<uint32_t> resourceIds_;
+    std::vector<Attribute> attributes_;
+    int depth_;
+    int componentDepth_;
+};
+
+} // namespace
+
+bool AxmlParser::parse(const uint8_t* data, size_t size, ManifestInfo& info) {
+    info = ManifestInfo();
+    ManifestBuilder builder(info);
+    return builder.parse(data, size);
+}
@@ -0,0 +1,43 @@
+#ifndef WHATSZAP_AXML_PARSER_H
+#define WHATSZAP_AXML_PARSER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct ManifestComponent {
+    enum class Kind { Activity, Service, Receiver, Provider };
+
+    Kind kind;
+    std::string name;
+    std::string permission;               // android:permission guarding it
+    std::vector<std::string> actions;     // intent-filter <action> names
+
+    ManifestComponent() : kind(Kind::Activity) {}
+};
+
+// Structured view of a compiled AndroidManifest.xml
+struct ManifestInfo {
+    std::string packageName;
+    std::string versionName;
+    long long versionCode;
+    std::string label;                    // only when given as a literal string
+    int minSdkVersion;
+    int targetSdkVersion;
+    std::vector<std::string> permissions; // <uses-permission> names
+    std::vector<ManifestComponent> components;
+
+    ManifestInfo() : versionCode(0), minSdkVersion(0), targetSdkVersion(0) {}
+};
+
+// Decoder for Android's binary XML (AXML) format. Walks the string pool and
+// the element chunks once, resolving attributes by resource ID so that
+// manifests with obfuscated attribute names still decode.
+class AxmlParser {
+public:
+    // Parse an inflated manifest; returns false if it is not valid AXML
+    static bool parse(const uint8_t* data, size_t size, ManifestInfo& info);
+};
+
+#endif // WHATSZAP_AXML_PARSER_H
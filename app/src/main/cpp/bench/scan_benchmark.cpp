@@ -0,0 +1,393 @@
+// Host benchmark of the scan engine over a corpus of APKs. Each stage runs
+// over every file a number of times and reports, in the manner of Google
+// Benchmark, its throughput, the p50/p99 latency per file and the peak RSS
+// while it ran:
+//
+//   inflate  every entry through ZipArchive::readEntry
+//   match    the signature automaton over the code entries, pre-inflated
+//   hash     the scan's digests over the mapped file
+//   scan     a whole MalwareScanner::scanApk, without the verdict cache
+//
+// Usage: whatszap-bench [options] <apk or directory>...
+//   --iterations N   recorded passes over the corpus per stage (default 5)
+//   --warmup N       unrecorded passes first (default 1)
+//   --threads N      worker pool for whole scans; 0 scans on this thread
+//   --budget MS      scan budget; 0 for none
+//   --filter TEXT    only stages whose name contains TEXT
+//   --json           one JSON document instead of the table
+
+#include "archive_probe.h"
+#include "file_digest.h"
+#include "malware_scanner.h"
+#include "worker_pool.h"
+#include "zip_reader.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <vector>
+
+namespace {
+
+struct Options {
+    int iterations = 5;
+    int warmup = 1;
+    size_t threads = 0;
+    long budgetMs = 0;
+    std::string filter;
+    bool json = false;
+    std::vector<std::string> inputs;
+};
+
+struct CorpusFile {
+    std::string path;
+    uint64_t size;
+};
+
+// One timed run of a stage over one file; bytes is what the stage got
+// through, which is not the file size for inflate and match
+struct Sample {
+    double seconds;
+    uint64_t bytes;
+};
+
+struct StageReport {
+    std::string name;
+    size_t samples;
+    uint64_t bytes;
+    double seconds;
+    double p50Ms;
+    double p99Ms;
+    long peakRssKb;
+};
+
+using StageFn = std::function<uint64_t(const CorpusFile& file)>;
+
+void collectCorpus(const std::string& path, std::vector<CorpusFile>& corpus, bool named = true) {
+    struct stat fileStat;
+    if (stat(path.c_str(), &fileStat) != 0) {
+        fprintf(stderr, "Cannot stat %s: %s\n", path.c_str(), strerror(errno));
+        return;
+    }
+    if (S_ISDIR(fileStat.st_mode)) {
+        // Directories named on the command line are followed, linked ones
+        // below them are not, so a link cycle cannot recurse forever
+        struct stat linkStat;
+        if (!named && lstat(path.c_str(), &linkStat) == 0 && S_ISLNK(linkStat.st_mode)) {
+            return;
+        }
+        DIR* dir = opendir(path.c_str());
+        if (dir == nullptr) {
+            return;
+        }
+        std::vector<std::string> children;
+        while (struct dirent* child = readdir(dir)) {
+            if (strcmp(child->d_name, ".") != 0 && strcmp(child->d_name, "..") != 0) {
+                children.push_back(path + "/" + child->d_name);
+            }
+        }
+        closedir(dir);
+        // Same order on every run, so results compare
+        std::sort(children.begin(), children.end());
+        for (const std::string& child : children) {
+            collectCorpus(child, corpus, false);
+        }
+        return;
+    }
+    // By content, as the monitor does; anything else in the corpus
+    // directory is skipped
+    if (S_ISREG(fileStat.st_mode) && isApkArchive(probeArchive(path))) {
+        corpus.push_back({path, static_cast<uint64_t>(fileStat.st_size)});
+    }
+}
+
+// VmHWM of this process, in KB. Writing 5 to clear_refs resets it, so each
+// stage reports its own peak; without procfs the lifetime peak is used.
+void resetPeakRss() {
+    std::ofstream clearRefs("/proc/self/clear_refs");
+    if (clearRefs) {
+        clearRefs << "5";
+    }
+}
+
+long peakRssKb() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0) {
+            return std::strtol(line.c_str() + 6, nullptr, 10);
+        }
+    }
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+// Nearest-rank percentile of sorted values
+double percentile(const std::vector<double>& sorted, double fraction) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t rank = static_cast<size_t>(std::ceil(fraction * static_cast<double>(sorted.size())));
+    return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+StageReport runStage(const std::string& name, const StageFn& stage,
+                     const std::vector<CorpusFile>& corpus, const Options& options) {
+    for (int pass = 0; pass < options.warmup; pass++) {
+        for (const CorpusFile& file : corpus) {
+            stage(file);
+        }
+    }
+
+    resetPeakRss();
+    std::vector<Sample> samples;
+    samples.reserve(corpus.size() * static_cast<size_t>(options.iterations));
+    for (int pass = 0; pass < options.iterations; pass++) {
+        for (const CorpusFile& file : corpus) {
+            auto start = std::chrono::steady_clock::now();
+            uint64_t bytes = stage(file);
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            samples.push_back({elapsed.count(), bytes});
+        }
+    }
+
+    StageReport report;
+    report.name = name;
+    report.samples = samples.size();
+    report.bytes = 0;
+    report.seconds = 0;
+    std::vector<double> latencies;
+    latencies.reserve(samples.size());
+    for (const Sample& sample : samples) {
+        report.bytes += sample.bytes;
+        report.seconds += sample.seconds;
+        latencies.push_back(sample.seconds * 1000);
+    }
+    std::sort(latencies.begin(), latencies.end());
+    report.p50Ms = percentile(latencies, 0.50);
+    report.p99Ms = percentile(latencies, 0.99);
+    report.peakRssKb = peakRssKb();
+    return report;
+}
+
+uint64_t inflateStage(const CorpusFile& file) {
+    ZipArchive archive;
+    if (!archive.open(file.path)) {
+        return 0;
+    }
+    uint64_t bytes = 0;
+    for (const ZipEntry& entry : archive.entries()) {
+        if (entry.isDirectory()) {
+            continue;
+        }
+        archive.readEntry(entry, [&](const uint8_t*, size_t length) {
+            bytes += length;
+            return true;
+        });
+    }
+    return bytes;
+}
+
+// Code entries of each file, inflated once up front so the match stage
+// times the automaton alone
+class MatchStage {
+public:
+    MatchStage(std::shared_ptr<const SignatureDatabase> database,
+               const std::vector<CorpusFile>& corpus)
+        : database_(std::move(database)) {
+        for (const CorpusFile& file : corpus) {
+            std::vector<std::string>& contents = contents_[file.path];
+            ZipArchive archive;
+            if (!archive.open(file.path)) {
+                continue;
+            }
+            for (const ZipEntry& entry : archive.entries()) {
+                std::string content;
+                if (MalwareScanner::isCodeEntry(entry.name) &&
+                    archive.extractEntry(entry, content, kMaxEntrySize)) {
+                    contents.push_back(std::move(content));
+                }
+            }
+        }
+    }
+
+    uint64_t operator()(const CorpusFile& file) const {
+        auto found = contents_.find(file.path);
+        if (found == contents_.end()) {
+            return 0;
+        }
+        // Every match is taken, as if none settled the entry
+        uint64_t bytes = 0;
+        const PatternMatcher& matcher = database_->matcher();
+        for (const std::string& content : found->second) {
+            PatternMatcher::Cursor cursor;
+            matcher.scan(cursor, reinterpret_cast<const uint8_t*>(content.data()), content.size(),
+                         [](uint32_t, uint64_t) { return true; });
+            bytes += content.size();
+        }
+        return bytes;
+    }
+
+private:
+    static constexpr size_t kMaxEntrySize = 256 * 1024 * 1024;
+
+    std::shared_ptr<const SignatureDatabase> database_;
+    std::map<std::string, std::vector<std::string>> contents_;
+};
+
+uint64_t hashStage(const CorpusFile& file) {
+    ZipArchive archive;
+    if (!archive.open(file.path)) {
+        return 0;
+    }
+    FileDigests digests;
+    MultiDigest::digestBuffer(archive.data(), archive.size(), MalwareScanner::SCAN_DIGESTS,
+                              digests);
+    return archive.size();
+}
+
+bool parseOptions(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--iterations" && hasValue) {
+            options.iterations = std::max(1, atoi(argv[++i]));
+        } else if (arg == "--warmup" && hasValue) {
+            options.warmup = std::max(0, atoi(argv[++i]));
+        } else if (arg == "--threads" && hasValue) {
+            options.threads = static_cast<size_t>(std::max(0, atoi(argv[++i])));
+        } else if (arg == "--budget" && hasValue) {
+            options.budgetMs = atol(argv[++i]);
+        } else if (arg == "--filter" && hasValue) {
+            options.filter = argv[++i];
+        } else if (arg == "--json") {
+            options.json = true;
+        } else if (arg.compare(0, 2, "--") == 0) {
+            return false;
+        } else {
+            options.inputs.push_back(arg);
+        }
+    }
+    return !options.inputs.empty();
+}
+
+double megabytes(uint64_t bytes) {
+    return static_cast<double>(bytes) / (1024.0 * 1024.0);
+}
+
+void printTable(const std::vector<StageReport>& reports, const std::vector<CorpusFile>& corpus,
+                uint64_t corpusBytes, const Options& options) {
+    printf("Corpus: %zu files, %.1f MB; %d iterations, %zu scan threads, SHA-256 %s\n",
+           corpus.size(), megabytes(corpusBytes), options.iterations, options.threads,
+           sha256IsHardwareAccelerated() ? "accelerated" : "portable");
+    printf("%-10s %10s %12s %10s %10s %10s %12s\n", "Stage", "Samples", "MB", "MB/s",
+           "p50 ms", "p99 ms", "Peak RSS MB");
+    printf("%.*s\n", 80, "--------------------------------------------------------------------------------");
+    for (const StageReport& report : reports) {
+        double throughput = report.seconds > 0 ? megabytes(report.bytes) / report.seconds : 0;
+        printf("%-10s %10zu %12.1f %10.1f %10.3f %10.3f %12.1f\n", report.name.c_str(),
+               report.samples, megabytes(report.bytes), throughput, report.p50Ms, report.p99Ms,
+               static_cast<double>(report.peakRssKb) / 1024.0);
+    }
+}
+
+void printJson(const std::vector<StageReport>& reports, const std::vector<CorpusFile>& corpus,
+               uint64_t corpusBytes, const Options& options) {
+    printf("{\n  \"context\": {\"files\": %zu, \"bytes\": %llu, \"iterations\": %d, "
+           "\"threads\": %zu, \"sha256_accelerated\": %s},\n  \"benchmarks\": [\n",
+           corpus.size(), static_cast<unsigned long long>(corpusBytes), options.iterations,
+           options.threads, sha256IsHardwareAccelerated() ? "true" : "false");
+    for (size_t i = 0; i < reports.size(); i++) {
+        const StageReport& report = reports[i];
+        double throughput = report.seconds > 0 ? static_cast<double>(report.bytes) / report.seconds : 0;
+        printf("    {\"name\": \"%s\", \"samples\": %zu, \"bytes\": %llu, "
+               "\"bytes_per_second\": %.0f, \"p50_ms\": %.3f, \"p99_ms\": %.3f, "
+               "\"peak_rss_kb\": %ld}%s\n",
+               report.name.c_str(), report.samples, static_cast<unsigned long long>(report.bytes),
+               throughput, report.p50Ms, report.p99Ms, report.peakRssKb,
+               i + 1 < reports.size() ? "," : "");
+    }
+    printf("  ]\n}\n");
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        fprintf(stderr,
+                "Usage: %s [--iterations N] [--warmup N] [--threads N] [--budget MS]\n"
+                "       [--filter TEXT] [--json] <apk or directory>...\n",
+                argv[0]);
+        return 2;
+    }
+
+    std::vector<CorpusFile> corpus;
+    for (const std::string& input : options.inputs) {
+        collectCorpus(input, corpus);
+    }
+    if (corpus.empty()) {
+        fprintf(stderr, "No APKs found\n");
+        return 1;
+    }
+    uint64_t corpusBytes = 0;
+    for (const CorpusFile& file : corpus) {
+        corpusBytes += file.size;
+    }
+
+    MalwareScanner scanner;
+    std::unique_ptr<WorkerPool> pool;
+    if (options.threads > 0) {
+        pool = std::make_unique<WorkerPool>(options.threads);
+        scanner.setWorkerPool(pool.get());
+    }
+
+    // Constructed only if the stage runs: it holds the inflated code
+    std::unique_ptr<MatchStage> matchStage;
+    struct NamedStage {
+        const char* name;
+        StageFn run;
+    };
+    const NamedStage stages[] = {
+        {"inflate", inflateStage},
+        {"match", [&](const CorpusFile& file) { return (*matchStage)(file); }},
+        {"hash", hashStage},
+        {"scan",
+         [&](const CorpusFile& file) {
+             scanner.scanApk(file.path, options.budgetMs);
+             return file.size;
+         }},
+    };
+
+    std::vector<StageReport> reports;
+    for (const NamedStage& stage : stages) {
+        std::string name = stage.name;
+        if (!options.filter.empty() && name.find(options.filter) == std::string::npos) {
+            continue;
+        }
+        if (name == "match") {
+            matchStage = std::make_unique<MatchStage>(scanner.currentDatabase(), corpus);
+        }
+        reports.push_back(runStage(name, stage.run, corpus, options));
+        matchStage.reset();
+    }
+
+    if (options.json) {
+        printJson(reports, corpus, corpusBytes, options);
+    } else {
+        printTable(reports, corpus, corpusBytes, options);
+    }
+    return 0;
+}
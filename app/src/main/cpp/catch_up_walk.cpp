@@ -0,0 +1,227 @@
+#include "catch_up_walk.h"
+#include "archive_probe.h"
+#include "native-lib.h"
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <thread>
+#include <utility>
+
+namespace {
+
+constexpr int64_t kNanosPerSecond = 1000000000LL;
+// Directories nested deeper than this below a root are not walked
+constexpr int kMaxTreeDepth = 16;
+// Timestamps are compared with this much slack against coarse clocks
+constexpr int64_t kCheckpointSlackNs = 2 * kNanosPerSecond;
+constexpr size_t kDirentBufferSize = 32 * 1024;
+
+// Record layout returned by getdents64; bionic only declares it for newer
+// API levels
+struct DirEntry64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[1];
+};
+
+int64_t realtimeNowNs() {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return static_cast<int64_t>(now.tv_sec) * kNanosPerSecond + now.tv_nsec;
+}
+
+int64_t changedNs(const struct stat& fileStat) {
+    int64_t modified = static_cast<int64_t>(fileStat.st_mtim.tv_sec) * kNanosPerSecond +
+                       fileStat.st_mtim.tv_nsec;
+    int64_t changed = static_cast<int64_t>(fileStat.st_ctim.tv_sec) * kNanosPerSecond +
+                      fileStat.st_ctim.tv_nsec;
+    return std::max(modified, changed);
+}
+
+} // namespace
+
+CatchUpWalk::CatchUpWalk(std::string checkpointPath, KnownFileFilter knownFileFilter)
+    : checkpointPath_(std::move(checkpointPath)), knownFileFilter_(std::move(knownFileFilter)),
+      runStartNs_(0), cancelled_(false) {
+}
+
+std::vector<std::string> CatchUpWalk::run(const std::vector<std::string>& roots) {
+    int64_t startNs = realtimeNowNs();
+    int64_t checkpointNs;
+    if (!readCheckpoint(checkpointNs)) {
+        checkpointNs = startNs - kFirstRunWindowNs;
+    }
+    int64_t sinceNs = checkpointNs - kCheckpointSlackNs;
+
+    // One thread per root; there are only a few, and each spends its time
+    // waiting on the file system
+    std::vector<std::vector<Found>> found(roots.size());
+    std::vector<size_t> directories(roots.size(), 0);
+    std::vector<std::thread> walkers;
+    walkers.reserve(roots.size());
+    for (size_t i = 0; i < roots.size(); i++) {
+        walkers.emplace_back(&CatchUpWalk::walkRoot, std::cref(roots[i]), sinceNs, startNs,
+                             std::cref(cancelled_), std::ref(found[i]),
+                             std::ref(directories[i]));
+    }
+    for (std::thread& walker : walkers) {
+        walker.join();
+    }
+    // Partial results would let commit() skip what was not walked
+    if (isCancelled()) {
+        LOGI("Catch-up walk cancelled");
+        return {};
+    }
+
+    std::vector<Found> changed;
+    size_t directoryCount = 0;
+    for (size_t i = 0; i < roots.size(); i++) {
+        directoryCount += directories[i];
+        for (Found& file : found[i]) {
+            changed.push_back(std::move(file));
+        }
+    }
+    // Nested roots list the same file twice
+    std::sort(changed.begin(), changed.end(), [](const Found& a, const Found& b) {
+        return a.path < b.path;
+    });
+    changed.erase(std::unique(changed.begin(), changed.end(), [](const Found& a, const Found& b) {
+        return a.path == b.path;
+    }), changed.end());
+    std::sort(changed.begin(), changed.end(), [](const Found& a, const Found& b) {
+        return a.changedNs > b.changedNs;
+    });
+
+    std::vector<std::string> missed;
+    for (const Found& file : changed) {
+        if (knownFileFilter_ && knownFileFilter_(file.identity)) {
+            continue;
+        }
+        missed.push_back(file.path);
+    }
+
+    runStartNs_ = startNs;
+    LOGI("Catch-up walk: %zu directories, %zu APK(s) changed since checkpoint, %zu not scanned yet "
+         "(%lld ms)", directoryCount, changed.size(), missed.size(),
+         static_cast<long long>((realtimeNowNs() - startNs) / 1000000));
+    return missed;
+}
+
+void CatchUpWalk::walkRoot(const std::string& root, int64_t sinceNs, int64_t untilNs,
+                           const std::atomic<bool>& cancelled, std::vector<Found>& out,
+                           size_t& directories) {
+    std::vector<uint8_t> buffer(kDirentBufferSize);
+    std::vector<std::pair<std::string, int>> stack;
+    stack.emplace_back(root, 0);
+    while (!stack.empty() && !cancelled.load(std::memory_order_relaxed)) {
+        std::string directory = std::move(stack.back().first);
+        int depth = stack.back().second;
+        stack.pop_back();
+
+        // O_NOFOLLOW: a symlinked directory is not walked into
+        int dirFd = open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (dirFd < 0) {
+            continue;
+        }
+        directories++;
+        while (true) {
+            long length = syscall(__NR_getdents64, dirFd, buffer.data(), buffer.size());
+            if (length <= 0) {
+                if (length < 0) {
+                    LOGW("getdents64 failed in %s: %s", directory.c_str(), strerror(errno));
+                }
+                break;
+            }
+            for (long offset = 0; offset < length;) {
+                const DirEntry64* entry = reinterpret_cast<const DirEntry64*>(buffer.data() + offset);
+                offset += entry->d_reclen;
+                const char* name = entry->d_name;
+                if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+                    continue;
+                }
+
+                unsigned char type = entry->d_type;
+                if (type == DT_DIR) {
+                    if (depth < kMaxTreeDepth) {
+                        stack.emplace_back(directory + "/" + name, depth + 1);
+                    }
+                    continue;
+                }
+                if (type != DT_REG && type != DT_UNKNOWN) {
+                    continue;
+                }
+                struct stat fileStat;
+                if (fstatat(dirFd, name, &fileStat, AT_SYMLINK_NOFOLLOW) != 0) {
+                    continue;
+                }
+                if (S_ISDIR(fileStat.st_mode)) {
+                    if (depth < kMaxTreeDepth) {
+                        stack.emplace_back(directory + "/" + name, depth + 1);
+                    }
+                    continue;
+                }
+                int64_t changed = changedNs(fileStat);
+                if (!S_ISREG(fileStat.st_mode) || changed < sinceNs || changed >= untilNs) {
+                    continue;
+                }
+
+                // Only changed files are opened, and only head and tail read
+                int fd = openat(dirFd, name, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+                if (fd < 0) {
+                    continue;
+                }
+                bool apk = isApkArchive(probeArchive(fd, static_cast<uint64_t>(fileStat.st_size)));
+                close(fd);
+                if (apk) {
+                    out.push_back(Found{directory + "/" + name,
+                                        FileIdentity::fromStat(fileStat), changed});
+                }
+            }
+        }
+        close(dirFd);
+    }
+}
+
+bool CatchUpWalk::readCheckpoint(int64_t& checkpointNs) const {
+    FILE* file = fopen(checkpointPath_.c_str(), "re");
+    if (file == nullptr) {
+        return false;
+    }
+    long long value;
+    bool valid = fscanf(file, "%lld", &value) == 1 && value > 0;
+    fclose(file);
+    if (valid) {
+        checkpointNs = value;
+    }
+    return valid;
+}
+
+bool CatchUpWalk::commit() {
+    if (runStartNs_ == 0) {
+        return false;
+    }
+    // Written aside and renamed, so a crash leaves the old checkpoint
+    std::string temporary = checkpointPath_ + ".tmp";
+    FILE* file = fopen(temporary.c_str(), "we");
+    if (file == nullptr) {
+        LOGE("Failed to write catch-up checkpoint %s: %s", temporary.c_str(), strerror(errno));
+        return false;
+    }
+    bool written = fprintf(file, "%lld\n", static_cast<long long>(runStartNs_)) > 0;
+    written = fclose(file) == 0 && written;
+    if (!written || rename(temporary.c_str(), checkpointPath_.c_str()) != 0) {
+        LOGE("Failed to save catch-up checkpoint %s: %s", checkpointPath_.c_str(), strerror(errno));
+        unlink(temporary.c_str());
+        return false;
+    }
+    return true;
+}
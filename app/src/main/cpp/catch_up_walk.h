@@ -0,0 +1,63 @@
+#ifndef WHATSZAP_CATCH_UP_WALK_H
+#define WHATSZAP_CATCH_UP_WALK_H
+
+#include "verdict_cache.h"
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Finds APKs that arrived in the monitored trees while the service was not
+// running, e.g. after a reboot or a low-memory kill: the watcher only
+// reports what happens while it is up.
+//
+// Each root is walked on its own thread with getdents64 and fstatat on
+// the directory fd. A file counts if its mtime or ctime (a move into the
+// tree updates only the latter) is past the checkpoint, the start of the
+// last walk whose files were all scanned; only those are opened, for
+// probeArchive() to tell APKs from everything else. Files the known-file
+// filter recognizes, i.e. the scanner's verdict cache, are dropped before
+// they are returned.
+class CatchUpWalk {
+public:
+    using KnownFileFilter = std::function<bool(const FileIdentity&)>;
+
+    CatchUpWalk(std::string checkpointPath, KnownFileFilter knownFileFilter);
+
+    // Paths changed since the checkpoint and not known, newest first. With
+    // no checkpoint yet, the last kFirstRunWindowNs count. Files changed
+    // after the walk started are left to the watcher.
+    std::vector<std::string> run(const std::vector<std::string>& roots);
+
+    // Stop a run() in progress, from any thread: the walkers stop at their
+    // next directory and run() returns nothing. Later runs return at once.
+    void cancel() { cancelled_.store(true, std::memory_order_relaxed); }
+    bool isCancelled() const { return cancelled_.load(std::memory_order_relaxed); }
+
+    // Move the checkpoint to the start of the last run(). Call once all it
+    // returned has been scanned; a restart before that walks the same span
+    // again, and the verdict cache skips what was finished.
+    bool commit();
+
+private:
+    struct Found {
+        std::string path;
+        FileIdentity identity;
+        int64_t changedNs;
+    };
+
+    static void walkRoot(const std::string& root, int64_t sinceNs, int64_t untilNs,
+                         const std::atomic<bool>& cancelled, std::vector<Found>& out,
+                         size_t& directories);
+    bool readCheckpoint(int64_t& checkpointNs) const;
+
+    static constexpr int64_t kFirstRunWindowNs = 7LL * 24 * 60 * 60 * 1000000000LL;
+
+    std::string checkpointPath_;
+    KnownFileFilter knownFileFilter_;
+    int64_t runStartNs_;            // 0 until run() has finished
+    std::atomic<bool> cancelled_;
+};
+
+#endif // WHATSZAP_CATCH_UP_WALK_H
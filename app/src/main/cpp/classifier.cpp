@@ -0,0 +1,338 @@
+#include "classifier.h"
+#include "native-lib.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+constexpr uint32_t kModelMagic = 0x4C4D5A57;        // "WZML"
+constexpr uint32_t kModelFormatVersion = 1;
+
+constexpr uint32_t kSectionInputs = 0x54504E49;     // "INPT"
+constexpr uint32_t kSectionLayers = 0x534E4544;     // "DENS"
+
+// Weight rows and bias arrays are padded to this, so every row starts on
+// a vector boundary and the dot product needs no tail
+constexpr uint32_t kRowAlignment = 16;
+
+struct InputsHeader {
+    uint32_t inputCount;
+    uint32_t reserved;
+};
+
+struct LayersHeader {
+    uint32_t layerCount;
+    uint32_t reserved;
+};
+
+struct LayerRecord {
+    uint32_t inputs;
+    uint32_t outputs;
+    uint32_t stride;
+    float scale;
+};
+
+static_assert(sizeof(InputsHeader) == 8, "inputs header layout");
+static_assert(sizeof(LayersHeader) == 8, "layers header layout");
+static_assert(sizeof(LayerRecord) == 16, "layer record layout");
+
+uint32_t alignUp(uint32_t value) {
+    return (value + kRowAlignment - 1) & ~(kRowAlignment - 1);
+}
+
+template <typename T>
+void appendRaw(std::string& out, const T* values, size_t count) {
+    out.append(reinterpret_cast<const char*>(values), count * sizeof(T));
+}
+
+void padTo(std::string& out, size_t alignment) {
+    out.resize((out.size() + alignment - 1) / alignment * alignment, '\0');
+}
+
+int8_t saturate(float value, float low) {
+    return static_cast<int8_t>(std::lrintf(std::min(127.0f, std::max(low, value))));
+}
+
+// Sum of a[i] * b[i]; length is a multiple of kRowAlignment
+int32_t dotProduct(const int8_t* a, const int8_t* b, uint32_t length) {
+#if defined(__aarch64__)
+    int32x4_t sum = vdupq_n_s32(0);
+    for (uint32_t i = 0; i < length; i += 16) {
+        int8x16_t x = vld1q_s8(a + i);
+        int8x16_t y = vld1q_s8(b + i);
+        sum = vpadalq_s16(sum, vmull_s8(vget_low_s8(x), vget_low_s8(y)));
+        sum = vpadalq_s16(sum, vmull_high_s8(x, y));
+    }
+    return vaddvq_s32(sum);
+#elif defined(__SSE2__)
+    __m128i sum = _mm_setzero_si128();
+    for (uint32_t i = 0; i < length; i += 16) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        // Sign-extend to 16 bits, then multiply and add pairs into 32
+        __m128i xLow = _mm_srai_epi16(_mm_unpacklo_epi8(x, x), 8);
+        __m128i xHigh = _mm_srai_epi16(_mm_unpackhi_epi8(x, x), 8);
+        __m128i yLow = _mm_srai_epi16(_mm_unpacklo_epi8(y, y), 8);
+        __m128i yHigh = _mm_srai_epi16(_mm_unpackhi_epi8(y, y), 8);
+        sum = _mm_add_epi32(sum, _mm_madd_epi16(xLow, yLow));
+        sum = _mm_add_epi32(sum, _mm_madd_epi16(xHigh, yHigh));
+    }
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(sum);
+#else
+    int32_t sum = 0;
+    for (uint32_t i = 0; i < length; i++) {
+        sum += static_cast<int32_t>(a[i]) * static_cast<int32_t>(b[i]);
+    }
+    return sum;
+#endif
+}
+
+bool isConsistent(const ClassifierDefinition& definition) {
+    size_t inputCount = definition.inputScales.size();
+    if (inputCount == 0 || inputCount > kModelInputCount ||
+        definition.inputOffsets.size() != inputCount || definition.layers.empty() ||
+        definition.layers.size() > Classifier::kMaxLayers ||
+        definition.layers.back().outputs != 1) {
+        return false;
+    }
+    uint32_t width = static_cast<uint32_t>(inputCount);
+    for (const ClassifierLayer& layer : definition.layers) {
+        if (layer.inputs != width || layer.outputs == 0 || layer.outputs > Classifier::kMaxWidth ||
+            layer.weights.size() != static_cast<size_t>(layer.inputs) * layer.outputs ||
+            layer.biases.size() != layer.outputs) {
+            return false;
+        }
+        width = layer.outputs;
+    }
+    return true;
+}
+
+std::string serializeModel(const ClassifierDefinition& definition, uint64_t version) {
+    // INPT: offsets then scales
+    std::string inputs;
+    InputsHeader inputsHeader;
+    inputsHeader.inputCount = static_cast<uint32_t>(definition.inputScales.size());
+    inputsHeader.reserved = 0;
+    appendRaw(inputs, &inputsHeader, 1);
+    appendRaw(inputs, definition.inputOffsets.data(), definition.inputOffsets.size());
+    appendRaw(inputs, definition.inputScales.data(), definition.inputScales.size());
+
+    // DENS: each layer's record, its biases then its weight rows, zero
+    // padded so padding lanes add nothing
+    std::string layers;
+    LayersHeader layersHeader;
+    layersHeader.layerCount = static_cast<uint32_t>(definition.layers.size());
+    layersHeader.reserved = 0;
+    appendRaw(layers, &layersHeader, 1);
+    padTo(layers, kRowAlignment);
+    for (const ClassifierLayer& layer : definition.layers) {
+        LayerRecord record;
+        record.inputs = layer.inputs;
+        record.outputs = layer.outputs;
+        record.stride = alignUp(layer.inputs);
+        record.scale = layer.scale;
+        appendRaw(layers, &record, 1);
+        appendRaw(layers, layer.biases.data(), layer.biases.size());
+        padTo(layers, kRowAlignment);
+        for (uint32_t row = 0; row < layer.outputs; row++) {
+            appendRaw(layers, layer.weights.data() + static_cast<size_t>(row) * layer.inputs,
+                      layer.inputs);
+            padTo(layers, kRowAlignment);
+        }
+    }
+
+    return PackFile::build(kModelMagic, kModelFormatVersion, version,
+                           {{kSectionInputs, std::move(inputs)},
+                            {kSectionLayers, std::move(layers)}});
+}
+
+// Count of each kind of threat, and the distance of the closest match
+void addThreatInputs(const ThreatList& threats, ModelInputs& inputs) {
+    inputs[ModelInput::KnownMalwareDistance] = kFarFromKnownMalware;
+    for (const Threat& threat : threats.threats()) {
+        switch (threat.id) {
+            case ThreatId::SuspiciousPermission: inputs[ModelInput::SuspiciousPermissions]++; break;
+            case ThreatId::KnownPackage: inputs[ModelInput::KnownPackages]++; break;
+            case ThreatId::SuspiciousContent: inputs[ModelInput::SuspiciousContent]++; break;
+            case ThreatId::SuspiciousApi: inputs[ModelInput::SuspiciousApis]++; break;
+            case ThreatId::SuspiciousNativeSymbol: inputs[ModelInput::SuspiciousNativeSymbols]++; break;
+            case ThreatId::PackedLibrary: inputs[ModelInput::PackedLibraries]++; break;
+            case ThreatId::EncryptedPayload: inputs[ModelInput::EncryptedPayloads]++; break;
+            case ThreatId::SimilarToKnownMalware:
+                inputs[ModelInput::KnownMalwareDistance] =
+                    std::min(inputs[ModelInput::KnownMalwareDistance],
+                             static_cast<float>(threat.value));
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+} // namespace
+
+Classifier::Classifier()
+    : inputCount_(0), inputOffsets_(nullptr), inputScales_(nullptr), layers_(), layerCount_(0) {
+}
+
+Classifier::~Classifier() {
+}
+
+std::shared_ptr<const Classifier> Classifier::compile(const ClassifierDefinition& definition,
+                                                      uint64_t version) {
+    if (!isConsistent(definition)) {
+        return nullptr;
+    }
+    std::shared_ptr<Classifier> classifier(new Classifier());
+    if (!classifier->pack_.adopt(serializeModel(definition, version), kModelMagic,
+                                 kModelFormatVersion) ||
+        !classifier->attach()) {
+        return nullptr;
+    }
+    return classifier;
+}
+
+std::shared_ptr<const Classifier> Classifier::load(const std::string& path, bool verifyChecksum) {
+    std::shared_ptr<Classifier> classifier(new Classifier());
+    if (!classifier->pack_.map(path, kModelMagic, kModelFormatVersion, verifyChecksum) ||
+        !classifier->attach()) {
+        LOGE("Malformed model file: %s", path.c_str());
+        return nullptr;
+    }
+    return classifier;
+}
+
+bool Classifier::write(const ClassifierDefinition& definition, uint64_t version,
+                       const std::string& path) {
+    if (!isConsistent(definition)) {
+        LOGE("Inconsistent model definition for %s", path.c_str());
+        return false;
+    }
+    return PackFile::write(serializeModel(definition, version), path);
+}
+
+bool Classifier::attach() {
+    size_t inputsSize = 0;
+    const uint8_t* inputs = pack_.section(kSectionInputs, inputsSize);
+    size_t layersSize = 0;
+    const uint8_t* layers = pack_.section(kSectionLayers, layersSize);
+    if (inputs == nullptr || layers == nullptr || inputsSize < sizeof(InputsHeader) ||
+        layersSize < sizeof(LayersHeader)) {
+        return false;
+    }
+
+    // Models trained on fewer inputs than the scan produces still apply
+    InputsHeader inputsHeader;
+    memcpy(&inputsHeader, inputs, sizeof(inputsHeader));
+    if (inputsHeader.inputCount == 0 || inputsHeader.inputCount > kModelInputCount ||
+        inputsSize < sizeof(InputsHeader) + 2 * inputsHeader.inputCount * sizeof(float)) {
+        return false;
+    }
+    inputCount_ = inputsHeader.inputCount;
+    inputOffsets_ = reinterpret_cast<const float*>(inputs + sizeof(InputsHeader));
+    inputScales_ = inputOffsets_ + inputCount_;
+
+    LayersHeader layersHeader;
+    memcpy(&layersHeader, layers, sizeof(layersHeader));
+    if (layersHeader.layerCount == 0 || layersHeader.layerCount > kMaxLayers) {
+        return false;
+    }
+    size_t offset = kRowAlignment;
+    uint32_t width = inputCount_;
+    for (uint32_t i = 0; i < layersHeader.layerCount; i++) {
+        if (layersSize < offset || layersSize - offset < sizeof(LayerRecord)) {
+            return false;
+        }
+        LayerRecord record;
+        memcpy(&record, layers + offset, sizeof(record));
+        offset += sizeof(LayerRecord);
+        if (record.inputs != width || record.outputs == 0 || record.outputs > kMaxWidth ||
+            record.stride != alignUp(record.inputs) || !std::isfinite(record.scale)) {
+            return false;
+        }
+        size_t biasesSize = alignUp(record.outputs * static_cast<uint32_t>(sizeof(int32_t)));
+        size_t weightsSize = static_cast<size_t>(record.outputs) * record.stride;
+        if (layersSize - offset < biasesSize || layersSize - offset - biasesSize < weightsSize) {
+            return false;
+        }
+        Layer& layer = layers_[i];
+        layer.inputs = record.inputs;
+        layer.outputs = record.outputs;
+        layer.stride = record.stride;
+        layer.scale = record.scale;
+        layer.biases = reinterpret_cast<const int32_t*>(layers + offset);
+        layer.weights = reinterpret_cast<const int8_t*>(layers + offset + biasesSize);
+        offset += biasesSize + weightsSize;
+        width = record.outputs;
+    }
+    if (width != 1) {
+        return false;
+    }
+    layerCount_ = layersHeader.layerCount;
+    return true;
+}
+
+int Classifier::predict(const ModelInputs& inputs) const {
+    // Ping-pong activation buffers. Lanes past a layer's width meet the
+    // zero padding of its weight rows, so what they hold adds nothing.
+    alignas(16) int8_t activations[2][kMaxWidth];
+    memset(activations, 0, sizeof(activations));
+    int8_t* in = activations[0];
+    int8_t* out = activations[1];
+    for (uint32_t i = 0; i < inputCount_; i++) {
+        in[i] = saturate((inputs.values[i] - inputOffsets_[i]) * inputScales_[i], -127.0f);
+    }
+
+    float logit = 0;
+    for (uint32_t i = 0; i < layerCount_; i++) {
+        const Layer& layer = layers_[i];
+        bool isLast = i + 1 == layerCount_;
+        for (uint32_t row = 0; row < layer.outputs; row++) {
+            int32_t sum = layer.biases[row] +
+                          dotProduct(layer.weights + static_cast<size_t>(row) * layer.stride, in,
+                                     layer.stride);
+            if (isLast) {
+                logit = static_cast<float>(sum) * layer.scale;
+            } else {
+                out[row] = saturate(static_cast<float>(sum) * layer.scale, 0.0f);
+            }
+        }
+        std::swap(in, out);
+    }
+    float probability = 1.0f / (1.0f + std::exp(-logit));
+    return static_cast<int>(std::lround(probability * 100.0f));
+}
+
+ModelInputs modelInputsOf(const ScanResult& result) {
+    ModelInputs inputs;
+    const AppProfile& app = result.app;
+    inputs[ModelInput::FileSizeLog2] =
+        app.fileSize > 0 ? std::log2(static_cast<float>(app.fileSize)) : 0.0f;
+    inputs[ModelInput::PermissionCount] = static_cast<float>(result.manifest.permissions.size());
+    inputs[ModelInput::DangerousPermissions] = static_cast<float>(app.dangerousPermissions.size());
+    inputs[ModelInput::HighRiskPermissions] = static_cast<float>(app.highRiskPermissions.size());
+    inputs[ModelInput::ComponentCount] = static_cast<float>(result.manifest.components.size());
+    inputs[ModelInput::SuspiciousPackageName] = app.suspiciousPackageName ? 1.0f : 0.0f;
+    inputs[ModelInput::InvalidStructure] = app.hasInvalidStructure() ? 1.0f : 0.0f;
+    inputs[ModelInput::DexCount] = static_cast<float>(app.dexCount);
+    inputs[ModelInput::NativeLibraries] = app.hasNativeLibraries ? 1.0f : 0.0f;
+    inputs[ModelInput::SuspiciousFiles] = static_cast<float>(app.suspiciousFiles.size());
+    addThreatInputs(result.threats, inputs);
+    for (const EntryEntropy& entropy : result.entryEntropy) {
+        inputs[ModelInput::MaxEntropy] =
+            std::max(inputs[ModelInput::MaxEntropy], static_cast<float>(entropy.entropy));
+        inputs[ModelInput::MaxWindowEntropy] = std::max(
+            inputs[ModelInput::MaxWindowEntropy], static_cast<float>(entropy.peakWindowEntropy));
+    }
+    inputs[ModelInput::MeasuredEntries] = static_cast<float>(result.entryEntropy.size());
+    return inputs;
+}
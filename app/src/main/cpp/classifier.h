@@ -0,0 +1,98 @@
+#ifndef WHATSZAP_CLASSIFIER_H
+#define WHATSZAP_CLASSIFIER_H
+
+#include "pack_file.h"
+#include "scan_result.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// One fully connected layer, quantized: out = scale * (bias + W * in),
+// with int8 weights and activations and int32 accumulators
+struct ClassifierLayer {
+    uint32_t inputs;
+    uint32_t outputs;
+    std::vector<int8_t> weights;    // outputs rows of inputs
+    std::vector<int32_t> biases;
+    float scale;                    // accumulator to the next layer's int8 activation
+};
+
+// Source form of a model, used to build model files
+struct ClassifierDefinition {
+    // Input i is quantized to round((x - offset) * scale), clamped to int8
+    std::vector<float> inputOffsets;
+    std::vector<float> inputScales;
+    // ReLU after each layer but the last, which has a single output: the
+    // logit of the file being malware
+    std::vector<ClassifierLayer> layers;
+};
+
+// Small int8 MLP over the ModelInputs of a scan, for a verdict that needs
+// no network. On disk it is a "model file", a PackFile with magic "WZML"
+// and these sections:
+//
+//   INPT   input count, then the offsets and scales of the inputs
+//   DENS   layer count, then per layer its shape, scale, biases and
+//          weights, rows padded to 16 bytes
+//
+// Loading maps the file and evaluates in place; a prediction is one pass
+// of int8 dot products, on NEON or SSE2 where available. Instances are
+// shared through shared_ptr like SignatureDatabase, so a newer model is
+// swapped in without disturbing running scans.
+class Classifier {
+public:
+    // Widest layer; activations live on the stack
+    static constexpr uint32_t kMaxWidth = 256;
+    static constexpr uint32_t kMaxLayers = 4;
+
+    ~Classifier();
+
+    Classifier(const Classifier&) = delete;
+    Classifier& operator=(const Classifier&) = delete;
+
+    // Build an in-memory model; nullptr if the definition is inconsistent
+    static std::shared_ptr<const Classifier> compile(const ClassifierDefinition& definition,
+                                                     uint64_t version);
+
+    // Map a model file; nullptr if it is missing or malformed
+    static std::shared_ptr<const Classifier> load(const std::string& path,
+                                                  bool verifyChecksum = false);
+
+    // Write a model file atomically
+    static bool write(const ClassifierDefinition& definition, uint64_t version,
+                      const std::string& path);
+
+    uint64_t version() const { return pack_.version(); }
+    uint32_t inputCount() const { return inputCount_; }
+
+    // Probability of malware, 0-100
+    int predict(const ModelInputs& inputs) const;
+
+private:
+    struct Layer {
+        uint32_t inputs;
+        uint32_t outputs;
+        uint32_t stride;            // bytes per weight row
+        float scale;
+        const int32_t* biases;
+        const int8_t* weights;
+    };
+
+    Classifier();
+
+    bool attach();
+
+    PackFile pack_;
+    uint32_t inputCount_;
+    const float* inputOffsets_;
+    const float* inputScales_;
+    Layer layers_[kMaxLayers];
+    uint32_t layerCount_;
+};
+
+// The classifier's view of a finished scan
+ModelInputs modelInputsOf(const ScanResult& result);
+
+#endif // WHATSZAP_CLASSIFIER_H
@@ -0,0 +1,139 @@
+#include "dex_parser.h"
+#include "scan_arena.h"
+#include <cstring>
+
+namespace {
+
+constexpr size_t kHeaderSize = 0x70;
+constexpr size_t kEndianTagOffset = 0x28;
+constexpr size_t kStringIdsOffset = 0x38;   // size, then offset
+constexpr size_t kTypeIdsOffset = 0x40;
+constexpr size_t kMethodIdsOffset = 0x58;
+
+constexpr uint32_t kEndianConstant = 0x12345678;
+
+constexpr size_t kStringIdSize = 4;         // string_data_off
+constexpr size_t kTypeIdSize = 4;           // descriptor_idx
+constexpr size_t kMethodIdSize = 8;         // class_idx u16, proto_idx u16, name_idx u32
+
+inline uint16_t readU16(const uint8_t* p) {
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+inline uint32_t readU32(const uint8_t* p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+// A table of `count` fixed-size items at the offset stored in the header
+bool locateTable(const uint8_t* data, size_t size, size_t headerOffset, size_t itemSize,
+                 const uint8_t*& table, uint32_t& count) {
+    count = readU32(data + headerOffset);
+    uint32_t offset = readU32(data + headerOffset + 4);
+    if (count == 0) {
+        table = nullptr;
+        return true;
+    }
+    if (offset > size || static_cast<uint64_t>(count) * itemSize > size - offset) {
+        return false;
+    }
+    table = data + offset;
+    return true;
+}
+
+// MUTF-8 bytes of a string_data_item: a ULEB128 UTF-16 length, then the
+// bytes up to a NUL. Identifiers are ASCII, so no decoding is needed.
+bool readString(const uint8_t* data, size_t size, const uint8_t* stringIds, uint32_t index,
+                const uint8_t*& text, size_t& length) {
+    size_t pos = readU32(stringIds + static_cast<size_t>(index) * kStringIdSize);
+    for (int i = 0; i < 5; i++) {
+        if (pos >= size) {
+            return false;
+        }
+        if ((data[pos++] & 0x80) == 0) {
+            break;
+        }
+    }
+    const void* end = memchr(data + pos, 0, size - pos);
+    if (end == nullptr) {
+        return false;
+    }
+    text = data + pos;
+    length = static_cast<const uint8_t*>(end) - text;
+    return true;
+}
+
+} // namespace
+
+bool DexParser::parse(const uint8_t* data, size_t size, const SignatureDatabase& database,
+                      DexFeatures& features) {
+    // "dex\n" then a three-digit version and a NUL
+    if (size < kHeaderSize || memcmp(data, "dex\n", 4) != 0 || data[7] != 0) {
+        return false;
+    }
+    // Byte-swapped files are allowed by the format but never produced
+    if (readU32(data + kEndianTagOffset) != kEndianConstant) {
+        return false;
+    }
+
+    const uint8_t* stringIds;
+    const uint8_t* typeIds;
+    const uint8_t* methodIds;
+    if (!locateTable(data, size, kStringIdsOffset, kStringIdSize, stringIds, features.stringCount) ||
+        !locateTable(data, size, kTypeIdsOffset, kTypeIdSize, typeIds, features.typeCount) ||
+        !locateTable(data, size, kMethodIdsOffset, kMethodIdSize, methodIds, features.methodCount)) {
+        return false;
+    }
+
+    ArenaScope scope(ScanArena::local());
+    ArenaAllocator<bool> allocator(scope.arena());
+    const PatternMatcher& matcher = database.matcher();
+    ArenaVector<bool> matched(database.signatureCount(), false, allocator);
+    // Built once; scan() takes the sink by reference
+    PatternMatchSink onMatch = [&](uint32_t patternId, uint64_t) {
+        if (database.signature(patternId).category == SignatureCategory::DexApi) {
+            matched[patternId] = true;
+        }
+        return true;
+    };
+
+    // Automaton state at the end of each type descriptor, e.g.
+    // "Landroid/telephony/SmsManager;"; matching types themselves counts too
+    ArenaVector<PatternMatcher::Cursor> typeCursors(features.typeCount, PatternMatcher::Cursor(),
+                                                    allocator);
+    for (uint32_t i = 0; i < features.typeCount; i++) {
+        uint32_t descriptorIndex = readU32(typeIds + static_cast<size_t>(i) * kTypeIdSize);
+        const uint8_t* text;
+        size_t length;
+        if (descriptorIndex >= features.stringCount ||
+            !readString(data, size, stringIds, descriptorIndex, text, length)) {
+            return false;
+        }
+        matcher.scan(typeCursors[i], text, length, onMatch);
+    }
+
+    // Each method reference continues from its class as "->name"
+    static const uint8_t kArrow[] = {'-', '>'};
+    for (uint32_t i = 0; i < features.methodCount; i++) {
+        const uint8_t* method = methodIds + static_cast<size_t>(i) * kMethodIdSize;
+        uint16_t classIndex = readU16(method);
+        uint32_t nameIndex = readU32(method + 4);
+        const uint8_t* text;
+        size_t length;
+        if (classIndex >= features.typeCount || nameIndex >= features.stringCount ||
+            !readString(data, size, stringIds, nameIndex, text, length)) {
+            return false;
+        }
+        PatternMatcher::Cursor cursor = typeCursors[classIndex];
+        matcher.scan(cursor, kArrow, sizeof(kArrow), onMatch);
+        matcher.scan(cursor, text, length, onMatch);
+    }
+
+    features.apiSignatures.clear();
+    for (uint32_t i = 0; i < matched.size(); i++) {
+        if (matched[i]) {
+            features.apiSignatures.push_back(i);
+        }
+    }
+    return true;
+}
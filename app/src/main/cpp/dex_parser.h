@@ -0,0 +1,33 @@
+#ifndef WHATSZAP_DEX_PARSER_H
+#define WHATSZAP_DEX_PARSER_H
+
+#include "signature_pack.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// What the identifier tables of one classes.dex reference
+struct DexFeatures {
+    uint32_t stringCount;
+    uint32_t typeCount;
+    uint32_t methodCount;
+    std::vector<uint32_t> apiSignatures;  // matched DexApi signature IDs, ascending
+
+    DexFeatures() : stringCount(0), typeCount(0), methodCount(0) {}
+};
+
+// Reader for the header and the string_ids, type_ids and method_ids tables
+// of a DEX file, read in place from the inflated buffer. Every type
+// descriptor is run through the signature matcher once and the automaton
+// state at its end is kept, so a method reference "Lpkg/Type;->name" only
+// costs the bytes of its name. Bytecode is not decoded: a referenced API is
+// one the code can call. Scratch tables come from the thread's ScanArena.
+class DexParser {
+public:
+    // Match DexApi signatures against the types and methods referenced by
+    // the file; returns false if it is not a well-formed DEX
+    static bool parse(const uint8_t* data, size_t size, const SignatureDatabase& database,
+                      DexFeatures& features);
+};
+
+#endif // WHATSZAP_DEX_PARSER_H
@@ -0,0 +1,239 @@
+#include "elf_parser.h"
+#include "entropy.h"
+#include "scan_arena.h"
+#include <cstring>
+#include <string_view>
+
+namespace {
+
+constexpr uint8_t ELFCLASS32 = 1;
+constexpr uint8_t ELFCLASS64 = 2;
+constexpr uint8_t ELFDATA2LSB = 1;
+
+constexpr uint32_t SHT_DYNAMIC = 6;
+constexpr uint32_t SHT_NOBITS = 8;
+constexpr uint32_t SHT_DYNSYM = 11;
+constexpr uint64_t SHF_EXECINSTR = 0x4;
+
+constexpr uint16_t SHN_UNDEF = 0;
+constexpr uint8_t STB_GLOBAL = 1;
+constexpr uint8_t STB_WEAK = 2;
+constexpr int64_t DT_NULL = 0;
+constexpr int64_t DT_NEEDED = 1;
+
+// Encrypted or compressed code; compiled ARM and x86 code stays below ~6.5
+constexpr double kPackedEntropy = 7.5;
+// Smaller sections (stubs, PLT) are too short for a meaningful estimate
+constexpr uint64_t kMinEntropySectionSize = 4096;
+// Larger sections are sampled as this many evenly spaced blocks
+constexpr size_t kEntropySampleBlocks = 32;
+constexpr size_t kEntropySampleBlockSize = 4096;
+
+inline uint16_t readU16(const uint8_t* p) {
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+inline uint32_t readU32(const uint8_t* p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+inline uint64_t readU64(const uint8_t* p) {
+    return static_cast<uint64_t>(readU32(p)) | (static_cast<uint64_t>(readU32(p + 4)) << 32);
+}
+
+// Section header fields we use, widened from either class
+struct Section {
+    uint32_t type;
+    uint64_t flags;
+    uint64_t offset;
+    uint64_t size;
+    uint32_t link;
+};
+
+// Reads the class-dependent layouts
+struct Layout {
+    bool is64;
+
+    size_t sectionHeaderSize() const { return is64 ? 64 : 40; }
+    size_t symbolSize() const { return is64 ? 24 : 16; }
+    size_t dynamicSize() const { return is64 ? 16 : 8; }
+
+    uint64_t word(const uint8_t* p) const { return is64 ? readU64(p) : readU32(p); }
+
+    Section section(const uint8_t* p) const {
+        Section section;
+        section.type = readU32(p + 4);
+        if (is64) {
+            section.flags = readU64(p + 8);
+            section.offset = readU64(p + 24);
+            section.size = readU64(p + 32);
+            section.link = readU32(p + 40);
+        } else {
+            section.flags = readU32(p + 8);
+            section.offset = readU32(p + 16);
+            section.size = readU32(p + 20);
+            section.link = readU32(p + 24);
+        }
+        return section;
+    }
+};
+
+bool inBounds(const Section& section, size_t size) {
+    return section.type == SHT_NOBITS ||
+           (section.offset <= size && section.size <= size - section.offset);
+}
+
+// NUL-terminated name at `offset` in a string table section
+std::string_view stringAt(const uint8_t* data, const Section& table, uint64_t offset) {
+    if (offset >= table.size) {
+        return std::string_view();
+    }
+    const char* start = reinterpret_cast<const char*>(data + table.offset + offset);
+    const void* end = memchr(start, 0, table.size - offset);
+    if (end == nullptr) {
+        return std::string_view();
+    }
+    return std::string_view(start, static_cast<const char*>(end) - start);
+}
+
+double sectionEntropy(const uint8_t* data, const Section& section) {
+    const uint8_t* start = data + section.offset;
+    ByteCounter counter;
+    if (section.size <= kEntropySampleBlocks * kEntropySampleBlockSize) {
+        counter.add(start, section.size);
+    } else {
+        uint64_t stride = (section.size - kEntropySampleBlockSize) / (kEntropySampleBlocks - 1);
+        for (size_t i = 0; i < kEntropySampleBlocks; i++) {
+            counter.add(start + i * stride, kEntropySampleBlockSize);
+        }
+    }
+    ByteHistogram histogram;
+    counter.addTo(histogram);
+    return histogram.entropy();
+}
+
+} // namespace
+
+bool ElfParser::parse(const uint8_t* data, size_t size, const SignatureDatabase& database,
+                      ElfFeatures& features) {
+    if (size < 52 || memcmp(data, "\x7f" "ELF", 4) != 0 || data[5] != ELFDATA2LSB ||
+        (data[4] != ELFCLASS32 && data[4] != ELFCLASS64)) {
+        return false;
+    }
+    Layout layout{data[4] == ELFCLASS64};
+    if (layout.is64 && size < 64) {
+        return false;
+    }
+
+    features.machine = readU16(data + 18);
+    uint64_t sectionHeaderOffset = layout.is64 ? readU64(data + 0x28) : readU32(data + 0x20);
+    uint16_t sectionHeaderSize = readU16(data + (layout.is64 ? 0x3A : 0x2E));
+    uint16_t sectionCount = readU16(data + (layout.is64 ? 0x3C : 0x30));
+    if (sectionCount == 0 || sectionHeaderOffset == 0) {
+        // Loadable through program headers alone, which tools used to
+        // hide code also rely on
+        features.sectionCount = 0;
+        return true;
+    }
+    if (sectionHeaderSize < layout.sectionHeaderSize() || sectionHeaderOffset > size ||
+        static_cast<uint64_t>(sectionCount) * sectionHeaderSize > size - sectionHeaderOffset) {
+        return false;
+    }
+    features.sectionCount = sectionCount;
+
+    ArenaScope scope(ScanArena::local());
+    ArenaAllocator<bool> allocator(scope.arena());
+    ArenaVector<Section> sections(sectionCount, Section(), allocator);
+    for (uint16_t i = 0; i < sectionCount; i++) {
+        sections[i] = layout.section(data + sectionHeaderOffset +
+                                     static_cast<size_t>(i) * sectionHeaderSize);
+    }
+
+    const PatternMatcher& matcher = database.matcher();
+    ArenaVector<bool> matched(database.signatureCount(), false, allocator);
+    // ElfSymbol signatures match from the start of the name, so "execv"
+    // also covers execve and execvp
+    PatternMatchSink onMatch = [&](uint32_t patternId, uint64_t endOffset) {
+        SignatureView signature = database.signature(patternId);
+        if (signature.category == SignatureCategory::ElfSymbol &&
+            endOffset == signature.text.size()) {
+            matched[patternId] = true;
+        }
+        return true;
+    };
+
+    for (const Section& section : sections) {
+        if (!inBounds(section, size)) {
+            return false;
+        }
+        if ((section.flags & SHF_EXECINSTR) && section.type != SHT_NOBITS &&
+            section.size >= kMinEntropySectionSize &&
+            sectionEntropy(data, section) >= kPackedEntropy) {
+            features.highEntropySections++;
+        }
+
+        bool isSymbols = section.type == SHT_DYNSYM;
+        bool isDynamic = section.type == SHT_DYNAMIC;
+        if (!isSymbols && !isDynamic) {
+            continue;
+        }
+        if (section.link >= sectionCount || !inBounds(sections[section.link], size) ||
+            sections[section.link].type == SHT_NOBITS) {
+            return false;
+        }
+        const Section& strings = sections[section.link];
+
+        if (isSymbols) {
+            // Entry 0 is the reserved undefined symbol
+            for (uint64_t offset = layout.symbolSize(); offset + layout.symbolSize() <= section.size;
+                 offset += layout.symbolSize()) {
+                const uint8_t* symbol = data + section.offset + offset;
+                uint8_t info = symbol[layout.is64 ? 4 : 12];
+                uint16_t sectionIndex = readU16(symbol + (layout.is64 ? 6 : 14));
+                std::string_view name = stringAt(data, strings, readU32(symbol));
+                if (name.empty()) {
+                    continue;
+                }
+                uint8_t binding = info >> 4;
+                if (sectionIndex == SHN_UNDEF) {
+                    features.importCount++;
+                } else if (binding == STB_GLOBAL || binding == STB_WEAK) {
+                    features.exportCount++;
+                    if (name.compare(0, 5, "Java_") == 0) {
+                        features.jniExportCount++;
+                    }
+                } else {
+                    continue;
+                }
+                matcher.scan(name, onMatch);
+            }
+        } else {
+            for (uint64_t offset = 0; offset + layout.dynamicSize() <= section.size;
+                 offset += layout.dynamicSize()) {
+                const uint8_t* entry = data + section.offset + offset;
+                int64_t tag = static_cast<int64_t>(layout.word(entry));
+                if (tag == DT_NULL) {
+                    break;
+                }
+                if (tag != DT_NEEDED) {
+                    continue;
+                }
+                std::string_view name =
+                    stringAt(data, strings, layout.word(entry + layout.dynamicSize() / 2));
+                if (!name.empty()) {
+                    features.needed.emplace_back(name);
+                    matcher.scan(name, onMatch);
+                }
+            }
+        }
+    }
+
+    features.symbolSignatures.clear();
+    for (uint32_t i = 0; i < matched.size(); i++) {
+        if (matched[i]) {
+            features.symbolSignatures.push_back(i);
+        }
+    }
+    return true;
+}
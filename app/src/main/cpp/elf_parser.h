@@ -0,0 +1,43 @@
+#ifndef WHATSZAP_ELF_PARSER_H
+#define WHATSZAP_ELF_PARSER_H
+
+#include "signature_pack.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// What one native library links against and exposes
+struct ElfFeatures {
+    uint16_t machine;                     // e_machine, e.g. 183 for AArch64
+    uint32_t sectionCount;
+    uint32_t importCount;                 // undefined dynamic symbols
+    uint32_t exportCount;                 // defined global or weak dynamic symbols
+    uint32_t jniExportCount;              // exports named Java_*
+    uint32_t highEntropySections;         // executable sections that look encrypted
+    std::vector<std::string> needed;      // DT_NEEDED libraries
+    std::vector<uint32_t> symbolSignatures;   // matched ElfSymbol signature IDs, ascending
+
+    ElfFeatures()
+        : machine(0), sectionCount(0), importCount(0), exportCount(0), jniExportCount(0),
+          highEntropySections(0) {}
+
+    // Code the loader maps but a static reader cannot see: no section
+    // headers at all, or executable sections that are encrypted or packed
+    bool isPacked() const { return sectionCount == 0 || highEntropySections > 0; }
+};
+
+// Reader for 32- and 64-bit little-endian ELF shared objects, read in place
+// from the entry's bytes. One pass over the section headers finds the
+// dynamic symbol table and the dynamic section; symbol and library names
+// are matched against ElfSymbol signatures by prefix. Executable sections
+// are sampled, not read in full, to estimate their entropy. Scratch
+// tables come from the thread's ScanArena.
+class ElfParser {
+public:
+    // Returns false if the data is not a well-formed ELF file
+    static bool parse(const uint8_t* data, size_t size, const SignatureDatabase& database,
+                      ElfFeatures& features);
+};
+
+#endif // WHATSZAP_ELF_PARSER_H
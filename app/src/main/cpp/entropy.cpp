@@ -0,0 +1,164 @@
+#include "entropy.h"
+#include <cmath>
+#include <cstring>
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+constexpr int kLanes = ByteCounter::kLanes;
+using LaneCounts = uint32_t[kLanes][256];
+
+// A lane counts at most this many bytes between folds, far below the
+// 32-bit limit
+constexpr uint64_t kMaxUnfolded = 256 * 1024 * 1024;
+
+// There is no scatter-increment in NEON (or SSE), so counting is bound by
+// the counter updates on every ABI. Eight bytes are loaded per 64-bit word
+// and split with shifts, one sub-table each.
+void countBytes(const uint8_t* data, size_t length, LaneCounts& lanes) {
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        lanes[0][word & 0xFF]++;
+        lanes[1][(word >> 8) & 0xFF]++;
+        lanes[2][(word >> 16) & 0xFF]++;
+        lanes[3][(word >> 24) & 0xFF]++;
+        lanes[4][(word >> 32) & 0xFF]++;
+        lanes[5][(word >> 40) & 0xFF]++;
+        lanes[6][(word >> 48) & 0xFF]++;
+        lanes[7][word >> 56]++;
+    }
+    for (; i < length; i++) {
+        lanes[0][data[i]]++;
+    }
+}
+
+// Sum the sub-tables into the 64-bit totals
+void foldLanes(const LaneCounts& lanes, uint64_t* counts) {
+#if defined(__ARM_NEON)
+    for (int value = 0; value < 256; value += 4) {
+        uint32x4_t sum = vld1q_u32(&lanes[0][value]);
+        for (int lane = 1; lane < kLanes; lane++) {
+            sum = vaddq_u32(sum, vld1q_u32(&lanes[lane][value]));
+        }
+        vst1q_u64(counts + value, vaddw_u32(vld1q_u64(counts + value), vget_low_u32(sum)));
+        vst1q_u64(counts + value + 2,
+                  vaddw_u32(vld1q_u64(counts + value + 2), vget_high_u32(sum)));
+    }
+#else
+    for (int value = 0; value < 256; value++) {
+        uint32_t sum = 0;
+        for (int lane = 0; lane < kLanes; lane++) {
+            sum += lanes[lane][value];
+        }
+        counts[value] += sum;
+    }
+#endif
+}
+
+} // namespace
+
+void ByteCounter::add(const uint8_t* data, size_t length) {
+    while (length > 0) {
+        if (unfolded_ == kMaxUnfolded) {
+            fold();
+        }
+        size_t room = static_cast<size_t>(kMaxUnfolded - unfolded_);
+        size_t chunk = length < room ? length : room;
+        countBytes(data, chunk, lanes_);
+        unfolded_ += chunk;
+        data += chunk;
+        length -= chunk;
+    }
+}
+
+void ByteCounter::fold() {
+    foldLanes(lanes_, folded_.counts);
+    folded_.total += unfolded_;
+    memset(lanes_, 0, sizeof(lanes_));
+    unfolded_ = 0;
+}
+
+void ByteCounter::addTo(ByteHistogram& histogram) const {
+    histogram.merge(folded_);
+    foldLanes(lanes_, histogram.counts);
+    histogram.total += unfolded_;
+}
+
+void ByteCounter::drain(ByteHistogram& histogram) {
+    addTo(histogram);
+    memset(lanes_, 0, sizeof(lanes_));
+    unfolded_ = 0;
+    folded_ = ByteHistogram();
+}
+
+void ByteHistogram::merge(const ByteHistogram& other) {
+    for (int value = 0; value < 256; value++) {
+        counts[value] += other.counts[value];
+    }
+    total += other.total;
+}
+
+double ByteHistogram::entropy() const {
+    if (total == 0) {
+        return 0.0;
+    }
+    double bits = 0.0;
+    double scale = 1.0 / static_cast<double>(total);
+    for (uint64_t count : counts) {
+        if (count != 0) {
+            double p = static_cast<double>(count) * scale;
+            bits -= p * std::log2(p);
+        }
+    }
+    return bits;
+}
+
+void EntropyMeter::update(const uint8_t* data, size_t length) {
+    while (length > 0) {
+        size_t room = kHalfWindowSize - static_cast<size_t>(half_.size());
+        size_t take = length < room ? length : room;
+        half_.add(data, take);
+        data += take;
+        length -= take;
+        if (half_.size() < kHalfWindowSize) {
+            break;
+        }
+        ByteHistogram half;
+        half_.drain(half);
+        if (previousHalf_.total != 0) {
+            ByteHistogram window = previousHalf_;
+            window.merge(half);
+            double windowEntropy = window.entropy();
+            if (fullWindows_ == 0 || windowEntropy > peakWindowEntropy_) {
+                peakWindowEntropy_ = windowEntropy;
+            }
+            fullWindows_++;
+        }
+        total_.merge(half);
+        previousHalf_ = half;
+    }
+}
+
+double EntropyMeter::entropy() const {
+    ByteHistogram all = total_;
+    half_.addTo(all);
+    return all.entropy();
+}
+
+double EntropyMeter::peakWindowEntropy() const {
+    if (fullWindows_ == 0) {
+        return entropy();
+    }
+    // The tail, at least half a window long, so the last bytes count too
+    if (half_.size() == 0) {
+        return peakWindowEntropy_;
+    }
+    ByteHistogram tail = previousHalf_;
+    half_.addTo(tail);
+    double tailEntropy = tail.entropy();
+    return tailEntropy > peakWindowEntropy_ ? tailEntropy : peakWindowEntropy_;
+}
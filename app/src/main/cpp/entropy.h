@@ -0,0 +1,76 @@
+#ifndef WHATSZAP_ENTROPY_H
+#define WHATSZAP_ENTROPY_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Byte histogram for Shannon entropy. Several inputs, e.g. samples spread
+// over a large section, can be counted into one histogram.
+struct ByteHistogram {
+    uint64_t counts[256];
+    uint64_t total;
+
+    ByteHistogram() : counts(), total(0) {}
+
+    void merge(const ByteHistogram& other);
+    // Bits per byte, 0 (constant) to 8 (uniformly random)
+    double entropy() const;
+};
+
+// Counts bytes for a ByteHistogram into eight 32-bit sub-tables, so runs of
+// one byte value do not serialize on a single counter. The sub-tables are
+// zeroed when the counter is made and again only by drain(), so however
+// many inputs are added they are folded, with NEON where the ABI
+// guarantees it (arm64-v8a, armeabi-v7a) and a scalar loop elsewhere such
+// as x86 emulator images, once per histogram.
+class ByteCounter {
+public:
+    static constexpr int kLanes = 8;
+
+    ByteCounter() : lanes_(), unfolded_(0) {}
+
+    void add(const uint8_t* data, size_t length);
+
+    uint64_t size() const { return folded_.total + unfolded_; }
+    // Add everything counted so far to `histogram`
+    void addTo(ByteHistogram& histogram) const;
+    // Same, then start over empty
+    void drain(ByteHistogram& histogram);
+
+private:
+    void fold();
+
+    uint32_t lanes_[kLanes][256];
+    uint64_t unfolded_;         // bytes counted in lanes_
+    ByteHistogram folded_;      // lanes_ folded early, before they could overflow
+};
+
+// Entropy of a stream fed in chunks, overall and per fixed-size window, so
+// an encrypted blob appended to an ordinary file still stands out. Windows
+// overlap by half: every byte is counted once, into the current half
+// window, and each window is the sum of two consecutive halves.
+class EntropyMeter {
+public:
+    static constexpr size_t kWindowSize = 64 * 1024;
+
+    EntropyMeter() : peakWindowEntropy_(0.0), fullWindows_(0) {}
+
+    void update(const uint8_t* data, size_t length);
+
+    uint64_t size() const { return total_.total + half_.size(); }
+    double entropy() const;
+    // Highest entropy of any window, including the one ending at the last
+    // byte; the overall entropy when the stream is shorter than one window
+    double peakWindowEntropy() const;
+
+private:
+    static constexpr size_t kHalfWindowSize = kWindowSize / 2;
+
+    ByteHistogram total_;       // every completed half window
+    ByteHistogram previousHalf_;
+    ByteCounter half_;          // the half window being filled
+    double peakWindowEntropy_;
+    uint64_t fullWindows_;
+};
+
+#endif // WHATSZAP_ENTROPY_H
@@ -0,0 +1,284 @@
+#include "entry_analyzers.h"
+#include "dex_parser.h"
+#include "elf_parser.h"
+#include "entropy.h"
+#include "malware_scanner.h"
+#include "native-lib.h"
+#include "score_table.h"
+#include <algorithm>
+#include <string>
+#include <utility>
+
+namespace {
+
+// A window this close to 8 bits per byte is compressed or encrypted
+constexpr double kEncryptedEntropy = 7.9;
+// Deflate gets at least this far below the original size on anything with
+// entropy under kEncryptedEntropy; entries that shrink more are not measured
+constexpr double kIncompressibleRatio = 0.98;
+
+// Formats that are compressed by design, so high entropy says nothing
+bool isCompressedFormat(std::string_view name) {
+    static const std::string_view kExtensions[] = {
+        ".png", ".jpg", ".jpeg", ".gif", ".webp", ".heic", ".avif",
+        ".mp3", ".mp4", ".m4a", ".aac", ".ogg", ".opus", ".webm", ".mkv",
+        ".zip", ".jar", ".apk", ".gz", ".xz", ".bz2", ".7z", ".br", ".zst",
+        ".woff", ".woff2"
+    };
+    std::string lower(name.substr(name.size() > 6 ? name.size() - 6 : 0));
+    std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+    for (std::string_view extension : kExtensions) {
+        if (lower.size() >= extension.size() &&
+            lower.compare(lower.size() - extension.size(), extension.size(), extension) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Assets and other data entries worth an entropy measurement: at least a
+// window long, not a media or archive format, and either stored or barely
+// shrunk by deflate
+bool isOpaqueEntry(const ZipEntry& entry) {
+    if (entry.isDirectory() || entry.uncompressedSize < EntropyMeter::kWindowSize ||
+        isCompressedFormat(entry.name)) {
+        return false;
+    }
+    return entry.isStored() ||
+           static_cast<double>(entry.compressedSize) >=
+               static_cast<double>(entry.uncompressedSize) * kIncompressibleRatio;
+}
+
+// Keyword signatures in the entry name and content; the first match
+// settles the entry
+class KeywordPass : public EntryPass {
+public:
+    explicit KeywordPass(const EntryContext& context)
+        : context_(context), matched_(false),
+          sink_([this](uint32_t patternId, uint64_t endOffset) {
+              return onMatch(patternId, endOffset);
+          }) {
+        context_.run.database().matcher().scan(context_.entry.name, sink_);
+    }
+
+    bool update(const uint8_t* data, size_t length) override {
+        if (!matched_) {
+            context_.run.database().matcher().scan(cursor_, data, length, sink_);
+        }
+        return !matched_;
+    }
+
+    void finish(EntryFindings& findings) override {
+        findings.suspiciousContent = matched_;
+    }
+
+private:
+    bool onMatch(uint32_t patternId, uint64_t endOffset) {
+        SignatureView signature = context_.run.database().signature(patternId);
+        if (signature.category != SignatureCategory::Keyword) {
+            return true;
+        }
+        LOGD("Signature '%.*s' matched in %.*s at offset %llu",
+             static_cast<int>(signature.text.size()), signature.text.data(),
+             static_cast<int>(context_.name.size()), context_.name.data(),
+             static_cast<unsigned long long>(endOffset - signature.text.size()));
+        matched_ = true;
+        context_.run.report(ScanRun::Finding::SuspiciousContent, featureWeight(Feature::SuspiciousContent));
+        return false;
+    }
+
+    const EntryContext& context_;
+    bool matched_;
+    PatternMatcher::Cursor cursor_;
+    PatternMatchSink sink_;
+};
+
+class KeywordAnalyzer : public EntryAnalyzer {
+public:
+    const char* name() const override { return "keywords"; }
+    AnalyzerCost cost() const override { return AnalyzerCost::Cheap; }
+    bool accepts(const ZipEntry& entry) const override {
+        return MalwareScanner::isCodeEntry(entry.name);
+    }
+    ArenaPtr<EntryPass> begin(const EntryContext& context, ScanArena& arena) const override {
+        return arena.make<KeywordPass>(context);
+    }
+};
+
+class EntropyPass : public EntryPass {
+public:
+    explicit EntropyPass(const EntryContext& context) : context_(context) {}
+
+    bool update(const uint8_t* data, size_t length) override {
+        meter_.update(data, length);
+        return true;
+    }
+
+    void finish(EntryFindings& findings) override {
+        findings.measured = meter_.size() > 0;
+        findings.entropy = EntryEntropy{std::string(context_.name), meter_.entropy(),
+                                        meter_.peakWindowEntropy(), meter_.size()};
+        // Native libraries are judged by their sections instead:
+        // compressed .rodata is normal there
+        findings.encryptedPayload = findings.measured &&
+                                    findings.entropy.peakWindowEntropy >= kEncryptedEntropy &&
+                                    !isNativeLibraryEntry(context_.entry.name);
+        if (findings.encryptedPayload) {
+            context_.run.report(ScanRun::Finding::EncryptedPayload, featureWeight(Feature::EncryptedPayload));
+        }
+    }
+
+private:
+    const EntryContext& context_;
+    EntropyMeter meter_;
+};
+
+class EntropyAnalyzer : public EntryAnalyzer {
+public:
+    const char* name() const override { return "entropy"; }
+    AnalyzerCost cost() const override { return AnalyzerCost::Cheap; }
+    bool accepts(const ZipEntry& entry) const override {
+        return MalwareScanner::isCodeEntry(entry.name) || isOpaqueEntry(entry);
+    }
+    ArenaPtr<EntryPass> begin(const EntryContext& context, ScanArena& arena) const override {
+        return arena.make<EntropyPass>(context);
+    }
+};
+
+class FuzzyDigestPass : public EntryPass {
+public:
+    explicit FuzzyDigestPass(const EntryContext& context) : context_(context) {}
+
+    bool update(const uint8_t* data, size_t length) override {
+        hasher_.update(data, length);
+        return true;
+    }
+
+    void finish(EntryFindings& findings) override {
+        // A digest of part of the file would not compare
+        findings.hasDigest = hasher_.size() == context_.entry.uncompressedSize &&
+                             hasher_.finish(findings.digest);
+    }
+
+private:
+    const EntryContext& context_;
+    FuzzyHasher hasher_;
+};
+
+class FuzzyDigestAnalyzer : public EntryAnalyzer {
+public:
+    const char* name() const override { return "fuzzy-digest"; }
+    AnalyzerCost cost() const override { return AnalyzerCost::Moderate; }
+    bool accepts(const ZipEntry& entry) const override { return isDexEntry(entry.name); }
+    ArenaPtr<EntryPass> begin(const EntryContext& context, ScanArena& arena) const override {
+        return arena.make<FuzzyDigestPass>(context);
+    }
+};
+
+class DexPass : public EntryPass {
+public:
+    explicit DexPass(const EntryContext& context) : context_(context) {}
+
+    void analyze(const uint8_t* content, size_t size) override {
+        const ZipEntry& entry = context_.entry;
+        DexFeatures features;
+        if (!DexParser::parse(content, size, context_.run.database(), features)) {
+            LOGW("Malformed dex file: %.*s", static_cast<int>(entry.name.size()), entry.name.data());
+            return;
+        }
+        LOGD("%.*s: %u types, %u methods, %zu suspicious APIs",
+             static_cast<int>(entry.name.size()), entry.name.data(), features.typeCount,
+             features.methodCount, features.apiSignatures.size());
+        for (uint32_t id : features.apiSignatures) {
+            context_.run.reportSignature(id, featureWeight(Feature::SuspiciousSignature));
+        }
+        apiSignatures_ = std::move(features.apiSignatures);
+    }
+
+    void finish(EntryFindings& findings) override {
+        findings.apiSignatures = std::move(apiSignatures_);
+    }
+
+private:
+    const EntryContext& context_;
+    std::vector<uint32_t> apiSignatures_;
+};
+
+class DexAnalyzer : public EntryAnalyzer {
+public:
+    const char* name() const override { return "dex"; }
+    AnalyzerCost cost() const override { return AnalyzerCost::Expensive; }
+    bool needsWholeEntry() const override { return true; }
+    bool accepts(const ZipEntry& entry) const override { return isDexEntry(entry.name); }
+    ArenaPtr<EntryPass> begin(const EntryContext& context, ScanArena& arena) const override {
+        return arena.make<DexPass>(context);
+    }
+};
+
+class ElfPass : public EntryPass {
+public:
+    explicit ElfPass(const EntryContext& context) : context_(context), packed_(false) {}
+
+    void analyze(const uint8_t* content, size_t size) override {
+        const ZipEntry& entry = context_.entry;
+        ElfFeatures features;
+        if (!ElfParser::parse(content, size, context_.run.database(), features)) {
+            LOGW("Malformed native library: %.*s",
+                 static_cast<int>(entry.name.size()), entry.name.data());
+            return;
+        }
+        LOGD("%.*s: %zu needed, %u imports, %u exports (%u JNI), %u packed sections",
+             static_cast<int>(entry.name.size()), entry.name.data(), features.needed.size(),
+             features.importCount, features.exportCount, features.jniExportCount,
+             features.highEntropySections);
+        for (uint32_t id : features.symbolSignatures) {
+            context_.run.reportSignature(id, featureWeight(Feature::SuspiciousSignature));
+        }
+        packed_ = features.isPacked();
+        if (packed_) {
+            context_.run.report(ScanRun::Finding::PackedLibrary, featureWeight(Feature::PackedLibrary));
+        }
+        symbolSignatures_ = std::move(features.symbolSignatures);
+    }
+
+    void finish(EntryFindings& findings) override {
+        findings.symbolSignatures = std::move(symbolSignatures_);
+        findings.packedLibrary = packed_;
+    }
+
+private:
+    const EntryContext& context_;
+    std::vector<uint32_t> symbolSignatures_;
+    bool packed_;
+};
+
+class ElfAnalyzer : public EntryAnalyzer {
+public:
+    const char* name() const override { return "elf"; }
+    AnalyzerCost cost() const override { return AnalyzerCost::Expensive; }
+    bool needsWholeEntry() const override { return true; }
+    bool accepts(const ZipEntry& entry) const override {
+        return isNativeLibraryEntry(entry.name);
+    }
+    ArenaPtr<EntryPass> begin(const EntryContext& context, ScanArena& arena) const override {
+        return arena.make<ElfPass>(context);
+    }
+};
+
+} // namespace
+
+bool isDexEntry(std::string_view name) {
+    return name.size() > 4 && name.substr(name.size() - 4) == ".dex";
+}
+
+bool isNativeLibraryEntry(std::string_view name) {
+    return name.size() > 7 && name.substr(0, 4) == "lib/" && name.substr(name.size() - 3) == ".so";
+}
+
+void addBuiltinAnalyzers(ScanPipeline& pipeline) {
+    pipeline.add(std::make_unique<KeywordAnalyzer>());
+    pipeline.add(std::make_unique<EntropyAnalyzer>());
+    pipeline.add(std::make_unique<FuzzyDigestAnalyzer>());
+    pipeline.add(std::make_unique<DexAnalyzer>());
+    pipeline.add(std::make_unique<ElfAnalyzer>());
+}
@@ -0,0 +1,18 @@
+#ifndef WHATSZAP_ENTRY_ANALYZERS_H
+#define WHATSZAP_ENTRY_ANALYZERS_H
+
+#include "scan_pipeline.h"
+#include <string_view>
+
+bool isDexEntry(std::string_view name);
+bool isNativeLibraryEntry(std::string_view name);
+
+// The content checks of MalwareScanner::scanApk, cheapest first:
+//   keywords     Cheap      signature keywords in code-bearing entries
+//   entropy      Cheap      overall and windowed entropy of code and opaque data
+//   fuzzy-digest Moderate   digest of each dex file, for similarity lookups
+//   dex          Expensive  APIs referenced by the dex identifier tables
+//   elf          Expensive  symbols and packed sections of native libraries
+void addBuiltinAnalyzers(ScanPipeline& pipeline);
+
+#endif // WHATSZAP_ENTRY_ANALYZERS_H
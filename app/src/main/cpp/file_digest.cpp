@@ -0,0 +1,375 @@
+#include "file_digest.h"
+#include "native-lib.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(WHATSZAP_ARMV8_SHA2)
+#include <asm/hwcap.h>
+#include <sys/auxv.h>
+
+// sha256_armv8.cpp, built with the crypto extensions enabled
+void sha256CompressArmv8(uint32_t* state, const uint8_t* blocks, size_t blockCount);
+#endif
+
+namespace {
+
+// Bytes hashed per step in MultiDigest; small enough to stay in L1/L2
+// while every selected algorithm passes over it
+constexpr size_t kDigestChunkSize = 64 * 1024;
+
+inline uint32_t rotl(uint32_t value, int bits) {
+    return (value << bits) | (value >> (32 - bits));
+}
+
+inline uint32_t rotr(uint32_t value, int bits) {
+    return (value >> bits) | (value << (32 - bits));
+}
+
+inline uint32_t loadBE32(const uint8_t* p) {
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+           (static_cast<uint32_t>(p[2]) << 8) | p[3];
+}
+
+inline uint32_t loadLE32(const uint8_t* p) {
+    return p[0] | (static_cast<uint32_t>(p[1]) << 8) | (static_cast<uint32_t>(p[2]) << 16) |
+           (static_cast<uint32_t>(p[3]) << 24);
+}
+
+inline void storeBE32(uint8_t* p, uint32_t value) {
+    p[0] = static_cast<uint8_t>(value >> 24);
+    p[1] = static_cast<uint8_t>(value >> 16);
+    p[2] = static_cast<uint8_t>(value >> 8);
+    p[3] = static_cast<uint8_t>(value);
+}
+
+inline void storeLE32(uint8_t* p, uint32_t value) {
+    p[0] = static_cast<uint8_t>(value);
+    p[1] = static_cast<uint8_t>(value >> 8);
+    p[2] = static_cast<uint8_t>(value >> 16);
+    p[3] = static_cast<uint8_t>(value >> 24);
+}
+
+std::string toHex(const uint8_t* data, size_t length) {
+    static const char kHexDigits[] = "0123456789abcdef";
+    std::string hex(length * 2, '0');
+    for (size_t i = 0; i < length; i++) {
+        hex[i * 2] = kHexDigits[data[i] >> 4];
+        hex[i * 2 + 1] = kHexDigits[data[i] & 0x0F];
+    }
+    return hex;
+}
+
+const uint32_t kSha256RoundConstants[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+void sha256CompressPortable(uint32_t* state, const uint8_t* blocks, size_t blockCount) {
+    uint32_t w[64];
+    for (; blockCount > 0; blockCount--, blocks += 64) {
+        for (int i = 0; i < 16; i++) {
+            w[i] = loadBE32(blocks + i * 4);
+        }
+        for (int i = 16; i < 64; i++) {
+            uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int i = 0; i < 64; i++) {
+            uint32_t s1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+            uint32_t choice = (e & f) ^ (~e & g);
+            uint32_t t1 = h + s1 + choice + kSha256RoundConstants[i] + w[i];
+            uint32_t s0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+            uint32_t majority = (a & b) ^ (a & c) ^ (b & c);
+            uint32_t t2 = s0 + majority;
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+        state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+    }
+}
+
+void sha1Compress(uint32_t* state, const uint8_t* blocks, size_t blockCount) {
+    uint32_t w[80];
+    for (; blockCount > 0; blockCount--, blocks += 64) {
+        for (int i = 0; i < 16; i++) {
+            w[i] = loadBE32(blocks + i * 4);
+        }
+        for (int i = 16; i < 80; i++) {
+            w[i] = rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+        for (int i = 0; i < 80; i++) {
+            uint32_t f, k;
+            if (i < 20) {
+                f = (b & c) | (~b & d);
+                k = 0x5a827999;
+            } else if (i < 40) {
+                f = b ^ c ^ d;
+                k = 0x6ed9eba1;
+            } else if (i < 60) {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8f1bbcdc;
+            } else {
+                f = b ^ c ^ d;
+                k = 0xca62c1d6;
+            }
+            uint32_t temp = rotl(a, 5) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = rotl(b, 30);
+            b = a;
+            a = temp;
+        }
+        state[0] += a; state[1] += b; state[2] += c; state[3] += d; state[4] += e;
+    }
+}
+
+const uint32_t kMd5Constants[64] = {
+    0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+    0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+    0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+    0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+    0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+    0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+    0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+    0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+};
+
+const int kMd5Shifts[64] = {
+    7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+    5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20,
+    4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+    6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21
+};
+
+void md5Compress(uint32_t* state, const uint8_t* blocks, size_t blockCount) {
+    uint32_t m[16];
+    for (; blockCount > 0; blockCount--, blocks += 64) {
+        for (int i = 0; i < 16; i++) {
+            m[i] = loadLE32(blocks + i * 4);
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        for (int i = 0; i < 64; i++) {
+            uint32_t f;
+            int g;
+            if (i < 16) {
+                f = (b & c) | (~b & d);
+                g = i;
+            } else if (i < 32) {
+                f = (d & b) | (~d & c);
+                g = (5 * i + 1) & 15;
+            } else if (i < 48) {
+                f = b ^ c ^ d;
+                g = (3 * i + 5) & 15;
+            } else {
+                f = c ^ (b | ~d);
+                g = (7 * i) & 15;
+            }
+            uint32_t rotated = rotl(a + f + kMd5Constants[i] + m[g], kMd5Shifts[i]);
+            a = d;
+            d = c;
+            c = b;
+            b += rotated;
+        }
+        state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    }
+}
+
+} // namespace
+
+bool sha256IsHardwareAccelerated() {
+#if defined(WHATSZAP_ARMV8_SHA2)
+    static const bool accelerated = (getauxval(AT_HWCAP) & HWCAP_SHA2) != 0;
+    return accelerated;
+#else
+    return false;
+#endif
+}
+
+void BlockDigest::absorb(uint32_t* state, const uint8_t* data, size_t length,
+                         CompressFn compress) {
+    length_ += length;
+    if (buffered_ > 0) {
+        size_t take = std::min(sizeof(buffer_) - buffered_, length);
+        memcpy(buffer_ + buffered_, data, take);
+        buffered_ += take;
+        data += take;
+        length -= take;
+        if (buffered_ < sizeof(buffer_)) {
+            return;
+        }
+        compress(state, buffer_, 1);
+        buffered_ = 0;
+    }
+    // Whole blocks go straight from the caller's buffer
+    size_t blockCount = length / 64;
+    if (blockCount > 0) {
+        compress(state, data, blockCount);
+        data += blockCount * 64;
+        length -= blockCount * 64;
+    }
+    memcpy(buffer_, data, length);
+    buffered_ = length;
+}
+
+void BlockDigest::pad(uint32_t* state, bool bigEndianLength, CompressFn compress) {
+    uint64_t bitLength = length_ * 8;
+    buffer_[buffered_++] = 0x80;
+    if (buffered_ > 56) {
+        memset(buffer_ + buffered_, 0, sizeof(buffer_) - buffered_);
+        compress(state, buffer_, 1);
+        buffered_ = 0;
+    }
+    memset(buffer_ + buffered_, 0, 56 - buffered_);
+    for (int i = 0; i < 8; i++) {
+        int shift = bigEndianLength ? 56 - i * 8 : i * 8;
+        buffer_[56 + i] = static_cast<uint8_t>(bitLength >> shift);
+    }
+    compress(state, buffer_, 1);
+    buffered_ = 0;
+}
+
+Sha256::Sha256()
+    : state_{0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+             0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19},
+      compress_(sha256CompressPortable) {
+#if defined(WHATSZAP_ARMV8_SHA2)
+    if (sha256IsHardwareAccelerated()) {
+        compress_ = sha256CompressArmv8;
+    }
+#endif
+}
+
+void Sha256::update(const uint8_t* data, size_t length) {
+    absorb(state_, data, length, compress_);
+}
+
+void Sha256::finish(uint8_t digest[kDigestSize]) {
+    pad(state_, true, compress_);
+    for (int i = 0; i < 8; i++) {
+        storeBE32(digest + i * 4, state_[i]);
+    }
+}
+
+Sha1::Sha1() : state_{0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0} {}
+
+void Sha1::update(const uint8_t* data, size_t length) {
+    absorb(state_, data, length, sha1Compress);
+}
+
+void Sha1::finish(uint8_t digest[kDigestSize]) {
+    pad(state_, true, sha1Compress);
+    for (int i = 0; i < 5; i++) {
+        storeBE32(digest + i * 4, state_[i]);
+    }
+}
+
+Md5::Md5() : state_{0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476} {}
+
+void Md5::update(const uint8_t* data, size_t length) {
+    absorb(state_, data, length, md5Compress);
+}
+
+void Md5::finish(uint8_t digest[kDigestSize]) {
+    pad(state_, false, md5Compress);
+    for (int i = 0; i < 4; i++) {
+        storeLE32(digest + i * 4, state_[i]);
+    }
+}
+
+MultiDigest::MultiDigest(unsigned algorithms) : algorithms_(algorithms) {}
+
+void MultiDigest::update(const uint8_t* data, size_t length) {
+    if (algorithms_ & kDigestSha256) {
+        sha256_.update(data, length);
+    }
+    if (algorithms_ & kDigestSha1) {
+        sha1_.update(data, length);
+    }
+    if (algorithms_ & kDigestMd5) {
+        md5_.update(data, length);
+    }
+}
+
+void MultiDigest::finish(FileDigests& out) {
+    if (algorithms_ & kDigestSha256) {
+        uint8_t digest[Sha256::kDigestSize];
+        sha256_.finish(digest);
+        out.sha256 = toHex(digest, sizeof(digest));
+    }
+    if (algorithms_ & kDigestSha1) {
+        uint8_t digest[Sha1::kDigestSize];
+        sha1_.finish(digest);
+        out.sha1 = toHex(digest, sizeof(digest));
+    }
+    if (algorithms_ & kDigestMd5) {
+        uint8_t digest[Md5::kDigestSize];
+        md5_.finish(digest);
+        out.md5 = toHex(digest, sizeof(digest));
+    }
+}
+
+void MultiDigest::digestBuffer(const uint8_t* data, size_t size, unsigned algorithms,
+                               FileDigests& out) {
+    MultiDigest digest(algorithms);
+    for (size_t offset = 0; offset < size; offset += kDigestChunkSize) {
+        digest.update(data + offset, std::min(kDigestChunkSize, size - offset));
+    }
+    digest.finish(out);
+}
+
+bool digestFile(const std::string& path, unsigned algorithms, FileDigests& out) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        LOGE("Failed to open %s for hashing: %s", path.c_str(), strerror(errno));
+        return false;
+    }
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0) {
+        close(fd);
+        return false;
+    }
+
+    size_t length = static_cast<size_t>(fileStat.st_size);
+    if (length == 0) {
+        close(fd);
+        MultiDigest::digestBuffer(nullptr, 0, algorithms, out);
+        return true;
+    }
+
+    void* mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        LOGE("Failed to mmap %s for hashing: %s", path.c_str(), strerror(errno));
+        return false;
+    }
+    madvise(mapping, length, MADV_SEQUENTIAL);
+    MultiDigest::digestBuffer(static_cast<const uint8_t*>(mapping), length, algorithms, out);
+    munmap(mapping, length);
+    return true;
+}
@@ -0,0 +1,101 @@
+#ifndef WHATSZAP_FILE_DIGEST_H
+#define WHATSZAP_FILE_DIGEST_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Shared 64-byte block buffering for the Merkle-Damgard hashes below
+class BlockDigest {
+protected:
+    BlockDigest() : buffered_(0), length_(0) {}
+
+    using CompressFn = void (*)(uint32_t* state, const uint8_t* blocks, size_t blockCount);
+
+    void absorb(uint32_t* state, const uint8_t* data, size_t length, CompressFn compress);
+    // Append the 0x80 terminator and the bit length in the given byte order
+    void pad(uint32_t* state, bool bigEndianLength, CompressFn compress);
+
+    uint8_t buffer_[64];
+    size_t buffered_;
+    uint64_t length_;
+};
+
+class Sha256 : public BlockDigest {
+public:
+    static constexpr size_t kDigestSize = 32;
+
+    Sha256();
+    void update(const uint8_t* data, size_t length);
+    void finish(uint8_t digest[kDigestSize]);
+
+private:
+    uint32_t state_[8];
+    CompressFn compress_;
+};
+
+class Sha1 : public BlockDigest {
+public:
+    static constexpr size_t kDigestSize = 20;
+
+    Sha1();
+    void update(const uint8_t* data, size_t length);
+    void finish(uint8_t digest[kDigestSize]);
+
+private:
+    uint32_t state_[5];
+};
+
+class Md5 : public BlockDigest {
+public:
+    static constexpr size_t kDigestSize = 16;
+
+    Md5();
+    void update(const uint8_t* data, size_t length);
+    void finish(uint8_t digest[kDigestSize]);
+
+private:
+    uint32_t state_[4];
+};
+
+// Lowercase hex digests of one file; algorithms not requested stay empty
+struct FileDigests {
+    std::string sha256;
+    std::string sha1;
+    std::string md5;
+};
+
+enum DigestAlgorithm : unsigned {
+    kDigestSha256 = 1u << 0,
+    kDigestSha1 = 1u << 1,
+    kDigestMd5 = 1u << 2,
+    kDigestAll = kDigestSha256 | kDigestSha1 | kDigestMd5
+};
+
+// Runs the selected hashes side by side over the same chunks, so each
+// chunk is read from memory once for all of them.
+class MultiDigest {
+public:
+    explicit MultiDigest(unsigned algorithms);
+
+    void update(const uint8_t* data, size_t length);
+    void finish(FileDigests& out);
+
+    // Hash a whole in-memory (typically mmap'd) buffer chunk by chunk
+    static void digestBuffer(const uint8_t* data, size_t size, unsigned algorithms,
+                             FileDigests& out);
+
+private:
+    unsigned algorithms_;
+    Sha256 sha256_;
+    Sha1 sha1_;
+    Md5 md5_;
+};
+
+// Map and hash a file that is not otherwise mapped; false if unreadable
+bool digestFile(const std::string& path, unsigned algorithms, FileDigests& out);
+
+// Whether SHA-256 runs on the ARMv8 crypto extensions on this device
+bool sha256IsHardwareAccelerated();
+
+#endif // WHATSZAP_FILE_DIGEST_H
@@ -1,16 +1,83 @@
 #include "file_monitor.h"
+#include "archive_probe.h"
+#include "jni_registry.h"
 #include "native-lib.h"
+#include "scan_metrics.h"
 #include <sys/inotify.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <sys/syscall.h>
+#include <linux/fanotify.h>
 #include <unistd.h>
 #include <sys/stat.h>
+#include <dirent.h>
 #include <fcntl.h>
 #include <string.h>
 #include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <time.h>
 #include <algorithm>
-#include <sys/select.h>
+#include <limits>
+#include <utility>
+#include <vector>
 #include <jni.h>
 
-FileMonitor::FileMonitor() : monitoring_(false), shouldStop_(false) {
+namespace {
+
+constexpr uint32_t kWatchMask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE |
+                                IN_MODIFY | IN_ONLYDIR | IN_EXCL_UNLINK;
+
+// Directories nested deeper than this below a root are not watched
+constexpr int kMaxTreeDepth = 16;
+// Used when max_user_watches cannot be read
+constexpr size_t kDefaultWatchLimit = 8192;
+// The limit is per uid; leave a quarter of it to other inotify users in
+// the app
+constexpr size_t kWatchHeadroomDivisor = 4;
+constexpr char kWatchLimitPath[] = "/proc/sys/fs/inotify/max_user_watches";
+// watchTree() trackSince that tracks nothing, for the first walk of a root
+constexpr time_t kTrackNothing = std::numeric_limits<time_t>::max();
+
+constexpr int64_t kNanosPerSecond = 1000000000LL;
+// A pending file is complete once size and mtime hold still this long
+constexpr int64_t kSettleQuietNs = 2 * kNanosPerSecond;
+// How often pending files are re-checked
+constexpr int64_t kSettleCheckNs = kNanosPerSecond / 2;
+// Writers stuck longer than this are given up on
+constexpr int64_t kPendingTimeoutNs = 10 * 60 * kNanosPerSecond;
+// After a queue overflow, files modified this recently are re-checked
+constexpr time_t kOverflowRescanWindowSec = 120;
+// Completed files are collected this long before one batch goes to Java
+constexpr int64_t kCoalesceNs = kNanosPerSecond / 4;
+// A reported file is not reported again while unchanged for this long
+constexpr int64_t kReportedTtlNs = 30 * 60 * kNanosPerSecond;
+// Streaming reads: one pread per chunk, and at most this much per file per
+// wakeup so a fast writer cannot hold up the other events
+constexpr size_t kStreamChunkSize = 256 * 1024;
+constexpr uint64_t kStreamBytesPerPass = 8 * 1024 * 1024;
+
+int64_t monotonicNowNs() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<int64_t>(now.tv_sec) * kNanosPerSecond + now.tv_nsec;
+}
+
+int64_t mtimeNs(const struct stat& fileStat) {
+    return static_cast<int64_t>(fileStat.st_mtim.tv_sec) * kNanosPerSecond + fileStat.st_mtim.tv_nsec;
+}
+
+bool sameFile(const FileIdentity& a, const FileIdentity& b) {
+    return a.device == b.device && a.inode == b.inode && a.size == b.size && a.mtimeNs == b.mtimeNs;
+}
+
+} // namespace
+
+FileMonitor::FileMonitor()
+    : monitoring_(false), inotifyFd_(-1), epollFd_(-1), wakeFd_(-1), timerFd_(-1),
+      fanotifyFd_(-1), stopRequested_(false), callback_(nullptr), watchLimit_(0),
+      watchLimitReported_(false), readyDueNs_(0) {
 }
 
 FileMonitor::~FileMonitor() {
@@ -18,199 +85,891 @@ FileMonitor::~FileMonitor() {
 }
 
 bool FileMonitor::startMonitoring(const std::string& directory, JNIEnv* env, jobject callback) {
-    if (monitoring_) {
-        LOGW("Already monitoring");
-        return false;
-    }
-    
     // Check if directory exists
     struct stat dirStat;
     if (stat(directory.c_str(), &dirStat) != 0 || !S_ISDIR(dirStat.st_mode)) {
         LOGE("Directory does not exist: %s", directory.c_str());
         return false;
     }
-    
-    // Get JavaVM pointer BEFORE starting the thread (JNIEnv is thread-local!)
-    JavaVM* jvm;
-    if (env->GetJavaVM(&jvm) != JNI_OK) {
-        LOGE("Failed to get JavaVM");
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (!monitoring_) {
+        // A watcher thread that failed has exited but is not joined yet
+        if (monitorThread_.joinable()) {
+            monitorThread_.join();
+            releaseWatcher();
+        }
+
+        // Get JavaVM pointer BEFORE starting the thread (JNIEnv is thread-local!)
+        JavaVM* jvm;
+        if (env->GetJavaVM(&jvm) != JNI_OK) {
+            LOGE("Failed to get JavaVM");
+            return false;
+        }
+
+        inotifyFd_ = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+        epollFd_ = epoll_create1(EPOLL_CLOEXEC);
+        wakeFd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        timerFd_ = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+        if (inotifyFd_ < 0 || epollFd_ < 0 || wakeFd_ < 0 || timerFd_ < 0) {
+            LOGE("Failed to initialize watcher: %s", strerror(errno));
+            closeDescriptors();
+            return false;
+        }
+
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.fd = inotifyFd_;
+        bool registered = epoll_ctl(epollFd_, EPOLL_CTL_ADD, inotifyFd_, &event) == 0;
+        event.data.fd = wakeFd_;
+        registered = registered && epoll_ctl(epollFd_, EPOLL_CTL_ADD, wakeFd_, &event) == 0;
+        event.data.fd = timerFd_;
+        registered = registered && epoll_ctl(epollFd_, EPOLL_CTL_ADD, timerFd_, &event) == 0;
+        if (!registered) {
+            LOGE("Failed to register watcher fds with epoll: %s", strerror(errno));
+            closeDescriptors();
+            return false;
+        }
+        initFanotify();
+        watchLimit_ = readWatchLimit();
+        stopRequested_ = false;
+
+        // Create global reference to callback
+        callback_ = env->NewGlobalRef(callback);
+        monitoring_ = true;
+
+        // Start monitoring thread - pass JavaVM* instead of JNIEnv*
+        monitorThread_ = std::thread(&FileMonitor::monitorThread, this, jvm);
+    }
+
+    if (std::find(roots_.begin(), roots_.end(), directory) != roots_.end()) {
+        return true;
+    }
+
+    // Watch the root itself right away so nothing written to it is missed;
+    // the watcher thread walks the rest of the tree
+    int wd = inotify_add_watch(inotifyFd_, directory.c_str(), kWatchMask);
+    if (wd < 0) {
+        LOGE("Failed to add watch for %s: %s", directory.c_str(), strerror(errno));
+        return false;
+    }
+    directories_[wd] = directory;
+    roots_.push_back(directory);
+    queuedWalks_.push_back(directory);
+    markMount(directory);
+
+    uint64_t one = 1;
+    if (write(wakeFd_, &one, sizeof(one)) != sizeof(one)) {
+        LOGE("Failed to signal watcher thread: %s", strerror(errno));
+    }
+
+    LOGI("Started monitoring directory: %s (wd=%d)", directory.c_str(), wd);
+    return true;
+}
+
+void FileMonitor::setKnownFileFilter(KnownFileFilter filter) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    knownFileFilter_ = std::move(filter);
+}
+
+void FileMonitor::setStreamingScanFactory(StreamingScanFactory factory) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    streamingScanFactory_ = std::move(factory);
+}
+
+bool FileMonitor::stopMonitoring(const std::string& directory) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto root = std::find(roots_.begin(), roots_.end(), directory);
+    if (root == roots_.end()) {
         return false;
     }
-    
-    // Create global reference to callback
-    jobject globalCallback = env->NewGlobalRef(callback);
-    
-    shouldStop_ = false;
-    monitoring_ = true;
-    
-    // Start monitoring thread - pass JavaVM* instead of JNIEnv*
-    monitorThread_ = std::thread(&FileMonitor::monitorThread, this, directory, jvm, globalCallback);
-    
-    LOGI("Started monitoring directory: %s", directory.c_str());
+    roots_.erase(root);
+    queuedWalks_.erase(std::remove(queuedWalks_.begin(), queuedWalks_.end(), directory),
+                       queuedWalks_.end());
+    // A tree nested in another root stays watched as part of that one
+    if (!isUnderRoot(directory)) {
+        removeWatchesUnder(directory);
+        // Its files' state belongs to the watcher thread, which forgets
+        // them before handling anything else
+        droppedRoots_.push_back(directory);
+        uint64_t one = 1;
+        if (write(wakeFd_, &one, sizeof(one)) != sizeof(one)) {
+            LOGE("Failed to signal watcher thread: %s", strerror(errno));
+        }
+    }
+    LOGI("Stopped monitoring directory: %s", directory.c_str());
     return true;
 }
 
 void FileMonitor::stopMonitoring() {
-    if (!monitoring_) {
+    // Joinable also after the thread failed and exited on its own
+    if (!monitorThread_.joinable()) {
         return;
     }
-    
-    shouldStop_ = true;
-    monitoring_ = false;
-    
+
+    // Wake the thread out of epoll_wait
+    stopRequested_ = true;
+    uint64_t one = 1;
+    if (write(wakeFd_, &one, sizeof(one)) != sizeof(one)) {
+        LOGE("Failed to signal watcher thread: %s", strerror(errno));
+    }
+
     if (monitorThread_.joinable()) {
         monitorThread_.join();
     }
-    
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    releaseWatcher();
+
     LOGI("Stopped monitoring");
 }
 
-void FileMonitor::monitorThread(const std::string& directory, JavaVM* jvm, jobject callback) {
+void FileMonitor::releaseWatcher() {
+    for (const auto& watch : directories_) {
+        inotify_rm_watch(inotifyFd_, watch.first);
+    }
+    directories_.clear();
+    roots_.clear();
+    queuedWalks_.clear();
+    droppedRoots_.clear();
+    watchLimitReported_ = false;
+    pending_.clear();
+    ready_.clear();
+    reported_.clear();
+    earlyVerdicts_.clear();
+    closeDescriptors();
+    monitoring_ = false;
+}
+
+void FileMonitor::closeDescriptors() {
+    for (int* fd : {&inotifyFd_, &epollFd_, &wakeFd_, &timerFd_, &fanotifyFd_}) {
+        if (*fd >= 0) {
+            close(*fd);
+            *fd = -1;
+        }
+    }
+}
+
+std::string FileMonitor::directoryFor(int wd) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = directories_.find(wd);
+    return it == directories_.end() ? std::string() : it->second;
+}
+
+void FileMonitor::monitorThread(JavaVM* jvm) {
     // Attach this thread to the JVM
     JNIEnv* threadEnv;
     JavaVMAttachArgs attachArgs;
     attachArgs.version = JNI_VERSION_1_6;
     attachArgs.name = "FileMonitorThread";
     attachArgs.group = nullptr;
-    
+
     jint attachResult = jvm->AttachCurrentThread(&threadEnv, &attachArgs);
     if (attachResult != JNI_OK) {
         LOGE("Failed to attach thread to JVM: %d", attachResult);
         monitoring_ = false;
         return;
     }
-    
+
     LOGI("Monitor thread attached to JVM");
-    
-    // Create inotify instance
-    int inotifyFd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
-    if (inotifyFd < 0) {
-        LOGE("Failed to initialize inotify: %s", strerror(errno));
-        monitoring_ = false;
-        jvm->DetachCurrentThread();
-        return;
+
+    // Resolved in JNI_OnLoad
+    const JniRegistry& registry = jniRegistry();
+    if (!registry.onApkBatchDetected) {
+        LOGE("onApkBatchDetected is not available; detections will not be reported");
     }
-    
-    // Add watch for directory
-    int wd = inotify_add_watch(inotifyFd, directory.c_str(), 
-        IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
-    if (wd < 0) {
-        LOGE("Failed to add watch for %s: %s", directory.c_str(), strerror(errno));
-        close(inotifyFd);
-        monitoring_ = false;
-        jvm->DetachCurrentThread();
-        return;
-    }
-    
-    LOGI("Added watch for: %s (wd=%d)", directory.c_str(), wd);
-    
-    char buffer[4096]; // Smaller buffer to avoid stack issues
-    
-    while (!shouldStop_ && monitoring_) {
-        fd_set readfds;
-        FD_ZERO(&readfds);
-        FD_SET(inotifyFd, &readfds);
-        
-        struct timeval timeout;
-        timeout.tv_sec = 1;
-        timeout.tv_usec = 0;
-        
-        int ret = select(inotifyFd + 1, &readfds, nullptr, nullptr, &timeout);
-        
-        if (ret < 0) {
+    if (!registry.onApkEarlyVerdict) {
+        LOGW("onApkEarlyVerdict is not available; early verdicts will not be reported");
+    }
+
+    // Room for a few hundred events per read
+    alignas(struct inotify_event) char buffer[16 * 1024];
+    bool running = true;
+
+    while (running) {
+        struct epoll_event events[4];
+        // No timeout: the thread sleeps until there is something to do
+        int ready = epoll_wait(epollFd_, events, 4, -1);
+
+        if (ready < 0) {
             if (errno != EINTR) {
-                LOGE("select error: %s", strerror(errno));
+                LOGE("epoll_wait error: %s", strerror(errno));
                 break;
             }
             continue;
         }
-        
-        if (ret == 0) {
-            // Timeout - continue monitoring
-            continue;
-        }
-        
-        if (FD_ISSET(inotifyFd, &readfds)) {
-            ssize_t length = read(inotifyFd, buffer, sizeof(buffer));
-            
-            if (length < 0) {
-                if (errno != EAGAIN && errno != EWOULDBLOCK) {
-                    LOGE("read error: %s", strerror(errno));
+
+        // Before any event, so a removed root's files are never reported
+        dropRemovedRoots();
+
+        for (int i = 0; i < ready; i++) {
+            if (events[i].data.fd == wakeFd_) {
+                uint64_t count;
+                if (read(wakeFd_, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+                    LOGE("eventfd read error: %s", strerror(errno));
+                }
+                if (stopRequested_) {
+                    running = false;
+                    continue;
                 }
+                walkQueuedTrees();
+                armTimer();
                 continue;
             }
-            
-            int i = 0;
-            while (i < length) {
-                struct inotify_event* event = (struct inotify_event*)&buffer[i];
-                
-                if (event->len > 0) {
-                    std::string filename(event->name);
-                    
-                    // Check if it's an APK file
-                    if (isApkFile(filename)) {
-                        std::string fullPath = directory + "/" + filename;
-                        
-                        // Wait a bit to ensure file is fully written
-                        usleep(500000); // 500ms
-                        
-                        // Verify file exists
-                        struct stat fileStat;
-                        if (stat(fullPath.c_str(), &fileStat) == 0 && 
-                            S_ISREG(fileStat.st_mode)) {
-                            LOGI("APK file detected: %s", fullPath.c_str());
-                            
-                            // Call Java callback
-                            jclass callbackClass = threadEnv->GetObjectClass(callback);
-                            if (callbackClass) {
-                                jmethodID methodId = threadEnv->GetMethodID(callbackClass, "onApkDetected", "(Ljava/lang/String;)V");
-                                
-                                if (methodId) {
-                                    jstring jPath = threadEnv->NewStringUTF(fullPath.c_str());
-                                    threadEnv->CallVoidMethod(callback, methodId, jPath);
-                                    threadEnv->DeleteLocalRef(jPath);
-                                } else {
-                                    LOGE("Failed to find onApkDetected method");
-                                }
-                                threadEnv->DeleteLocalRef(callbackClass);
-                            } else {
-                                LOGE("Failed to get callback class");
-                            }
-                            
-                            // Check for exceptions
-                            if (threadEnv->ExceptionCheck()) {
-                                LOGE("Exception in callback");
-                                threadEnv->ExceptionDescribe();
-                                threadEnv->ExceptionClear();
-                            }
-                        }
+
+            if (events[i].data.fd == fanotifyFd_) {
+                handleFanotifyEvents();
+                armTimer();
+                continue;
+            }
+
+            if (events[i].data.fd == timerFd_) {
+                uint64_t expirations;
+                if (read(timerFd_, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+                    settlePending();
+                    streamPending();
+                    if (!earlyVerdicts_.empty() && registry.onApkEarlyVerdict) {
+                        flushEarlyVerdicts(threadEnv);
+                    }
+                    if (!ready_.empty() && readyDueNs_ <= monotonicNowNs() &&
+                        registry.onApkBatchDetected) {
+                        flushReady(threadEnv);
                     }
                 }
-                
-                i += sizeof(struct inotify_event) + event->len;
+                armTimer();
+                continue;
             }
+
+            // Drain everything queued on the inotify fd
+            while (true) {
+                ssize_t length = read(inotifyFd_, buffer, sizeof(buffer));
+                if (length < 0) {
+                    if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                        LOGE("read error: %s", strerror(errno));
+                    }
+                    break;
+                }
+                handleEvents(buffer, length);
+            }
+            // Once per drain, however many IN_MODIFY events arrived
+            streamPending();
+            if (!earlyVerdicts_.empty() && registry.onApkEarlyVerdict) {
+                flushEarlyVerdicts(threadEnv);
+            }
+            armTimer();
+        }
+
+        // Levels as of this wakeup
+        Metrics::set(Gauge::PendingFiles, static_cast<int64_t>(pending_.size()));
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            Metrics::set(Gauge::Watches, static_cast<int64_t>(directories_.size()));
         }
     }
-    
-    // Cleanup
-    inotify_rm_watch(inotifyFd, wd);
-    close(inotifyFd);
+
+    // Also when epoll failed: the watcher is gone whether or not
+    // stopMonitoring() asked
     monitoring_ = false;
-    
+
     // Cleanup global reference
-    threadEnv->DeleteGlobalRef(callback);
-    
+    threadEnv->DeleteGlobalRef(callback_);
+    callback_ = nullptr;
+
     LOGI("Monitor thread exiting");
     jvm->DetachCurrentThread();
 }
 
-bool FileMonitor::isApkFile(const std::string& filename) {
-    if (filename.length() < 4) {
+void FileMonitor::handleEvents(const char* buffer, ssize_t length) {
+    int64_t now = monotonicNowNs();
+    ssize_t i = 0;
+    uint64_t eventCount = 0;
+    while (i < length) {
+        const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(&buffer[i]);
+        i += sizeof(struct inotify_event) + event->len;
+        eventCount++;
+
+        if (event->mask & IN_Q_OVERFLOW) {
+            LOGW("inotify queue overflowed, rescanning watched directories");
+            rescanAfterOverflow();
+            continue;
+        }
+
+        if (event->mask & IN_IGNORED) {
+            // Watch removed, or its directory deleted
+            std::lock_guard<std::mutex> lock(mutex_);
+            directories_.erase(event->wd);
+            continue;
+        }
+
+        if (event->len == 0) {
+            continue;
+        }
+
+        if (event->mask & IN_ISDIR) {
+            std::string directory = directoryFor(event->wd);
+            if (directory.empty()) {
+                continue;
+            }
+            std::string fullPath = directory + "/" + event->name;
+            if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                // Files created before the new watch are found by the walk
+                watchTree(fullPath, 0);
+            } else if (event->mask & IN_MOVED_FROM) {
+                // Its watches would report under the old path; if it moved
+                // within the tree, IN_MOVED_TO adds them back
+                std::lock_guard<std::mutex> lock(mutex_);
+                removeWatchesUnder(fullPath);
+            }
+            continue;
+        }
+
+        if (event->mask & IN_MOVED_FROM) {
+            continue;
+        }
+
+        // Any file may be an APK whatever its name; content decides once
+        // it is complete
+        std::string filename(event->name);
+        std::string directory = directoryFor(event->wd);
+        if (directory.empty()) {
+            // Watch removed while its events were queued
+            continue;
+        }
+        std::string fullPath = directory + "/" + filename;
+
+        if (event->mask & IN_MODIFY) {
+            // More bytes for the streaming scan; read after the drain
+            auto pending = pending_.find(fullPath);
+            if (pending != pending_.end()) {
+                pending->second.hasNewData = true;
+            }
+        } else if (event->mask & IN_CREATE) {
+            // Still being written; reported on close or once it settles
+            trackPending(fullPath, now);
+        } else {
+            // IN_CLOSE_WRITE or IN_MOVED_TO: the file is complete
+            pending_.erase(fullPath);
+            enqueueReady(fullPath, now);
+        }
+    }
+    Metrics::count(Counter::InotifyEvents, eventCount);
+    Metrics::record(Histogram::InotifyBatch, eventCount);
+}
+
+void FileMonitor::trackPending(const std::string& path, int64_t nowNs) {
+    struct stat fileStat;
+    if (pending_.count(path) != 0 ||
+        stat(path.c_str(), &fileStat) != 0 || !S_ISREG(fileStat.st_mode)) {
+        return;
+    }
+    PendingFile file;
+    file.size = fileStat.st_size;
+    file.mtimeNs = mtimeNs(fileStat);
+    file.lastChangeNs = nowNs;
+    file.firstSeenNs = nowNs;
+    file.nextCheckNs = nowNs + kSettleCheckNs;
+    // Started once the first bytes show a ZIP
+    file.streamChecked = false;
+    file.streamedBytes = 0;
+    // Whatever was written before the watch saw the file
+    file.hasNewData = file.size > 0;
+    pending_.emplace(path, std::move(file));
+}
+
+void FileMonitor::settlePending() {
+    int64_t now = monotonicNowNs();
+    for (auto it = pending_.begin(); it != pending_.end();) {
+        PendingFile& file = it->second;
+        if (file.nextCheckNs > now) {
+            ++it;
+            continue;
+        }
+        file.nextCheckNs = now + kSettleCheckNs;
+
+        struct stat fileStat;
+        if (stat(it->first.c_str(), &fileStat) != 0 || !S_ISREG(fileStat.st_mode)) {
+            // Deleted or replaced before it was finished
+            it = pending_.erase(it);
+            continue;
+        }
+
+        if (fileStat.st_size != file.size || mtimeNs(fileStat) != file.mtimeNs) {
+            file.size = fileStat.st_size;
+            file.mtimeNs = mtimeNs(fileStat);
+            file.lastChangeNs = now;
+            // Covers writes whose IN_MODIFY was lost to an overflow
+            file.hasNewData = true;
+        }
+
+        if (now - file.firstSeenNs > kPendingTimeoutNs) {
+            LOGW("Giving up on stalled file: %s", it->first.c_str());
+            it = pending_.erase(it);
+        } else if (file.size > 0 && now - file.lastChangeNs >= kSettleQuietNs) {
+            // The writer went quiet without closing the file
+            std::string path = it->first;
+            it = pending_.erase(it);
+            enqueueReady(path, now);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void FileMonitor::streamPending() {
+    for (auto& entry : pending_) {
+        PendingFile& file = entry.second;
+        if (file.hasNewData && (file.stream || !file.streamChecked)) {
+            advanceStream(entry.first, file);
+        }
+    }
+}
+
+void FileMonitor::advanceStream(const std::string& path, PendingFile& file) {
+    file.hasNewData = false;
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    streamBuffer_.resize(kStreamChunkSize);
+    if (!file.stream) {
+        // Only what starts like an APK is worth streaming; anything else
+        // waits for the probe on completion
+        ssize_t length = pread(fd, streamBuffer_.data(), 4, 0);
+        if (length < 4) {
+            close(fd);
+            return;
+        }
+        file.streamChecked = true;
+        if (startsWithZipHeader(streamBuffer_.data(), static_cast<size_t>(length))) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (streamingScanFactory_) {
+                file.stream = streamingScanFactory_();
+            }
+        }
+        if (!file.stream) {
+            close(fd);
+            return;
+        }
+    }
+    uint64_t passed = 0;
+    bool wantsMore = true;
+    while (wantsMore && passed < kStreamBytesPerPass) {
+        ssize_t length = pread(fd, streamBuffer_.data(), streamBuffer_.size(),
+                               static_cast<off_t>(file.streamedBytes));
+        if (length <= 0) {
+            break;
+        }
+        file.streamedBytes += length;
+        passed += length;
+        Metrics::count(Counter::StreamedBytes, static_cast<uint64_t>(length));
+        wantsMore = file.stream->feed(streamBuffer_.data(), static_cast<size_t>(length));
+    }
+    close(fd);
+    if (wantsMore && passed >= kStreamBytesPerPass) {
+        // Pick up the rest on the next wakeup
+        file.hasNewData = true;
+        return;
+    }
+
+    if (!file.stream->isDone()) {
+        return;
+    }
+    const StreamingProgress& progress = file.stream->progress();
+    if (progress.isMalicious) {
+        LOGI("Early verdict for %s after %llu bytes: confidence %d", path.c_str(),
+             static_cast<unsigned long long>(progress.bytesConsumed), progress.confidence);
+        earlyVerdicts_.push_back(EarlyVerdict{path, progress});
+    }
+    // Nothing more to learn from this file until it is complete
+    file.stream.reset();
+}
+
+void FileMonitor::rescanAfterOverflow() {
+    std::vector<std::string> roots;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        roots = roots_;
+    }
+
+    // Events were lost, so treat recently touched APKs as just created and
+    // let the settle check report them. The walk also watches directories
+    // whose IN_CREATE was among the lost events.
+    time_t cutoff = time(nullptr) - kOverflowRescanWindowSec;
+    for (const std::string& root : roots) {
+        watchTree(root, cutoff);
+    }
+}
+
+void FileMonitor::walkQueuedTrees() {
+    std::vector<std::string> roots;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        roots.swap(queuedWalks_);
+    }
+    for (const std::string& root : roots) {
+        watchTree(root, kTrackNothing);
+        std::lock_guard<std::mutex> lock(mutex_);
+        LOGI("Watching tree %s: %zu directories watched in total", root.c_str(),
+             directories_.size());
+    }
+}
+
+void FileMonitor::dropRemovedRoots() {
+    std::vector<std::string> dropped;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        dropped.swap(droppedRoots_);
+    }
+    if (dropped.empty()) {
+        return;
+    }
+    auto isDropped = [&](const std::string& path) {
+        for (const std::string& root : dropped) {
+            if (path.size() > root.size() && path.compare(0, root.size(), root) == 0 &&
+                path[root.size()] == '/') {
+                return true;
+            }
+        }
         return false;
+    };
+    for (auto it = pending_.begin(); it != pending_.end();) {
+        if (isDropped(it->first)) {
+            it = pending_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    ready_.erase(std::remove_if(ready_.begin(), ready_.end(), isDropped), ready_.end());
+    earlyVerdicts_.erase(std::remove_if(earlyVerdicts_.begin(), earlyVerdicts_.end(),
+                                        [&](const EarlyVerdict& verdict) {
+                                            return isDropped(verdict.path);
+                                        }),
+                         earlyVerdicts_.end());
+}
+
+void FileMonitor::watchTree(const std::string& root, time_t trackSince) {
+    int64_t now = monotonicNowNs();
+    std::vector<std::pair<std::string, int>> stack;
+    stack.emplace_back(root, 0);
+    while (!stack.empty()) {
+        std::string directory = std::move(stack.back().first);
+        int depth = stack.back().second;
+        stack.pop_back();
+
+        // Watch before listing, so a file created in between is either
+        // listed or reported by the watch
+        if (!addWatch(directory)) {
+            continue;
+        }
+        DIR* dir = opendir(directory.c_str());
+        if (dir == nullptr) {
+            continue;
+        }
+        while (struct dirent* entry = readdir(dir)) {
+            const char* name = entry->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+                continue;
+            }
+            std::string path = directory + "/" + name;
+            unsigned char type = entry->d_type;
+            if (type == DT_UNKNOWN) {
+                struct stat entryStat;
+                if (lstat(path.c_str(), &entryStat) != 0) {
+                    continue;
+                }
+                type = S_ISDIR(entryStat.st_mode) ? DT_DIR
+                     : S_ISREG(entryStat.st_mode) ? DT_REG : DT_UNKNOWN;
+            }
+
+            // Symlinks are not followed, so a link cannot pull in a tree
+            // outside the root or form a cycle
+            if (type == DT_DIR) {
+                if (depth < kMaxTreeDepth) {
+                    stack.emplace_back(std::move(path), depth + 1);
+                }
+            } else if (type == DT_REG && trackSince != kTrackNothing) {
+                struct stat fileStat;
+                if (trackSince == 0 ||
+                    (stat(path.c_str(), &fileStat) == 0 && fileStat.st_mtime >= trackSince)) {
+                    trackPending(path, now);
+                }
+            }
+        }
+        closedir(dir);
+    }
+}
+
+bool FileMonitor::addWatch(const std::string& directory) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (directories_.size() < watchLimit_) {
+        int wd = inotify_add_watch(inotifyFd_, directory.c_str(), kWatchMask);
+        if (wd >= 0) {
+            directories_[wd] = directory;
+            return true;
+        }
+        if (errno != ENOSPC) {
+            // Usually removed again before the walk got to it
+            LOGD("Failed to add watch for %s: %s", directory.c_str(), strerror(errno));
+            return false;
+        }
+    }
+    if (!watchLimitReported_) {
+        LOGW("inotify watch limit reached at %zu directories; %s and further new directories "
+             "are not watched%s", directories_.size(), directory.c_str(),
+             fanotifyFd_ >= 0 ? " (fanotify still reports completed files)" : "");
+        watchLimitReported_ = true;
+    }
+    return false;
+}
+
+void FileMonitor::removeWatchesUnder(const std::string& directory) {
+    std::string prefix = directory + "/";
+    for (auto it = directories_.begin(); it != directories_.end();) {
+        if (it->second == directory || it->second.compare(0, prefix.size(), prefix) == 0) {
+            inotify_rm_watch(inotifyFd_, it->first);
+            it = directories_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+bool FileMonitor::isUnderRoot(const std::string& path) const {
+    for (const std::string& root : roots_) {
+        if (path.size() > root.size() && path.compare(0, root.size(), root) == 0 &&
+            path[root.size()] == '/') {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Raw syscalls, since bionic has no fanotify wrappers. 64-bit only: on 32-bit
+// ABIs fanotify_mark's 64-bit mask is split across registers.
+void FileMonitor::initFanotify() {
+#if defined(__LP64__)
+    int fd = static_cast<int>(syscall(__NR_fanotify_init, FAN_CLASS_NOTIF | FAN_CLOEXEC | FAN_NONBLOCK,
+                                      O_RDONLY | O_CLOEXEC | O_LARGEFILE));
+    if (fd < 0) {
+        // EPERM without CAP_SYS_ADMIN, which is the normal case for an app
+        LOGI("fanotify not available (%s); using inotify only", strerror(errno));
+        return;
+    }
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &event) != 0) {
+        LOGE("Failed to register fanotify fd with epoll: %s", strerror(errno));
+        close(fd);
+        return;
+    }
+    fanotifyFd_ = fd;
+    LOGI("fanotify mount marks enabled");
+#endif
+}
+
+void FileMonitor::markMount(const std::string& directory) {
+#if defined(__LP64__)
+    if (fanotifyFd_ < 0) {
+        return;
+    }
+    // Marking a mount that is already marked is a no-op, so roots sharing
+    // one mount need no bookkeeping
+    if (syscall(__NR_fanotify_mark, fanotifyFd_, FAN_MARK_ADD | FAN_MARK_MOUNT,
+                static_cast<uint64_t>(FAN_CLOSE_WRITE), AT_FDCWD, directory.c_str()) != 0) {
+        LOGW("Failed to mark mount of %s: %s", directory.c_str(), strerror(errno));
+    }
+#else
+    (void) directory;
+#endif
+}
+
+void FileMonitor::handleFanotifyEvents() {
+    alignas(struct fanotify_event_metadata) char buffer[4096];
+    int64_t now = monotonicNowNs();
+    while (true) {
+        ssize_t length = read(fanotifyFd_, buffer, sizeof(buffer));
+        if (length <= 0) {
+            if (length < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                LOGE("fanotify read error: %s", strerror(errno));
+            }
+            break;
+        }
+        const struct fanotify_event_metadata* event =
+            reinterpret_cast<const struct fanotify_event_metadata*>(buffer);
+        for (; FAN_EVENT_OK(event, length); event = FAN_EVENT_NEXT(event, length)) {
+            if (event->vers != FANOTIFY_METADATA_VERSION) {
+                LOGE("Unexpected fanotify metadata version %u", event->vers);
+                return;
+            }
+            Metrics::count(Counter::FanotifyEvents);
+            if (event->mask & FAN_Q_OVERFLOW) {
+                rescanAfterOverflow();
+                continue;
+            }
+            if (event->fd < 0) {
+                continue;
+            }
+
+            // The event carries an open fd; its path is the file's current name
+            char link[32];
+            snprintf(link, sizeof(link), "/proc/self/fd/%d", event->fd);
+            char target[PATH_MAX];
+            ssize_t targetLength = readlink(link, target, sizeof(target) - 1);
+            close(event->fd);
+            if (targetLength <= 0) {
+                continue;
+            }
+            std::string path(target, static_cast<size_t>(targetLength));
+
+            // The mark covers the whole mount; keep what lies in a watched tree
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (!isUnderRoot(path)) {
+                    continue;
+                }
+            }
+            pending_.erase(path);
+            enqueueReady(path, now);
+        }
+    }
+}
+
+void FileMonitor::armTimer() {
+    // One-shot at the next pending re-check or batch flush, whichever
+    // comes first; disarmed while there is neither
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    if (!pending_.empty() || !ready_.empty()) {
+        int64_t due = ready_.empty() ? INT64_MAX : readyDueNs_;
+        for (const auto& file : pending_) {
+            due = std::min(due, file.second.nextCheckNs);
+        }
+        // Zero would disarm the timer
+        due = std::max<int64_t>(due, 1);
+        spec.it_value.tv_sec = due / kNanosPerSecond;
+        spec.it_value.tv_nsec = due % kNanosPerSecond;
+    }
+    if (timerfd_settime(timerFd_, TFD_TIMER_ABSTIME, &spec, nullptr) != 0) {
+        LOGE("timerfd_settime failed: %s", strerror(errno));
+    }
+}
+
+void FileMonitor::enqueueReady(const std::string& path, int64_t nowNs) {
+    // Verify file exists
+    struct stat fileStat;
+    if (stat(path.c_str(), &fileStat) != 0 || !S_ISREG(fileStat.st_mode)) {
+        return;
+    }
+    FileIdentity identity = FileIdentity::fromStat(fileStat);
+
+    // CREATE + CLOSE_WRITE, a settle followed by a late close, or an
+    // overflow rescan all land here for the same file
+    auto reported = reported_.find(path);
+    if (reported != reported_.end() && sameFile(reported->second.identity, identity)) {
+        return;
+    }
+    reported_[path] = ReportedFile{identity, nowNs};
+
+    KnownFileFilter filter;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        filter = knownFileFilter_;
+    }
+    if (filter && filter(identity)) {
+        LOGD("Already scanned, not reporting: %s", path.c_str());
+        return;
+    }
+
+    // Remembered above either way, so an unchanged file is probed once
+    if (!isApkArchive(probeArchive(path))) {
+        return;
+    }
+
+    if (std::find(ready_.begin(), ready_.end(), path) != ready_.end()) {
+        // Rewritten while its batch was still open
+        return;
+    }
+    LOGI("APK file detected: %s", path.c_str());
+    if (ready_.empty()) {
+        readyDueNs_ = nowNs + kCoalesceNs;
+    }
+    ready_.push_back(path);
+}
+
+void FileMonitor::flushReady(JNIEnv* env) {
+    jobjectArray paths = newStringArray(env, ready_);
+    if (paths == nullptr) {
+        env->ExceptionClear();
+        return;
+    }
+    LOGI("Reporting %zu APK file(s)", ready_.size());
+    Metrics::count(Counter::FilesReported, ready_.size());
+    ready_.clear();
+
+    // Call Java callback
+    {
+        ScopedStage callback(Histogram::JniCallbackUs, "onApkBatchDetected");
+        env->CallVoidMethod(callback_, jniRegistry().onApkBatchDetected, paths);
+    }
+    env->DeleteLocalRef(paths);
+
+    // Check for exceptions
+    if (env->ExceptionCheck()) {
+        LOGE("Exception in callback");
+        env->ExceptionDescribe();
+        env->ExceptionClear();
+    }
+
+    // Forget old reports so the table stays small
+    int64_t now = monotonicNowNs();
+    for (auto it = reported_.begin(); it != reported_.end();) {
+        if (now - it->second.reportedNs > kReportedTtlNs) {
+            it = reported_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void FileMonitor::flushEarlyVerdicts(JNIEnv* env) {
+    for (const EarlyVerdict& verdict : earlyVerdicts_) {
+        jstring path = newJavaString(env, verdict.path);
+        jobjectArray threats = newThreatArray(env, verdict.progress.threats);
+        if (path != nullptr && threats != nullptr) {
+            Metrics::count(Counter::EarlyVerdicts);
+            ScopedStage callback(Histogram::JniCallbackUs, "onApkEarlyVerdict");
+            env->CallVoidMethod(callback_, jniRegistry().onApkEarlyVerdict, path,
+                                static_cast<jlong>(verdict.progress.bytesConsumed),
+                                static_cast<jint>(verdict.progress.confidence), threats);
+        }
+        if (env->ExceptionCheck()) {
+            LOGE("Exception in early verdict callback");
+            env->ExceptionDescribe();
+            env->ExceptionClear();
+        }
+        if (threats != nullptr) {
+            env->DeleteLocalRef(threats);
+        }
+        if (path != nullptr) {
+            env->DeleteLocalRef(path);
+        }
+    }
+    earlyVerdicts_.clear();
+}
+
+size_t FileMonitor::readWatchLimit() {
+    size_t limit = kDefaultWatchLimit;
+    FILE* file = fopen(kWatchLimitPath, "re");
+    if (file != nullptr) {
+        unsigned long value;
+        if (fscanf(file, "%lu", &value) == 1 && value > 0) {
+            limit = value;
+        }
+        fclose(file);
     }
-    
-    std::string lower = filename;
-    std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
-    
-    return lower.substr(lower.length() - 4) == ".apk";
+    return limit - limit / kWatchHeadroomDivisor;
 }
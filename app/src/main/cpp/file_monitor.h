@@ -3,30 +3,161 @@
 
 #include <string>
 #include <thread>
+#include "streaming_scan.h"
+#include "verdict_cache.h"
 #include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 #include <vector>
+#include <sys/types.h>
+#include <time.h>
 #include <jni.h>
 
+// Watches any number of directory trees from one thread: a single inotify
+// fd holds a watch descriptor per directory, and the thread blocks in
+// epoll_wait on it plus an eventfd used for commands and shutdown, so it
+// never wakes up while nothing happens.
+//
+// Each root is watched recursively. The watcher thread walks the tree once
+// when the root is added, adds a watch for every subdirectory that appears
+// later (scanning it at once for files created before the watch), and
+// drops the watches of subdirectories moved away. Watches come out of the
+// per-user max_user_watches limit; once our share is used up the rest of a
+// tree is left unwatched and that is logged once.
+//
+// Where fanotify is permitted (it needs CAP_SYS_ADMIN, so on most devices
+// it is not), the mounts holding the roots are also marked for
+// FAN_CLOSE_WRITE, which reports completed files anywhere on them
+// regardless of the watch limit. inotify still provides moves, creation
+// and the streaming scan.
+//
+// A file is reported once it is complete: IN_CREATE only registers it as
+// pending, IN_CLOSE_WRITE or IN_MOVED_TO reports it right away, and a
+// timerfd re-checks pending files so writers that never close cleanly are
+// reported once size and mtime stop changing. The event loop never sleeps.
+// Names do not matter: a complete file is reported if probeArchive() finds
+// an APK or a bundle of split APKs in it.
+//
+// Completed files are coalesced for a short window and handed to Java in
+// one onApkBatchDetected call. A file already reported with the same
+// identity, or one the known-file filter recognizes (the scanner's
+// verdict cache), is not reported again.
+//
+// With a streaming scan factory set, pending files are also scanned while
+// they are written: IN_MODIFY marks new bytes, which are read and fed to
+// the file's StreamingScan. A file that is malicious before it is complete
+// is reported through onApkEarlyVerdict right away; the normal batch
+// report still follows once it is closed.
 class FileMonitor {
 public:
+    // Returns true for files that need no new scan
+    using KnownFileFilter = std::function<bool(const FileIdentity&)>;
+    // Returns a fresh scan for a newly created file, or nullptr
+    using StreamingScanFactory = std::function<std::unique_ptr<StreamingScan>()>;
+
     FileMonitor();
     ~FileMonitor();
-    
-    // Start monitoring directory
+
+    // Add a directory tree to the watch set; the first call starts the
+    // watcher thread, which reports to `callback` for every tree
     bool startMonitoring(const std::string& directory, JNIEnv* env, jobject callback);
+    // Remove one tree from the watch set
+    bool stopMonitoring(const std::string& directory);
+    // Remove all directories and stop the watcher thread
     void stopMonitoring();
-    
+
     bool isMonitoring() const { return monitoring_; }
 
+    void setKnownFileFilter(KnownFileFilter filter);
+    void setStreamingScanFactory(StreamingScanFactory factory);
+
 private:
     // Pass JavaVM* instead of JNIEnv* to the thread
-    void monitorThread(const std::string& directory, JavaVM* jvm, jobject callback);
-    
+    void monitorThread(JavaVM* jvm);
+    // A file seen being created but not yet closed
+    struct PendingFile {
+        off_t size;
+        int64_t mtimeNs;
+        int64_t lastChangeNs;   // monotonic time size or mtime last moved
+        int64_t firstSeenNs;
+        int64_t nextCheckNs;
+        std::unique_ptr<StreamingScan> stream;  // released once it is done
+        uint64_t streamedBytes;
+        bool hasNewData;        // IN_MODIFY seen since the last read
+        bool streamChecked;     // first bytes looked at for a ZIP header
+    };
+
+    struct EarlyVerdict {
+        std::string path;
+        StreamingProgress progress;
+    };
+
+    struct ReportedFile {
+        FileIdentity identity;
+        int64_t reportedNs;
+    };
+
+    void handleEvents(const char* buffer, ssize_t length);
+    void handleFanotifyEvents();
+    void walkQueuedTrees();
+    // Forget pending, ready and early-verdict files under roots removed
+    // since the last wakeup
+    void dropRemovedRoots();
+    // Watch `root` and every directory below it; files modified at or after
+    // `trackSince` are tracked as pending (0 tracks all of them)
+    void watchTree(const std::string& root, time_t trackSince);
+    bool addWatch(const std::string& directory);
+    // Callers hold mutex_
+    void removeWatchesUnder(const std::string& directory);
+    bool isUnderRoot(const std::string& path) const;
+    void initFanotify();
+    void markMount(const std::string& directory);
+    void trackPending(const std::string& path, int64_t nowNs);
+    void settlePending();
+    void streamPending();
+    void advanceStream(const std::string& path, PendingFile& file);
+    void rescanAfterOverflow();
+    void armTimer();
+    void enqueueReady(const std::string& path, int64_t nowNs);
+    void flushReady(JNIEnv* env);
+    void flushEarlyVerdicts(JNIEnv* env);
+    std::string directoryFor(int wd) const;
+    void closeDescriptors();
+    // Callers hold mutex_ and have joined the watcher thread
+    void releaseWatcher();
+
     std::atomic<bool> monitoring_;
-    std::atomic<bool> shouldStop_;
     std::thread monitorThread_;
-    
-    static bool isApkFile(const std::string& filename);
+    int inotifyFd_;
+    int epollFd_;
+    int wakeFd_;                // eventfd; written for queued walks or to stop
+    int timerFd_;               // fires when the next pending file is due
+    int fanotifyFd_;            // -1 unless fanotify is permitted
+    std::atomic<bool> stopRequested_;
+    jobject callback_;          // global reference, owned by the thread
+
+    mutable std::mutex mutex_;
+    std::unordered_map<int, std::string> directories_;  // wd -> path
+    std::vector<std::string> roots_;
+    std::vector<std::string> queuedWalks_;  // roots not walked yet
+    std::vector<std::string> droppedRoots_; // removed, files not yet forgotten
+    size_t watchLimit_;                     // our share of max_user_watches
+    bool watchLimitReported_;
+    KnownFileFilter knownFileFilter_;
+    StreamingScanFactory streamingScanFactory_;
+
+    // Only touched by the watcher thread
+    std::unordered_map<std::string, PendingFile> pending_;
+    std::vector<std::string> ready_;        // next batch, in completion order
+    int64_t readyDueNs_;
+    std::unordered_map<std::string, ReportedFile> reported_;
+    std::vector<EarlyVerdict> earlyVerdicts_;
+    std::vector<uint8_t> streamBuffer_;
+
+    static size_t readWatchLimit();
 };
 
 #endif // WHATSZAP_FILE_MONITOR_H
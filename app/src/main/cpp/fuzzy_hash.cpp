@@ -0,0 +1,319 @@
+#include "fuzzy_hash.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+constexpr size_t kBucketCount = 128;
+
+// Fixed permutation of 0-255 for Pearson hashing. Changing it changes
+// every digest, so packs built against it would stop matching.
+const uint8_t kPearson[256] = {
+    216, 253,  55, 103,   3, 222,  91, 180, 178, 221,  40, 218, 217,  71, 138, 185,
+     72,  58, 240, 227,  95, 102, 136,   2, 209,  17, 111,  22,  19,  36,  82, 199,
+      0, 195, 188, 135,  46, 124, 244,  11, 137, 128, 229,  56,  15, 247,  44,  10,
+    169, 230, 123, 172,  13,  50, 181, 166, 125, 158, 255, 110,  97, 170, 109,  39,
+    156,  38, 112, 235,  32, 197, 146, 254, 186, 239,  47, 204, 243,  65,  45,  73,
+    107, 226,   9, 157, 242,  63, 104,  34, 220, 211, 225, 141,  12, 142,  25,  18,
+    214, 198,  30, 208, 129,  57, 246, 118, 115, 113, 164, 193,  98, 194,  80,  21,
+    207, 191, 190,  83,  66,  42, 132,  54,  76,  35,  33, 184,  26, 131, 215, 206,
+    149,  69,  16, 153,  60, 234, 241,  85, 143,  89, 121, 159, 174,  87,  70,  62,
+      7, 212, 173,  59,  64, 108,  92, 187,  68, 100,  51,  90, 237, 144, 223, 249,
+    101, 210,  84, 176,  37,  96,  41, 140,   5, 167,  49,  43, 213,  31,  61, 139,
+    202, 179, 145,  67, 196,  28, 168, 119, 120,  79, 150, 192, 147, 105, 189,  27,
+     94,   4, 252,   8, 205, 165,  74, 182, 171,  88, 175, 219, 183, 161,  77, 233,
+    250,  24,  99, 224, 251, 151, 130, 232, 236,   6, 122,  93, 155,  23, 177, 248,
+     14,  78,  53,  75, 117, 245, 126, 203, 127, 148, 200, 116,  86, 162,  29,  52,
+    238,  48, 133,  81, 106, 152,   1, 231, 163, 201, 134,  20, 154, 160, 228, 114,
+};
+
+inline uint8_t pearson(uint8_t salt, uint8_t a, uint8_t b, uint8_t c) {
+    return kPearson[kPearson[kPearson[salt ^ a] ^ b] ^ c];
+}
+
+// Log-scale length, finer for small inputs
+uint8_t lengthCode(uint64_t length) {
+    double value = static_cast<double>(length);
+    double code;
+    if (length <= 656) {
+        code = std::log(value) / std::log(1.5);
+    } else if (length <= 3199) {
+        code = std::log(value) / std::log(1.3) - 8.72777;
+    } else {
+        code = std::log(value) / std::log(1.1) - 62.5472;
+    }
+    return static_cast<uint8_t>(static_cast<int>(std::floor(code)) & 0xFF);
+}
+
+// Distance on a ring of `range` values
+inline int ringDistance(int a, int b, int range) {
+    int direct = a > b ? a - b : b - a;
+    return std::min(direct, range - direct);
+}
+
+// Header fields tolerate a step of one; anything further weighs heavily
+inline int headerDistance(int difference) {
+    return difference <= 1 ? difference : (difference - 1) * 12;
+}
+
+// Per body byte: the summed distance of its four bucket codes, where
+// opposite quartiles (0 and 3) count 6
+struct BodyDistanceTable {
+    uint8_t values[256][256];
+
+    BodyDistanceTable() {
+        for (int a = 0; a < 256; a++) {
+            for (int b = 0; b < 256; b++) {
+                int sum = 0;
+                for (int shift = 0; shift < 8; shift += 2) {
+                    int difference = std::abs(((a >> shift) & 3) - ((b >> shift) & 3));
+                    sum += difference == 3 ? 6 : difference;
+                }
+                values[a][b] = static_cast<uint8_t>(sum);
+            }
+        }
+    }
+};
+
+const BodyDistanceTable& bodyDistance() {
+    static const BodyDistanceTable table;
+    return table;
+}
+
+int hexValue(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+// Serialized layout: a header followed by the tables, every field 4-byte
+// aligned so the blob can be used straight from a mapping
+struct SerializedHeader {
+    uint32_t count;
+    uint32_t bandCount;
+};
+
+template <typename T>
+void appendRaw(std::string& out, const T* data, size_t count) {
+    out.append(reinterpret_cast<const char*>(data), count * sizeof(T));
+}
+
+} // namespace
+
+std::string FuzzyDigest::toHex() const {
+    static const char kDigits[] = "0123456789abcdef";
+    uint8_t bytes[3 + kBodySize] = {checksum, lengthCode, quartileRatios};
+    memcpy(bytes + 3, body, kBodySize);
+    std::string hex;
+    hex.reserve(kHexSize);
+    for (uint8_t byte : bytes) {
+        hex += kDigits[byte >> 4];
+        hex += kDigits[byte & 0x0F];
+    }
+    return hex;
+}
+
+bool FuzzyDigest::fromHex(std::string_view hex, FuzzyDigest& digest) {
+    if (hex.size() != kHexSize) {
+        return false;
+    }
+    uint8_t bytes[3 + kBodySize];
+    for (size_t i = 0; i < sizeof(bytes); i++) {
+        int high = hexValue(hex[2 * i]);
+        int low = hexValue(hex[2 * i + 1]);
+        if (high < 0 || low < 0) {
+            return false;
+        }
+        bytes[i] = static_cast<uint8_t>((high << 4) | low);
+    }
+    digest.checksum = bytes[0];
+    digest.lengthCode = bytes[1];
+    digest.quartileRatios = bytes[2];
+    digest.reserved = 0;
+    memcpy(digest.body, bytes + 3, kBodySize);
+    return true;
+}
+
+int fuzzyDistance(const FuzzyDigest& a, const FuzzyDigest& b) {
+    int distance = a.checksum != b.checksum ? 1 : 0;
+    int lengthDifference = ringDistance(a.lengthCode, b.lengthCode, 256);
+    distance += lengthDifference <= 1 ? lengthDifference : lengthDifference * 12;
+    distance += headerDistance(ringDistance(a.quartileRatios >> 4, b.quartileRatios >> 4, 16));
+    distance += headerDistance(ringDistance(a.quartileRatios & 0x0F, b.quartileRatios & 0x0F, 16));
+
+    const BodyDistanceTable& table = bodyDistance();
+    for (size_t i = 0; i < FuzzyDigest::kBodySize; i++) {
+        distance += table.values[a.body[i]][b.body[i]];
+    }
+    return distance;
+}
+
+FuzzyHasher::FuzzyHasher() : buckets_(), window_(), checksum_(0), length_(0) {}
+
+void FuzzyHasher::update(const uint8_t* data, size_t length) {
+    uint8_t c1 = window_[0];
+    uint8_t c2 = window_[1];
+    uint8_t c3 = window_[2];
+    uint8_t c4 = window_[3];
+    for (size_t i = 0; i < length; i++) {
+        uint8_t c0 = data[i];
+        // Triplets need the full five-byte window
+        if (length_ + i >= 4) {
+            checksum_ = pearson(0, c0, c1, checksum_);
+            // Six triplets that all include the newest byte, each salted
+            // so they land in unrelated buckets
+            const uint8_t keys[6] = {
+                pearson(2, c0, c1, c2), pearson(3, c0, c1, c3), pearson(5, c0, c2, c3),
+                pearson(7, c0, c2, c4), pearson(11, c0, c1, c4), pearson(13, c0, c3, c4)
+            };
+            for (uint8_t key : keys) {
+                if (key < kBucketCount) {
+                    buckets_[key]++;
+                }
+            }
+        }
+        c4 = c3;
+        c3 = c2;
+        c2 = c1;
+        c1 = c0;
+    }
+    window_[0] = c1;
+    window_[1] = c2;
+    window_[2] = c3;
+    window_[3] = c4;
+    length_ += length;
+}
+
+bool FuzzyHasher::finish(FuzzyDigest& digest) const {
+    if (length_ < kMinLength) {
+        return false;
+    }
+    uint32_t sorted[kBucketCount];
+    memcpy(sorted, buckets_, sizeof(sorted));
+    std::sort(sorted, sorted + kBucketCount);
+    uint32_t q1 = sorted[kBucketCount / 4 - 1];
+    uint32_t q2 = sorted[kBucketCount / 2 - 1];
+    uint32_t q3 = sorted[kBucketCount * 3 / 4 - 1];
+    // Mostly empty buckets: too little variety to say anything
+    size_t empty = std::upper_bound(sorted, sorted + kBucketCount, 0u) - sorted;
+    if (q3 == 0 || empty >= kBucketCount / 2) {
+        return false;
+    }
+
+    digest = FuzzyDigest();
+    digest.checksum = checksum_;
+    digest.lengthCode = lengthCode(length_);
+    uint32_t q1Ratio = static_cast<uint32_t>(static_cast<uint64_t>(q1) * 100 / q3) % 16;
+    uint32_t q2Ratio = static_cast<uint32_t>(static_cast<uint64_t>(q2) * 100 / q3) % 16;
+    digest.quartileRatios = static_cast<uint8_t>((q1Ratio << 4) | q2Ratio);
+    for (size_t i = 0; i < kBucketCount; i++) {
+        uint32_t count = buckets_[i];
+        uint8_t code = count <= q1 ? 0 : count <= q2 ? 1 : count <= q3 ? 2 : 3;
+        digest.body[i / 4] |= static_cast<uint8_t>(code << (2 * (i % 4)));
+    }
+    return true;
+}
+
+FuzzyIndex::FuzzyIndex() : count_(0), ids_(nullptr), digests_(nullptr), postings_(nullptr) {}
+
+void FuzzyIndex::add(const FuzzyDigest& digest, uint32_t id) {
+    digestStorage_.push_back(digest);
+    idStorage_.push_back(id);
+}
+
+void FuzzyIndex::build() {
+    count_ = static_cast<uint32_t>(digestStorage_.size());
+    pointAtStorage();
+    postingStorage_.resize(kBandCount * count_);
+    for (size_t band = 0; band < kBandCount; band++) {
+        uint32_t* postings = postingStorage_.data() + band * count_;
+        for (uint32_t i = 0; i < count_; i++) {
+            postings[i] = i;
+        }
+        std::sort(postings, postings + count_, [&](uint32_t a, uint32_t b) {
+            uint16_t keyA = bandKey(a, band);
+            uint16_t keyB = bandKey(b, band);
+            return keyA != keyB ? keyA < keyB : a < b;
+        });
+    }
+    pointAtStorage();
+}
+
+void FuzzyIndex::pointAtStorage() {
+    ids_ = idStorage_.data();
+    digests_ = digestStorage_.data();
+    postings_ = postingStorage_.data();
+}
+
+void FuzzyIndex::serialize(std::string& out) const {
+    SerializedHeader header;
+    header.count = count_;
+    header.bandCount = kBandCount;
+    appendRaw(out, &header, 1);
+    appendRaw(out, ids_, count_);
+    appendRaw(out, digests_, count_);
+    appendRaw(out, postings_, kBandCount * count_);
+}
+
+bool FuzzyIndex::attach(const uint8_t* data, size_t size) {
+    if (size < sizeof(SerializedHeader) || reinterpret_cast<uintptr_t>(data) % 4 != 0) {
+        return false;
+    }
+    SerializedHeader header;
+    memcpy(&header, data, sizeof(header));
+    uint64_t required = sizeof(SerializedHeader) +
+                        static_cast<uint64_t>(header.count) *
+                            (sizeof(uint32_t) + sizeof(FuzzyDigest) + kBandCount * sizeof(uint32_t));
+    if (header.bandCount != kBandCount || required > size) {
+        return false;
+    }
+
+    const uint8_t* tables = data + sizeof(SerializedHeader);
+    count_ = header.count;
+    ids_ = reinterpret_cast<const uint32_t*>(tables);
+    digests_ = reinterpret_cast<const FuzzyDigest*>(tables + count_ * sizeof(uint32_t));
+    postings_ = reinterpret_cast<const uint32_t*>(tables + count_ * (sizeof(uint32_t) +
+                                                                     sizeof(FuzzyDigest)));
+
+    idStorage_.clear();
+    digestStorage_.clear();
+    postingStorage_.clear();
+    return true;
+}
+
+uint16_t FuzzyIndex::bandKey(uint32_t entry, size_t band) const {
+    const uint8_t* body = digests_[entry].body;
+    return static_cast<uint16_t>(body[2 * band] | (body[2 * band + 1] << 8));
+}
+
+bool FuzzyIndex::findNearest(const FuzzyDigest& digest, int maxDistance, Match& match) const {
+    bool found = false;
+    int best = maxDistance + 1;
+    for (size_t band = 0; band < kBandCount && best > 0; band++) {
+        uint16_t key = static_cast<uint16_t>(digest.body[2 * band] | (digest.body[2 * band + 1] << 8));
+        const uint32_t* first = postings_ + band * count_;
+        const uint32_t* last = first + count_;
+        // Postings come from the pack; out-of-range ones are never followed
+        const uint32_t* it = std::lower_bound(first, last, key, [&](uint32_t entry, uint16_t k) {
+            return entry < count_ && bandKey(entry, band) < k;
+        });
+        for (; it != last && *it < count_ && bandKey(*it, band) == key; ++it) {
+            int distance = fuzzyDistance(digest, digests_[*it]);
+            if (distance < best) {
+                best = distance;
+                match.id = ids_[*it];
+                match.distance = distance;
+                found = true;
+            }
+        }
+    }
+    return found;
+}
@@ -0,0 +1,114 @@
+#ifndef WHATSZAP_FUZZY_HASH_H
+#define WHATSZAP_FUZZY_HASH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Locality-sensitive digest in the style of TLSH: byte triplets from a
+// sliding five-byte window are counted into 128 buckets, and each bucket is
+// stored as its quartile, two bits each. Files that differ in a few places,
+// such as a repackaged dex with a new package name, keep most buckets and
+// so have a small distance, where their SHA-256 values share nothing.
+struct FuzzyDigest {
+    static constexpr size_t kBodySize = 32;
+    static constexpr size_t kHexSize = 2 * (3 + kBodySize);
+
+    uint8_t checksum;
+    uint8_t lengthCode;             // log-scale input length
+    uint8_t quartileRatios;         // q1/q3 and q2/q3, four bits each
+    uint8_t reserved;
+    uint8_t body[kBodySize];        // bucket 4*i+j in bits 2*j of byte i
+
+    FuzzyDigest() : checksum(0), lengthCode(0), quartileRatios(0), reserved(0), body() {}
+
+    // 70 lowercase hex digits: checksum, length, ratios, then the body
+    std::string toHex() const;
+    static bool fromHex(std::string_view hex, FuzzyDigest& digest);
+};
+
+static_assert(sizeof(FuzzyDigest) == 36, "digest layout");
+
+// 0 for identical inputs; unrelated files are usually above 200
+int fuzzyDistance(const FuzzyDigest& a, const FuzzyDigest& b);
+
+// Builds a digest from input fed in chunks
+class FuzzyHasher {
+public:
+    // Shorter inputs do not fill enough buckets to compare meaningfully
+    static constexpr uint64_t kMinLength = 256;
+
+    FuzzyHasher();
+
+    void update(const uint8_t* data, size_t length);
+
+    uint64_t size() const { return length_; }
+
+    // False if the input was too short or too uniform to digest
+    bool finish(FuzzyDigest& digest) const;
+
+private:
+    uint32_t buckets_[128];
+    uint8_t window_[4];             // previous bytes, most recent first
+    uint8_t checksum_;
+    uint64_t length_;
+};
+
+// Nearest-neighbour index over known digests. The body is cut into bands
+// of two bytes (eight buckets); a candidate must match the query exactly
+// in at least one band, so a lookup costs one binary search per band plus
+// a distance computation for each candidate, independent of index size
+// for all practical purposes.
+//
+// Like PatternMatcher, the built index can be serialized and later
+// attached in place from an mmap'd signature pack.
+class FuzzyIndex {
+public:
+    static constexpr size_t kBandCount = FuzzyDigest::kBodySize / 2;
+
+    struct Match {
+        uint32_t id;
+        int distance;
+    };
+
+    FuzzyIndex();
+
+    FuzzyIndex(const FuzzyIndex&) = delete;
+    FuzzyIndex& operator=(const FuzzyIndex&) = delete;
+
+    // Register a digest before build()
+    void add(const FuzzyDigest& digest, uint32_t id);
+
+    void build();
+
+    // Append the built tables to `out`; the blob needs 4-byte alignment
+    void serialize(std::string& out) const;
+
+    // Use tables produced by serialize() in place. The memory must outlive
+    // the index. Returns false if the blob is malformed.
+    bool attach(const uint8_t* data, size_t size);
+
+    size_t size() const { return count_; }
+
+    // Closest known digest within maxDistance; false if there is none
+    bool findNearest(const FuzzyDigest& digest, int maxDistance, Match& match) const;
+
+private:
+    uint16_t bandKey(uint32_t entry, size_t band) const;
+    void pointAtStorage();
+
+    // Built form, either owned by the storage below or attached
+    uint32_t count_;
+    const uint32_t* ids_;           // count_ caller IDs
+    const FuzzyDigest* digests_;    // count_ digests
+    const uint32_t* postings_;      // kBandCount x count_ entries, each
+                                    // band sorted by its key
+
+    std::vector<uint32_t> idStorage_;
+    std::vector<FuzzyDigest> digestStorage_;
+    std::vector<uint32_t> postingStorage_;
+};
+
+#endif // WHATSZAP_FUZZY_HASH_H
@@ -0,0 +1,185 @@
+#include "jni_registry.h"
+#include "native-lib.h"
+
+namespace {
+
+JniRegistry gRegistry = {};
+
+constexpr jchar kReplacementCharacter = 0xFFFD;
+
+// Decode one UTF-8 or modified UTF-8 sequence into `units` (a surrogate
+// encoded alone is kept as is); returns its length, or 0 if it is malformed
+size_t decodeSequence(const uint8_t* p, size_t available, std::vector<jchar>& units) {
+    uint8_t lead = p[0];
+    if (lead < 0x80) {
+        units.push_back(lead);
+        return 1;
+    }
+    size_t length;
+    uint32_t codePoint;
+    uint8_t low = 0x80;
+    uint8_t high = 0xBF;
+    if (lead == 0xC0) {
+        // Modified UTF-8 NUL, the only overlong form allowed
+        length = 2;
+        codePoint = 0;
+        high = 0x80;
+    } else if (lead >= 0xC2 && lead <= 0xDF) {
+        length = 2;
+        codePoint = lead & 0x1F;
+    } else if (lead >= 0xE0 && lead <= 0xEF) {
+        length = 3;
+        codePoint = lead & 0x0F;
+        low = lead == 0xE0 ? 0xA0 : 0x80;
+    } else if (lead >= 0xF0 && lead <= 0xF4) {
+        length = 4;
+        codePoint = lead & 0x07;
+        low = lead == 0xF0 ? 0x90 : 0x80;
+        high = lead == 0xF4 ? 0x8F : 0xBF;
+    } else {
+        return 0;
+    }
+    if (length > available) {
+        return 0;
+    }
+    for (size_t i = 1; i < length; i++) {
+        uint8_t next = p[i];
+        if (next < (i == 1 ? low : 0x80) || next > (i == 1 ? high : 0xBF)) {
+            return 0;
+        }
+        codePoint = (codePoint << 6) | (next & 0x3F);
+    }
+    if (codePoint >= 0x10000) {
+        codePoint -= 0x10000;
+        units.push_back(static_cast<jchar>(0xD800 + (codePoint >> 10)));
+        units.push_back(static_cast<jchar>(0xDC00 + (codePoint & 0x3FF)));
+    } else {
+        units.push_back(static_cast<jchar>(codePoint));
+    }
+    return length;
+}
+
+jclass findGlobalClass(JNIEnv* env, const char* name) {
+    jclass localClass = env->FindClass(name);
+    if (localClass == nullptr) {
+        LOGE("Could not find class %s", name);
+        env->ExceptionClear();
+        return nullptr;
+    }
+    jclass globalClass = static_cast<jclass>(env->NewGlobalRef(localClass));
+    env->DeleteLocalRef(localClass);
+    return globalClass;
+}
+
+jmethodID findMethod(JNIEnv* env, jclass owner, const char* name, const char* signature) {
+    jmethodID method = owner ? env->GetMethodID(owner, name, signature) : nullptr;
+    if (method == nullptr) {
+        LOGE("Could not find method %s%s", name, signature);
+        env->ExceptionClear();
+    }
+    return method;
+}
+
+} // namespace
+
+bool initJniRegistry(JNIEnv* env) {
+    JniRegistry registry = {};
+    registry.stringClass = findGlobalClass(env, "java/lang/String");
+
+    // Interface method IDs work on any implementing object
+    jclass detectionCallback = env->FindClass("com/example/whatszap/ApkDetectionCallback");
+    registry.onApkBatchDetected =
+        findMethod(env, detectionCallback, "onApkBatchDetected", "([Ljava/lang/String;)V");
+    registry.onApkEarlyVerdict = findMethod(env, detectionCallback, "onApkEarlyVerdict",
+                                            "(Ljava/lang/String;JI[Ljava/lang/String;)V");
+    jclass completionCallback = env->FindClass("com/example/whatszap/ScanCompletionCallback");
+    registry.onScanComplete = findMethod(env, completionCallback, "onScanComplete",
+                                         "(JLcom/example/whatszap/ScanResult;)V");
+
+    jclass resultClass = env->FindClass("com/example/whatszap/ScanResult");
+    jclass companionClass = env->FindClass("com/example/whatszap/ScanResult$Companion");
+    if (resultClass && companionClass) {
+        jfieldID companionField = env->GetStaticFieldID(
+            resultClass, "Companion", "Lcom/example/whatszap/ScanResult$Companion;");
+        jobject companion =
+            companionField ? env->GetStaticObjectField(resultClass, companionField) : nullptr;
+        if (companion) {
+            registry.scanResultCompanion = env->NewGlobalRef(companion);
+            env->DeleteLocalRef(companion);
+        }
+        registry.createFromNative = findMethod(
+            env, companionClass, "createFromNative",
+            "(ZI[Ljava/lang/String;JZLjava/lang/String;Ljava/lang/String;JLjava/lang/String;"
+            "[Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;ZZII"
+            "[Ljava/lang/String;I[Ljava/lang/String;[Ljava/lang/String;ZZZZI[Ljava/lang/String;JI"
+            "[Ljava/lang/String;[D[D[J)"
+            "Lcom/example/whatszap/ScanResult;");
+    }
+    env->ExceptionClear();
+
+    for (jclass localClass : {detectionCallback, completionCallback, resultClass, companionClass}) {
+        if (localClass) {
+            env->DeleteLocalRef(localClass);
+        }
+    }
+
+    gRegistry = registry;
+    bool complete = registry.stringClass && registry.onApkBatchDetected &&
+                    registry.onApkEarlyVerdict &&
+                    registry.onScanComplete && registry.scanResultCompanion &&
+                    registry.createFromNative;
+    if (!complete) {
+        LOGE("JNI registry is incomplete");
+    }
+    return complete;
+}
+
+const JniRegistry& jniRegistry() {
+    return gRegistry;
+}
+
+jstring newJavaString(JNIEnv* env, std::string_view text) {
+    // Built as UTF-16 with NewString, which takes any code units
+    std::vector<jchar> units;
+    units.reserve(text.size());
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(text.data());
+    for (size_t i = 0; i < text.size();) {
+        size_t consumed = decodeSequence(bytes + i, text.size() - i, units);
+        if (consumed == 0) {
+            units.push_back(kReplacementCharacter);
+            consumed = 1;
+        }
+        i += consumed;
+    }
+    return env->NewString(units.data(), static_cast<jsize>(units.size()));
+}
+
+jobjectArray newStringArray(JNIEnv* env, const std::vector<std::string>& values) {
+    jobjectArray array =
+        env->NewObjectArray(static_cast<jsize>(values.size()), gRegistry.stringClass, nullptr);
+    if (array == nullptr) {
+        return nullptr;
+    }
+    for (size_t i = 0; i < values.size(); i++) {
+        jstring value = newJavaString(env, values[i]);
+        env->SetObjectArrayElement(array, static_cast<jsize>(i), value);
+        env->DeleteLocalRef(value);
+    }
+    return array;
+}
+
+jobjectArray newThreatArray(JNIEnv* env, const ThreatList& threats) {
+    jobjectArray array =
+        env->NewObjectArray(static_cast<jsize>(threats.size()), gRegistry.stringClass, nullptr);
+    if (array == nullptr) {
+        return nullptr;
+    }
+    std::string text;
+    for (size_t i = 0; i < threats.size(); i++) {
+        threats.format(i, text);
+        jstring value = newJavaString(env, text);
+        env->SetObjectArrayElement(array, static_cast<jsize>(i), value);
+        env->DeleteLocalRef(value);
+    }
+    return array;
+}
@@ -0,0 +1,38 @@
+#ifndef WHATSZAP_JNI_REGISTRY_H
+#define WHATSZAP_JNI_REGISTRY_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <jni.h>
+#include "threat.h"
+
+// Classes and member IDs the native code calls back through, resolved
+// once in JNI_OnLoad. That runs on the thread loading the library, whose
+// class loader sees the app classes; FindClass on a natively attached
+// thread only sees system classes.
+struct JniRegistry {
+    jclass stringClass;
+    jmethodID onApkBatchDetected;   // ApkDetectionCallback
+    jmethodID onApkEarlyVerdict;
+    jmethodID onScanComplete;       // ScanCompletionCallback
+    jobject scanResultCompanion;    // ScanResult.Companion instance
+    jmethodID createFromNative;
+};
+
+bool initJniRegistry(JNIEnv* env);
+const JniRegistry& jniRegistry();
+
+// For every string that comes from a file: ZIP entry names, paths and
+// manifest text are arbitrary bytes, and NewStringUTF aborts under CheckJNI
+// on anything but modified UTF-8. UTF-8 and modified UTF-8 are decoded;
+// any other byte becomes U+FFFD.
+jstring newJavaString(JNIEnv* env, std::string_view text);
+
+// One String[] for a whole list instead of a call per element
+jobjectArray newStringArray(JNIEnv* env, const std::vector<std::string>& values);
+
+// Threats formatted to their text here, the only place it is needed
+jobjectArray newThreatArray(JNIEnv* env, const ThreatList& threats);
+
+#endif // WHATSZAP_JNI_REGISTRY_H
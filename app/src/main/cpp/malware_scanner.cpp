@@ -1,13 +1,18 @@
 #include "malware_scanner.h"
+#include "app_profile.h"
+#include "entry_analyzers.h"
+#include "score_table.h"
 #include "native-lib.h"
-#include <fstream>
-#include <sstream>
+#include "scan_arena.h"
+#include "scan_metrics.h"
+#include "worker_pool.h"
+#include "zip_reader.h"
 #include <sys/stat.h>
 #include <unistd.h>
 #include <algorithm>
+#include <atomic>
 #include <cstring>
-#include <iomanip>
-#include <ctime>
+#include <strings.h>
 #include <vector>
 #include <memory>
 
@@ -30,169 +35,791 @@ const std::vector<std::string> MalwareScanner::SUSPICIOUS_PACKAGES = {
     "com.virus.sample"
 };
 
-MalwareScanner::MalwareScanner() {
+const std::vector<std::string> MalwareScanner::SUSPICIOUS_KEYWORDS = {
+    "malware",
+    "virus",
+    "trojan",
+    "exploit"
+};
+
+const std::vector<std::string> MalwareScanner::SUSPICIOUS_APIS = {
+    // Code loaded at runtime, out of reach of install-time checks
+    "Ldalvik/system/DexClassLoader;",
+    "Ldalvik/system/InMemoryDexClassLoader;",
+    "Ljava/lang/reflect/Method;->invoke",
+    "Ljava/lang/Runtime;->exec",
+    // SMS fraud and interception
+    "Landroid/telephony/SmsManager;->sendTextMessage",
+    "Landroid/telephony/SmsManager;->sendMultipartTextMessage",
+    "Landroid/telephony/SmsMessage;->createFromPdu",
+    // Screen reading and input injection
+    "Landroid/accessibilityservice/AccessibilityService;->performGlobalAction",
+    "Landroid/view/accessibility/AccessibilityNodeInfo;->performAction",
+    // Locking the user out
+    "Landroid/app/admin/DevicePolicyManager;->lockNow",
+    "Landroid/app/admin/DevicePolicyManager;->resetPassword"
+};
+
+const std::vector<std::string> MalwareScanner::SUSPICIOUS_NATIVE_SYMBOLS = {
+    // Anti-debugging and tampering with other processes
+    "ptrace",
+    "process_vm_writev",
+    // Spawning commands from native code
+    "execv",
+    "execl",
+    "popen",
+    // Natives bound into framework classes instead of the app's own
+    "Java_android_",
+    "Java_com_android_",
+    "Java_java_"
+};
+
+namespace {
+
+// Binary manifests are a few KB; anything far larger is not a real manifest
+constexpr size_t MAX_MANIFEST_SIZE = 8 * 1024 * 1024;
+
+// Splits of a bundle beyond this many are not scanned
+constexpr size_t MAX_BUNDLE_SPLITS = 64;
+// Deflated splits are inflated into memory up to these sizes, per split
+// and per bundle; larger ones are only streamed
+constexpr uint64_t MAX_INFLATED_SPLIT_SIZE = 64 * 1024 * 1024;
+constexpr uint64_t MAX_INFLATED_BUNDLE_SIZE = 128 * 1024 * 1024;
+
+bool isApkEntry(std::string_view name) {
+    return name.size() > 4 && strncasecmp(name.data() + name.size() - 4, ".apk", 4) == 0;
+}
+
+// One APK of a scan: the file itself, or a split inside a bundle
+struct ApkPart {
+    const ZipArchive* archive = nullptr;    // null for a split that is streamed
+    const ZipEntry* entry = nullptr;        // the split's entry in the bundle
+    std::string_view name;                  // empty for the file itself
+    ZipArchive nested;                      // a split, viewed in place or in `inflated`
+    std::vector<uint8_t> inflated;          // a deflated split, decompressed
+};
+
+// An entry to analyze and the APK it is in
+struct ContentEntry {
+    const ApkPart* part;
+    const ZipEntry* entry;
+};
+
+// Entry name as reported: qualified by the split inside a bundle
+std::string displayName(const ContentEntry& content) {
+    std::string name;
+    if (!content.part->name.empty()) {
+        name.append(content.part->name.data(), content.part->name.size());
+        name += '!';
+    }
+    name.append(content.entry->name.data(), content.entry->name.size());
+    return name;
+}
+
+void mergePermissions(ManifestInfo& into, const ManifestInfo& from) {
+    for (const std::string& permission : from.permissions) {
+        if (std::find(into.permissions.begin(), into.permissions.end(), permission) ==
+            into.permissions.end()) {
+            into.permissions.push_back(permission);
+        }
+    }
+}
+
+// Fuzzy digests further than this from every known-bad file are not
+// related to any; kCloseFuzzyDistance tells a copy from a relative
+constexpr int SIMILAR_FUZZY_DISTANCE = 70;
+
+// Closest known-bad file to any digest of this APK
+struct FuzzyMatch {
+    bool found = false;
+    FuzzyIndex::Match match;
+    std::string entryName;
+};
+
+void findFuzzyMatch(const SignatureDatabase& database, const FuzzyDigest& digest,
+                    std::string_view entryName, FuzzyMatch& best) {
+    int maxDistance = best.found ? best.match.distance - 1 : SIMILAR_FUZZY_DISTANCE;
+    FuzzyIndex::Match match;
+    if (database.fuzzyIndex().findNearest(digest, maxDistance, match)) {
+        best.found = true;
+        best.match = match;
+        best.entryName = std::string(entryName);
+    }
+}
+
+// Hashed between cancellation checks
+constexpr size_t DIGEST_SLICE_SIZE = 1024 * 1024;
+
+// Hash with one pass per algorithm; with a pool the passes run in parallel
+// instead of one core running all of them over every chunk. Returns false,
+// leaving `out` unset, if cancelled part way.
+bool digestMapping(WorkerPool* pool, const uint8_t* data, size_t size, FileDigests& out,
+                   const std::atomic<bool>* cancelled) {
+    auto digestAll = [&](unsigned algorithms, FileDigests& digests) {
+        MultiDigest digest(algorithms);
+        for (size_t offset = 0; offset < size; offset += DIGEST_SLICE_SIZE) {
+            if (cancelled != nullptr && cancelled->load(std::memory_order_relaxed)) {
+                return false;
+            }
+            digest.update(data + offset, std::min(DIGEST_SLICE_SIZE, size - offset));
+        }
+        digest.finish(digests);
+        return true;
+    };
+    if (pool == nullptr) {
+        return digestAll(MalwareScanner::SCAN_DIGESTS, out);
+    }
+    const unsigned algorithms[] = {kDigestSha256, kDigestSha1, kDigestMd5};
+    FileDigests perAlgorithm[3];
+    std::atomic<bool> complete(true);
+    pool->parallelFor(3, [&](size_t i) {
+        if ((MalwareScanner::SCAN_DIGESTS & algorithms[i]) &&
+            !digestAll(algorithms[i], perAlgorithm[i])) {
+            complete.store(false, std::memory_order_relaxed);
+        }
+    }, WorkerPool::currentPriority());
+    out.sha256 = std::move(perAlgorithm[0].sha256);
+    out.sha1 = std::move(perAlgorithm[1].sha1);
+    out.md5 = std::move(perAlgorithm[2].md5);
+    return complete.load(std::memory_order_relaxed);
+}
+
+} // namespace
+
+MalwareScanner::MalwareScanner() : workerPool_(nullptr) {
+    // Compile the built-in lists once; a signature pack may replace them
+    std::vector<SignatureDefinition> definitions;
+    for (const auto& text : SUSPICIOUS_PERMISSIONS) {
+        definitions.push_back({SignatureCategory::Permission, text});
+    }
+    for (const auto& text : SUSPICIOUS_PACKAGES) {
+        definitions.push_back({SignatureCategory::Package, text});
+    }
+    for (const auto& text : SUSPICIOUS_KEYWORDS) {
+        definitions.push_back({SignatureCategory::Keyword, text});
+    }
+    for (const auto& text : SUSPICIOUS_APIS) {
+        definitions.push_back({SignatureCategory::DexApi, text});
+    }
+    for (const auto& text : SUSPICIOUS_NATIVE_SYMBOLS) {
+        definitions.push_back({SignatureCategory::ElfSymbol, text});
+    }
+    database_ = SignatureDatabase::compile(definitions, BUILTIN_SIGNATURE_VERSION);
+    addBuiltinAnalyzers(pipeline_);
+    LOGI("Compiled %zu built-in signatures into %zu matcher states",
+         database_->signatureCount(), database_->matcher().stateCount());
 }
 
 MalwareScanner::~MalwareScanner() {
 }
 
-ScanResult MalwareScanner::scanApk(const std::string& apkPath) {
+std::shared_ptr<const SignatureDatabase> MalwareScanner::currentDatabase() const {
+    return std::atomic_load(&database_);
+}
+
+std::unique_ptr<StreamingScan> MalwareScanner::beginStreamingScan() const {
+    return std::make_unique<StreamingScan>(currentDatabase());
+}
+
+bool MalwareScanner::isCodeEntry(std::string_view name) {
+    if (name == "AndroidManifest.xml") {
+        return true;
+    }
+    return isDexEntry(name) || isNativeLibraryEntry(name);
+}
+
+void MalwareScanner::installDatabase(std::shared_ptr<const SignatureDatabase> database) {
+    LOGI("Installing signature pack v%llu (%zu signatures)",
+         static_cast<unsigned long long>(database->version()), database->signatureCount());
+    std::atomic_store(&database_, std::shared_ptr<const SignatureDatabase>(std::move(database)));
+}
+
+void MalwareScanner::setWorkerPool(WorkerPool* pool) {
+    workerPool_.store(pool, std::memory_order_release);
+}
+
+void MalwareScanner::addAnalyzer(std::unique_ptr<EntryAnalyzer> analyzer) {
+    pipeline_.add(std::move(analyzer));
+}
+
+uint64_t MalwareScanner::signatureVersion() const {
+    return currentDatabase()->version();
+}
+
+bool MalwareScanner::loadSignaturePack(const std::string& packPath) {
+    auto database = SignatureDatabase::load(packPath);
+    if (!database) {
+        return false;
+    }
+    if (database->version() < BUILTIN_SIGNATURE_VERSION) {
+        LOGW("Ignoring stale signature pack v%llu",
+             static_cast<unsigned long long>(database->version()));
+        return false;
+    }
+    installDatabase(std::move(database));
+    return true;
+}
+
+bool MalwareScanner::loadClassifier(const std::string& modelPath) {
+    auto classifier = Classifier::load(modelPath);
+    if (!classifier) {
+        return false;
+    }
+    LOGI("Installing classifier v%llu (%u inputs)",
+         static_cast<unsigned long long>(classifier->version()), classifier->inputCount());
+    std::atomic_store(&classifier_, std::shared_ptr<const Classifier>(std::move(classifier)));
+    return true;
+}
+
+void MalwareScanner::classify(ScanResult& result) const {
+    std::shared_ptr<const Classifier> classifier = std::atomic_load(&classifier_);
+    if (classifier) {
+        result.modelScore = classifier->predict(result.modelInputs);
+    }
+}
+
+bool MalwareScanner::applySignatureDelta(const std::string& deltaPath,
+                                         const std::string& packPath) {
+    auto base = currentDatabase();
+    std::vector<SignatureDefinition> definitions;
+    uint64_t newVersion = 0;
+    if (!base->applyDelta(deltaPath, definitions, newVersion)) {
+        return false;
+    }
+    if (!SignatureDatabase::write(definitions, newVersion, packPath)) {
+        return false;
+    }
+    // Re-map what was written so the live database is the persisted one
+    auto database = SignatureDatabase::load(packPath, true);
+    if (!database) {
+        return false;
+    }
+    installDatabase(std::move(database));
+    return true;
+}
+
+bool MalwareScanner::openVerdictCache(const std::string& cachePath) {
+    return verdictCache_.open(cachePath);
+}
+
+bool MalwareScanner::hasCachedVerdict(const FileIdentity& identity) {
+    return verdictCache_.containsFile(identity, signatureVersion());
+}
+
+bool MalwareScanner::recordReputation(const std::string& sha256,
+                                      const ReputationVerdict& reputation) {
+    return verdictCache_.storeReputation(sha256, reputation, signatureVersion());
+}
+
+ScanResult MalwareScanner::scanApk(const std::string& apkPath, long budgetMs,
+                                   const std::atomic<bool>* cancelled) {
     ScanResult result;
-    long startTime = time(nullptr) * 1000; // milliseconds
+    ScanDeadline deadline(budgetMs);
+    ScopedStage scanStage(Histogram::ScanUs, "scanApk");
+    Metrics::count(Counter::ScansStarted);
+    auto isCancelled = [cancelled] {
+        return cancelled != nullptr && cancelled->load(std::memory_order_relaxed);
+    };
+    auto cancelledResult = [&] {
+        ScanResult stopped;
+        stopped.isCancelled = true;
+        stopped.scanDuration = deadline.elapsedMs();
+        Metrics::count(Counter::ScansCancelled);
+        LOGI("Scan of %s cancelled", apkPath.c_str());
+        return stopped;
+    };
+    
+    // Snapshot: a concurrent pack swap does not affect this scan
+    std::shared_ptr<const SignatureDatabase> database = currentDatabase();
+    
+    // Temporaries of this scan; entry tasks on other workers use theirs
+    ArenaScope scanScope(ScanArena::local());
+    ScanArena& arena = scanScope.arena();
     
     try {
         // Check if file exists
         struct stat fileStat;
         if (stat(apkPath.c_str(), &fileStat) != 0) {
-            result.threats.push_back("File not found or inaccessible");
-            result.scanDuration = (time(nullptr) * 1000) - startTime;
+            result.threats.add(ThreatId::FileNotFound);
+            result.scanDuration = deadline.elapsedMs();
+            return result;
+        }
+        
+        // Re-delivered file: answered without opening it
+        FileIdentity identity = FileIdentity::fromStat(fileStat);
+        if (verdictCache_.findByFile(identity, database->version(), result)) {
+            result.isCached = true;
+            Metrics::count(Counter::CacheHitsByFile);
+            classify(result);
+            result.scanDuration = deadline.elapsedMs();
+            LOGI("Verdict cache hit for %s", apkPath.c_str());
             return result;
         }
         
         // Check file size
         long fileSize = fileStat.st_size;
+        result.app.fileSize = static_cast<uint64_t>(fileSize);
         double fileSizeMB = fileSize / (1024.0 * 1024.0);
         
         if (fileSizeMB < 0.1) {
-            result.threats.push_back("Suspiciously small APK file");
-            result.confidence += 10;
+            result.threats.add(ThreatId::SmallApk);
         } else if (fileSizeMB > 100) {
-            result.threats.push_back("Unusually large APK file");
-            result.confidence += 5;
+            result.threats.add(ThreatId::LargeApk);
+        }
+        
+        if (isCancelled()) {
+            return cancelledResult();
+        }
+        
+        // Map the archive and walk its central directory; entry data is
+        // viewed in place instead of slurping the whole file
+        ZipArchive archive;
+        bool archiveOpened = archive.open(apkPath);
+        
+        // Hash the file from the same mapping the entries are read from, so
+        // it is read from storage once. Not subject to the budget: the
+        // digests are needed for reputation lookups even on a partial scan.
+        ScopedStage hashStage(Histogram::HashUs, "hash");
+        if (archiveOpened) {
+            if (!digestMapping(workerPool_.load(std::memory_order_acquire), archive.data(),
+                               archive.size(), result.digests, cancelled)) {
+                return cancelledResult();
+            }
+        } else {
+            digestFile(apkPath, SCAN_DIGESTS, result.digests);
         }
+        hashStage.finish();
+        Metrics::count(Counter::BytesScanned, result.app.fileSize);
+        LOGI("APK SHA-256: %s", result.digests.sha256.c_str());
         
-        // Calculate simple file hash (not MD5, but sufficient for identification)
-        std::string fileHash = calculateSimpleHash(apkPath);
-        LOGI("APK Hash: %s", fileHash.c_str());
+        // Same content seen under another path or inode
+        ScanResult cached;
+        if (verdictCache_.findByDigest(result.digests.sha256, identity, database->version(),
+                                       cached)) {
+            cached.isCached = true;
+            Metrics::count(Counter::CacheHitsByDigest);
+            classify(cached);
+            cached.scanDuration = deadline.elapsedMs();
+            LOGI("Verdict cache hit by hash for %s", apkPath.c_str());
+            return cached;
+        }
+        Metrics::count(Counter::CacheMisses);
+        
+        if (isCancelled()) {
+            return cancelledResult();
+        }
         
-        // Try to read APK as ZIP file using basic file operations
-        // Since libzip may not be available, we'll use a simpler approach
-        std::ifstream apkFile(apkPath, std::ios::binary);
-        if (!apkFile.is_open()) {
-            result.threats.push_back("Failed to open APK file (corrupted or invalid)");
-            result.confidence += 30;
-            result.scanDuration = (time(nullptr) * 1000) - startTime;
+        if (!archiveOpened) {
+            result.threats.add(ThreatId::CorruptArchive);
+            result.confidence = scoreThreats(result.threats);
+            result.app.riskScore = appRiskScore(result.app);
+            result.modelInputs = modelInputsOf(result);
+            classify(result);
+            result.scanDuration = deadline.elapsedMs();
             return result;
         }
         
+        // A bundle of split APKs (XAPK, APKS) has no manifest of its own;
+        // its splits are scanned together as one APK. Stored splits are
+        // opened in place inside the mapping. Deflated ones cannot be read
+        // at random, so they are inflated into memory and then analyzed
+        // like stored ones. Past the size caps a split is only inflated
+        // straight into a StreamingScan, which checks its manifest and
+        // keywords, and the verdict is partial.
+        std::vector<std::unique_ptr<ApkPart>> parts;
+        parts.push_back(std::make_unique<ApkPart>());
+        parts[0]->archive = &archive;
+        std::vector<const ApkPart*> streamedSplits;
+        uint64_t inflatedTotal = 0;
+        if (archive.findEntry("AndroidManifest.xml") == nullptr) {
+            for (const auto& entry : archive.entries()) {
+                if (!isApkEntry(entry.name) || parts.size() > MAX_BUNDLE_SPLITS) {
+                    continue;
+                }
+                auto part = std::make_unique<ApkPart>();
+                part->entry = &entry;
+                part->name = entry.name;
+                const uint8_t* splitData = nullptr;
+                size_t splitSize = 0;
+                if (entry.isStored()) {
+                    std::string_view raw = archive.rawData(entry);
+                    splitData = reinterpret_cast<const uint8_t*>(raw.data());
+                    splitSize = raw.size();
+                } else if (entry.uncompressedSize <= MAX_INFLATED_SPLIT_SIZE &&
+                           entry.uncompressedSize <= MAX_INFLATED_BUNDLE_SIZE - inflatedTotal) {
+                    part->inflated.resize(static_cast<size_t>(entry.uncompressedSize));
+                    if (!archive.extractEntry(entry, part->inflated.data(), part->inflated.size(),
+                                              splitSize)) {
+                        LOGW("Unreadable split %.*s in %s", static_cast<int>(entry.name.size()),
+                             entry.name.data(), apkPath.c_str());
+                        continue;
+                    }
+                    inflatedTotal += entry.uncompressedSize;
+                    splitData = part->inflated.data();
+                } else {
+                    streamedSplits.push_back(part.get());
+                    parts.push_back(std::move(part));
+                    continue;
+                }
+                if (!part->nested.openMemory(splitData, splitSize)) {
+                    LOGW("Unreadable split %.*s in %s", static_cast<int>(entry.name.size()),
+                         entry.name.data(), apkPath.c_str());
+                    continue;
+                }
+                part->archive = &part->nested;
+                parts.push_back(std::move(part));
+            }
+            if (parts.size() > 1) {
+                LOGI("%s is a bundle of %zu split APK(s), %zu streamed", apkPath.c_str(),
+                     parts.size() - 1, streamedSplits.size());
+            }
+        }
+        // A streamed split's entries are not analyzed and its manifest is
+        // not part of the profile, so the verdict is not final
+        bool splitsStreamed = !streamedSplits.empty();
+        
+        ScopedStage manifestStage(Histogram::ManifestUs, "manifest");
         bool manifestFound = false;
-        int suspiciousPermCount = 0;
-        
-        // Read file and search for AndroidManifest.xml content
-        // This is a simplified approach - in production, you'd want proper ZIP parsing
-        std::string fileContent;
-        apkFile.seekg(0, std::ios::end);
-        fileContent.reserve(apkFile.tellg());
-        apkFile.seekg(0, std::ios::beg);
-        fileContent.assign((std::istreambuf_iterator<char>(apkFile)),
-                          std::istreambuf_iterator<char>());
-        apkFile.close();
-        
-        // Search for manifest indicators in the binary content
-        // Look for common Android manifest strings
-        std::string lowerContent = fileContent;
-        std::transform(lowerContent.begin(), lowerContent.end(), lowerContent.begin(), ::tolower);
-        
-        if (lowerContent.find("androidmanifest") != std::string::npos) {
-            manifestFound = true;
+        // Repackaged samples keep most of their manifest and dex bytes
+        FuzzyMatch fuzzyMatch;
+        
+        // Of a bundle, the split declaring the most components is the base
+        // and describes the app; permissions of all splits count
+        std::vector<ManifestInfo> manifests;
+        for (const auto& part : parts) {
+            if (part->archive == nullptr) {
+                continue;
+            }
+            const ZipEntry* manifestEntry = part->archive->findEntry("AndroidManifest.xml");
+            if (manifestEntry == nullptr || manifestEntry->uncompressedSize > MAX_MANIFEST_SIZE) {
+                continue;
+            }
+            size_t capacity = static_cast<size_t>(manifestEntry->uncompressedSize);
+            uint8_t* manifestContent = arena.allocateArray<uint8_t>(capacity);
+            size_t manifestSize = 0;
+            ManifestInfo manifest;
+            if (!part->archive->extractEntry(*manifestEntry, manifestContent, capacity,
+                                             manifestSize) ||
+                !AxmlParser::parse(manifestContent, manifestSize, manifest)) {
+                continue;
+            }
+            manifests.push_back(std::move(manifest));
             
-            // Try to extract manifest-like content (this is simplified)
-            // In a real implementation, you'd parse the binary XML properly
-            size_t manifestPos = lowerContent.find("androidmanifest");
-            if (manifestPos != std::string::npos) {
-                // Extract a chunk around the manifest for analysis
-                size_t start = manifestPos > 1000 ? manifestPos - 1000 : 0;
-                size_t length = std::min(static_cast<size_t>(50000), fileContent.length() - start);
-                std::string manifestSection = fileContent.substr(start, length);
-                
-                suspiciousPermCount = analyzeManifest(manifestSection, result.threats);
-                result.confidence += suspiciousPermCount * 5;
+            FuzzyHasher hasher;
+            hasher.update(manifestContent, manifestSize);
+            FuzzyDigest digest;
+            if (hasher.finish(digest)) {
+                findFuzzyMatch(*database, digest,
+                               displayName(ContentEntry{part.get(), manifestEntry}), fuzzyMatch);
+            }
+        }
+        if (!manifests.empty()) {
+            size_t base = 0;
+            for (size_t i = 1; i < manifests.size(); i++) {
+                if (manifests[i].components.size() > manifests[base].components.size()) {
+                    base = i;
+                }
+            }
+            result.manifest = std::move(manifests[base]);
+            for (size_t i = 0; i < manifests.size(); i++) {
+                if (i != base) {
+                    mergePermissions(result.manifest, manifests[i]);
+                }
             }
+            manifestFound = true;
+            analyzeManifest(*database, result.manifest, result.threats);
         }
         
-        // Check for suspicious file names/strings in the binary
-        if (lowerContent.find("malware") != std::string::npos ||
-            lowerContent.find("virus") != std::string::npos ||
-            lowerContent.find("trojan") != std::string::npos ||
-            lowerContent.find("exploit") != std::string::npos) {
-            result.threats.push_back("Suspicious content detected in APK");
-            result.confidence += 20;
+        // Streamed splits bring their own manifests, unseen here
+        if (!manifestFound && streamedSplits.empty()) {
+            result.threats.add(ThreatId::MissingManifest);
         }
         
-        if (!manifestFound) {
-            result.threats.push_back("AndroidManifest.xml not found or corrupted");
-            result.confidence += 30;
+        // The app as it presents itself, from the manifest and central
+        // directories already read: nothing more is opened for it
+        AppProfile& app = result.app;
+        for (const auto& part : parts) {
+            // A bundle's own entries are its splits
+            bool isBundle = part->name.empty() && parts.size() > 1;
+            if (part->archive != nullptr && !isBundle) {
+                profileEntries(*part->archive, app);
+            }
+        }
+        // Streamed splits are not listed; they hold the manifest and code
+        // of the app as a whole
+        if (!streamedSplits.empty()) {
+            app.hasManifest = true;
+            app.hasDex = true;
         }
+        if (manifestFound) {
+            profileManifest(result.manifest, app);
+        }
+        app.riskScore = appRiskScore(app);
+        manifestStage.finish();
         
-        // Ensure minimum scan time of 10 seconds
-        long elapsed = (time(nullptr) * 1000) - startTime;
-        long minScanTime = 10000; // 10 seconds
-        if (elapsed < minScanTime) {
-            usleep((minScanTime - elapsed) * 1000);
+        // Run the content analyzers over code-bearing entries and opaque
+        // data entries. Entries are independent, so they are analyzed
+        // concurrently on the worker pool, largest first so the long ones
+        // start early. Each is read once and never held in memory as a
+        // whole unless an analyzer needs it so. Skipped once the verdict is
+        // already malicious, and cut short once the running confidence
+        // gets there.
+        ScopedStage contentStage(Histogram::ContentUs, "content");
+        ScanRun run(*database, deadline, cancelled, scoreThreats(result.threats),
+                    MALICIOUS_THRESHOLD, arena);
+        ArenaVector<ContentEntry> codeEntries{ArenaAllocator<ContentEntry>(arena)};
+        if (!run.settled()) {
+            for (const auto& part : parts) {
+                if (part->archive == nullptr) {
+                    continue;
+                }
+                for (const auto& entry : part->archive->entries()) {
+                    if (pipeline_.accepts(entry)) {
+                        codeEntries.push_back(ContentEntry{part.get(), &entry});
+                    }
+                }
+            }
+            std::sort(codeEntries.begin(), codeEntries.end(),
+                      [](const ContentEntry& a, const ContentEntry& b) {
+                          return a.entry->uncompressedSize > b.entry->uncompressedSize;
+                      });
+        } else {
+            streamedSplits.clear();
         }
         
-        result.isMalicious = result.confidence >= 30;
-        result.confidence = std::min(100, result.confidence);
-        result.scanDuration = (time(nullptr) * 1000) - startTime;
+        // One slot per entry, written only by the task analyzing it
+        ArenaVector<EntryFindings> findings(codeEntries.size(), EntryFindings(),
+                                            ArenaAllocator<EntryFindings>(arena));
+        std::vector<StreamingProgress> streamed(streamedSplits.size());
+        ArenaVector<bool> streamIncomplete(streamedSplits.size(), false,
+                                           ArenaAllocator<bool>(arena));
+        
+        auto analyzeEntry = [&](size_t index) {
+            const ContentEntry& content = codeEntries[index];
+            pipeline_.analyzeEntry(*content.part->archive, *content.entry, displayName(content),
+                                   run, findings[index]);
+        };
+        
+        // A deflated split, inflated chunk by chunk into the manifest and
+        // keyword checks of a download in progress
+        auto streamSplit = [&](size_t index) {
+            if (run.stopped()) {
+                return;
+            }
+            StreamingScan stream(database);
+            archive.readEntry(*streamedSplits[index]->entry, [&](const uint8_t* data, size_t length) {
+                if (!stream.feed(data, length)) {
+                    return false;
+                }
+                if (run.expired()) {
+                    streamIncomplete[index] = true;
+                    run.stop();
+                    return false;
+                }
+                return !run.stopped();
+            });
+            streamed[index] = stream.progress();
+            if (streamed[index].threats.contains(ThreatId::SuspiciousContent)) {
+                run.report(ScanRun::Finding::SuspiciousContent,
+                           featureWeight(Feature::SuspiciousContent));
+            }
+            if (streamed[index].isMalicious) {
+                run.stop();
+            }
+        };
+        
+        // Streamed splits first: they are whole APKs, larger than any entry
+        auto analyzeTask = [&](size_t index) {
+            if (index < streamedSplits.size()) {
+                streamSplit(index);
+            } else {
+                analyzeEntry(index - streamedSplits.size());
+            }
+        };
+        size_t taskCount = streamedSplits.size() + codeEntries.size();
+        WorkerPool* pool = workerPool_.load(std::memory_order_acquire);
+        if (pool != nullptr) {
+            pool->parallelFor(taskCount, analyzeTask, WorkerPool::currentPriority());
+        } else {
+            for (size_t i = 0; i < taskCount; i++) {
+                analyzeTask(i);
+            }
+        }
+        contentStage.finish();
+        
+        if (isCancelled()) {
+            return cancelledResult();
+        }
+        
+        // Ends with the try block, once the verdict is stored
+        ScopedStage verdictStage(Histogram::VerdictUs, "verdict");
+        bool suspiciousContent = false;
+        bool incomplete = false;
+        ArenaVector<bool> referenced(database->signatureCount(), false,
+                                     ArenaAllocator<bool>(arena));
+        const ContentEntry* packedLibrary = nullptr;
+        const EntryEntropy* encryptedEntry = nullptr;
+        for (size_t i = 0; i < findings.size(); i++) {
+            const EntryFindings& entryFindings = findings[i];
+            if (entryFindings.measured) {
+                const EntryEntropy& entropy = entryFindings.entropy;
+                LOGD("%s: %.3f bits/byte, %.3f peak window, %llu bytes", entropy.name.c_str(),
+                     entropy.entropy, entropy.peakWindowEntropy,
+                     static_cast<unsigned long long>(entropy.bytesMeasured));
+                result.entryEntropy.push_back(entropy);
+                if (entryFindings.encryptedPayload && encryptedEntry == nullptr) {
+                    encryptedEntry = &entryFindings.entropy;
+                }
+            }
+            if (entryFindings.hasDigest) {
+                findFuzzyMatch(*database, entryFindings.digest, displayName(codeEntries[i]),
+                               fuzzyMatch);
+            }
+            suspiciousContent = suspiciousContent || entryFindings.suspiciousContent;
+            incomplete = incomplete || entryFindings.incomplete;
+            for (uint32_t id : entryFindings.apiSignatures) {
+                referenced[id] = true;
+            }
+            for (uint32_t id : entryFindings.symbolSignatures) {
+                referenced[id] = true;
+            }
+            if (entryFindings.packedLibrary && packedLibrary == nullptr) {
+                packedLibrary = &codeEntries[i];
+            }
+        }
+        // What streamed splits found, less what another split already
+        // reported
+        for (size_t i = 0; i < streamed.size(); i++) {
+            const ThreatList& threats = streamed[i].threats;
+            for (size_t j = 0; j < threats.size(); j++) {
+                const Threat& threat = threats[j];
+                std::string_view first = threats.argument(threat, 0);
+                if (threat.id == ThreatId::SuspiciousContent) {
+                    suspiciousContent = true;
+                } else if (!result.threats.contains(threat.id, first)) {
+                    result.threats.add(threat.id, first);
+                }
+            }
+            incomplete = incomplete || streamIncomplete[i];
+        }
+        
+        if (suspiciousContent) {
+            result.threats.add(ThreatId::SuspiciousContent);
+        }
+        
+        // Each API or symbol once, however many files reference it; in
+        // signature order so results are stable
+        for (uint32_t i = 0; i < referenced.size(); i++) {
+            if (!referenced[i]) {
+                continue;
+            }
+            SignatureView signature = database->signature(i);
+            result.threats.add(signature.category == SignatureCategory::ElfSymbol
+                                   ? ThreatId::SuspiciousNativeSymbol
+                                   : ThreatId::SuspiciousApi,
+                               signature.text);
+        }
+        
+        if (packedLibrary != nullptr) {
+            result.threats.add(ThreatId::PackedLibrary, displayName(*packedLibrary));
+        }
+        
+        if (encryptedEntry != nullptr) {
+            LOGI("%s: %.3f bits/byte peak, %.3f overall", encryptedEntry->name.c_str(),
+                 encryptedEntry->peakWindowEntropy, encryptedEntry->entropy);
+            result.threats.add(ThreatId::EncryptedPayload, encryptedEntry->name);
+        }
+        
+        if (fuzzyMatch.found) {
+            const FuzzyIndex::Match& match = fuzzyMatch.match;
+            std::string_view family =
+                SignatureDatabase::fuzzyFamily(database->signature(match.id).text);
+            LOGI("%s is %d from known malware %.*s", fuzzyMatch.entryName.c_str(), match.distance,
+                 static_cast<int>(family.size()), family.data());
+            result.threats.add(ThreatId::SimilarToKnownMalware, family, fuzzyMatch.entryName,
+                               match.distance);
+        }
+        
+        // One pass over the rule table for everything found
+        result.confidence = scoreThreats(result.threats);
+        // A malicious verdict stands even if an entry ran out of time
+        result.isPartial = (incomplete || splitsStreamed) &&
+                           result.confidence < MALICIOUS_THRESHOLD;
+        if (result.isPartial) {
+            Metrics::count(Counter::ScansPartial);
+            if (incomplete) {
+                LOGW("Scan budget of %ldms exceeded for %s", budgetMs, apkPath.c_str());
+                result.threats.add(ThreatId::BudgetExceeded);
+            } else {
+                LOGW("Splits of %s too large to analyze fully; verdict not cached",
+                     apkPath.c_str());
+            }
+        }
+        
+        result.isMalicious = result.confidence >= MALICIOUS_THRESHOLD;
+        result.modelInputs = modelInputsOf(result);
+        classify(result);
+        result.scanDuration = deadline.elapsedMs();
         
         if (result.threats.empty() && !result.isMalicious) {
-            result.threats.push_back("No threats detected");
+            result.threats.add(ThreatId::NoThreats);
+        }
+        
+        // Partial verdicts are not final; they are recomputed next time
+        if (!result.isPartial) {
+            verdictCache_.store(identity, result, database->version());
         }
         
     } catch (const std::exception& e) {
         LOGE("Exception during scan: %s", e.what());
-        result.threats.push_back("Scan error: " + std::string(e.what()));
+        result.threats.add(ThreatId::ScanError, e.what());
+        result.scanDuration = deadline.elapsedMs();
     }
     
     return result;
 }
 
-int MalwareScanner::analyzeManifest(const std::string& manifestContent, 
-                                   std::vector<std::string>& threats) {
-    int suspiciousCount = 0;
+size_t MalwareScanner::analyzeManifest(const SignatureDatabase& database,
+                                      const ManifestInfo& manifest,
+                                      ThreatList& threats) {
+    size_t findingCount = 0;
+    const PatternMatcher& matcher = database.matcher();
+    std::vector<bool> matched(database.signatureCount(), false);
     
-    // Check for suspicious permissions
-    for (const auto& permission : SUSPICIOUS_PERMISSIONS) {
-        if (manifestContent.find(permission) != std::string::npos) {
-            suspiciousCount++;
-            threats.push_back("Suspicious permission requested: " + permission);
-        }
+    // Permissions must match a signature exactly
+    for (const auto& permission : manifest.permissions) {
+        matcher.scan(permission, [&](uint32_t patternId, uint64_t endOffset) {
+            SignatureView signature = database.signature(patternId);
+            if (signature.category == SignatureCategory::Permission &&
+                endOffset == permission.size() && signature.text.size() == permission.size()) {
+                matched[patternId] = true;
+            }
+            return true;
+        });
     }
     
-    // Check for suspicious package names
-    for (const auto& pkg : SUSPICIOUS_PACKAGES) {
-        if (manifestContent.find(pkg) != std::string::npos) {
-            threats.push_back("Known malicious package detected: " + pkg);
-            suspiciousCount += 5;
+    // Known package names may appear anywhere in the package
+    matcher.scan(manifest.packageName, [&](uint32_t patternId, uint64_t) {
+        if (database.signature(patternId).category == SignatureCategory::Package) {
+            matched[patternId] = true;
         }
-    }
+        return true;
+    });
     
-    return suspiciousCount;
-}
-
-std::string MalwareScanner::calculateSimpleHash(const std::string& filePath) {
-    std::ifstream file(filePath, std::ios::binary);
-    if (!file) {
-        return "";
-    }
-    
-    // Simple hash calculation (not cryptographically secure, but good enough for identification)
-    unsigned long hash = 5381;
-    char c;
-    
-    // Read first 64KB for quick hash
-    char buffer[65536];
-    size_t bytesRead = 0;
-    while (file.read(buffer, sizeof(buffer)) && bytesRead < 65536) {
-        size_t count = file.gcount();
-        for (size_t i = 0; i < count; i++) {
-            hash = ((hash << 5) + hash) + buffer[i]; // hash * 33 + c
+    // Report in signature order so results are stable
+    for (uint32_t i = 0; i < matched.size(); i++) {
+        if (!matched[i]) {
+            continue;
+        }
+        SignatureView signature = database.signature(i);
+        if (signature.category == SignatureCategory::Permission) {
+            threats.add(ThreatId::SuspiciousPermission, signature.text);
+            findingCount++;
+        } else if (signature.category == SignatureCategory::Package) {
+            threats.add(ThreatId::KnownPackage, signature.text);
+            findingCount++;
         }
-        bytesRead += count;
     }
     
-    std::ostringstream oss;
-    oss << std::hex << hash;
-    return oss.str();
+    return findingCount;
 }
-
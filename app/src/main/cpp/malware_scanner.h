@@ -1,34 +1,109 @@
 #ifndef WHATSZAP_MALWARE_SCANNER_H
 #define WHATSZAP_MALWARE_SCANNER_H
 
+#include <atomic>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
-#include <jni.h>
+#include "classifier.h"
+#include "scan_pipeline.h"
+#include "scan_result.h"
+#include "score_table.h"
+#include "signature_pack.h"
+#include "streaming_scan.h"
+#include "verdict_cache.h"
 
-struct ScanResult {
-    bool isMalicious;
-    int confidence;
-    std::vector<std::string> threats;
-    long scanDuration;
-    
-    ScanResult() : isMalicious(false), confidence(0), scanDuration(0) {}
-};
+class WorkerPool;
 
 class MalwareScanner {
 public:
     MalwareScanner();
     ~MalwareScanner();
     
-    // Scan APK file (blocks until complete)
-    ScanResult scanApk(const std::string& apkPath);
+    // Confidence at which an APK is reported as malicious
+    static constexpr int MALICIOUS_THRESHOLD = kMaliciousThreshold;
+    
+    // Scan APK file. Returns as soon as a verdict is reached; if budgetMs
+    // elapses first the remaining content analysis is skipped and the
+    // result is marked partial. budgetMs <= 0 means no budget. Once
+    // *cancelled is set the scan stops at the next entry boundary and
+    // returns a result marked cancelled, which is never cached.
+    ScanResult scanApk(const std::string& apkPath, long budgetMs = 0,
+                       const std::atomic<bool>* cancelled = nullptr);
+    
+    // Map a signature pack and swap it in; scans already running keep the
+    // database they started with. Packs older than the built-in set are ignored.
+    bool loadSignaturePack(const std::string& packPath);
+    
+    // Apply a downloaded delta to the current signatures, persist the result
+    // as a new pack at packPath and swap it in
+    bool applySignatureDelta(const std::string& deltaPath, const std::string& packPath);
+    
+    uint64_t signatureVersion() const;
+    
+    // The signatures a scan started now would use; a swap does not
+    // invalidate the snapshot
+    std::shared_ptr<const SignatureDatabase> currentDatabase() const;
+    
+    // Map a model file and swap it in like a signature pack. From then on
+    // every verdict carries a model score, cached ones included.
+    bool loadClassifier(const std::string& modelPath);
+    
+    // Spread the entries of one APK across this pool; nullptr scans them
+    // on the calling thread. The pool must outlive any scan using it.
+    void setWorkerPool(WorkerPool* pool);
+    
+    // Run another content check over the entries of every APK, after the
+    // built-in ones of the same cost. Register before the first scan.
+    void addAnalyzer(std::unique_ptr<EntryAnalyzer> analyzer);
+    
+    // Persist verdicts in the given file; scans of files already seen with
+    // the current signatures are then answered from it
+    bool openVerdictCache(const std::string& cachePath);
+    
+    // True if this exact file already has a verdict under the current signatures
+    bool hasCachedVerdict(const FileIdentity& identity);
+    
+    // Remember an online reputation verdict alongside the cached scan
+    bool recordReputation(const std::string& sha256, const ReputationVerdict& reputation);
+    
+    // Start scanning a file that is still being written, against the
+    // current signatures
+    std::unique_ptr<StreamingScan> beginStreamingScan() const;
+    
+    // Entries worth inspecting for content: manifest, dex bytecode, native libs
+    static bool isCodeEntry(std::string_view name);
+    
+    // Match the manifest against permission and package signatures. Each
+    // finding is added to threats; returns how many there were
+    static size_t analyzeManifest(const SignatureDatabase& database, const ManifestInfo& manifest,
+                                  ThreatList& threats);
+    
+    // Hashes computed over every scanned file
+    static constexpr unsigned SCAN_DIGESTS = kDigestAll;
+    
+    // Version of the signature set compiled into the library
+    static constexpr uint64_t BUILTIN_SIGNATURE_VERSION = 3;
     
 private:
-    int analyzeManifest(const std::string& manifestContent, 
-                        std::vector<std::string>& threats);
-    std::string calculateSimpleHash(const std::string& filePath);
+    void installDatabase(std::shared_ptr<const SignatureDatabase> database);
+    // Score result.modelInputs with the current model, if there is one
+    void classify(ScanResult& result) const;
+    
+    // Published RCU-style: readers atomically load a snapshot, updates
+    // atomically store a new one
+    std::shared_ptr<const SignatureDatabase> database_;
+    std::shared_ptr<const Classifier> classifier_;
+    VerdictCache verdictCache_;
+    std::atomic<WorkerPool*> workerPool_;
+    ScanPipeline pipeline_;
     
     static const std::vector<std::string> SUSPICIOUS_PERMISSIONS;
     static const std::vector<std::string> SUSPICIOUS_PACKAGES;
+    static const std::vector<std::string> SUSPICIOUS_KEYWORDS;
+    static const std::vector<std::string> SUSPICIOUS_APIS;
+    static const std::vector<std::string> SUSPICIOUS_NATIVE_SYMBOLS;
 };
 
 #endif // WHATSZAP_MALWARE_SCANNER_H
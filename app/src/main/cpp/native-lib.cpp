@@ -1,8 +1,15 @@
+#include "catch_up_walk.h"
 #include "file_monitor.h"
+#include "jni_registry.h"
 #include "malware_scanner.h"
+#include "scan_metrics.h"
+#include "scan_scheduler.h"
+#include "score_table.h"
 #include <android/log.h>
 #include <jni.h>
+#include <memory>
 #include <string>
+#include <vector>
 
 #define LOG_TAG "WhatsZapNative"
 #define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
@@ -21,16 +28,14 @@ Java_com_example_whatszap_MainActivity_stringFromJNI(JNIEnv *env,
   return env->NewStringUTF(hello.c_str());
 }
 
-extern "C" JNIEXPORT jlong JNICALL
-Java_com_example_whatszap_FileMonitorService_nativeCreateFileMonitor(
+static jlong nativeCreateFileMonitor(
     JNIEnv *env, jobject /* this */) {
   LOGI("Creating file monitor");
   FileMonitor *monitor = new FileMonitor();
   return reinterpret_cast<jlong>(monitor);
 }
 
-extern "C" JNIEXPORT jboolean JNICALL
-Java_com_example_whatszap_FileMonitorService_nativeStartMonitoring(
+static jboolean nativeStartMonitoring(
     JNIEnv *env, jobject /* this */, jlong nativeHandle, jstring directory,
     jobject callback) {
   if (nativeHandle == 0) {
@@ -47,8 +52,7 @@ Java_com_example_whatszap_FileMonitorService_nativeStartMonitoring(
   return result ? JNI_TRUE : JNI_FALSE;
 }
 
-extern "C" JNIEXPORT void JNICALL
-Java_com_example_whatszap_FileMonitorService_nativeStopMonitoring(
+static void nativeStopMonitoring(
     JNIEnv *env, jobject /* this */, jlong nativeHandle) {
   if (nativeHandle == 0) {
     return;
@@ -58,8 +62,46 @@ Java_com_example_whatszap_FileMonitorService_nativeStopMonitoring(
   monitor->stopMonitoring();
 }
 
-extern "C" JNIEXPORT void JNICALL
-Java_com_example_whatszap_FileMonitorService_nativeDestroyFileMonitor(
+static jboolean nativeStopMonitoringDirectory(
+    JNIEnv *env, jobject /* this */, jlong nativeHandle, jstring directory) {
+  if (nativeHandle == 0) {
+    return JNI_FALSE;
+  }
+
+  FileMonitor *monitor = reinterpret_cast<FileMonitor *>(nativeHandle);
+  const char *dirStr = env->GetStringUTFChars(directory, nullptr);
+  std::string dir(dirStr);
+  env->ReleaseStringUTFChars(directory, dirStr);
+
+  return monitor->stopMonitoring(dir) ? JNI_TRUE : JNI_FALSE;
+}
+
+// Files the scanner already has a verdict for are not reported again.
+// The scanner must outlive the monitor.
+static void nativeSetMonitorScanner(
+    JNIEnv *env, jobject /* this */, jlong monitorHandle, jlong scannerHandle) {
+  if (monitorHandle == 0) {
+    return;
+  }
+
+  FileMonitor *monitor = reinterpret_cast<FileMonitor *>(monitorHandle);
+  MalwareScanner *scanner = reinterpret_cast<MalwareScanner *>(scannerHandle);
+  if (scanner == nullptr) {
+    monitor->setKnownFileFilter(nullptr);
+    monitor->setStreamingScanFactory(nullptr);
+    return;
+  }
+  monitor->setKnownFileFilter([scanner](const FileIdentity &identity) {
+    return scanner->hasCachedVerdict(identity);
+  });
+  // Files still downloading are scanned against the signatures current
+  // when they appeared
+  monitor->setStreamingScanFactory([scanner]() {
+    return scanner->beginStreamingScan();
+  });
+}
+
+static void nativeDestroyFileMonitor(
     JNIEnv *env, jobject /* this */, jlong nativeHandle) {
   if (nativeHandle == 0) {
     return;
@@ -69,115 +111,545 @@ Java_com_example_whatszap_FileMonitorService_nativeDestroyFileMonitor(
   delete monitor;
 }
 
-extern "C" JNIEXPORT jlong JNICALL
-Java_com_example_whatszap_FileMonitorService_nativeCreateMalwareScanner(
+// Build a Java ScanResult through the companion object factory method
+static jobject toJavaScanResult(JNIEnv *env, const ScanResult &result) {
+  const JniRegistry &registry = jniRegistry();
+  if (!registry.createFromNative) {
+    return nullptr;
+  }
+
+  jobjectArray threatsList = newThreatArray(env, result.threats);
+
+  // Manifest fields decoded natively
+  const ManifestInfo &manifest = result.manifest;
+  jobjectArray permissionsList = newStringArray(env, manifest.permissions);
+
+  jstring packageName = manifest.packageName.empty()
+                            ? nullptr
+                            : newJavaString(env, manifest.packageName);
+  jstring versionName = manifest.versionName.empty()
+                            ? nullptr
+                            : newJavaString(env, manifest.versionName);
+  jstring label =
+      manifest.label.empty() ? nullptr : newJavaString(env, manifest.label);
+
+  // Digests computed during the scan; empty strings if hashing failed
+  jstring sha256 = env->NewStringUTF(result.digests.sha256.c_str());
+  jstring sha1 = env->NewStringUTF(result.digests.sha1.c_str());
+  jstring md5 = env->NewStringUTF(result.digests.md5.c_str());
+
+  // Reputation remembered by the verdict cache, if any
+  const ReputationVerdict &reputation = result.reputation;
+  jobjectArray reputationThreats = newStringArray(env, reputation.threatNames);
+
+  // App profile, in place of a second pass over the file from Kotlin
+  const AppProfile &app = result.app;
+  jobjectArray dangerousPermissions = newStringArray(env, app.dangerousPermissions);
+  jobjectArray highRiskPermissions = newStringArray(env, app.highRiskPermissions);
+  jobjectArray suspiciousFiles = newStringArray(env, app.suspiciousFiles);
+
+  // Entropy per measured entry, as parallel arrays
+  size_t measured = result.entryEntropy.size();
+  std::vector<std::string> entropyNames;
+  std::vector<jdouble> entropyValues;
+  std::vector<jdouble> peakWindowEntropyValues;
+  std::vector<jlong> entropyBytesMeasured;
+  entropyNames.reserve(measured);
+  entropyValues.reserve(measured);
+  peakWindowEntropyValues.reserve(measured);
+  entropyBytesMeasured.reserve(measured);
+  for (const EntryEntropy &entry : result.entryEntropy) {
+    entropyNames.push_back(entry.name);
+    entropyValues.push_back(entry.entropy);
+    peakWindowEntropyValues.push_back(entry.peakWindowEntropy);
+    entropyBytesMeasured.push_back(static_cast<jlong>(entry.bytesMeasured));
+  }
+  jobjectArray entropyEntries = newStringArray(env, entropyNames);
+  jdoubleArray entropies = env->NewDoubleArray(static_cast<jsize>(measured));
+  jdoubleArray peakWindowEntropies = env->NewDoubleArray(static_cast<jsize>(measured));
+  jlongArray bytesMeasured = env->NewLongArray(static_cast<jsize>(measured));
+  if (entropies && peakWindowEntropies && bytesMeasured) {
+    env->SetDoubleArrayRegion(entropies, 0, static_cast<jsize>(measured), entropyValues.data());
+    env->SetDoubleArrayRegion(peakWindowEntropies, 0, static_cast<jsize>(measured),
+                              peakWindowEntropyValues.data());
+    env->SetLongArrayRegion(bytesMeasured, 0, static_cast<jsize>(measured),
+                            entropyBytesMeasured.data());
+  }
+
+  // Call the factory method
+  jobject javaResult = env->CallObjectMethod(
+      registry.scanResultCompanion, registry.createFromNative,
+      result.isMalicious ? JNI_TRUE : JNI_FALSE, result.confidence, threatsList,
+      (jlong)result.scanDuration, result.isPartial ? JNI_TRUE : JNI_FALSE,
+      packageName, versionName, (jlong)manifest.versionCode, label,
+      permissionsList, sha256, sha1, md5, result.isCached ? JNI_TRUE : JNI_FALSE,
+      reputation.isKnown ? JNI_TRUE : JNI_FALSE, (jint)reputation.detections,
+      (jint)reputation.engines, reputationThreats, (jint)app.riskScore,
+      dangerousPermissions, highRiskPermissions,
+      app.suspiciousPackageName ? JNI_TRUE : JNI_FALSE,
+      app.hasManifest ? JNI_TRUE : JNI_FALSE, app.hasDex ? JNI_TRUE : JNI_FALSE,
+      app.hasNativeLibraries ? JNI_TRUE : JNI_FALSE, (jint)app.dexCount, suspiciousFiles,
+      (jlong)app.fileSize, (jint)result.modelScore, entropyEntries, entropies,
+      peakWindowEntropies, bytesMeasured);
+
+  // Cleanup local references
+  env->DeleteLocalRef(threatsList);
+  env->DeleteLocalRef(permissionsList);
+  env->DeleteLocalRef(sha256);
+  env->DeleteLocalRef(sha1);
+  env->DeleteLocalRef(md5);
+  env->DeleteLocalRef(reputationThreats);
+  env->DeleteLocalRef(dangerousPermissions);
+  env->DeleteLocalRef(highRiskPermissions);
+  env->DeleteLocalRef(suspiciousFiles);
+  env->DeleteLocalRef(entropyEntries);
+  env->DeleteLocalRef(entropies);
+  env->DeleteLocalRef(peakWindowEntropies);
+  env->DeleteLocalRef(bytesMeasured);
+  if (packageName) {
+    env->DeleteLocalRef(packageName);
+  }
+  if (versionName) {
+    env->DeleteLocalRef(versionName);
+  }
+  if (label) {
+    env->DeleteLocalRef(label);
+  }
+
+  return javaResult;
+}
+
+static jlong nativeCreateMalwareScanner(
     JNIEnv *env, jobject /* this */) {
   LOGI("Creating malware scanner");
   MalwareScanner *scanner = new MalwareScanner();
   return reinterpret_cast<jlong>(scanner);
 }
 
-extern "C" JNIEXPORT jobject JNICALL
-Java_com_example_whatszap_FileMonitorService_nativeScanApk(JNIEnv *env,
-                                                           jobject /* this */,
-                                                           jlong nativeHandle,
-                                                           jstring apkPath) {
+static void nativeDestroyMalwareScanner(
+    JNIEnv *env, jobject /* this */, jlong nativeHandle) {
   if (nativeHandle == 0) {
-    LOGE("Invalid native handle");
-    return nullptr;
+    return;
+  }
+
+  MalwareScanner *scanner = reinterpret_cast<MalwareScanner *>(nativeHandle);
+  delete scanner;
+}
+
+static jboolean nativeLoadSignaturePack(
+    JNIEnv *env, jobject /* this */, jlong nativeHandle, jstring packPath) {
+  if (nativeHandle == 0) {
+    return JNI_FALSE;
+  }
+
+  MalwareScanner *scanner = reinterpret_cast<MalwareScanner *>(nativeHandle);
+  const char *pathStr = env->GetStringUTFChars(packPath, nullptr);
+  std::string path(pathStr);
+  env->ReleaseStringUTFChars(packPath, pathStr);
+
+  return scanner->loadSignaturePack(path) ? JNI_TRUE : JNI_FALSE;
+}
+
+static jboolean nativeLoadClassifier(
+    JNIEnv *env, jobject /* this */, jlong nativeHandle, jstring modelPath) {
+  if (nativeHandle == 0) {
+    return JNI_FALSE;
   }
 
   MalwareScanner *scanner = reinterpret_cast<MalwareScanner *>(nativeHandle);
+  const char *pathStr = env->GetStringUTFChars(modelPath, nullptr);
+  std::string path(pathStr);
+  env->ReleaseStringUTFChars(modelPath, pathStr);
+
+  return scanner->loadClassifier(path) ? JNI_TRUE : JNI_FALSE;
+}
+
+static jboolean nativeApplySignatureDelta(
+    JNIEnv *env, jobject /* this */, jlong nativeHandle, jstring deltaPath,
+    jstring packPath) {
+  if (nativeHandle == 0) {
+    return JNI_FALSE;
+  }
+
+  MalwareScanner *scanner = reinterpret_cast<MalwareScanner *>(nativeHandle);
+  const char *deltaStr = env->GetStringUTFChars(deltaPath, nullptr);
+  std::string delta(deltaStr);
+  env->ReleaseStringUTFChars(deltaPath, deltaStr);
+  const char *packStr = env->GetStringUTFChars(packPath, nullptr);
+  std::string pack(packStr);
+  env->ReleaseStringUTFChars(packPath, packStr);
+
+  return scanner->applySignatureDelta(delta, pack) ? JNI_TRUE : JNI_FALSE;
+}
+
+static jlong nativeGetSignatureVersion(
+    JNIEnv *env, jobject /* this */, jlong nativeHandle) {
+  if (nativeHandle == 0) {
+    return 0;
+  }
+
+  MalwareScanner *scanner = reinterpret_cast<MalwareScanner *>(nativeHandle);
+  return static_cast<jlong>(scanner->signatureVersion());
+}
+
+static jboolean nativeOpenVerdictCache(
+    JNIEnv *env, jobject /* this */, jlong nativeHandle, jstring cachePath) {
+  if (nativeHandle == 0) {
+    return JNI_FALSE;
+  }
+
+  MalwareScanner *scanner = reinterpret_cast<MalwareScanner *>(nativeHandle);
+  const char *pathStr = env->GetStringUTFChars(cachePath, nullptr);
+  std::string path(pathStr);
+  env->ReleaseStringUTFChars(cachePath, pathStr);
+
+  return scanner->openVerdictCache(path) ? JNI_TRUE : JNI_FALSE;
+}
+
+static jboolean nativeRecordReputation(
+    JNIEnv *env, jobject /* this */, jlong nativeHandle, jstring sha256,
+    jint detections, jint engines, jobjectArray threatNames) {
+  if (nativeHandle == 0) {
+    return JNI_FALSE;
+  }
+
+  MalwareScanner *scanner = reinterpret_cast<MalwareScanner *>(nativeHandle);
+  const char *hashStr = env->GetStringUTFChars(sha256, nullptr);
+  std::string hash(hashStr);
+  env->ReleaseStringUTFChars(sha256, hashStr);
+
+  ReputationVerdict reputation;
+  reputation.isKnown = true;
+  reputation.detections = detections;
+  reputation.engines = engines;
+  jsize threatCount = threatNames ? env->GetArrayLength(threatNames) : 0;
+  for (jsize i = 0; i < threatCount; i++) {
+    jstring threatName =
+        static_cast<jstring>(env->GetObjectArrayElement(threatNames, i));
+    const char *threatStr = env->GetStringUTFChars(threatName, nullptr);
+    reputation.threatNames.emplace_back(threatStr);
+    env->ReleaseStringUTFChars(threatName, threatStr);
+    env->DeleteLocalRef(threatName);
+  }
+
+  return scanner->recordReputation(hash, reputation) ? JNI_TRUE : JNI_FALSE;
+}
+
+// The verdict shown to the user, from the native scan, the app risk score,
+// the VirusTotal result and the model score (-1 for none). Returns the
+// confidence, with kVerdictMaliciousFlag set when the file is malicious.
+static constexpr jint kVerdictMaliciousFlag = 0x100;
+
+static jint nativeCombineVerdict(JNIEnv * /* env */, jobject /* this */,
+                                 jint scanConfidence, jboolean scanMalicious,
+                                 jint riskScore, jboolean vtFound,
+                                 jboolean vtMalicious, jint vtDetections,
+                                 jint modelScore) {
+  VerdictInputs inputs;
+  inputs.scanConfidence = scanConfidence;
+  inputs.scanMalicious = scanMalicious == JNI_TRUE;
+  inputs.riskScore = riskScore;
+  inputs.reputationKnown = vtFound == JNI_TRUE;
+  inputs.reputationMalicious = vtMalicious == JNI_TRUE;
+  inputs.detections = vtDetections;
+  inputs.modelScore = modelScore;
+
+  CombinedVerdict verdict = combineVerdict(inputs);
+  return verdict.confidence | (verdict.isMalicious ? kVerdictMaliciousFlag : 0);
+}
+
+// Counters and histograms of the watcher and every scan so far, as one
+// JSON object; cumulative since the library was loaded
+static jstring nativeGetMetrics(JNIEnv *env, jobject /* this */) {
+  return env->NewStringUTF(Metrics::snapshot().toJson().c_str());
+}
+
+// Attach the calling worker thread to the JVM once; it is detached when
+// the thread exits
+static JNIEnv *attachWorkerThread(JavaVM *jvm) {
+  struct Attachment {
+    JavaVM *jvm = nullptr;
+    JNIEnv *env = nullptr;
+    ~Attachment() {
+      if (jvm) {
+        jvm->DetachCurrentThread();
+      }
+    }
+  };
+  thread_local Attachment attachment;
+
+  if (!attachment.env) {
+    JavaVMAttachArgs attachArgs;
+    attachArgs.version = JNI_VERSION_1_6;
+    attachArgs.name = "ScanWorkerThread";
+    attachArgs.group = nullptr;
+    if (jvm->AttachCurrentThread(&attachment.env, &attachArgs) != JNI_OK) {
+      LOGE("Failed to attach scan worker to JVM");
+      attachment.env = nullptr;
+      return nullptr;
+    }
+    attachment.jvm = jvm;
+  }
+  return attachment.env;
+}
+
+// Scheduler plus the Java callback it reports to
+struct ScanSchedulerBinding {
+  JavaVM *jvm;
+  jobject callback;
+  std::unique_ptr<ScanScheduler> scheduler;
+};
+
+static jlong nativeCreateScanScheduler(
+    JNIEnv *env, jobject /* this */, jlong scannerHandle, jobject callback,
+    jint maxPendingJobs) {
+  if (scannerHandle == 0 || !jniRegistry().onScanComplete) {
+    LOGE("Invalid native handle");
+    return 0;
+  }
+
+  JavaVM *jvm;
+  if (env->GetJavaVM(&jvm) != JNI_OK) {
+    LOGE("Failed to get JavaVM");
+    return 0;
+  }
+
+  ScanSchedulerBinding *binding = new ScanSchedulerBinding();
+  binding->jvm = jvm;
+  binding->callback = env->NewGlobalRef(callback);
+
+  MalwareScanner *scanner = reinterpret_cast<MalwareScanner *>(scannerHandle);
+  binding->scheduler.reset(new ScanScheduler(
+      *scanner,
+      [binding](uint64_t jobId, const ScanResult *result) {
+        JNIEnv *threadEnv = attachWorkerThread(binding->jvm);
+        if (!threadEnv) {
+          return;
+        }
+        ScopedStage callback(Histogram::JniCallbackUs, "onScanComplete");
+        jobject javaResult =
+            result ? toJavaScanResult(threadEnv, *result) : nullptr;
+        threadEnv->CallVoidMethod(binding->callback,
+                                  jniRegistry().onScanComplete,
+                                  (jlong)jobId, javaResult);
+        if (threadEnv->ExceptionCheck()) {
+          LOGE("Exception in scan callback");
+          threadEnv->ExceptionDescribe();
+          threadEnv->ExceptionClear();
+        }
+        if (javaResult) {
+          threadEnv->DeleteLocalRef(javaResult);
+        }
+      },
+      maxPendingJobs > 0 ? static_cast<size_t>(maxPendingJobs)
+                         : ScanScheduler::kDefaultMaxPendingJobs));
+
+  LOGI("Created scan scheduler");
+  return reinterpret_cast<jlong>(binding);
+}
+
+static jlong nativeSubmitScan(
+    JNIEnv *env, jobject /* this */, jlong schedulerHandle, jstring apkPath,
+    jint priority, jlong budgetMs) {
+  if (schedulerHandle == 0) {
+    return 0;
+  }
+
+  ScanSchedulerBinding *binding =
+      reinterpret_cast<ScanSchedulerBinding *>(schedulerHandle);
   const char *pathStr = env->GetStringUTFChars(apkPath, nullptr);
   std::string path(pathStr);
   env->ReleaseStringUTFChars(apkPath, pathStr);
 
-  ScanResult result = scanner->scanApk(path);
-
-  // Create Java ScanResult object using the companion object factory method
-  jclass resultClass = env->FindClass("com/example/whatszap/ScanResult");
-  if (!resultClass) {
-    LOGE("Could not find ScanResult class");
-    return nullptr;
+  TaskPriority taskPriority = TaskPriority::Normal;
+  if (priority <= static_cast<jint>(TaskPriority::Foreground)) {
+    taskPriority = TaskPriority::Foreground;
+  } else if (priority >= static_cast<jint>(TaskPriority::Background)) {
+    taskPriority = TaskPriority::Background;
   }
 
-  // Find the companion object
-  jclass companionClass =
-      env->FindClass("com/example/whatszap/ScanResult$Companion");
-  if (!companionClass) {
-    LOGE("Could not find ScanResult$Companion class");
-    env->DeleteLocalRef(resultClass);
-    return nullptr;
+  return static_cast<jlong>(binding->scheduler->submit(
+      path, taskPriority, static_cast<long>(budgetMs)));
+}
+
+static jboolean nativeCancelScan(
+    JNIEnv *env, jobject /* this */, jlong schedulerHandle, jlong jobId) {
+  if (schedulerHandle == 0) {
+    return JNI_FALSE;
   }
 
-  // Get the companion instance field
-  jfieldID companionField = env->GetStaticFieldID(
-      resultClass, "Companion", "Lcom/example/whatszap/ScanResult$Companion;");
-  if (!companionField) {
-    LOGE("Could not find Companion field");
-    env->DeleteLocalRef(resultClass);
-    env->DeleteLocalRef(companionClass);
-    return nullptr;
+  ScanSchedulerBinding *binding =
+      reinterpret_cast<ScanSchedulerBinding *>(schedulerHandle);
+  return binding->scheduler->cancel(static_cast<uint64_t>(jobId)) ? JNI_TRUE
+                                                                  : JNI_FALSE;
+}
+
+static jint nativeGetScanStatus(
+    JNIEnv *env, jobject /* this */, jlong schedulerHandle, jlong jobId) {
+  if (schedulerHandle == 0) {
+    return static_cast<jint>(ScanJobState::Unknown);
   }
 
-  jobject companion = env->GetStaticObjectField(resultClass, companionField);
-  if (!companion) {
-    LOGE("Could not get Companion instance");
-    env->DeleteLocalRef(resultClass);
-    env->DeleteLocalRef(companionClass);
-    return nullptr;
+  ScanSchedulerBinding *binding =
+      reinterpret_cast<ScanSchedulerBinding *>(schedulerHandle);
+  return static_cast<jint>(
+      binding->scheduler->status(static_cast<uint64_t>(jobId)));
+}
+
+static void nativeDestroyScanScheduler(
+    JNIEnv *env, jobject /* this */, jlong schedulerHandle) {
+  if (schedulerHandle == 0) {
+    return;
   }
 
-  // Find the factory method on the companion
-  jmethodID factoryMethod = env->GetMethodID(
-      companionClass, "createFromNative",
-      "(ZILjava/util/List;J)Lcom/example/whatszap/ScanResult;");
-  if (!factoryMethod) {
-    LOGE("Could not find createFromNative method");
-    env->DeleteLocalRef(resultClass);
-    env->DeleteLocalRef(companionClass);
-    env->DeleteLocalRef(companion);
-    return nullptr;
+  ScanSchedulerBinding *binding =
+      reinterpret_cast<ScanSchedulerBinding *>(schedulerHandle);
+  // Joins the workers; no callback can run after this
+  binding->scheduler.reset();
+  env->DeleteGlobalRef(binding->callback);
+  delete binding;
+}
+
+// Files the scanner has a verdict for are skipped by the walk. The scanner
+// must outlive the walk.
+static jlong nativeCreateCatchUpWalk(
+    JNIEnv *env, jobject /* this */, jlong scannerHandle,
+    jstring checkpointPath) {
+  if (scannerHandle == 0) {
+    LOGE("Invalid native handle");
+    return 0;
   }
 
-  // Create ArrayList for threats
-  jclass arrayListClass = env->FindClass("java/util/ArrayList");
-  jmethodID arrayListConstructor =
-      env->GetMethodID(arrayListClass, "<init>", "(I)V");
-  jmethodID arrayListAdd =
-      env->GetMethodID(arrayListClass, "add", "(Ljava/lang/Object;)Z");
+  MalwareScanner *scanner = reinterpret_cast<MalwareScanner *>(scannerHandle);
+  const char *pathStr = env->GetStringUTFChars(checkpointPath, nullptr);
+  std::string path(pathStr);
+  env->ReleaseStringUTFChars(checkpointPath, pathStr);
 
-  jobject threatsList = env->NewObject(arrayListClass, arrayListConstructor,
-                                       (jint)result.threats.size());
+  CatchUpWalk *walk = new CatchUpWalk(
+      path, [scanner](const FileIdentity &identity) {
+        return scanner->hasCachedVerdict(identity);
+      });
+  return reinterpret_cast<jlong>(walk);
+}
 
-  for (const auto &threat : result.threats) {
-    jstring threatStr = env->NewStringUTF(threat.c_str());
-    env->CallBooleanMethod(threatsList, arrayListAdd, threatStr);
-    env->DeleteLocalRef(threatStr);
+// Blocks for the whole walk; call it off the main thread. Returns null if
+// the walk was cancelled.
+static jobjectArray nativeRunCatchUpWalk(
+    JNIEnv *env, jobject /* this */, jlong walkHandle, jobjectArray roots) {
+  std::vector<std::string> missed;
+  if (walkHandle != 0) {
+    std::vector<std::string> rootPaths;
+    jsize rootCount = roots ? env->GetArrayLength(roots) : 0;
+    for (jsize i = 0; i < rootCount; i++) {
+      jstring root = static_cast<jstring>(env->GetObjectArrayElement(roots, i));
+      const char *rootStr = env->GetStringUTFChars(root, nullptr);
+      rootPaths.emplace_back(rootStr);
+      env->ReleaseStringUTFChars(root, rootStr);
+      env->DeleteLocalRef(root);
+    }
+    CatchUpWalk *walk = reinterpret_cast<CatchUpWalk *>(walkHandle);
+    missed = walk->run(rootPaths);
+    if (walk->isCancelled()) {
+      return nullptr;
+    }
   }
+  return newStringArray(env, missed);
+}
 
-  // Call the factory method
-  jobject javaResult = env->CallObjectMethod(
-      companion, factoryMethod, result.isMalicious ? JNI_TRUE : JNI_FALSE,
-      result.confidence, threatsList, (jlong)result.scanDuration);
+// Stops a nativeRunCatchUpWalk in progress on another thread
+static void nativeCancelCatchUpWalk(
+    JNIEnv *env, jobject /* this */, jlong walkHandle) {
+  if (walkHandle == 0) {
+    return;
+  }
 
-  // Cleanup local references
-  env->DeleteLocalRef(threatsList);
-  env->DeleteLocalRef(resultClass);
-  env->DeleteLocalRef(companionClass);
-  env->DeleteLocalRef(companion);
-  env->DeleteLocalRef(arrayListClass);
+  reinterpret_cast<CatchUpWalk *>(walkHandle)->cancel();
+}
 
-  return javaResult;
+static jboolean nativeCommitCatchUpWalk(
+    JNIEnv *env, jobject /* this */, jlong walkHandle) {
+  if (walkHandle == 0) {
+    return JNI_FALSE;
+  }
+
+  CatchUpWalk *walk = reinterpret_cast<CatchUpWalk *>(walkHandle);
+  return walk->commit() ? JNI_TRUE : JNI_FALSE;
 }
 
-extern "C" JNIEXPORT void JNICALL
-Java_com_example_whatszap_FileMonitorService_nativeDestroyMalwareScanner(
-    JNIEnv *env, jobject /* this */, jlong nativeHandle) {
-  if (nativeHandle == 0) {
+static void nativeDestroyCatchUpWalk(
+    JNIEnv *env, jobject /* this */, jlong walkHandle) {
+  if (walkHandle == 0) {
     return;
   }
 
-  MalwareScanner *scanner = reinterpret_cast<MalwareScanner *>(nativeHandle);
-  delete scanner;
+  CatchUpWalk *walk = reinterpret_cast<CatchUpWalk *>(walkHandle);
+  delete walk;
+}
+
+// Bound with RegisterNatives in JNI_OnLoad instead of by symbol name
+static const JNINativeMethod kFileMonitorServiceMethods[] = {
+    {"nativeCreateFileMonitor", "()J", (void *)nativeCreateFileMonitor},
+    {"nativeStartMonitoring",
+     "(JLjava/lang/String;Lcom/example/whatszap/ApkDetectionCallback;)Z",
+     (void *)nativeStartMonitoring},
+    {"nativeStopMonitoring", "(J)V", (void *)nativeStopMonitoring},
+    {"nativeStopMonitoringDirectory", "(JLjava/lang/String;)Z",
+     (void *)nativeStopMonitoringDirectory},
+    {"nativeSetMonitorScanner", "(JJ)V", (void *)nativeSetMonitorScanner},
+    {"nativeDestroyFileMonitor", "(J)V", (void *)nativeDestroyFileMonitor},
+    {"nativeCreateMalwareScanner", "()J", (void *)nativeCreateMalwareScanner},
+    {"nativeDestroyMalwareScanner", "(J)V", (void *)nativeDestroyMalwareScanner},
+    {"nativeLoadSignaturePack", "(JLjava/lang/String;)Z",
+     (void *)nativeLoadSignaturePack},
+    {"nativeApplySignatureDelta", "(JLjava/lang/String;Ljava/lang/String;)Z",
+     (void *)nativeApplySignatureDelta},
+    {"nativeLoadClassifier", "(JLjava/lang/String;)Z", (void *)nativeLoadClassifier},
+    {"nativeGetSignatureVersion", "(J)J", (void *)nativeGetSignatureVersion},
+    {"nativeOpenVerdictCache", "(JLjava/lang/String;)Z",
+     (void *)nativeOpenVerdictCache},
+    {"nativeRecordReputation", "(JLjava/lang/String;II[Ljava/lang/String;)Z",
+     (void *)nativeRecordReputation},
+    {"nativeCombineVerdict", "(IZIZZII)I", (void *)nativeCombineVerdict},
+    {"nativeGetMetrics", "()Ljava/lang/String;", (void *)nativeGetMetrics},
+    {"nativeCreateScanScheduler",
+     "(JLcom/example/whatszap/ScanCompletionCallback;I)J",
+     (void *)nativeCreateScanScheduler},
+    {"nativeSubmitScan", "(JLjava/lang/String;IJ)J", (void *)nativeSubmitScan},
+    {"nativeCancelScan", "(JJ)Z", (void *)nativeCancelScan},
+    {"nativeGetScanStatus", "(JJ)I", (void *)nativeGetScanStatus},
+    {"nativeDestroyScanScheduler", "(J)V", (void *)nativeDestroyScanScheduler},
+    {"nativeCreateCatchUpWalk", "(JLjava/lang/String;)J",
+     (void *)nativeCreateCatchUpWalk},
+    {"nativeRunCatchUpWalk", "(J[Ljava/lang/String;)[Ljava/lang/String;",
+     (void *)nativeRunCatchUpWalk},
+    {"nativeCancelCatchUpWalk", "(J)V", (void *)nativeCancelCatchUpWalk},
+    {"nativeCommitCatchUpWalk", "(J)Z", (void *)nativeCommitCatchUpWalk},
+    {"nativeDestroyCatchUpWalk", "(J)V", (void *)nativeDestroyCatchUpWalk},
+};
+
+extern "C" JNIEXPORT jint JNICALL JNI_OnLoad(JavaVM *vm, void * /* reserved */) {
+  JNIEnv *env;
+  if (vm->GetEnv(reinterpret_cast<void **>(&env), JNI_VERSION_1_6) != JNI_OK) {
+    return JNI_ERR;
+  }
+
+  // Callbacks fail soft if something could not be resolved; the natives
+  // themselves are required
+  initJniRegistry(env);
+
+  jclass serviceClass = env->FindClass("com/example/whatszap/FileMonitorService");
+  if (!serviceClass) {
+    LOGE("Could not find FileMonitorService");
+    return JNI_ERR;
+  }
+  jint registered = env->RegisterNatives(
+      serviceClass, kFileMonitorServiceMethods,
+      sizeof(kFileMonitorServiceMethods) / sizeof(kFileMonitorServiceMethods[0]));
+  env->DeleteLocalRef(serviceClass);
+  if (registered != JNI_OK) {
+    LOGE("Failed to register FileMonitorService natives");
+    return JNI_ERR;
+  }
+
+  return JNI_VERSION_1_6;
 }
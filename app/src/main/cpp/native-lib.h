@@ -1,16 +1,37 @@
 #ifndef WHATSZAP_NATIVE_LIB_H
 #define WHATSZAP_NATIVE_LIB_H
 
-#include <jni.h>
 #include <string>
-#include <android/log.h>
 
 // Logging macros
 #define LOG_TAG "WhatsZapNative"
+#if defined(__ANDROID__)
+#include <android/log.h>
 #define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
 #define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
 #define LOGD(...) __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
 #define LOGW(...) __android_log_print(ANDROID_LOG_WARN, LOG_TAG, __VA_ARGS__)
+#else
+// Host builds (benchmarks) print warnings and errors to stderr. Info and
+// debug lines are per scan and would swamp the output, so they are only
+// printed with WHATSZAP_VERBOSE_LOG; the format is still checked either way.
+#include <cstdio>
+#if defined(WHATSZAP_VERBOSE_LOG)
+#define WHATSZAP_LOG_VERBOSE 1
+#else
+#define WHATSZAP_LOG_VERBOSE 0
+#endif
+#define WHATSZAP_HOST_LOG(enabled, level, ...)                       \
+    do {                                                             \
+        if (enabled) {                                               \
+            fprintf(stderr, level " " LOG_TAG ": " __VA_ARGS__);     \
+            fputc('\n', stderr);                                     \
+        }                                                            \
+    } while (0)
+#define LOGI(...) WHATSZAP_HOST_LOG(WHATSZAP_LOG_VERBOSE, "I", __VA_ARGS__)
+#define LOGE(...) WHATSZAP_HOST_LOG(1, "E", __VA_ARGS__)
+#define LOGD(...) WHATSZAP_HOST_LOG(WHATSZAP_LOG_VERBOSE, "D", __VA_ARGS__)
+#define LOGW(...) WHATSZAP_HOST_LOG(1, "W", __VA_ARGS__)
+#endif
 
 #endif // WHATSZAP_NATIVE_LIB_H
-
@@ -0,0 +1,184 @@
+#include "pack_file.h"
+#include "native-lib.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <zlib.h>
+
+namespace {
+
+struct PackHeader {
+    uint32_t magic;
+    uint32_t formatVersion;
+    uint64_t packVersion;
+    uint32_t crc32;             // over everything after the header
+    uint32_t sectionCount;
+};
+
+struct SectionEntry {
+    uint32_t tag;
+    uint32_t reserved;
+    uint64_t offset;
+    uint64_t size;
+};
+
+static_assert(sizeof(PackHeader) == 24, "pack header layout");
+static_assert(sizeof(SectionEntry) == 24, "section layout");
+
+void alignTo8(std::string& out) {
+    out.resize((out.size() + 7) & ~static_cast<size_t>(7), '\0');
+}
+
+} // namespace
+
+PackFile::PackFile()
+    : mapping_(nullptr), mappingSize_(0), data_(nullptr), size_(0), version_(0),
+      sectionCount_(0) {
+}
+
+PackFile::~PackFile() {
+    if (mapping_ != nullptr) {
+        munmap(const_cast<uint8_t*>(mapping_), mappingSize_);
+    }
+}
+
+std::string PackFile::build(uint32_t magic, uint32_t formatVersion, uint64_t version,
+                            const std::vector<PackSection>& sections) {
+    uint32_t sectionCount = static_cast<uint32_t>(sections.size());
+    std::string out(sizeof(PackHeader) + sectionCount * sizeof(SectionEntry), '\0');
+    std::vector<SectionEntry> table(sectionCount);
+    for (uint32_t i = 0; i < sectionCount; i++) {
+        alignTo8(out);
+        table[i].tag = sections[i].tag;
+        table[i].reserved = 0;
+        table[i].offset = out.size();
+        table[i].size = sections[i].payload.size();
+        out += sections[i].payload;
+    }
+    if (sectionCount > 0) {
+        memcpy(&out[sizeof(PackHeader)], table.data(), sectionCount * sizeof(SectionEntry));
+    }
+
+    PackHeader header;
+    header.magic = magic;
+    header.formatVersion = formatVersion;
+    header.packVersion = version;
+    header.sectionCount = sectionCount;
+    header.crc32 = static_cast<uint32_t>(
+        crc32(0L, reinterpret_cast<const Bytef*>(out.data() + sizeof(PackHeader)),
+              static_cast<uInt>(out.size() - sizeof(PackHeader))));
+    memcpy(&out[0], &header, sizeof(header));
+    return out;
+}
+
+bool PackFile::write(const std::string& image, const std::string& path) {
+    std::string tempPath = path + ".tmp";
+
+    int fd = open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        LOGE("Failed to create %s: %s", tempPath.c_str(), strerror(errno));
+        return false;
+    }
+    size_t done = 0;
+    while (done < image.size()) {
+        ssize_t n = ::write(fd, image.data() + done, image.size() - done);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        done += static_cast<size_t>(n);
+    }
+    bool ok = done == image.size() && fsync(fd) == 0;
+    close(fd);
+
+    // rename() is atomic, readers see either the old or the new file
+    if (!ok || rename(tempPath.c_str(), path.c_str()) != 0) {
+        LOGE("Failed to write %s: %s", path.c_str(), strerror(errno));
+        unlink(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool PackFile::map(const std::string& path, uint32_t magic, uint32_t formatVersion,
+                   bool verifyChecksum) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || fileStat.st_size < static_cast<off_t>(sizeof(PackHeader))) {
+        close(fd);
+        return false;
+    }
+    size_t size = static_cast<size_t>(fileStat.st_size);
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        LOGE("Failed to mmap %s: %s", path.c_str(), strerror(errno));
+        return false;
+    }
+    mapping_ = static_cast<const uint8_t*>(mapping);
+    mappingSize_ = size;
+
+    if (verifyChecksum) {
+        PackHeader header;
+        memcpy(&header, mapping_, sizeof(header));
+        uint32_t actual = static_cast<uint32_t>(
+            crc32(0L, mapping_ + sizeof(PackHeader), static_cast<uInt>(size - sizeof(PackHeader))));
+        if (actual != header.crc32) {
+            LOGE("Checksum mismatch: %s", path.c_str());
+            return false;
+        }
+    }
+    return attach(mapping_, size, magic, formatVersion);
+}
+
+bool PackFile::adopt(std::string image, uint32_t magic, uint32_t formatVersion) {
+    ownedImage_ = std::move(image);
+    return attach(reinterpret_cast<const uint8_t*>(ownedImage_.data()), ownedImage_.size(),
+                  magic, formatVersion);
+}
+
+bool PackFile::attach(const uint8_t* data, size_t size, uint32_t magic,
+                      uint32_t formatVersion) {
+    if (size < sizeof(PackHeader)) {
+        return false;
+    }
+    PackHeader header;
+    memcpy(&header, data, sizeof(header));
+    if (header.magic != magic || header.formatVersion != formatVersion ||
+        header.sectionCount > (size - sizeof(PackHeader)) / sizeof(SectionEntry)) {
+        return false;
+    }
+    for (uint32_t i = 0; i < header.sectionCount; i++) {
+        SectionEntry section;
+        memcpy(&section, data + sizeof(PackHeader) + i * sizeof(SectionEntry), sizeof(section));
+        if (section.offset > size || section.size > size - section.offset || section.offset % 8 != 0) {
+            return false;
+        }
+    }
+    data_ = data;
+    size_ = size;
+    version_ = header.packVersion;
+    sectionCount_ = header.sectionCount;
+    return true;
+}
+
+const uint8_t* PackFile::section(uint32_t tag, size_t& size) const {
+    for (uint32_t i = 0; i < sectionCount_; i++) {
+        SectionEntry section;
+        memcpy(&section, data_ + sizeof(PackHeader) + i * sizeof(SectionEntry), sizeof(section));
+        if (section.tag == tag) {
+            size = static_cast<size_t>(section.size);
+            return data_ + section.offset;
+        }
+    }
+    size = 0;
+    return nullptr;
+}
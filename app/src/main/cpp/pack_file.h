@@ -0,0 +1,65 @@
+#ifndef WHATSZAP_PACK_FILE_H
+#define WHATSZAP_PACK_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// One section of a pack, as written
+struct PackSection {
+    uint32_t tag;               // four ASCII characters, little-endian
+    std::string payload;
+};
+
+// The container of signature packs and model files:
+//
+//   header   magic, format version, content version, CRC32, section count
+//   sections table of {tag, offset, size}, each section 8-byte aligned
+//
+// What the sections hold is up to the owner, which looks them up by tag
+// and points into them. Unknown tags are ignored so newer files stay
+// loadable. The image is either a read-only mapping of the file or a
+// buffer built in memory.
+class PackFile {
+public:
+    PackFile();
+    ~PackFile();
+
+    PackFile(const PackFile&) = delete;
+    PackFile& operator=(const PackFile&) = delete;
+
+    // Lay out sections behind a header
+    static std::string build(uint32_t magic, uint32_t formatVersion, uint64_t version,
+                             const std::vector<PackSection>& sections);
+
+    // Write an image atomically (temp file + fsync + rename)
+    static bool write(const std::string& image, const std::string& path);
+
+    // Map a file; false if it is missing, has another magic or format
+    // version, or a section runs past its end. The CRC is only checked if
+    // verifyChecksum is set, as that costs a pass over the file.
+    bool map(const std::string& path, uint32_t magic, uint32_t formatVersion,
+             bool verifyChecksum);
+
+    // Take over an image made by build()
+    bool adopt(std::string image, uint32_t magic, uint32_t formatVersion);
+
+    uint64_t version() const { return version_; }
+
+    // Payload of the first section with this tag, or nullptr
+    const uint8_t* section(uint32_t tag, size_t& size) const;
+
+private:
+    bool attach(const uint8_t* data, size_t size, uint32_t magic, uint32_t formatVersion);
+
+    std::string ownedImage_;
+    const uint8_t* mapping_;
+    size_t mappingSize_;
+    const uint8_t* data_;
+    size_t size_;
+    uint64_t version_;
+    uint32_t sectionCount_;
+};
+
+#endif // WHATSZAP_PACK_FILE_H
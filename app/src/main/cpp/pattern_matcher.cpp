@@ -0,0 +1,346 @@
+#include "pattern_matcher.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
+namespace {
+
+// Marks transitions into states that have outputs, so the scan loop needs
+// a single table load per byte
+constexpr uint32_t kMatchFlag = 0x80000000u;
+constexpr uint32_t kNoTransition = 0xFFFFFFFFu;
+
+constexpr uint32_t kCaseInsensitiveFlag = 1;
+
+// Serialized layout: a fixed header followed by the tables, every field
+// 4-byte aligned so the blob can be used straight from a mapping
+struct SerializedHeader {
+    uint32_t classCount;
+    uint32_t stateCount;
+    uint32_t outputCount;
+    uint32_t flags;
+    uint16_t byteClass[256];
+    uint8_t isStartByte[256];
+    uint8_t lowNibbleMask[16];
+    uint8_t highNibbleMask[16];
+};
+static_assert(sizeof(SerializedHeader) % 4 == 0, "tables must stay 4-byte aligned");
+
+template <typename T>
+void appendRaw(std::string& out, const T* data, size_t count) {
+    out.append(reinterpret_cast<const char*>(data), count * sizeof(T));
+}
+
+} // namespace
+
+PatternMatcher::PatternMatcher(bool caseInsensitive)
+    : caseInsensitive_(caseInsensitive), built_(false),
+      classCount_(1), stateCount_(1), outputCount_(0) {
+    memset(byteClassStorage_, 0, sizeof(byteClassStorage_));
+    memset(isStartByteStorage_, 0, sizeof(isStartByteStorage_));
+    memset(lowNibbleStorage_, 0, sizeof(lowNibbleStorage_));
+    memset(highNibbleStorage_, 0, sizeof(highNibbleStorage_));
+    transitionStorage_.assign(1, 0);
+    outputStartStorage_.assign(2, 0);
+    pointAtStorage();
+}
+
+void PatternMatcher::pointAtStorage() {
+    byteClass_ = byteClassStorage_;
+    isStartByte_ = isStartByteStorage_;
+    lowNibbleMask_ = lowNibbleStorage_;
+    highNibbleMask_ = highNibbleStorage_;
+    transitions_ = transitionStorage_.data();
+    outputStart_ = outputStartStorage_.data();
+    outputs_ = outputStorage_.data();
+}
+
+uint8_t PatternMatcher::foldByte(uint8_t byte) const {
+    if (caseInsensitive_ && byte >= 'A' && byte <= 'Z') {
+        return static_cast<uint8_t>(byte + ('a' - 'A'));
+    }
+    return byte;
+}
+
+void PatternMatcher::addPattern(std::string_view pattern, uint32_t patternId) {
+    if (pattern.empty()) {
+        return;
+    }
+    Pattern entry;
+    entry.bytes.reserve(pattern.size());
+    for (char c : pattern) {
+        entry.bytes.push_back(static_cast<char>(foldByte(static_cast<uint8_t>(c))));
+    }
+    entry.id = patternId;
+    patterns_.push_back(std::move(entry));
+    built_ = false;
+}
+
+void PatternMatcher::build() {
+    // Byte equivalence classes: every byte used by a pattern gets its own
+    // class, all other bytes share class 0
+    memset(byteClassStorage_, 0, sizeof(byteClassStorage_));
+    classCount_ = 1;
+    for (const auto& pattern : patterns_) {
+        for (char c : pattern.bytes) {
+            uint8_t byte = static_cast<uint8_t>(c);
+            if (byteClassStorage_[byte] == 0) {
+                byteClassStorage_[byte] = static_cast<uint16_t>(classCount_++);
+            }
+        }
+    }
+    if (caseInsensitive_) {
+        for (int c = 'A'; c <= 'Z'; c++) {
+            byteClassStorage_[c] = byteClassStorage_[c + ('a' - 'A')];
+        }
+    }
+
+    // Trie, stored directly in the dense table
+    std::vector<uint32_t> table(classCount_, kNoTransition);
+    std::vector<std::vector<uint32_t>> ownOutputs(1);
+    uint32_t states = 1;
+    for (const auto& pattern : patterns_) {
+        uint32_t state = 0;
+        for (char c : pattern.bytes) {
+            uint32_t cls = byteClassStorage_[static_cast<uint8_t>(c)];
+            uint32_t& next = table[state * classCount_ + cls];
+            if (next == kNoTransition) {
+                next = states++;
+                table.resize(static_cast<size_t>(states) * classCount_, kNoTransition);
+                ownOutputs.emplace_back();
+            }
+            state = table[state * classCount_ + cls];
+        }
+        ownOutputs[state].push_back(pattern.id);
+    }
+
+    // Breadth-first pass: failure links turn the trie into a full DFA and
+    // each state inherits the outputs of its failure state
+    std::vector<uint32_t> failure(states, 0);
+    std::vector<uint32_t> order;
+    order.reserve(states);
+    for (uint32_t cls = 0; cls < classCount_; cls++) {
+        uint32_t& next = table[cls];
+        if (next == kNoTransition) {
+            next = 0;
+        } else {
+            order.push_back(next);
+        }
+    }
+    for (size_t head = 0; head < order.size(); head++) {
+        uint32_t state = order[head];
+        for (uint32_t cls = 0; cls < classCount_; cls++) {
+            uint32_t& next = table[state * classCount_ + cls];
+            uint32_t fallback = table[failure[state] * classCount_ + cls];
+            if (next == kNoTransition) {
+                next = fallback;
+            } else {
+                failure[next] = fallback;
+                order.push_back(next);
+            }
+        }
+    }
+
+    outputStartStorage_.assign(states + 1, 0);
+    outputStorage_.clear();
+    std::vector<std::vector<uint32_t>> allOutputs(states);
+    for (uint32_t state : order) {
+        allOutputs[state] = ownOutputs[state];
+        const auto& inherited = allOutputs[failure[state]];
+        allOutputs[state].insert(allOutputs[state].end(), inherited.begin(), inherited.end());
+    }
+    for (uint32_t state = 0; state < states; state++) {
+        outputStartStorage_[state] = static_cast<uint32_t>(outputStorage_.size());
+        outputStorage_.insert(outputStorage_.end(), allOutputs[state].begin(), allOutputs[state].end());
+    }
+    outputStartStorage_[states] = static_cast<uint32_t>(outputStorage_.size());
+
+    // Store transitions as pre-multiplied row offsets with the match flag
+    transitionStorage_.resize(table.size());
+    for (size_t i = 0; i < table.size(); i++) {
+        uint32_t target = table[i];
+        uint32_t row = target * classCount_;
+        transitionStorage_[i] = outputStartStorage_[target] != outputStartStorage_[target + 1] ? (row | kMatchFlag) : row;
+    }
+    stateCount_ = states;
+    outputCount_ = static_cast<uint32_t>(outputStorage_.size());
+
+    // Prefilter tables: exact start-byte set plus nibble masks for SIMD.
+    // Bucket k holds start bytes whose high nibble is k or k + 8.
+    memset(isStartByteStorage_, 0, sizeof(isStartByteStorage_));
+    memset(lowNibbleStorage_, 0, sizeof(lowNibbleStorage_));
+    memset(highNibbleStorage_, 0, sizeof(highNibbleStorage_));
+    for (int byte = 0; byte < 256; byte++) {
+        if (table[byteClassStorage_[byte]] != 0) {
+            isStartByteStorage_[byte] = 1;
+            uint8_t bucket = static_cast<uint8_t>(1u << ((byte >> 4) & 7));
+            lowNibbleStorage_[byte & 0x0F] |= bucket;
+            highNibbleStorage_[byte >> 4] = bucket;
+        }
+    }
+
+    pointAtStorage();
+    built_ = true;
+}
+
+void PatternMatcher::serialize(std::string& out) const {
+    SerializedHeader header;
+    header.classCount = classCount_;
+    header.stateCount = stateCount_;
+    header.outputCount = outputCount_;
+    header.flags = caseInsensitive_ ? kCaseInsensitiveFlag : 0;
+    memcpy(header.byteClass, byteClass_, sizeof(header.byteClass));
+    memcpy(header.isStartByte, isStartByte_, sizeof(header.isStartByte));
+    memcpy(header.lowNibbleMask, lowNibbleMask_, sizeof(header.lowNibbleMask));
+    memcpy(header.highNibbleMask, highNibbleMask_, sizeof(header.highNibbleMask));
+
+    appendRaw(out, &header, 1);
+    appendRaw(out, transitions_, static_cast<size_t>(stateCount_) * classCount_);
+    appendRaw(out, outputStart_, static_cast<size_t>(stateCount_) + 1);
+    appendRaw(out, outputs_, outputCount_);
+}
+
+bool PatternMatcher::attach(const uint8_t* data, size_t size) {
+    if (size < sizeof(SerializedHeader) || reinterpret_cast<uintptr_t>(data) % 4 != 0) {
+        return false;
+    }
+    const auto* header = reinterpret_cast<const SerializedHeader*>(data);
+    if (header->classCount == 0 || header->classCount > 257 || header->stateCount == 0) {
+        return false;
+    }
+    uint64_t transitionCount = static_cast<uint64_t>(header->stateCount) * header->classCount;
+    uint64_t required = sizeof(SerializedHeader) +
+                        (transitionCount + header->stateCount + 1 + header->outputCount) * 4;
+    if (transitionCount > kMatchFlag || required > size) {
+        return false;
+    }
+
+    // The scan loop indexes with these unchecked, so a corrupt blob would
+    // read out of bounds on every scan; one pass here rules that out
+    const auto* tables = reinterpret_cast<const uint32_t*>(data + sizeof(SerializedHeader));
+    for (uint16_t byteClass : header->byteClass) {
+        if (byteClass >= header->classCount) {
+            return false;
+        }
+    }
+    for (uint64_t i = 0; i < transitionCount; i++) {
+        uint32_t row = tables[i] & ~kMatchFlag;
+        if (row % header->classCount != 0 || row / header->classCount >= header->stateCount) {
+            return false;
+        }
+    }
+    const uint32_t* outputStart = tables + transitionCount;
+    for (uint32_t state = 0; state < header->stateCount; state++) {
+        if (outputStart[state] > outputStart[state + 1]) {
+            return false;
+        }
+    }
+    if (outputStart[header->stateCount] > header->outputCount) {
+        return false;
+    }
+
+    caseInsensitive_ = (header->flags & kCaseInsensitiveFlag) != 0;
+    classCount_ = header->classCount;
+    stateCount_ = header->stateCount;
+    outputCount_ = header->outputCount;
+    byteClass_ = header->byteClass;
+    isStartByte_ = header->isStartByte;
+    lowNibbleMask_ = header->lowNibbleMask;
+    highNibbleMask_ = header->highNibbleMask;
+    transitions_ = tables;
+    outputStart_ = tables + transitionCount;
+    outputs_ = outputStart_ + stateCount_ + 1;
+
+    patterns_.clear();
+    transitionStorage_.clear();
+    outputStartStorage_.clear();
+    outputStorage_.clear();
+    built_ = true;
+    return true;
+}
+
+size_t PatternMatcher::skipToCandidate(const uint8_t* data, size_t position, size_t length) const {
+#if defined(__aarch64__)
+    const uint8x16_t lowTable = vld1q_u8(lowNibbleMask_);
+    const uint8x16_t highTable = vld1q_u8(highNibbleMask_);
+    const uint8x16_t nibble = vdupq_n_u8(0x0F);
+    while (position + 16 <= length) {
+        uint8x16_t bytes = vld1q_u8(data + position);
+        uint8x16_t hits = vandq_u8(vqtbl1q_u8(lowTable, vandq_u8(bytes, nibble)),
+                                   vqtbl1q_u8(highTable, vshrq_n_u8(bytes, 4)));
+        if (vmaxvq_u8(hits) != 0) {
+            for (size_t i = 0; i < 16; i++) {
+                if (isStartByte_[data[position + i]]) {
+                    return position + i;
+                }
+            }
+        }
+        position += 16;
+    }
+#elif defined(__SSSE3__)
+    const __m128i lowTable = _mm_loadu_si128(reinterpret_cast<const __m128i*>(lowNibbleMask_));
+    const __m128i highTable = _mm_loadu_si128(reinterpret_cast<const __m128i*>(highNibbleMask_));
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+    const __m128i zero = _mm_setzero_si128();
+    while (position + 16 <= length) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + position));
+        __m128i low = _mm_shuffle_epi8(lowTable, _mm_and_si128(bytes, nibble));
+        __m128i high = _mm_shuffle_epi8(highTable, _mm_and_si128(_mm_srli_epi16(bytes, 4), nibble));
+        int misses = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(low, high), zero));
+        if (misses != 0xFFFF) {
+            for (size_t i = 0; i < 16; i++) {
+                if (isStartByte_[data[position + i]]) {
+                    return position + i;
+                }
+            }
+        }
+        position += 16;
+    }
+#endif
+    while (position < length && !isStartByte_[data[position]]) {
+        position++;
+    }
+    return position;
+}
+
+bool PatternMatcher::scan(Cursor& cursor, const uint8_t* data, size_t length,
+                          const PatternMatchSink& sink) const {
+    if (!built_ || outputCount_ == 0) {
+        cursor.offset += length;
+        return true;
+    }
+
+    const uint32_t* transitions = transitions_;
+    uint32_t row = cursor.state;
+    size_t i = 0;
+    while (i < length) {
+        if (row == 0) {
+            i = skipToCandidate(data, i, length);
+            if (i >= length) {
+                break;
+            }
+        }
+        uint32_t next = transitions[row + byteClass_[data[i]]];
+        i++;
+        row = next & ~kMatchFlag;
+        if (next & kMatchFlag) {
+            uint32_t state = row / classCount_;
+            for (uint32_t k = outputStart_[state]; k < outputStart_[state + 1]; k++) {
+                if (!sink(outputs_[k], cursor.offset + i)) {
+                    cursor.state = row;
+                    cursor.offset += i;
+                    return false;
+                }
+            }
+        }
+    }
+
+    cursor.state = row;
+    cursor.offset += length;
+    return true;
+}
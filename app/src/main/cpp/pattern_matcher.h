@@ -0,0 +1,101 @@
+#ifndef WHATSZAP_PATTERN_MATCHER_H
+#define WHATSZAP_PATTERN_MATCHER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Called for every match with the caller's pattern ID and the offset one
+// past the last matched byte; return false to stop scanning.
+using PatternMatchSink = std::function<bool(uint32_t patternId, uint64_t endOffset)>;
+
+// Multi-pattern matcher: an Aho-Corasick automaton compiled into a dense
+// DFA over byte equivalence classes, so every input byte costs one table
+// lookup regardless of the number of patterns. While the automaton sits in
+// its root state a SIMD nibble-table prefilter skips bytes that cannot
+// start any pattern.
+//
+// The compiled tables can be serialized and later attached in place (e.g.
+// from an mmap'd signature pack) without rebuilding anything.
+class PatternMatcher {
+public:
+    // Streaming position; carry it across chunks of the same input
+    struct Cursor {
+        uint32_t state;
+        uint64_t offset;
+
+        Cursor() : state(0), offset(0) {}
+    };
+
+    explicit PatternMatcher(bool caseInsensitive = true);
+
+    // Table pointers may reference internal storage
+    PatternMatcher(const PatternMatcher&) = delete;
+    PatternMatcher& operator=(const PatternMatcher&) = delete;
+
+    // Register a pattern before build(); empty patterns are ignored
+    void addPattern(std::string_view pattern, uint32_t patternId);
+
+    // Compile the automaton. Patterns added afterwards require another build
+    void build();
+
+    // Append the compiled tables to `out`; the blob needs 4-byte alignment
+    void serialize(std::string& out) const;
+
+    // Use tables produced by serialize() in place. The memory must outlive
+    // the matcher. Returns false if the blob is malformed; every table
+    // entry is range-checked, in one pass over the tables.
+    bool attach(const uint8_t* data, size_t size);
+
+    bool isBuilt() const { return built_; }
+    size_t stateCount() const { return stateCount_; }
+
+    // Scan one chunk; returns false if the sink asked to stop
+    bool scan(Cursor& cursor, const uint8_t* data, size_t length,
+              const PatternMatchSink& sink) const;
+
+    // Convenience for a whole, self-contained buffer
+    bool scan(std::string_view text, const PatternMatchSink& sink) const {
+        Cursor cursor;
+        return scan(cursor, reinterpret_cast<const uint8_t*>(text.data()), text.size(), sink);
+    }
+
+private:
+    struct Pattern {
+        std::string bytes;
+        uint32_t id;
+    };
+
+    uint8_t foldByte(uint8_t byte) const;
+    size_t skipToCandidate(const uint8_t* data, size_t position, size_t length) const;
+    void pointAtStorage();
+
+    bool caseInsensitive_;
+    bool built_;
+    std::vector<Pattern> patterns_;
+
+    // Compiled form, either owned by the storage below or attached
+    uint32_t classCount_;
+    uint32_t stateCount_;
+    uint32_t outputCount_;
+    const uint16_t* byteClass_;         // 256 entries
+    const uint8_t* isStartByte_;        // 256 entries
+    const uint8_t* lowNibbleMask_;      // 16 entries
+    const uint8_t* highNibbleMask_;     // 16 entries
+    const uint32_t* transitions_;       // stateCount_ x classCount_
+    const uint32_t* outputStart_;       // stateCount_ + 1 offsets into outputs_
+    const uint32_t* outputs_;           // caller pattern IDs
+
+    uint16_t byteClassStorage_[256];
+    uint8_t isStartByteStorage_[256];
+    uint8_t lowNibbleStorage_[16];
+    uint8_t highNibbleStorage_[16];
+    std::vector<uint32_t> transitionStorage_;
+    std::vector<uint32_t> outputStartStorage_;
+    std::vector<uint32_t> outputStorage_;
+};
+
+#endif // WHATSZAP_PATTERN_MATCHER_H
@@ -0,0 +1,91 @@
+#include "scan_arena.h"
+
+ScanArena::ScanArena() : current_(0) {}
+
+void* ScanArena::allocate(size_t size, size_t alignment) {
+    if (size == 0) {
+        size = 1;
+    }
+    if (!blocks_.empty()) {
+        Block& block = blocks_[current_];
+        size_t offset = (block.used + alignment - 1) & ~(alignment - 1);
+        if (offset <= block.size && size <= block.size - offset) {
+            block.used = offset + size;
+            return block.data.get() + offset;
+        }
+    }
+
+    // Move on to an empty block that fits, or add one right after the
+    // current block. Block storage from new[] is aligned for any type.
+    size_t next = blocks_.empty() ? 0 : current_ + 1;
+    size_t fit = next;
+    while (fit < blocks_.size() && blocks_[fit].size < size) {
+        fit++;
+    }
+    if (fit < blocks_.size()) {
+        std::swap(blocks_[next], blocks_[fit]);
+    } else {
+        Block block;
+        block.size = size > kBlockSize ? size : kBlockSize;
+        block.data.reset(new uint8_t[block.size]);
+        block.used = 0;
+        blocks_.insert(blocks_.begin() + next, std::move(block));
+    }
+    current_ = next;
+    Block& block = blocks_[current_];
+    block.used = size;
+    return block.data.get();
+}
+
+ScanArena::Marker ScanArena::mark() const {
+    Marker marker;
+    marker.block = current_;
+    marker.used = blocks_.empty() ? 0 : blocks_[current_].used;
+    return marker;
+}
+
+void ScanArena::rewind(const Marker& marker) {
+    if (blocks_.empty()) {
+        return;
+    }
+    for (size_t i = marker.block + 1; i <= current_ && i < blocks_.size(); i++) {
+        blocks_[i].used = 0;
+    }
+    current_ = marker.block;
+    blocks_[current_].used = marker.used;
+
+    // Trim the empty tail: oversized blocks first, then whatever exceeds
+    // the retained size
+    size_t first = blocks_[current_].used == 0 ? current_ : current_ + 1;
+    size_t retained = 0;
+    for (size_t i = 0; i < first; i++) {
+        retained += blocks_[i].size;
+    }
+    size_t keep = first;
+    for (size_t i = first; i < blocks_.size(); i++) {
+        if (blocks_[i].size <= kBlockSize && retained + blocks_[i].size <= kRetainedSize) {
+            retained += blocks_[i].size;
+            if (keep != i) {
+                blocks_[keep] = std::move(blocks_[i]);
+            }
+            keep++;
+        }
+    }
+    blocks_.resize(keep);
+    if (current_ >= blocks_.size()) {
+        current_ = blocks_.empty() ? 0 : blocks_.size() - 1;
+    }
+}
+
+size_t ScanArena::bytesReserved() const {
+    size_t total = 0;
+    for (const Block& block : blocks_) {
+        total += block.size;
+    }
+    return total;
+}
+
+ScanArena& ScanArena::local() {
+    static thread_local ScanArena arena;
+    return arena;
+}
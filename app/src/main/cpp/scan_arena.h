@@ -0,0 +1,130 @@
+#ifndef WHATSZAP_SCAN_ARENA_H
+#define WHATSZAP_SCAN_ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Deleter for objects constructed in an arena: runs the destructor only,
+// the memory returns with the ArenaScope
+struct ArenaDestroy {
+    template <typename T>
+    void operator()(T* object) const { object->~T(); }
+};
+
+template <typename T>
+using ArenaPtr = std::unique_ptr<T, ArenaDestroy>;
+
+// Monotonic allocator for the temporaries of a scan: inflated entries,
+// parser tables, per-entry findings. Allocation bumps a pointer in the
+// current block and nothing is freed individually; an ArenaScope hands
+// everything allocated within it back at once. Each thread has its own
+// arena, kept across scans, so a worker scanning one APK after another
+// reuses the same blocks instead of going back to malloc.
+class ScanArena {
+public:
+    struct Marker {
+        size_t block;
+        size_t used;
+    };
+
+    ScanArena();
+
+    ScanArena(const ScanArena&) = delete;
+    ScanArena& operator=(const ScanArena&) = delete;
+
+    // alignment must be a power of two
+    void* allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+    // Uninitialized storage; only for types that need no destructor
+    template <typename T>
+    T* allocateArray(size_t count) {
+        static_assert(std::is_trivially_destructible<T>::value, "arena memory is never destroyed");
+        return static_cast<T*>(allocate(count * sizeof(T), alignof(T)));
+    }
+
+    // An object with a destructor, such as a polymorphic analyzer state;
+    // the pointer must be gone before the scope it was made in ends
+    template <typename T, typename... Args>
+    ArenaPtr<T> make(Args&&... args) {
+        return ArenaPtr<T>(new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...));
+    }
+
+    Marker mark() const;
+
+    // Release everything allocated since `marker`. Blocks stay for reuse,
+    // up to kRetainedSize; larger ones, e.g. for one huge dex file, go back
+    // to the system.
+    void rewind(const Marker& marker);
+
+    size_t bytesReserved() const;
+
+    // The calling thread's arena
+    static ScanArena& local();
+
+private:
+    static constexpr size_t kBlockSize = 256 * 1024;
+    static constexpr size_t kRetainedSize = 4 * 1024 * 1024;
+
+    struct Block {
+        std::unique_ptr<uint8_t[]> data;
+        size_t size;
+        size_t used;
+    };
+
+    std::vector<Block> blocks_;
+    size_t current_;            // blocks after it are empty
+};
+
+// Everything allocated from the arena during its lifetime is released at
+// its end. Scopes on one thread nest.
+class ArenaScope {
+public:
+    explicit ArenaScope(ScanArena& arena) : arena_(arena), marker_(arena.mark()) {}
+    ~ArenaScope() { arena_.rewind(marker_); }
+
+    ArenaScope(const ArenaScope&) = delete;
+    ArenaScope& operator=(const ArenaScope&) = delete;
+
+    ScanArena& arena() const { return arena_; }
+
+private:
+    ScanArena& arena_;
+    ScanArena::Marker marker_;
+};
+
+// Standard allocator over an arena, for containers that live within one
+// ArenaScope. deallocate() is a no-op; memory returns with the scope.
+template <typename T>
+class ArenaAllocator {
+public:
+    using value_type = T;
+
+    explicit ArenaAllocator(ScanArena& arena) : arena_(&arena) {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : arena_(other.arena()) {}
+
+    T* allocate(size_t count) {
+        return static_cast<T*>(arena_->allocate(count * sizeof(T), alignof(T)));
+    }
+    void deallocate(T*, size_t) {}
+
+    ScanArena* arena() const { return arena_; }
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>& other) const { return arena_ == other.arena(); }
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const { return arena_ != other.arena(); }
+
+private:
+    ScanArena* arena_;
+};
+
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+#endif // WHATSZAP_SCAN_ARENA_H
@@ -0,0 +1,275 @@
+#include "scan_metrics.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+#if defined(WHATSZAP_ATRACE)
+#include <android/trace.h>
+#endif
+
+namespace {
+
+constexpr size_t kBuckets = HistogramSnapshot::kBuckets;
+
+// Snapshot keys, in enum order
+constexpr const char* kCounterNames[] = {
+    "inotify_events",
+    "fanotify_events",
+    "files_reported",
+    "early_verdicts",
+    "streamed_bytes",
+    "scans_started",
+    "scans_cancelled",
+    "scans_partial",
+    "cache_hits_by_file",
+    "cache_hits_by_digest",
+    "cache_misses",
+    "bytes_scanned",
+    "jobs_rejected",
+};
+constexpr const char* kHistogramNames[] = {
+    "inotify_batch",
+    "queue_depth",
+    "queue_wait_us",
+    "scan_us",
+    "hash_us",
+    "manifest_us",
+    "content_us",
+    "verdict_us",
+    "jni_callback_us",
+};
+constexpr const char* kGaugeNames[] = {
+    "pending_scans",
+    "pending_files",
+    "watches",
+};
+static_assert(sizeof(kCounterNames) / sizeof(kCounterNames[0]) == kCounterCount,
+              "a counter has no name");
+static_assert(sizeof(kHistogramNames) / sizeof(kHistogramNames[0]) == kHistogramCount,
+              "a histogram has no name");
+static_assert(sizeof(kGaugeNames) / sizeof(kGaugeNames[0]) == kGaugeCount,
+              "a gauge has no name");
+
+// Only the owning thread writes a shard, so a relaxed load and store is
+// enough and cheaper than a read-modify-write
+void bump(std::atomic<uint64_t>& value, uint64_t amount) {
+    value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+size_t bucketOf(uint64_t value) {
+    if (value == 0) {
+        return 0;
+    }
+    size_t bits = static_cast<size_t>(64 - __builtin_clzll(value));
+    return std::min(bits, kBuckets - 1);
+}
+
+struct alignas(64) Shard {
+    struct Distribution {
+        std::atomic<uint64_t> buckets[kBuckets];
+        std::atomic<uint64_t> count;
+        std::atomic<uint64_t> sum;
+        std::atomic<uint64_t> max;
+    };
+
+    std::atomic<uint64_t> counters[kCounterCount];
+    Distribution histograms[kHistogramCount];
+
+    Shard() {
+        for (auto& counter : counters) {
+            counter.store(0, std::memory_order_relaxed);
+        }
+        for (auto& histogram : histograms) {
+            for (auto& bucket : histogram.buckets) {
+                bucket.store(0, std::memory_order_relaxed);
+            }
+            histogram.count.store(0, std::memory_order_relaxed);
+            histogram.sum.store(0, std::memory_order_relaxed);
+            histogram.max.store(0, std::memory_order_relaxed);
+        }
+    }
+};
+
+void accumulate(const Shard& shard, MetricsSnapshot& into) {
+    for (size_t i = 0; i < kCounterCount; i++) {
+        into.counters[i] += shard.counters[i].load(std::memory_order_relaxed);
+    }
+    for (size_t i = 0; i < kHistogramCount; i++) {
+        const Shard::Distribution& from = shard.histograms[i];
+        HistogramSnapshot& to = into.histograms[i];
+        for (size_t b = 0; b < kBuckets; b++) {
+            to.buckets[b] += from.buckets[b].load(std::memory_order_relaxed);
+        }
+        to.count += from.count.load(std::memory_order_relaxed);
+        to.sum += from.sum.load(std::memory_order_relaxed);
+        to.max = std::max(to.max, from.max.load(std::memory_order_relaxed));
+    }
+}
+
+struct Registry {
+    std::mutex mutex;
+    std::vector<const Shard*> shards;
+    MetricsSnapshot retired{};      // shards of threads that have exited
+    std::atomic<int64_t> gauges[kGaugeCount];
+
+    Registry() {
+        for (auto& gauge : gauges) {
+            gauge.store(0, std::memory_order_relaxed);
+        }
+    }
+};
+
+// Never destroyed: threads may still exit after static destructors ran
+Registry& registry() {
+    static Registry* instance = new Registry();
+    return *instance;
+}
+
+// Registers the thread's shard on its first metric and folds it into the
+// totals when the thread exits
+struct ShardOwner {
+    Shard* shard;
+
+    ShardOwner() : shard(new Shard()) {
+        Registry& metrics = registry();
+        std::lock_guard<std::mutex> lock(metrics.mutex);
+        metrics.shards.push_back(shard);
+    }
+
+    ~ShardOwner() {
+        Registry& metrics = registry();
+        {
+            std::lock_guard<std::mutex> lock(metrics.mutex);
+            accumulate(*shard, metrics.retired);
+            metrics.shards.erase(std::find(metrics.shards.begin(), metrics.shards.end(), shard));
+        }
+        delete shard;
+    }
+};
+
+Shard& localShard() {
+    thread_local ShardOwner owner;
+    return *owner.shard;
+}
+
+void appendf(std::string& out, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+void appendf(std::string& out, const char* format, ...) {
+    char buffer[256];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (length > 0) {
+        out.append(buffer, std::min(static_cast<size_t>(length), sizeof(buffer) - 1));
+    }
+}
+
+} // namespace
+
+uint64_t HistogramSnapshot::percentile(double fraction) const {
+    if (count == 0) {
+        return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(std::ceil(fraction * static_cast<double>(count)));
+    rank = std::max<uint64_t>(rank, 1);
+    uint64_t seen = 0;
+    for (size_t b = 0; b < kBuckets; b++) {
+        seen += buckets[b];
+        if (seen >= rank) {
+            if (b == 0) {
+                return 0;
+            }
+            uint64_t upper = b + 1 < kBuckets ? (uint64_t{1} << b) - 1 : max;
+            return std::min(upper, max);
+        }
+    }
+    return max;
+}
+
+std::string MetricsSnapshot::toJson() const {
+    std::string out = "{\"counters\":{";
+    for (size_t i = 0; i < kCounterCount; i++) {
+        appendf(out, "%s\"%s\":%llu", i > 0 ? "," : "", kCounterNames[i],
+                static_cast<unsigned long long>(counters[i]));
+    }
+    out += "},\"gauges\":{";
+    for (size_t i = 0; i < kGaugeCount; i++) {
+        appendf(out, "%s\"%s\":%lld", i > 0 ? "," : "", kGaugeNames[i],
+                static_cast<long long>(gauges[i]));
+    }
+    out += "},\"histograms\":{";
+    for (size_t i = 0; i < kHistogramCount; i++) {
+        const HistogramSnapshot& histogram = histograms[i];
+        appendf(out, "%s\"%s\":{\"count\":%llu,\"sum\":%llu,\"max\":%llu,", i > 0 ? "," : "",
+                kHistogramNames[i], static_cast<unsigned long long>(histogram.count),
+                static_cast<unsigned long long>(histogram.sum),
+                static_cast<unsigned long long>(histogram.max));
+        appendf(out, "\"p50\":%llu,\"p90\":%llu,\"p99\":%llu}",
+                static_cast<unsigned long long>(histogram.percentile(0.50)),
+                static_cast<unsigned long long>(histogram.percentile(0.90)),
+                static_cast<unsigned long long>(histogram.percentile(0.99)));
+    }
+    uint64_t hits = counter(Counter::CacheHitsByFile) + counter(Counter::CacheHitsByDigest);
+    uint64_t lookups = hits + counter(Counter::CacheMisses);
+    appendf(out, "},\"cache_hit_rate\":%.3f}",
+            lookups > 0 ? static_cast<double>(hits) / static_cast<double>(lookups) : 0.0);
+    return out;
+}
+
+void Metrics::count(Counter counter, uint64_t amount) {
+    bump(localShard().counters[static_cast<size_t>(counter)], amount);
+}
+
+void Metrics::record(Histogram histogram, uint64_t value) {
+    Shard::Distribution& distribution = localShard().histograms[static_cast<size_t>(histogram)];
+    bump(distribution.buckets[bucketOf(value)], 1);
+    bump(distribution.count, 1);
+    bump(distribution.sum, value);
+    if (value > distribution.max.load(std::memory_order_relaxed)) {
+        distribution.max.store(value, std::memory_order_relaxed);
+    }
+}
+
+void Metrics::set(Gauge gauge, int64_t value) {
+    registry().gauges[static_cast<size_t>(gauge)].store(value, std::memory_order_relaxed);
+}
+
+MetricsSnapshot Metrics::snapshot() {
+    Registry& metrics = registry();
+    std::lock_guard<std::mutex> lock(metrics.mutex);
+    MetricsSnapshot snapshot = metrics.retired;
+    for (const Shard* shard : metrics.shards) {
+        accumulate(*shard, snapshot);
+    }
+    for (size_t i = 0; i < kGaugeCount; i++) {
+        snapshot.gauges[i] = metrics.gauges[i].load(std::memory_order_relaxed);
+    }
+    return snapshot;
+}
+
+ScopedStage::ScopedStage(Histogram histogram, const char* traceName)
+    : histogram_(histogram), start_(std::chrono::steady_clock::now()), finished_(false) {
+#if defined(WHATSZAP_ATRACE)
+    ATrace_beginSection(traceName);
+#else
+    (void)traceName;
+#endif
+}
+
+void ScopedStage::finish() {
+    if (finished_) {
+        return;
+    }
+    finished_ = true;
+#if defined(WHATSZAP_ATRACE)
+    ATrace_endSection();
+#endif
+    Metrics::record(histogram_, static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start_).count()));
+}
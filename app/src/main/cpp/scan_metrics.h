@@ -0,0 +1,121 @@
+#ifndef WHATSZAP_SCAN_METRICS_H
+#define WHATSZAP_SCAN_METRICS_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Events counted as they happen
+enum class Counter : uint32_t {
+    InotifyEvents,
+    FanotifyEvents,
+    FilesReported,
+    EarlyVerdicts,
+    StreamedBytes,      // read from files still being written
+    ScansStarted,
+    ScansCancelled,
+    ScansPartial,
+    CacheHitsByFile,
+    CacheHitsByDigest,
+    CacheMisses,
+    BytesScanned,       // archive bytes hashed and analyzed
+    JobsRejected,       // scan queue full
+    Count
+};
+
+// Distributions of a value, in log2 buckets
+enum class Histogram : uint32_t {
+    InotifyBatch,       // events per inotify read
+    QueueDepth,         // unfinished jobs, sampled at each submit
+    QueueWaitUs,        // submit to start of the scan
+    ScanUs,             // whole scanApk call, cache hits included
+    HashUs,
+    ManifestUs,
+    ContentUs,          // entry analyzers
+    VerdictUs,          // scoring, classifier and cache store
+    JniCallbackUs,      // time spent in calls into Java
+    Count
+};
+
+// Current levels, set rather than added to
+enum class Gauge : uint32_t {
+    PendingScans,
+    PendingFiles,       // created but not yet complete
+    Watches,
+    Count
+};
+
+constexpr size_t kCounterCount = static_cast<size_t>(Counter::Count);
+constexpr size_t kHistogramCount = static_cast<size_t>(Histogram::Count);
+constexpr size_t kGaugeCount = static_cast<size_t>(Gauge::Count);
+
+struct HistogramSnapshot {
+    // Bucket 0 holds 0, bucket b holds [2^(b-1), 2^b); the last one
+    // everything above
+    static constexpr size_t kBuckets = 32;
+
+    uint64_t buckets[kBuckets];
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+
+    // Upper bound of the bucket holding that rank, so exact to within a
+    // factor of two; 0 when empty
+    uint64_t percentile(double fraction) const;
+};
+
+struct MetricsSnapshot {
+    uint64_t counters[kCounterCount];
+    HistogramSnapshot histograms[kHistogramCount];
+    int64_t gauges[kGaugeCount];
+
+    uint64_t counter(Counter counter) const { return counters[static_cast<size_t>(counter)]; }
+    const HistogramSnapshot& histogram(Histogram histogram) const {
+        return histograms[static_cast<size_t>(histogram)];
+    }
+
+    // One JSON object: counters, gauges, count/sum/max/p50/p90/p99 per
+    // histogram and the verdict cache hit rate
+    std::string toJson() const;
+};
+
+// Process-wide counters and histograms for the scanner and the watcher.
+//
+// Each thread writes to a shard of its own with relaxed atomic stores, so
+// recording takes no lock and shares no cache line with other writers.
+// snapshot() sums the shards under the registry lock; a shard is folded
+// into the totals when its thread exits, so nothing counted is lost.
+// Gauges are single process-wide values.
+class Metrics {
+public:
+    static void count(Counter counter, uint64_t amount = 1);
+    static void record(Histogram histogram, uint64_t value);
+    static void set(Gauge gauge, int64_t value);
+
+    static MetricsSnapshot snapshot();
+};
+
+// Times a stage into a histogram, in microseconds, when finished or at the
+// end of the scope. With WHATSZAP_ATRACE the stage is also an ATrace
+// section, shown by Perfetto and systrace when the app is traced. Sections
+// end in reverse order of starting on the same thread, so stages nest or
+// follow each other, never overlap.
+class ScopedStage {
+public:
+    ScopedStage(Histogram histogram, const char* traceName);
+    ~ScopedStage() { finish(); }
+
+    ScopedStage(const ScopedStage&) = delete;
+    ScopedStage& operator=(const ScopedStage&) = delete;
+
+    // End the stage before the scope does; later calls do nothing
+    void finish();
+
+private:
+    Histogram histogram_;
+    std::chrono::steady_clock::time_point start_;
+    bool finished_;
+};
+
+#endif // WHATSZAP_SCAN_METRICS_H
@@ -0,0 +1,160 @@
+#include "scan_pipeline.h"
+#include <algorithm>
+#include <utility>
+
+namespace {
+
+constexpr size_t kFindingSlots = static_cast<size_t>(ScanRun::Finding::Count);
+
+// An accepting analyzer and its pass over the current entry
+struct Stage {
+    const EntryAnalyzer* analyzer;
+    ArenaPtr<EntryPass> pass;
+    bool reading;               // still takes chunks
+};
+
+} // namespace
+
+ScanRun::ScanRun(const SignatureDatabase& database, const ScanDeadline& deadline,
+                 const std::atomic<bool>* cancelled, int confidence, int threshold,
+                 ScanArena& arena)
+    : database_(database), deadline_(deadline), cancelled_(cancelled), threshold_(threshold),
+      confidence_(confidence), stopped_(false),
+      reported_(kFindingSlots + database.signatureCount(),
+                ArenaAllocator<std::atomic<bool>>(arena)) {
+}
+
+void ScanRun::claim(size_t slot, int weight) {
+    if (slot < reported_.size() && !reported_[slot].exchange(true, std::memory_order_relaxed)) {
+        confidence_.fetch_add(weight, std::memory_order_relaxed);
+    }
+}
+
+void ScanRun::report(Finding finding, int weight) {
+    claim(static_cast<size_t>(finding), weight);
+}
+
+void ScanRun::reportSignature(uint32_t signatureId, int weight) {
+    claim(kFindingSlots + signatureId, weight);
+}
+
+void ScanPipeline::add(std::unique_ptr<EntryAnalyzer> analyzer) {
+    auto position = std::upper_bound(
+        analyzers_.begin(), analyzers_.end(), analyzer->cost(),
+        [](AnalyzerCost cost, const std::unique_ptr<EntryAnalyzer>& other) {
+            return cost < other->cost();
+        });
+    analyzers_.insert(position, std::move(analyzer));
+}
+
+bool ScanPipeline::accepts(const ZipEntry& entry) const {
+    for (const auto& analyzer : analyzers_) {
+        if (analyzer->accepts(entry)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void ScanPipeline::analyzeEntry(const ZipArchive& archive, const ZipEntry& entry,
+                                std::string_view name, ScanRun& run,
+                                EntryFindings& findings) const {
+    if (run.stopped()) {
+        return;
+    }
+    if (run.expired()) {
+        findings.incomplete = true;
+        run.stop();
+        return;
+    }
+
+    // This worker's arena; released when the entry is done
+    ArenaScope entryScope(ScanArena::local());
+    ScanArena& arena = entryScope.arena();
+    EntryContext context{entry, name, run};
+    ArenaVector<Stage> stages{ArenaAllocator<Stage>(arena)};
+    stages.reserve(analyzers_.size());
+    bool wantsWhole = false;
+    bool wantsChunks = false;
+    for (const auto& analyzer : analyzers_) {
+        if (!analyzer->accepts(entry)) {
+            continue;
+        }
+        bool whole = analyzer->needsWholeEntry();
+        if (whole && entry.uncompressedSize > kMaxWholeEntrySize) {
+            continue;
+        }
+        stages.push_back(Stage{analyzer.get(), analyzer->begin(context, arena), !whole});
+        wantsWhole = wantsWhole || whole;
+        wantsChunks = wantsChunks || !whole;
+    }
+    if (stages.empty()) {
+        return;
+    }
+
+    // In place when stored (native libraries usually are, page-aligned),
+    // inflated once otherwise; the chunks are then cut from this buffer
+    const uint8_t* content = nullptr;
+    size_t contentSize = 0;
+    if (wantsWhole) {
+        if (entry.isStored()) {
+            std::string_view raw = archive.rawData(entry);
+            content = reinterpret_cast<const uint8_t*>(raw.data());
+            contentSize = raw.size();
+        } else {
+            size_t capacity = static_cast<size_t>(entry.uncompressedSize);
+            uint8_t* inflated = arena.allocateArray<uint8_t>(capacity);
+            if (archive.extractEntry(entry, inflated, capacity, contentSize)) {
+                content = inflated;
+            } else {
+                contentSize = 0;
+            }
+        }
+        if (contentSize == 0) {
+            content = nullptr;
+        }
+    }
+
+    auto feed = [&](const uint8_t* data, size_t length) {
+        bool reading = false;
+        for (Stage& stage : stages) {
+            if (stage.reading) {
+                stage.reading = stage.pass->update(data, length);
+                reading = reading || stage.reading;
+            }
+        }
+        if (run.expired()) {
+            findings.incomplete = true;
+            run.stop();
+            return false;
+        }
+        return reading && !run.stopped();
+    };
+    if (wantsChunks) {
+        if (content == nullptr) {
+            archive.readEntry(entry, feed);
+        } else {
+            for (size_t offset = 0; offset < contentSize; offset += ZipArchive::kChunkSize) {
+                if (!feed(content + offset, std::min(ZipArchive::kChunkSize, contentSize - offset))) {
+                    break;
+                }
+            }
+        }
+    }
+
+    // Costlier stages are worth running after a match in this entry; not
+    // once the verdict is settled or the budget is gone
+    if (content != nullptr && !findings.incomplete) {
+        for (Stage& stage : stages) {
+            if (run.stopped()) {
+                break;
+            }
+            if (stage.analyzer->needsWholeEntry()) {
+                stage.pass->analyze(content, contentSize);
+            }
+        }
+    }
+    for (Stage& stage : stages) {
+        stage.pass->finish(findings);
+    }
+}
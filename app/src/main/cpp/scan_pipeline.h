@@ -0,0 +1,182 @@
+#ifndef WHATSZAP_SCAN_PIPELINE_H
+#define WHATSZAP_SCAN_PIPELINE_H
+
+#include "fuzzy_hash.h"
+#include "scan_arena.h"
+#include "scan_result.h"
+#include "signature_pack.h"
+#include "zip_reader.h"
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// Wall-clock budget for one scan, measured on the monotonic clock.
+// A budget of zero or less never expires.
+class ScanDeadline {
+public:
+    explicit ScanDeadline(long budgetMs)
+        : start_(std::chrono::steady_clock::now()), budgetMs_(budgetMs) {}
+
+    long elapsedMs() const {
+        return static_cast<long>(std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start_).count());
+    }
+
+    bool expired() const { return budgetMs_ > 0 && elapsedMs() >= budgetMs_; }
+
+private:
+    std::chrono::steady_clock::time_point start_;
+    long budgetMs_;
+};
+
+// What the content analyzers found in one entry
+struct EntryFindings {
+    bool suspiciousContent = false;
+    bool incomplete = false;        // budget ran out while analyzing it
+    std::vector<uint32_t> apiSignatures;    // DexApi matches, dex entries only
+    std::vector<uint32_t> symbolSignatures; // ElfSymbol matches, native libraries only
+    bool packedLibrary = false;
+    bool measured = false;          // entropy below was taken
+    bool encryptedPayload = false;  // and looks encrypted
+    EntryEntropy entropy;
+    bool hasDigest = false;         // whole dex file digested
+    FuzzyDigest digest;
+};
+
+// State shared by the entry tasks of one scan: the running confidence,
+// which decides when the rest of the analysis can be skipped, and the
+// reasons to stop early
+class ScanRun {
+public:
+    // Findings that count once per scan, besides signature matches
+    enum class Finding : uint32_t {
+        SuspiciousContent,
+        PackedLibrary,
+        EncryptedPayload,
+        Count
+    };
+
+    // `confidence` is what the scan reached before the content pass
+    ScanRun(const SignatureDatabase& database, const ScanDeadline& deadline,
+            const std::atomic<bool>* cancelled, int confidence, int threshold, ScanArena& arena);
+
+    ScanRun(const ScanRun&) = delete;
+    ScanRun& operator=(const ScanRun&) = delete;
+
+    const SignatureDatabase& database() const { return database_; }
+
+    // Add `weight` to the running confidence, the first time in this scan
+    // a finding or signature is reported; later reports add nothing
+    void report(Finding finding, int weight);
+    void reportSignature(uint32_t signatureId, int weight);
+
+    int confidence() const { return confidence_.load(std::memory_order_relaxed); }
+
+    // The threshold is reached. Scores only grow, so no further analysis
+    // can clear the file.
+    bool settled() const { return confidence() >= threshold_; }
+
+    bool cancelled() const {
+        return cancelled_ != nullptr && cancelled_->load(std::memory_order_relaxed);
+    }
+    bool expired() const { return deadline_.expired(); }
+
+    // No more entries are read: the budget ran out or a verdict is final
+    void stop() { stopped_.store(true, std::memory_order_relaxed); }
+    bool stopped() const {
+        return stopped_.load(std::memory_order_relaxed) || settled() || cancelled();
+    }
+
+private:
+    void claim(size_t slot, int weight);
+
+    const SignatureDatabase& database_;
+    const ScanDeadline& deadline_;
+    const std::atomic<bool>* cancelled_;
+    const int threshold_;
+    std::atomic<int> confidence_;
+    std::atomic<bool> stopped_;
+    // Finding slots first, then one per signature
+    ArenaVector<std::atomic<bool>> reported_;
+};
+
+// Relative cost of an analyzer over one entry. Stages run cheapest first,
+// and a settled verdict skips those not yet started.
+enum class AnalyzerCost : int {
+    Cheap = 0,          // a table lookup or two per byte, during inflation
+    Moderate = 1,       // heavier per-byte work, such as a rolling digest
+    Expensive = 2       // random access over the whole inflated entry
+};
+
+// The entry an analyzer runs over
+struct EntryContext {
+    const ZipEntry& entry;
+    std::string_view name;          // as reported: qualified by the split inside a bundle
+    ScanRun& run;
+};
+
+// One analyzer's work on one entry
+class EntryPass {
+public:
+    virtual ~EntryPass() {}
+
+    // Next inflated bytes of the entry, in order; return false once no
+    // more are needed. Not called for analyzers that need the whole entry.
+    virtual bool update(const uint8_t*, size_t) { return true; }
+
+    // The whole entry in one buffer, for analyzers that asked for it
+    virtual void analyze(const uint8_t*, size_t) {}
+
+    // Record what was found; called once, even if the entry was not read
+    // to the end
+    virtual void finish(EntryFindings& findings) = 0;
+};
+
+// A content check registered with the pipeline. Analyzers hold no state
+// of their own; begin() makes a pass for each entry they accept, in the
+// arena of the thread analyzing it.
+class EntryAnalyzer {
+public:
+    virtual ~EntryAnalyzer() {}
+
+    virtual const char* name() const = 0;
+    virtual AnalyzerCost cost() const = 0;
+    // Tables read at random need the entry whole: viewed in place when
+    // stored, inflated once otherwise. Entries over kMaxWholeEntrySize
+    // are not given to such analyzers.
+    virtual bool needsWholeEntry() const { return false; }
+    virtual bool accepts(const ZipEntry& entry) const = 0;
+    virtual ArenaPtr<EntryPass> begin(const EntryContext& context, ScanArena& arena) const = 0;
+};
+
+// Content pass over the entries of an APK. Each entry is read once, by a
+// single producer that views or inflates it and hands the same chunks to
+// every analyzer that accepts it; analyzers that need it whole then get
+// the buffer the chunks came from. Between stages and between chunks the
+// shared ScanRun is checked, so once the verdict is settled the costlier
+// stages of every entry still pending are skipped.
+class ScanPipeline {
+public:
+    // Larger entries are only streamed
+    static constexpr size_t kMaxWholeEntrySize = 64 * 1024 * 1024;
+
+    // Register before the first scan; analyzers are kept in order of cost
+    void add(std::unique_ptr<EntryAnalyzer> analyzer);
+
+    // Whether any analyzer wants the entry
+    bool accepts(const ZipEntry& entry) const;
+
+    // Run every accepting analyzer over one entry of `archive`. Safe to
+    // call for different entries concurrently.
+    void analyzeEntry(const ZipArchive& archive, const ZipEntry& entry, std::string_view name,
+                      ScanRun& run, EntryFindings& findings) const;
+
+private:
+    std::vector<std::unique_ptr<EntryAnalyzer>> analyzers_;
+};
+
+#endif // WHATSZAP_SCAN_PIPELINE_H
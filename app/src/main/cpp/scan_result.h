@@ -0,0 +1,115 @@
+#ifndef WHATSZAP_SCAN_RESULT_H
+#define WHATSZAP_SCAN_RESULT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "axml_parser.h"
+#include "file_digest.h"
+#include "threat.h"
+
+// Outcome of an online reputation lookup (VirusTotal) for a file hash
+struct ReputationVerdict {
+    bool isKnown;               // the service had a report for the hash
+    int detections;
+    int engines;
+    std::vector<std::string> threatNames;
+    
+    ReputationVerdict() : isKnown(false), detections(0), engines(0) {}
+};
+
+// Byte entropy of one entry, as measured by the content pass
+struct EntryEntropy {
+    std::string name;
+    double entropy;             // bits per byte over the whole entry
+    double peakWindowEntropy;   // highest over any 64 KB window
+    uint64_t bytesMeasured;     // less than the entry if the scan stopped early
+};
+
+// The app as installed would present itself, summarized from the manifest
+// and the central directories already read for the scan: for display, and
+// for the app risk score that stands beside the malware confidence
+struct AppProfile {
+    std::vector<std::string> dangerousPermissions;  // runtime permissions guarding user data
+    std::vector<std::string> highRiskPermissions;   // rarely needed by a legitimate app
+    bool suspiciousPackageName;     // poses as a platform vendor or advertises a hack
+    bool hasManifest;
+    bool hasDex;
+    bool hasNativeLibraries;
+    uint32_t dexCount;
+    std::vector<std::string> suspiciousFiles;       // embedded APKs, JARs, hidden dex files
+    int riskScore;                  // 0-100
+    uint64_t fileSize;
+
+    AppProfile()
+        : suspiciousPackageName(false), hasManifest(false), hasDex(false),
+          hasNativeLibraries(false), dexCount(0), riskScore(0), fileSize(0) {}
+
+    // Not an installable APK as it stands
+    bool hasInvalidStructure() const { return !hasManifest || !hasDex; }
+    // Multidex this wide is more often obfuscation than size
+    bool hasExcessiveDex() const { return dexCount > 5; }
+};
+
+// What the classifier sees of a scan, in this order. A model is trained on
+// a prefix of it, so inputs are only ever appended.
+enum class ModelInput : uint8_t {
+    FileSizeLog2,               // log2 of the size in bytes
+    PermissionCount,
+    DangerousPermissions,
+    HighRiskPermissions,
+    ComponentCount,
+    SuspiciousPackageName,      // 0 or 1
+    InvalidStructure,           // 0 or 1
+    DexCount,
+    NativeLibraries,            // 0 or 1
+    SuspiciousFiles,
+    SuspiciousPermissions,      // the rest count threats of each kind
+    KnownPackages,
+    SuspiciousContent,
+    SuspiciousApis,
+    SuspiciousNativeSymbols,
+    PackedLibraries,
+    EncryptedPayloads,
+    KnownMalwareDistance,       // to the closest known sample; kFarFromKnownMalware if none
+    MaxEntropy,                 // bits per byte, highest of the measured entries
+    MaxWindowEntropy,
+    MeasuredEntries,
+    Count
+};
+
+constexpr size_t kModelInputCount = static_cast<size_t>(ModelInput::Count);
+constexpr float kFarFromKnownMalware = 255;
+
+struct ModelInputs {
+    float values[kModelInputCount];
+
+    ModelInputs() : values() {}
+
+    float& operator[](ModelInput input) { return values[static_cast<size_t>(input)]; }
+    float operator[](ModelInput input) const { return values[static_cast<size_t>(input)]; }
+};
+
+struct ScanResult {
+    bool isMalicious;
+    int confidence;
+    ThreatList threats;
+    long scanDuration;          // milliseconds
+    bool isPartial;             // budget ran out, or a split was too large, before all content was analyzed
+    bool isCached;              // served from the verdict cache
+    bool isCancelled;           // stopped on request; the verdict means nothing
+    ManifestInfo manifest;
+    AppProfile app;
+    FileDigests digests;        // whole-file hashes, for reputation lookups
+    ReputationVerdict reputation;
+    std::vector<EntryEntropy> entryEntropy;     // every measured entry, in scan order
+    ModelInputs modelInputs;
+    int modelScore;             // 0-100 from the classifier, -1 without a model
+    
+    ScanResult()
+        : isMalicious(false), confidence(0), scanDuration(0), isPartial(false), isCached(false),
+          isCancelled(false), modelScore(-1) {}
+};
+
+#endif // WHATSZAP_SCAN_RESULT_H
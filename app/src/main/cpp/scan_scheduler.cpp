@@ -0,0 +1,134 @@
+#include "scan_scheduler.h"
+#include "malware_scanner.h"
+#include "native-lib.h"
+#include "scan_metrics.h"
+
+ScanScheduler::ScanScheduler(MalwareScanner& scanner, ScanCompletion onComplete,
+                             size_t maxPendingJobs)
+    : scanner_(scanner), onComplete_(std::move(onComplete)), maxPendingJobs_(maxPendingJobs),
+      activeJobs_(0), nextJobId_(1), stopping_(false), pool_(new WorkerPool(0)) {
+    scanner_.setWorkerPool(pool_.get());
+}
+
+ScanScheduler::~ScanScheduler() {
+    // Queued jobs are dropped without a callback; running ones are
+    // cancelled and stop at their next entry boundary, before the pool's
+    // threads are joined
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+        for (auto& job : jobs_) {
+            job.second.cancelled->store(true, std::memory_order_relaxed);
+        }
+    }
+    // Detach the pool first: a scan started from now on, on any thread,
+    // runs without it. Scans that already hold it finish before the
+    // reset below returns, as it joins the workers.
+    scanner_.setWorkerPool(nullptr);
+    pool_.reset();
+}
+
+uint64_t ScanScheduler::submit(const std::string& apkPath, TaskPriority priority,
+                               long budgetMs) {
+    uint64_t jobId;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_ || activeJobs_ >= maxPendingJobs_) {
+            LOGW("Scan queue full (%zu jobs); rejecting %s", activeJobs_, apkPath.c_str());
+            Metrics::count(Counter::JobsRejected);
+            return 0;
+        }
+        jobId = nextJobId_++;
+        jobs_[jobId] = Job{apkPath, budgetMs, ScanJobState::Queued,
+                           std::chrono::steady_clock::now(),
+                           std::make_shared<std::atomic<bool>>(false)};
+        activeJobs_++;
+        Metrics::record(Histogram::QueueDepth, activeJobs_);
+        Metrics::set(Gauge::PendingScans, static_cast<int64_t>(activeJobs_));
+    }
+    pool_->submit([this, jobId] { run(jobId); }, priority);
+    return jobId;
+}
+
+bool ScanScheduler::cancel(uint64_t jobId) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = jobs_.find(jobId);
+    if (it == jobs_.end()) {
+        return false;
+    }
+    Job& job = it->second;
+    if (job.state == ScanJobState::Queued) {
+        job.state = ScanJobState::Cancelled;
+        activeJobs_--;
+        Metrics::set(Gauge::PendingScans, static_cast<int64_t>(activeJobs_));
+        return true;
+    }
+    if (job.state == ScanJobState::Running) {
+        // Still counted as active until the scan has actually stopped
+        job.state = ScanJobState::Cancelled;
+        job.cancelled->store(true, std::memory_order_relaxed);
+        return true;
+    }
+    return false;
+}
+
+ScanJobState ScanScheduler::status(uint64_t jobId) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = jobs_.find(jobId);
+    return it == jobs_.end() ? ScanJobState::Unknown : it->second.state;
+}
+
+size_t ScanScheduler::pendingCount() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return activeJobs_;
+}
+
+void ScanScheduler::run(uint64_t jobId) {
+    std::string apkPath;
+    long budgetMs;
+    std::shared_ptr<std::atomic<bool>> cancelled;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        auto it = jobs_.find(jobId);
+        if (it == jobs_.end()) {
+            return;
+        }
+        if (stopping_ || it->second.state == ScanJobState::Cancelled) {
+            bool notify = !stopping_;
+            if (it->second.state != ScanJobState::Cancelled) {
+                activeJobs_--;
+                Metrics::set(Gauge::PendingScans, static_cast<int64_t>(activeJobs_));
+            }
+            jobs_.erase(it);
+            lock.unlock();
+            if (notify) {
+                onComplete_(jobId, nullptr);
+            }
+            return;
+        }
+        it->second.state = ScanJobState::Running;
+        Metrics::record(Histogram::QueueWaitUs, static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - it->second.queuedAt).count()));
+        apkPath = it->second.apkPath;
+        budgetMs = it->second.budgetMs;
+        cancelled = it->second.cancelled;
+    }
+
+    ScanResult result = scanner_.scanApk(apkPath, budgetMs, cancelled.get());
+    bool shuttingDown;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        shuttingDown = stopping_;
+    }
+    if (!result.isCancelled) {
+        onComplete_(jobId, &result);
+    } else if (!shuttingDown) {
+        onComplete_(jobId, nullptr);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    jobs_.erase(jobId);
+    activeJobs_--;
+    Metrics::set(Gauge::PendingScans, static_cast<int64_t>(activeJobs_));
+}
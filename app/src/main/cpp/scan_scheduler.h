@@ -0,0 +1,80 @@
+#ifndef WHATSZAP_SCAN_SCHEDULER_H
+#define WHATSZAP_SCAN_SCHEDULER_H
+
+#include "scan_result.h"
+#include "worker_pool.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+class MalwareScanner;
+
+enum class ScanJobState : int {
+    Unknown = 0,        // never submitted, or its result was already delivered
+    Queued = 1,
+    Running = 2,
+    Cancelled = 3
+};
+
+// Receives every finished job on a worker thread. `result` is null for
+// cancelled jobs.
+using ScanCompletion = std::function<void(uint64_t jobId, const ScanResult* result)>;
+
+// Runs scans on a WorkerPool sized to the big cores, highest priority
+// first, so a burst of downloads is scanned a few at a time instead of
+// all at once. The number of unfinished jobs is bounded: submit() rejects
+// work when the queue is full and the caller decides whether to retry.
+class ScanScheduler {
+public:
+    ScanScheduler(MalwareScanner& scanner, ScanCompletion onComplete,
+                  size_t maxPendingJobs = kDefaultMaxPendingJobs);
+    ~ScanScheduler();
+
+    ScanScheduler(const ScanScheduler&) = delete;
+    ScanScheduler& operator=(const ScanScheduler&) = delete;
+
+    // Queue a scan; returns its job ID, or 0 if the queue is full
+    uint64_t submit(const std::string& apkPath, TaskPriority priority, long budgetMs);
+
+    // Cancel a job. A queued job is dropped; a running one stops at its
+    // next entry boundary. Either way it completes with a null result.
+    bool cancel(uint64_t jobId);
+
+    ScanJobState status(uint64_t jobId) const;
+    size_t pendingCount() const;
+
+    static constexpr size_t kDefaultMaxPendingJobs = 32;
+
+private:
+    struct Job {
+        std::string apkPath;
+        long budgetMs;
+        ScanJobState state;
+        std::chrono::steady_clock::time_point queuedAt;
+        // Read by the running scan without the lock
+        std::shared_ptr<std::atomic<bool>> cancelled;
+    };
+
+    void run(uint64_t jobId);
+
+    MalwareScanner& scanner_;
+    ScanCompletion onComplete_;
+    size_t maxPendingJobs_;
+
+    mutable std::mutex mutex_;
+    std::unordered_map<uint64_t, Job> jobs_;
+    size_t activeJobs_;         // queued or running, not cancelled
+    uint64_t nextJobId_;
+    bool stopping_;
+
+    // Also lent to the scanner for per-entry work; torn down explicitly
+    // in the destructor, after the scanner stops referencing it
+    std::unique_ptr<WorkerPool> pool_;
+};
+
+#endif // WHATSZAP_SCAN_SCHEDULER_H
@@ -0,0 +1,100 @@
+#include "score_table.h"
+#include <algorithm>
+
+namespace {
+
+// Indexed by ThreatId
+constexpr Feature kThreatFeatures[] = {
+    Feature::None,                  // NoThreats
+    Feature::None,                  // FileNotFound
+    Feature::SmallApk,
+    Feature::LargeApk,
+    Feature::CorruptArchive,
+    Feature::MissingManifest,
+    Feature::SuspiciousPermission,
+    Feature::KnownPackage,
+    Feature::SuspiciousContent,
+    Feature::SuspiciousSignature,   // SuspiciousApi
+    Feature::SuspiciousSignature,   // SuspiciousNativeSymbol
+    Feature::PackedLibrary,
+    Feature::EncryptedPayload,
+    Feature::SimilarToKnownMalware, // or CloseToKnownMalware, by distance
+    Feature::None,                  // BudgetExceeded
+    Feature::None                   // ScanError
+};
+
+static_assert(sizeof(kThreatFeatures) / sizeof(kThreatFeatures[0]) ==
+                  static_cast<size_t>(ThreatId::ScanError) + 1,
+              "one feature per threat");
+
+// Reputation tiers, highest first: at least `detections` engines flag the
+// file. A file the service knows but nobody flags still counts for a little.
+struct ReputationTier {
+    int detections;
+    int confidence;
+};
+
+constexpr ReputationTier kReputationTiers[] = {
+    {10, 50},
+    {5, 40},
+    {1, 30},
+    {0, 10}
+};
+
+// Shares of the app risk score and of the scan confidence, in percent
+constexpr int kRiskScoreShare = 30;
+constexpr int kScanConfidenceShare = 20;
+
+// App risk score at which the combined verdict is malicious on its own
+constexpr int kMaliciousRiskScore = 50;
+
+// Offline, the model score is scaled to the top reputation tier, and is
+// malicious on its own when the model is this sure
+constexpr int kModelScoreShare = 50;
+constexpr int kMaliciousModelScore = 80;
+
+} // namespace
+
+Feature threatFeature(const Threat& threat) {
+    size_t index = static_cast<size_t>(threat.id);
+    if (index >= sizeof(kThreatFeatures) / sizeof(kThreatFeatures[0])) {
+        return Feature::None;
+    }
+    if (threat.id == ThreatId::SimilarToKnownMalware && threat.value <= kCloseFuzzyDistance) {
+        return Feature::CloseToKnownMalware;
+    }
+    return kThreatFeatures[index];
+}
+
+ScanFeatures featuresOf(const ThreatList& threats) {
+    ScanFeatures features;
+    for (const Threat& threat : threats.threats()) {
+        features.add(threatFeature(threat));
+    }
+    return features;
+}
+
+CombinedVerdict combineVerdict(const VerdictInputs& inputs) {
+    int confidence = 0;
+    if (inputs.reputationKnown) {
+        for (const ReputationTier& tier : kReputationTiers) {
+            if (inputs.detections >= tier.detections) {
+                confidence = tier.confidence;
+                break;
+            }
+        }
+    }
+    bool modelMalicious = false;
+    if (!inputs.reputationKnown && inputs.modelScore >= 0) {
+        confidence = inputs.modelScore * kModelScoreShare / 100;
+        modelMalicious = inputs.modelScore >= kMaliciousModelScore;
+    }
+    confidence += inputs.riskScore * kRiskScoreShare / 100;
+    confidence += inputs.scanConfidence * kScanConfidenceShare / 100;
+
+    CombinedVerdict verdict;
+    verdict.confidence = std::min(confidence, 100);
+    verdict.isMalicious = inputs.reputationMalicious || modelMalicious ||
+                          inputs.riskScore >= kMaliciousRiskScore || inputs.scanMalicious;
+    return verdict;
+}
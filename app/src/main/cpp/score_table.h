@@ -0,0 +1,193 @@
+#ifndef WHATSZAP_SCORE_TABLE_H
+#define WHATSZAP_SCORE_TABLE_H
+
+#include "threat.h"
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Confidence scoring as data. What a scan finds is counted into a
+// FeatureVector, one slot per feature, and scored against a rule table
+// built at compile time: each rule gives a feature's weight per occurrence
+// and the most it can add. Scoring is one pass over the slots with no
+// branches or string compares, so it costs the same however many threats
+// were found; a new rule is a new row and, if needed, a new feature.
+
+// Confidence at which an APK is reported as malicious
+constexpr int kMaliciousThreshold = 30;
+
+// Fuzzy digests at most this far from a known-bad file are the same
+// sample with cosmetic changes; further ones are a close relative
+constexpr int kCloseFuzzyDistance = 30;
+
+// What the confidence of a scan weighs. Threats map onto these one to one,
+// except that a fuzzy match splits by distance.
+enum class Feature : uint8_t {
+    None = 0,               // threats that carry no weight
+    SmallApk,
+    LargeApk,
+    CorruptArchive,
+    MissingManifest,
+    SuspiciousPermission,
+    KnownPackage,
+    SuspiciousContent,
+    SuspiciousSignature,    // referenced dex API or native symbol
+    PackedLibrary,
+    EncryptedPayload,
+    CloseToKnownMalware,
+    SimilarToKnownMalware,
+    Count
+};
+
+// What the app risk score of an AppProfile weighs
+enum class AppFeature : uint8_t {
+    HighRiskPermission = 0,
+    DangerousPermission,
+    SuspiciousPackageName,
+    InvalidStructure,
+    ExcessiveDex,
+    SuspiciousFile,
+    Count
+};
+
+template <typename FeatureId>
+struct ScoreRule {
+    FeatureId feature;
+    int16_t weight;         // per occurrence
+    int16_t cap;            // most the feature adds in total
+};
+
+constexpr int16_t kUncapped = INT16_MAX;
+
+template <typename FeatureId>
+constexpr size_t featureCount() {
+    return static_cast<size_t>(FeatureId::Count);
+}
+
+// Rules indexed by feature. Every feature needs exactly one rule; a table
+// that misses one or names one twice does not compile.
+template <typename FeatureId>
+struct ScoreTable {
+    std::array<int16_t, featureCount<FeatureId>()> weight;
+    std::array<int16_t, featureCount<FeatureId>()> cap;
+};
+
+template <typename FeatureId, size_t N>
+constexpr ScoreTable<FeatureId> buildScoreTable(const ScoreRule<FeatureId> (&rules)[N]) {
+    ScoreTable<FeatureId> table{};
+    std::array<bool, featureCount<FeatureId>()> seen{};
+    for (size_t i = 0; i < N; i++) {
+        size_t slot = static_cast<size_t>(rules[i].feature);
+        if (slot >= featureCount<FeatureId>() || seen[slot]) {
+            throw "feature ruled twice or out of range";
+        }
+        seen[slot] = true;
+        table.weight[slot] = rules[i].weight;
+        table.cap[slot] = rules[i].cap;
+    }
+    for (bool ruled : seen) {
+        if (!ruled) {
+            throw "feature without a rule";
+        }
+    }
+    return table;
+}
+
+constexpr ScoreRule<Feature> kScanRules[] = {
+    {Feature::None, 0, 0},
+    {Feature::SmallApk, 10, kUncapped},
+    {Feature::LargeApk, 5, kUncapped},
+    {Feature::CorruptArchive, 30, kUncapped},
+    {Feature::MissingManifest, 30, kUncapped},
+    {Feature::SuspiciousPermission, 5, kUncapped},
+    {Feature::KnownPackage, 25, kUncapped},
+    {Feature::SuspiciousContent, 20, kUncapped},
+    {Feature::SuspiciousSignature, 5, kUncapped},
+    {Feature::PackedLibrary, 10, kUncapped},
+    {Feature::EncryptedPayload, 10, kUncapped},
+    // Alone enough for a malicious verdict
+    {Feature::CloseToKnownMalware, kMaliciousThreshold, kUncapped},
+    {Feature::SimilarToKnownMalware, 15, kUncapped},
+};
+
+constexpr ScoreRule<AppFeature> kAppRules[] = {
+    {AppFeature::HighRiskPermission, 15, 45},
+    {AppFeature::DangerousPermission, 5, 25},
+    {AppFeature::SuspiciousPackageName, 15, kUncapped},
+    {AppFeature::InvalidStructure, 20, kUncapped},
+    {AppFeature::ExcessiveDex, 10, kUncapped},
+    {AppFeature::SuspiciousFile, 5, 15},
+};
+
+constexpr ScoreTable<Feature> kScanScoreTable = buildScoreTable(kScanRules);
+constexpr ScoreTable<AppFeature> kAppScoreTable = buildScoreTable(kAppRules);
+
+// Occurrences of each feature
+template <typename FeatureId>
+class FeatureVector {
+public:
+    FeatureVector() : counts_{} {}
+
+    void add(FeatureId feature, uint32_t count = 1) {
+        counts_[static_cast<size_t>(feature)] += count;
+    }
+
+    uint32_t count(FeatureId feature) const { return counts_[static_cast<size_t>(feature)]; }
+
+    // Sum over the rules, out of 100
+    int score(const ScoreTable<FeatureId>& table) const {
+        int total = 0;
+        for (size_t i = 0; i < counts_.size(); i++) {
+            int64_t weighted = static_cast<int64_t>(counts_[i]) * table.weight[i];
+            total += static_cast<int>(std::min<int64_t>(weighted, table.cap[i]));
+        }
+        return std::min(total, 100);
+    }
+
+private:
+    std::array<uint32_t, featureCount<FeatureId>()> counts_;
+};
+
+using ScanFeatures = FeatureVector<Feature>;
+using AppFeatures = FeatureVector<AppFeature>;
+
+constexpr int featureWeight(Feature feature) {
+    return kScanScoreTable.weight[static_cast<size_t>(feature)];
+}
+
+// The feature a reported threat counts as
+Feature threatFeature(const Threat& threat);
+
+// Features of everything in the list, for scoring a finished scan
+ScanFeatures featuresOf(const ThreatList& threats);
+
+// Confidence of a list of threats, out of 100
+inline int scoreThreats(const ThreatList& threats) {
+    return featuresOf(threats).score(kScanScoreTable);
+}
+
+// Inputs to the verdict shown to the user: the native scan, the app risk
+// score and whatever online reputation is known for the file
+struct VerdictInputs {
+    int scanConfidence;
+    bool scanMalicious;
+    int riskScore;
+    bool reputationKnown;
+    bool reputationMalicious;   // any engine flags the file as malicious or suspicious
+    int detections;             // engines flagging the file as malicious
+    int modelScore;             // the classifier's 0-100, -1 without a model
+};
+
+struct CombinedVerdict {
+    int confidence;             // 0-100
+    bool isMalicious;
+};
+
+// The reputation tier for the number of detections, plus fixed shares of
+// the app risk score and the scan confidence. Malicious if any one source
+// says so: the reputation, a high app risk score, or the scan itself.
+// Without a reputation the model score, if any, stands in for it.
+CombinedVerdict combineVerdict(const VerdictInputs& inputs);
+
+#endif // WHATSZAP_SCORE_TABLE_H
@@ -0,0 +1,64 @@
+// SHA-256 block function on the ARMv8 crypto extensions. Only built for
+// arm64-v8a, with this file compiled for armv8-a+crypto; file_digest.cpp
+// picks it at runtime when the CPU reports HWCAP_SHA2.
+
+#include <arm_neon.h>
+#include <cstddef>
+#include <cstdint>
+
+namespace {
+
+alignas(16) const uint32_t kRoundConstants[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+inline uint32x4_t loadMessageWords(const uint8_t* p) {
+    // Message words are big-endian
+    return vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(p)));
+}
+
+} // namespace
+
+void sha256CompressArmv8(uint32_t* state, const uint8_t* blocks, size_t blockCount) {
+    uint32x4_t abcd = vld1q_u32(state);
+    uint32x4_t efgh = vld1q_u32(state + 4);
+
+    for (; blockCount > 0; blockCount--, blocks += 64) {
+        uint32x4_t abcdSaved = abcd;
+        uint32x4_t efghSaved = efgh;
+
+        // msg[i % 4] holds W[4i .. 4i+3] for the current group of rounds
+        uint32x4_t msg[4] = {
+            loadMessageWords(blocks),
+            loadMessageWords(blocks + 16),
+            loadMessageWords(blocks + 32),
+            loadMessageWords(blocks + 48)
+        };
+
+        for (int group = 0; group < 16; group++) {
+            uint32x4_t& words = msg[group & 3];
+            uint32x4_t wk = vaddq_u32(words, vld1q_u32(kRoundConstants + group * 4));
+            uint32x4_t abcdBefore = abcd;
+            abcd = vsha256hq_u32(abcd, efgh, wk);
+            efgh = vsha256h2q_u32(efgh, abcdBefore, wk);
+            if (group < 12) {
+                // Expand W[4i+16 .. 4i+19] in place of the words just consumed
+                words = vsha256su1q_u32(vsha256su0q_u32(words, msg[(group + 1) & 3]),
+                                        msg[(group + 2) & 3], msg[(group + 3) & 3]);
+            }
+        }
+
+        abcd = vaddq_u32(abcd, abcdSaved);
+        efgh = vaddq_u32(efgh, efghSaved);
+    }
+
+    vst1q_u32(state, abcd);
+    vst1q_u32(state + 4, efgh);
+}
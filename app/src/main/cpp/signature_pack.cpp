@@ -0,0 +1,299 @@
+#include "signature_pack.h"
+#include "native-lib.h"
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <algorithm>
+#include <zlib.h>
+
+namespace {
+
+constexpr uint32_t kPackMagic = 0x50535A57;        // "WZSP"
+constexpr uint32_t kDeltaMagic = 0x44535A57;       // "WZSD"
+constexpr uint32_t kPackFormatVersion = 1;
+constexpr uint32_t kDeltaFormatVersion = 1;
+
+constexpr uint32_t kSectionSignatures = 0x53474953; // "SIGS"
+constexpr uint32_t kSectionMatcher = 0x46444341;    // "ACDF"
+constexpr uint32_t kSectionFuzzyIndex = 0x58495A46; // "FZIX"
+
+constexpr uint8_t kDeltaAdd = 1;
+constexpr uint8_t kDeltaRemove = 2;
+
+constexpr size_t kMaxDeltaSize = 16 * 1024 * 1024;
+
+struct SignatureRecord {
+    uint8_t category;
+    uint8_t reserved[3];
+    uint32_t textOffset;
+    uint32_t textLength;
+};
+
+struct DeltaHeader {
+    uint32_t magic;
+    uint32_t formatVersion;
+    uint64_t baseVersion;
+    uint64_t targetVersion;
+    uint32_t recordCount;
+    uint32_t crc32;             // over the records
+};
+
+static_assert(sizeof(SignatureRecord) == 12, "record layout");
+static_assert(sizeof(DeltaHeader) == 32, "delta header layout");
+
+template <typename T>
+void appendRaw(std::string& out, const T& value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+bool isValidCategory(uint8_t category) {
+    return category >= static_cast<uint8_t>(SignatureCategory::Permission) &&
+           category <= static_cast<uint8_t>(SignatureCategory::FuzzyHash);
+}
+
+// The digest of a FuzzyHash signature: its text up to the family name
+bool parseFuzzyDigest(std::string_view text, FuzzyDigest& digest) {
+    if (text.size() > FuzzyDigest::kHexSize && text[FuzzyDigest::kHexSize] != ' ') {
+        return false;
+    }
+    return FuzzyDigest::fromHex(text.substr(0, FuzzyDigest::kHexSize), digest);
+}
+
+std::string serializePack(const std::vector<SignatureDefinition>& definitions, uint64_t version) {
+    // SIGS: records then the concatenated texts
+    std::string signatures;
+    uint32_t count = static_cast<uint32_t>(definitions.size());
+    appendRaw(signatures, count);
+    appendRaw(signatures, static_cast<uint32_t>(0));
+    std::string texts;
+    for (const auto& definition : definitions) {
+        SignatureRecord record;
+        memset(&record, 0, sizeof(record));
+        record.category = static_cast<uint8_t>(definition.category);
+        record.textOffset = static_cast<uint32_t>(texts.size());
+        record.textLength = static_cast<uint32_t>(definition.text.size());
+        appendRaw(signatures, record);
+        texts += definition.text;
+    }
+    signatures += texts;
+
+    // ACDF: the automaton, pattern IDs are record indices. Fuzzy digests
+    // are hex, never searched for as text.
+    // FZIX: the fuzzy digests, IDs are record indices too
+    PatternMatcher builder(true);
+    FuzzyIndex fuzzyBuilder;
+    for (uint32_t i = 0; i < count; i++) {
+        if (definitions[i].category != SignatureCategory::FuzzyHash) {
+            builder.addPattern(definitions[i].text, i);
+            continue;
+        }
+        FuzzyDigest digest;
+        if (parseFuzzyDigest(definitions[i].text, digest)) {
+            fuzzyBuilder.add(digest, i);
+        } else {
+            LOGW("Ignoring malformed fuzzy hash signature %u", i);
+        }
+    }
+    builder.build();
+    std::string matcher;
+    builder.serialize(matcher);
+    fuzzyBuilder.build();
+    std::string fuzzyIndex;
+    fuzzyBuilder.serialize(fuzzyIndex);
+
+    return PackFile::build(kPackMagic, kPackFormatVersion, version,
+                           {{kSectionSignatures, std::move(signatures)},
+                            {kSectionMatcher, std::move(matcher)},
+                            {kSectionFuzzyIndex, std::move(fuzzyIndex)}});
+}
+
+bool readWholeFile(const std::string& path, std::string& out, size_t maxSize) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || fileStat.st_size < 0 ||
+        static_cast<size_t>(fileStat.st_size) > maxSize) {
+        close(fd);
+        return false;
+    }
+    out.resize(static_cast<size_t>(fileStat.st_size));
+    size_t done = 0;
+    while (done < out.size()) {
+        ssize_t n = read(fd, &out[done], out.size() - done);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        done += static_cast<size_t>(n);
+    }
+    close(fd);
+    return done == out.size();
+}
+
+} // namespace
+
+SignatureDatabase::SignatureDatabase()
+    : version_(0), signatureCount_(0), records_(nullptr), strings_(nullptr), stringsSize_(0),
+      matcher_(true) {
+}
+
+SignatureDatabase::~SignatureDatabase() {
+}
+
+std::shared_ptr<const SignatureDatabase> SignatureDatabase::compile(
+    const std::vector<SignatureDefinition>& definitions, uint64_t version) {
+    std::shared_ptr<SignatureDatabase> database(new SignatureDatabase());
+    if (!database->pack_.adopt(serializePack(definitions, version), kPackMagic,
+                               kPackFormatVersion) ||
+        !database->attach()) {
+        return nullptr;
+    }
+    return database;
+}
+
+std::shared_ptr<const SignatureDatabase> SignatureDatabase::load(const std::string& path,
+                                                                 bool verifyChecksum) {
+    std::shared_ptr<SignatureDatabase> database(new SignatureDatabase());
+    if (!database->pack_.map(path, kPackMagic, kPackFormatVersion, verifyChecksum) ||
+        !database->attach()) {
+        LOGE("Malformed signature pack: %s", path.c_str());
+        return nullptr;
+    }
+    return database;
+}
+
+bool SignatureDatabase::write(const std::vector<SignatureDefinition>& definitions,
+                              uint64_t version, const std::string& path) {
+    return PackFile::write(serializePack(definitions, version), path);
+}
+
+bool SignatureDatabase::attach() {
+    size_t signaturesSize = 0;
+    const uint8_t* signatures = pack_.section(kSectionSignatures, signaturesSize);
+    size_t matcherSize = 0;
+    const uint8_t* matcher = pack_.section(kSectionMatcher, matcherSize);
+    // Packs without a fuzzy index have no fuzzy hashes
+    size_t fuzzyIndexSize = 0;
+    const uint8_t* fuzzyIndex = pack_.section(kSectionFuzzyIndex, fuzzyIndexSize);
+    if (signatures == nullptr || matcher == nullptr || signaturesSize < 8) {
+        return false;
+    }
+
+    uint32_t count;
+    memcpy(&count, signatures, sizeof(count));
+    if (count > (signaturesSize - 8) / sizeof(SignatureRecord)) {
+        return false;
+    }
+    size_t recordsSize = static_cast<size_t>(count) * sizeof(SignatureRecord);
+
+    version_ = pack_.version();
+    signatureCount_ = count;
+    records_ = signatures + 8;
+    strings_ = reinterpret_cast<const char*>(records_ + recordsSize);
+    stringsSize_ = signaturesSize - 8 - recordsSize;
+    if (fuzzyIndex != nullptr && !fuzzyIndex_.attach(fuzzyIndex, fuzzyIndexSize)) {
+        return false;
+    }
+    return matcher_.attach(matcher, matcherSize);
+}
+
+SignatureView SignatureDatabase::signature(uint32_t id) const {
+    SignatureView view;
+    view.category = SignatureCategory::Keyword;
+    if (id >= signatureCount_) {
+        return view;
+    }
+    SignatureRecord record;
+    memcpy(&record, records_ + static_cast<size_t>(id) * sizeof(SignatureRecord), sizeof(record));
+    view.category = static_cast<SignatureCategory>(record.category);
+    if (record.textOffset <= stringsSize_ && record.textLength <= stringsSize_ - record.textOffset) {
+        view.text = std::string_view(strings_ + record.textOffset, record.textLength);
+    }
+    return view;
+}
+
+std::string_view SignatureDatabase::fuzzyFamily(std::string_view text) {
+    if (text.size() > FuzzyDigest::kHexSize + 1) {
+        return text.substr(FuzzyDigest::kHexSize + 1);
+    }
+    return text;
+}
+
+std::vector<SignatureDefinition> SignatureDatabase::definitions() const {
+    std::vector<SignatureDefinition> out;
+    out.reserve(signatureCount_);
+    for (uint32_t i = 0; i < signatureCount_; i++) {
+        SignatureView view = signature(i);
+        out.push_back({view.category, std::string(view.text)});
+    }
+    return out;
+}
+
+bool SignatureDatabase::applyDelta(const std::string& deltaPath,
+                                   std::vector<SignatureDefinition>& definitions,
+                                   uint64_t& newVersion) const {
+    std::string delta;
+    if (!readWholeFile(deltaPath, delta, kMaxDeltaSize) || delta.size() < sizeof(DeltaHeader)) {
+        LOGE("Failed to read signature delta %s", deltaPath.c_str());
+        return false;
+    }
+    DeltaHeader header;
+    memcpy(&header, delta.data(), sizeof(header));
+    if (header.magic != kDeltaMagic || header.formatVersion != kDeltaFormatVersion) {
+        LOGE("Not a signature delta: %s", deltaPath.c_str());
+        return false;
+    }
+    if (header.baseVersion != version_ || header.targetVersion <= version_) {
+        LOGW("Signature delta %llu->%llu does not apply to version %llu",
+             static_cast<unsigned long long>(header.baseVersion),
+             static_cast<unsigned long long>(header.targetVersion),
+             static_cast<unsigned long long>(version_));
+        return false;
+    }
+    const uint8_t* records = reinterpret_cast<const uint8_t*>(delta.data()) + sizeof(DeltaHeader);
+    size_t recordsSize = delta.size() - sizeof(DeltaHeader);
+    if (crc32(0L, records, static_cast<uInt>(recordsSize)) != header.crc32) {
+        LOGE("Signature delta checksum mismatch: %s", deltaPath.c_str());
+        return false;
+    }
+
+    // Each record: op u8, category u8, length u16, text
+    definitions = this->definitions();
+    size_t pos = 0;
+    for (uint32_t i = 0; i < header.recordCount; i++) {
+        if (recordsSize - pos < 4) {
+            return false;
+        }
+        uint8_t op = records[pos];
+        uint8_t category = records[pos + 1];
+        size_t length = static_cast<size_t>(records[pos + 2] | (records[pos + 3] << 8));
+        pos += 4;
+        if (length > recordsSize - pos || !isValidCategory(category)) {
+            return false;
+        }
+        SignatureDefinition definition{static_cast<SignatureCategory>(category),
+                                       std::string(reinterpret_cast<const char*>(records + pos), length)};
+        pos += length;
+
+        auto existing = std::find_if(definitions.begin(), definitions.end(),
+                                     [&](const SignatureDefinition& d) {
+                                         return d.category == definition.category &&
+                                                d.text == definition.text;
+                                     });
+        if (op == kDeltaAdd && existing == definitions.end()) {
+            definitions.push_back(std::move(definition));
+        } else if (op == kDeltaRemove && existing != definitions.end()) {
+            definitions.erase(existing);
+        } else if (op != kDeltaAdd && op != kDeltaRemove) {
+            return false;
+        }
+    }
+    newVersion = header.targetVersion;
+    return true;
+}
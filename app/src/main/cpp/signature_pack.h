@@ -0,0 +1,107 @@
+#ifndef WHATSZAP_SIGNATURE_PACK_H
+#define WHATSZAP_SIGNATURE_PACK_H
+
+#include "fuzzy_hash.h"
+#include "pack_file.h"
+#include "pattern_matcher.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+enum class SignatureCategory : uint8_t {
+    Permission = 1,   // exact <uses-permission> name
+    Package = 2,      // substring of the package name
+    Keyword = 3,      // string IOC inside code-bearing entries
+    DexApi = 4,       // type or method referenced by a dex file, as
+                      // "Lpkg/Type;" or "Lpkg/Type;->method"
+    ElfSymbol = 5,    // prefix of a dynamic symbol or DT_NEEDED name in lib/*.so
+    FuzzyHash = 6     // FuzzyDigest hex of a known-bad dex or manifest, then
+                      // optionally a space and the family name
+};
+
+// Source form of a signature, used to build packs and apply deltas
+struct SignatureDefinition {
+    SignatureCategory category;
+    std::string text;
+};
+
+// Signature as seen by the scanner; `text` points into the pack
+struct SignatureView {
+    SignatureCategory category;
+    std::string_view text;
+};
+
+// Immutable, versioned signature set. On disk it is a "signature pack", a
+// PackFile with magic "WZSP" and these sections:
+//
+//   SIGS   signature records plus their string blob
+//   ACDF   pre-built PatternMatcher tables over all signatures but fuzzy
+//          hashes
+//   FZIX   pre-built FuzzyIndex over the fuzzy hashes; packs without it
+//          have none
+//
+// Loading maps the file and points into it, so startup cost does not
+// depend on the number of signatures. Instances are shared through
+// shared_ptr so a scan keeps its snapshot alive while a newer pack is
+// swapped in.
+class SignatureDatabase {
+public:
+    ~SignatureDatabase();
+
+    SignatureDatabase(const SignatureDatabase&) = delete;
+    SignatureDatabase& operator=(const SignatureDatabase&) = delete;
+
+    // Build an in-memory database from definitions
+    static std::shared_ptr<const SignatureDatabase> compile(
+        const std::vector<SignatureDefinition>& definitions, uint64_t version);
+
+    // Map a pack file; nullptr if it is missing or malformed. Section
+    // bounds and the matcher tables are always checked, so a corrupt pack
+    // fails to load rather than being read out of bounds; verifyChecksum
+    // also checks the CRC, which costs a pass over the whole file and is
+    // meant for freshly installed packs.
+    static std::shared_ptr<const SignatureDatabase> load(const std::string& path,
+                                                         bool verifyChecksum = false);
+
+    // Write a pack atomically (temp file + fsync + rename)
+    static bool write(const std::vector<SignatureDefinition>& definitions, uint64_t version,
+                      const std::string& path);
+
+    // Apply a delta file to this database's signatures. Fails if the delta
+    // was produced against a different version or is corrupted.
+    bool applyDelta(const std::string& deltaPath, std::vector<SignatureDefinition>& definitions,
+                    uint64_t& newVersion) const;
+
+    uint64_t version() const { return version_; }
+    size_t signatureCount() const { return signatureCount_; }
+    SignatureView signature(uint32_t id) const;
+    const PatternMatcher& matcher() const { return matcher_; }
+    // Signature IDs are the FuzzyHash records' IDs
+    const FuzzyIndex& fuzzyIndex() const { return fuzzyIndex_; }
+
+    // Family named by a FuzzyHash signature, or its digest if it has none
+    static std::string_view fuzzyFamily(std::string_view text);
+
+    // Copy out all signatures, e.g. as the base for a delta
+    std::vector<SignatureDefinition> definitions() const;
+
+private:
+    SignatureDatabase();
+
+    bool attach();
+
+    PackFile pack_;
+
+    uint64_t version_;
+    uint32_t signatureCount_;
+    const uint8_t* records_;
+    const char* strings_;
+    size_t stringsSize_;
+    PatternMatcher matcher_;
+    FuzzyIndex fuzzyIndex_;
+};
+
+#endif // WHATSZAP_SIGNATURE_PACK_H
@@ -0,0 +1,278 @@
+#include "streaming_scan.h"
+#include "axml_parser.h"
+#include "malware_scanner.h"
+#include "native-lib.h"
+#include "score_table.h"
+#include "zip_reader.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+constexpr uint32_t kLocalHeaderSig = 0x04034b50;
+constexpr uint32_t kDescriptorSig = 0x08074b50;
+constexpr size_t kLocalHeaderSize = 30;
+// crc32 and 32-bit sizes, optionally preceded by a signature. Streamed
+// ZIP64 entries (8-byte sizes) do not occur in APKs; one would surface as
+// a bad header and end the scan.
+constexpr size_t kDescriptorSize = 12;
+
+constexpr uint16_t kFlagEncrypted = 0x0001;
+constexpr uint16_t kFlagDescriptor = 0x0008;
+
+// Same limit as the full scan
+constexpr size_t kMaxManifestSize = 8 * 1024 * 1024;
+
+inline uint16_t readU16(const uint8_t* p) {
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+inline uint32_t readU32(const uint8_t* p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+} // namespace
+
+StreamingScan::StreamingScan(std::shared_ptr<const SignatureDatabase> database)
+    : database_(std::move(database)), state_(State::Header), method_(0),
+      hasDescriptor_(false), remaining_(0), inspect_(false), isManifest_(false),
+      inflaterReady_(false), contentMatched_(false) {
+    memset(&inflater_, 0, sizeof(inflater_));
+}
+
+StreamingScan::~StreamingScan() {
+    if (inflaterReady_) {
+        inflateEnd(&inflater_);
+    }
+}
+
+bool StreamingScan::feed(const uint8_t* data, size_t length) {
+    while (length > 0 && state_ != State::Done) {
+        size_t used = 0;
+        switch (state_) {
+            case State::Header:
+                used = readHeader(data, length);
+                break;
+            case State::Data:
+                used = readData(data, length);
+                break;
+            case State::Descriptor:
+                used = readDescriptor(data, length);
+                break;
+            case State::Done:
+                break;
+        }
+        data += used;
+        length -= used;
+        progress_.bytesConsumed += used;
+        if (progress_.isMalicious) {
+            // Further bytes cannot change the verdict
+            state_ = State::Done;
+        }
+    }
+    return state_ != State::Done;
+}
+
+size_t StreamingScan::readHeader(const uint8_t* data, size_t length) {
+    // Fixed part first, then the name and extra field it announces
+    size_t needed = kLocalHeaderSize;
+    if (header_.size() >= kLocalHeaderSize) {
+        needed += readU16(header_.data() + 26) + readU16(header_.data() + 28);
+    }
+    size_t take = std::min(needed - header_.size(), length);
+    header_.insert(header_.end(), data, data + take);
+
+    if (header_.size() == kLocalHeaderSize && readU32(header_.data()) != kLocalHeaderSig) {
+        // Central directory: every entry has been seen
+        state_ = State::Done;
+        return take;
+    }
+    if (header_.size() >= kLocalHeaderSize &&
+        header_.size() == kLocalHeaderSize + readU16(header_.data() + 26) +
+                              readU16(header_.data() + 28)) {
+        if (!beginEntry()) {
+            state_ = State::Done;
+        }
+        header_.clear();
+    }
+    return take;
+}
+
+bool StreamingScan::beginEntry() {
+    const uint8_t* header = header_.data();
+    uint16_t nameLength = readU16(header + 26);
+    uint16_t extraLength = readU16(header + 28);
+
+    ZipEntry entry{};
+    entry.flags = readU16(header + 6);
+    entry.method = readU16(header + 8);
+    entry.compressedSize = readU32(header + 18);
+    entry.uncompressedSize = readU32(header + 22);
+    applyZip64Extra(header + kLocalHeaderSize + nameLength, extraLength, entry);
+
+    name_.assign(reinterpret_cast<const char*>(header + kLocalHeaderSize), nameLength);
+    method_ = entry.method;
+    hasDescriptor_ = (entry.flags & kFlagDescriptor) != 0;
+    remaining_ = entry.compressedSize;
+
+    // Without sizes the end of the data is only found by inflating it
+    if (hasDescriptor_ && method_ != 8) {
+        LOGD("Streaming scan stops at %s: stored entry without sizes", name_.c_str());
+        return false;
+    }
+
+    bool readable = (method_ == 0 || method_ == 8) && (entry.flags & kFlagEncrypted) == 0;
+    inspect_ = readable && !contentMatched_ && MalwareScanner::isCodeEntry(name_);
+    isManifest_ = readable && name_ == "AndroidManifest.xml";
+    manifest_.clear();
+    cursor_ = PatternMatcher::Cursor();
+
+    if (inspect_) {
+        // Names are matched like content, as in the full scan
+        const PatternMatcher& matcher = database_->matcher();
+        matcher.scan(name_, [&](uint32_t patternId, uint64_t) {
+            if (database_->signature(patternId).category != SignatureCategory::Keyword) {
+                return true;
+            }
+            contentMatched_ = true;
+            return false;
+        });
+        if (contentMatched_) {
+            inspect_ = false;
+            progress_.threats.add(ThreatId::SuspiciousContent);
+            rescore();
+        }
+    }
+
+    // Deflated data is inflated when inspected, or when that is the only
+    // way to find where it ends
+    if (method_ == 8 && (inspect_ || isManifest_ || hasDescriptor_)) {
+        if (inflaterReady_) {
+            inflateReset(&inflater_);
+        } else if (inflateInit2(&inflater_, -MAX_WBITS) == Z_OK) {
+            inflaterReady_ = true;
+        } else {
+            return false;
+        }
+        window_.resize(ZipArchive::kChunkSize);
+    }
+
+    state_ = State::Data;
+    if (!hasDescriptor_ && remaining_ == 0) {
+        endEntry();
+    }
+    return state_ != State::Done;
+}
+
+size_t StreamingScan::readData(const uint8_t* data, size_t length) {
+    bool sized = !hasDescriptor_;
+    size_t take = sized ? static_cast<size_t>(std::min<uint64_t>(remaining_, length)) : length;
+    bool inflating = method_ == 8 && (inspect_ || isManifest_ || hasDescriptor_);
+
+    if (!inflating) {
+        // Stored, or deflated and not of interest
+        if (inspect_ || isManifest_) {
+            consumeEntryBytes(data, take);
+        }
+    } else {
+        inflater_.next_in = const_cast<Bytef*>(data);
+        inflater_.avail_in = static_cast<uInt>(take);
+        int status = Z_OK;
+        while (inflater_.avail_in > 0 && status != Z_STREAM_END && !progress_.isMalicious) {
+            inflater_.next_out = window_.data();
+            inflater_.avail_out = static_cast<uInt>(window_.size());
+            status = inflate(&inflater_, Z_NO_FLUSH);
+            if (status != Z_OK && status != Z_STREAM_END && status != Z_BUF_ERROR) {
+                LOGD("Streaming scan stops at %s: inflate error %d", name_.c_str(), status);
+                state_ = State::Done;
+                return take;
+            }
+            size_t produced = window_.size() - inflater_.avail_out;
+            if (produced > 0 && (inspect_ || isManifest_)) {
+                consumeEntryBytes(window_.data(), produced);
+            }
+            if (status == Z_BUF_ERROR && produced == 0) {
+                break;
+            }
+        }
+        if (status == Z_STREAM_END && !sized) {
+            // What inflate did not use belongs to the descriptor
+            take -= inflater_.avail_in;
+            state_ = State::Descriptor;
+            endEntry();
+            return take;
+        }
+    }
+
+    if (sized) {
+        remaining_ -= take;
+        if (remaining_ == 0) {
+            endEntry();
+        }
+    }
+    return take;
+}
+
+size_t StreamingScan::readDescriptor(const uint8_t* data, size_t length) {
+    auto needed = [this]() {
+        bool withSignature = header_.size() >= 4 && readU32(header_.data()) == kDescriptorSig;
+        return withSignature ? kDescriptorSize + 4 : kDescriptorSize;
+    };
+    size_t take = std::min(needed() - header_.size(), length);
+    header_.insert(header_.end(), data, data + take);
+    if (header_.size() == needed()) {
+        header_.clear();
+        state_ = State::Header;
+    }
+    return take;
+}
+
+void StreamingScan::consumeEntryBytes(const uint8_t* data, size_t length) {
+    if (isManifest_) {
+        if (manifest_.size() + length > kMaxManifestSize) {
+            isManifest_ = false;
+            manifest_.clear();
+        } else {
+            manifest_.append(reinterpret_cast<const char*>(data), length);
+        }
+    }
+    if (!inspect_ || contentMatched_) {
+        return;
+    }
+    const PatternMatcher& matcher = database_->matcher();
+    matcher.scan(cursor_, data, length, [&](uint32_t patternId, uint64_t) {
+        if (database_->signature(patternId).category != SignatureCategory::Keyword) {
+            return true;
+        }
+        contentMatched_ = true;
+        return false;
+    });
+    if (contentMatched_) {
+        LOGD("Keyword signature matched in %s while streaming", name_.c_str());
+        progress_.threats.add(ThreatId::SuspiciousContent);
+        rescore();
+    }
+}
+
+void StreamingScan::endEntry() {
+    if (isManifest_) {
+        ManifestInfo manifest;
+        if (AxmlParser::parse(reinterpret_cast<const uint8_t*>(manifest_.data()),
+                              manifest_.size(), manifest)) {
+            if (MalwareScanner::analyzeManifest(*database_, manifest, progress_.threats) > 0) {
+                rescore();
+            }
+        }
+        manifest_.clear();
+    }
+    progress_.entriesScanned++;
+    if (state_ == State::Data) {
+        state_ = State::Header;
+    }
+}
+
+void StreamingScan::rescore() {
+    progress_.confidence = scoreThreats(progress_.threats);
+    progress_.isMalicious = progress_.confidence >= MalwareScanner::MALICIOUS_THRESHOLD;
+}
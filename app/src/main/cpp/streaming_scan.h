@@ -0,0 +1,83 @@
+#ifndef WHATSZAP_STREAMING_SCAN_H
+#define WHATSZAP_STREAMING_SCAN_H
+
+#include "pattern_matcher.h"
+#include "signature_pack.h"
+#include "threat.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+// Verdict so far for a file that is still being written
+struct StreamingProgress {
+    uint64_t bytesConsumed;
+    uint32_t entriesScanned;
+    int confidence;
+    // Confidence already reached the threshold. Scores only grow as more
+    // of the file is seen, so the full scan cannot come out cleaner.
+    bool isMalicious;
+    ThreatList threats;
+
+    StreamingProgress() : bytesConsumed(0), entriesScanned(0), confidence(0), isMalicious(false) {}
+};
+
+// Scan of a ZIP fed front to back while it is written. Downloads arrive in
+// order and every entry is preceded by its local file header, so entries
+// can be inflated and matched as their bytes land, without the central
+// directory at the end. Runs the manifest and keyword checks of
+// MalwareScanner::scanApk; once these alone make the file malicious the
+// verdict is final and the scan stops. The full scan still runs when the
+// file is complete.
+class StreamingScan {
+public:
+    explicit StreamingScan(std::shared_ptr<const SignatureDatabase> database);
+    ~StreamingScan();
+
+    StreamingScan(const StreamingScan&) = delete;
+    StreamingScan& operator=(const StreamingScan&) = delete;
+
+    // Feed the next bytes of the file, in order. Returns false once more
+    // bytes cannot change the outcome: verdict reached, central directory
+    // reached, or a layout that cannot be followed without it.
+    bool feed(const uint8_t* data, size_t length);
+
+    bool isDone() const { return state_ == State::Done; }
+    const StreamingProgress& progress() const { return progress_; }
+
+private:
+    enum class State { Header, Data, Descriptor, Done };
+
+    size_t readHeader(const uint8_t* data, size_t length);
+    size_t readData(const uint8_t* data, size_t length);
+    size_t readDescriptor(const uint8_t* data, size_t length);
+    bool beginEntry();
+    void endEntry();
+    void consumeEntryBytes(const uint8_t* data, size_t length);
+    // Score the threats found so far, as the full scan would
+    void rescore();
+
+    std::shared_ptr<const SignatureDatabase> database_;
+    State state_;
+    StreamingProgress progress_;
+    std::vector<uint8_t> header_;   // local header or descriptor being assembled
+
+    // Entry being read
+    std::string name_;
+    uint16_t method_;
+    bool hasDescriptor_;            // sizes follow the data instead
+    uint64_t remaining_;            // compressed bytes left, if known
+    bool inspect_;                  // a code entry whose content is matched
+    bool isManifest_;
+    std::string manifest_;
+    PatternMatcher::Cursor cursor_;
+    z_stream inflater_;
+    bool inflaterReady_;
+    std::vector<uint8_t> window_;
+
+    bool contentMatched_;
+};
+
+#endif // WHATSZAP_STREAMING_SCAN_H
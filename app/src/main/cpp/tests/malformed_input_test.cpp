@@ -0,0 +1,809 @@
+// Host regression tests for the parsers that read files the app did not
+// write: signature packs and deltas, the verdict cache, archives probed and
+// streamed while downloading, and fuzzy digests. Each case builds a valid
+// input, checks that it is accepted, then feeds truncated, bit-flipped and
+// hand-corrupted variants, which must be rejected or handled without
+// reading out of bounds. Build with -fsanitize=address to catch reads that
+// do not crash.
+//
+// Usage: whatszap-tests <case>...
+//   signature-pack   SignatureDatabase::load, PatternMatcher::attach, deltas
+//   verdict-cache    VerdictCache over a damaged cache file
+//   streaming-scan   StreamingScan fed damaged ZIPs in uneven chunks
+//   archive-probe    probeArchive over damaged ZIPs
+//   fuzzy-index      FuzzyDigest::fromHex and FuzzyIndex::attach
+// With no arguments every case runs.
+
+#include "archive_probe.h"
+#include "fuzzy_hash.h"
+#include "pattern_matcher.h"
+#include "signature_pack.h"
+#include "streaming_scan.h"
+#include "verdict_cache.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+#include <zlib.h>
+
+namespace {
+
+int failures = 0;
+
+#define EXPECT(condition)                                                       \
+    do {                                                                        \
+        if (!(condition)) {                                                     \
+            fprintf(stderr, "%s:%d: expected %s\n", __FILE__, __LINE__, #condition); \
+            failures++;                                                         \
+        }                                                                       \
+    } while (0)
+
+// Fixed seed, so a failure reproduces
+constexpr uint32_t kSeed = 20240611;
+constexpr int kMutations = 1500;
+
+// Scratch directory, removed with its files
+class TempDir {
+public:
+    TempDir() {
+        const char* base = getenv("TMPDIR");
+        path_ = std::string(base != nullptr && *base != '\0' ? base : "/tmp") + "/whatszap-XXXXXX";
+        if (mkdtemp(&path_[0]) == nullptr) {
+            perror("mkdtemp");
+            exit(2);
+        }
+    }
+
+    ~TempDir() {
+        if (DIR* dir = opendir(path_.c_str())) {
+            while (dirent* entry = readdir(dir)) {
+                if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
+                    unlink((path_ + "/" + entry->d_name).c_str());
+                }
+            }
+            closedir(dir);
+        }
+        rmdir(path_.c_str());
+    }
+
+    std::string file(const char* name) const { return path_ + "/" + name; }
+
+private:
+    std::string path_;
+};
+
+bool writeFile(const std::string& path, const std::string& data) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(data.data(), static_cast<std::streamsize>(data.size()));
+    return static_cast<bool>(out);
+}
+
+std::string readFile(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+void put16(std::string& out, uint16_t value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void put32(std::string& out, uint32_t value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void store32(std::string& data, size_t offset, uint32_t value) {
+    memcpy(&data[offset], &value, sizeof(value));
+}
+
+uint32_t load32(const std::string& data, size_t offset) {
+    uint32_t value;
+    memcpy(&value, &data[offset], sizeof(value));
+    return value;
+}
+
+// Flip one to four random bytes
+std::string mutate(const std::string& data, std::mt19937& random) {
+    std::string out = data;
+    int flips = 1 + static_cast<int>(random() % 4);
+    for (int i = 0; i < flips && !out.empty(); i++) {
+        out[random() % out.size()] ^= static_cast<char>(1 + random() % 255);
+    }
+    return out;
+}
+
+std::string randomBytes(size_t size, std::mt19937& random) {
+    std::string out(size, '\0');
+    for (char& byte : out) {
+        byte = static_cast<char>(random());
+    }
+    return out;
+}
+
+std::string rawDeflate(const std::string& data) {
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+    std::string out(deflateBound(&stream, data.size()), '\0');
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    stream.avail_in = static_cast<uInt>(data.size());
+    stream.next_out = reinterpret_cast<Bytef*>(&out[0]);
+    stream.avail_out = static_cast<uInt>(out.size());
+    deflate(&stream, Z_FINISH);
+    out.resize(stream.total_out);
+    deflateEnd(&stream);
+    return out;
+}
+
+struct ZipEntry {
+    std::string name;
+    std::string data;
+    bool deflate;
+};
+
+// Local headers and data, the central directory, then the EOCD record
+std::string buildZip(const std::vector<ZipEntry>& entries, const std::string& comment = "") {
+    std::string out;
+    std::string directory;
+    for (const ZipEntry& entry : entries) {
+        std::string stored = entry.deflate ? rawDeflate(entry.data) : entry.data;
+        uint32_t crc = static_cast<uint32_t>(
+            crc32(0L, reinterpret_cast<const Bytef*>(entry.data.data()),
+                  static_cast<uInt>(entry.data.size())));
+        uint16_t method = entry.deflate ? 8 : 0;
+        uint32_t localOffset = static_cast<uint32_t>(out.size());
+
+        put32(out, 0x04034B50);
+        put16(out, 20);
+        put16(out, 0);
+        put16(out, method);
+        put32(out, 0);                                      // time and date
+        put32(out, crc);
+        put32(out, static_cast<uint32_t>(stored.size()));
+        put32(out, static_cast<uint32_t>(entry.data.size()));
+        put16(out, static_cast<uint16_t>(entry.name.size()));
+        put16(out, 0);
+        out += entry.name;
+        out += stored;
+
+        put32(directory, 0x02014B50);
+        put16(directory, 20);
+        put16(directory, 20);
+        put16(directory, 0);
+        put16(directory, method);
+        put32(directory, 0);
+        put32(directory, crc);
+        put32(directory, static_cast<uint32_t>(stored.size()));
+        put32(directory, static_cast<uint32_t>(entry.data.size()));
+        put16(directory, static_cast<uint16_t>(entry.name.size()));
+        put16(directory, 0);                                // extra
+        put16(directory, 0);                                // comment
+        put16(directory, 0);                                // disk
+        put16(directory, 0);                                // internal attributes
+        put32(directory, 0);                                // external attributes
+        put32(directory, localOffset);
+        directory += entry.name;
+    }
+    uint32_t directoryOffset = static_cast<uint32_t>(out.size());
+    out += directory;
+
+    put32(out, 0x06054B50);
+    put16(out, 0);
+    put16(out, 0);
+    put16(out, static_cast<uint16_t>(entries.size()));
+    put16(out, static_cast<uint16_t>(entries.size()));
+    put32(out, static_cast<uint32_t>(directory.size()));
+    put32(out, directoryOffset);
+    put16(out, static_cast<uint16_t>(comment.size()));
+    out += comment;
+    return out;
+}
+
+const char kKeyword[] = "evil-payload-marker";
+
+// A manifest is binary AXML on a device; for the parsers below it is only
+// bytes, and garbage ones must not matter either
+std::string sampleApk(std::mt19937& random) {
+    std::string dex = "dex\n035" + randomBytes(4096, random) + kKeyword + randomBytes(512, random);
+    return buildZip({
+        {"AndroidManifest.xml", randomBytes(600, random), true},
+        {"classes.dex", dex, true},
+        {"lib/arm64-v8a/libnative.so", "\x7f" "ELF" + randomBytes(300, random), false},
+        {"assets/readme.txt", std::string(2000, 'a'), true},
+    });
+}
+
+std::vector<SignatureDefinition> sampleDefinitions(const FuzzyDigest& fuzzy) {
+    return {
+        {SignatureCategory::Permission, "android.permission.SEND_SMS"},
+        {SignatureCategory::Package, "com.evil."},
+        {SignatureCategory::Keyword, kKeyword},
+        {SignatureCategory::Keyword, "stealer"},
+        {SignatureCategory::DexApi, "Landroid/telephony/SmsManager;->sendTextMessage"},
+        {SignatureCategory::ElfSymbol, "Java_com_evil_"},
+        {SignatureCategory::FuzzyHash, fuzzy.toHex() + " Evil.Family"},
+    };
+}
+
+FuzzyDigest sampleDigest(std::mt19937& random) {
+    std::string input = randomBytes(8192, random);
+    FuzzyHasher hasher;
+    hasher.update(reinterpret_cast<const uint8_t*>(input.data()), input.size());
+    FuzzyDigest digest;
+    hasher.finish(digest);
+    return digest;
+}
+
+// Touch everything a loaded database points at
+void exerciseDatabase(const SignatureDatabase& database, const std::string& probe,
+                      const FuzzyDigest& fuzzy) {
+    for (uint32_t id = 0; id < database.signatureCount() + 2; id++) {
+        SignatureView view = database.signature(id);
+        volatile size_t sink = view.text.size();
+        (void)sink;
+    }
+    database.matcher().scan(probe, [&](uint32_t patternId, uint64_t endOffset) {
+        database.signature(patternId);
+        return endOffset <= probe.size();
+    });
+    FuzzyIndex::Match match;
+    database.fuzzyIndex().findNearest(fuzzy, 300, match);
+}
+
+// Section of a pack image, read with the layout in pack_file.cpp: a 24-byte
+// header ending in the section count, then 24-byte {tag, reserved, offset,
+// size} entries
+bool findSection(const std::string& image, uint32_t tag, size_t& offset, size_t& size) {
+    uint32_t count = load32(image, 20);
+    for (uint32_t i = 0; i < count; i++) {
+        size_t entry = 24 + static_cast<size_t>(i) * 24;
+        if (load32(image, entry) == tag) {
+            uint64_t value;
+            memcpy(&value, &image[entry + 8], sizeof(value));
+            offset = static_cast<size_t>(value);
+            memcpy(&value, &image[entry + 16], sizeof(value));
+            size = static_cast<size_t>(value);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Tables of a serialized PatternMatcher, from pattern_matcher.cpp: counts
+// and flags, then 256 uint16 byte classes and 288 bytes of prefilter
+constexpr size_t kMatcherTablesOffset = 16 + 512 + 256 + 32;
+
+// A copy of a serialized blob in 4-byte aligned memory, as attach needs
+struct AlignedBlob {
+    std::vector<uint32_t> words;
+    size_t size;
+
+    explicit AlignedBlob(const std::string& bytes)
+        : words((bytes.size() + 3) / 4), size(bytes.size()) {
+        memcpy(words.data(), bytes.data(), bytes.size());
+    }
+
+    const uint8_t* data() const { return reinterpret_cast<const uint8_t*>(words.data()); }
+};
+
+void testPatternMatcherTables() {
+    PatternMatcher built;
+    built.addPattern("stealer", 1);
+    built.addPattern("payload", 2);
+    built.addPattern("steal", 3);
+    built.build();
+    std::string blob;
+    built.serialize(blob);
+
+    uint32_t classCount = load32(blob, 0);
+    uint32_t stateCount = load32(blob, 4);
+    size_t outputStart = kMatcherTablesOffset + static_cast<size_t>(stateCount) * classCount * 4;
+
+    AlignedBlob aligned(blob);
+    PatternMatcher attached;
+    EXPECT(attached.attach(aligned.data(), aligned.size));
+    int matches = 0;
+    attached.scan("a stolen payload", [&](uint32_t patternId, uint64_t) {
+        matches += patternId == 2;
+        return true;
+    });
+    EXPECT(matches == 1);
+    for (size_t size = 0; size < blob.size(); size += 7) {
+        PatternMatcher truncated;
+        EXPECT(!truncated.attach(aligned.data(), size));
+    }
+
+    struct Corruption {
+        const char* what;
+        std::function<void(std::string&)> apply;
+    };
+    const Corruption corruptions[] = {
+        {"class count", [&](std::string& b) { store32(b, 0, 0); }},
+        {"state count", [&](std::string& b) { store32(b, 4, 0xFFFFFF); }},
+        {"byte class", [&](std::string& b) { b[16 + 2 * 'x'] = static_cast<char>(classCount); }},
+        {"transition past the last state",
+         [&](std::string& b) { store32(b, kMatcherTablesOffset + 4, stateCount * classCount); }},
+        {"transition into a row", [&](std::string& b) { store32(b, kMatcherTablesOffset, 1); }},
+        {"match flag on a bad row",
+         [&](std::string& b) { store32(b, kMatcherTablesOffset + 8, 0x80000000u | 0x7FFFFFFF); }},
+        {"output offsets out of order", [&](std::string& b) {
+             store32(b, outputStart + 4, load32(b, outputStart + 8) + 1);
+         }},
+        {"output offsets past the outputs", [&](std::string& b) {
+             store32(b, outputStart + static_cast<size_t>(stateCount) * 4, 0xFFFF);
+         }},
+    };
+    for (const Corruption& corruption : corruptions) {
+        std::string corrupt = blob;
+        corruption.apply(corrupt);
+        AlignedBlob corruptBlob(corrupt);
+        PatternMatcher matcher;
+        if (matcher.attach(corruptBlob.data(), corruptBlob.size)) {
+            fprintf(stderr, "matcher tables with a bad %s were attached\n", corruption.what);
+            failures++;
+        }
+    }
+}
+
+void testSignaturePack() {
+    testPatternMatcherTables();
+
+    TempDir dir;
+    std::mt19937 random(kSeed);
+    FuzzyDigest fuzzy = sampleDigest(random);
+    std::string packPath = dir.file("signatures.pack");
+    EXPECT(SignatureDatabase::write(sampleDefinitions(fuzzy), 7, packPath));
+
+    std::string probe = std::string("xx") + kKeyword + " stealer Java_com_evil_x";
+    auto valid = SignatureDatabase::load(packPath, true);
+    EXPECT(valid != nullptr);
+    if (valid == nullptr) {
+        return;
+    }
+    EXPECT(valid->version() == 7);
+    EXPECT(valid->signatureCount() == 7);
+    EXPECT(valid->fuzzyIndex().size() == 1);
+    int matches = 0;
+    valid->matcher().scan(probe, [&](uint32_t, uint64_t) { return ++matches > 0; });
+    EXPECT(matches >= 2);
+
+    std::string image = readFile(packPath);
+    std::string corruptPath = dir.file("corrupt.pack");
+
+    // Corrupt matcher tables behind a valid section table: the pack only
+    // carries a CRC, which startup loads skip
+    size_t matcherOffset = 0;
+    size_t matcherSize = 0;
+    EXPECT(findSection(image, 0x46444341, matcherOffset, matcherSize));    // "ACDF"
+    if (matcherSize > kMatcherTablesOffset) {
+        std::string corrupt = image;
+        store32(corrupt, matcherOffset + kMatcherTablesOffset, 0x7FFFFFF0);
+        EXPECT(writeFile(corruptPath, corrupt));
+        EXPECT(SignatureDatabase::load(corruptPath, false) == nullptr);
+        EXPECT(SignatureDatabase::load(corruptPath, true) == nullptr);
+
+        corrupt = image;
+        corrupt[matcherOffset + 16 + 2 * 'e'] = static_cast<char>(0xFF);
+        EXPECT(writeFile(corruptPath, corrupt));
+        EXPECT(SignatureDatabase::load(corruptPath, false) == nullptr);
+    }
+
+    // A section running past the end of the file
+    {
+        std::string corrupt = image;
+        store32(corrupt, 24 + 16, static_cast<uint32_t>(image.size()));
+        EXPECT(writeFile(corruptPath, corrupt));
+        EXPECT(SignatureDatabase::load(corruptPath, false) == nullptr);
+    }
+
+    for (size_t size = 0; size < image.size(); size += 1 + size / 8) {
+        EXPECT(writeFile(corruptPath, image.substr(0, size)));
+        auto database = SignatureDatabase::load(corruptPath, false);
+        EXPECT(database == nullptr || size >= matcherOffset + matcherSize);
+        if (database != nullptr) {
+            exerciseDatabase(*database, probe, fuzzy);
+        }
+    }
+
+    // Bit flips anywhere: rejected, or loaded and safe to use. With the
+    // CRC checked every one of them is rejected.
+    for (int i = 0; i < kMutations; i++) {
+        std::string corrupt = mutate(image, random);
+        EXPECT(writeFile(corruptPath, corrupt));
+        if (auto database = SignatureDatabase::load(corruptPath, false)) {
+            exerciseDatabase(*database, probe, fuzzy);
+        }
+        if (i % 10 == 0 && corrupt != image) {
+            EXPECT(SignatureDatabase::load(corruptPath, true) == nullptr);
+        }
+    }
+
+    // Deltas: garbage, truncated and flipped files never apply
+    std::string deltaPath = dir.file("signatures.delta");
+    std::vector<SignatureDefinition> definitions;
+    uint64_t newVersion = 0;
+    EXPECT(!valid->applyDelta(dir.file("missing.delta"), definitions, newVersion));
+    for (size_t size : {0, 4, 31, 32, 33, 200}) {
+        EXPECT(writeFile(deltaPath, randomBytes(size, random)));
+        EXPECT(!valid->applyDelta(deltaPath, definitions, newVersion));
+    }
+    std::string header;
+    put32(header, 0x44535A57);                              // "WZSD"
+    header += randomBytes(60, random);
+    EXPECT(writeFile(deltaPath, header));
+    EXPECT(!valid->applyDelta(deltaPath, definitions, newVersion));
+}
+
+// Layout of verdict_cache.cpp: a 64-byte header, 1024 content slots of 48
+// bytes, 1024 file slots of 40 bytes, then the heap
+constexpr size_t kCacheHeapUsedOffset = 32;
+constexpr size_t kCacheContentsOffset = 64;
+constexpr size_t kCacheSlotCount = 1024;
+constexpr size_t kCacheFilesOffset = kCacheContentsOffset + kCacheSlotCount * 48;
+constexpr size_t kCacheHeapOffset = kCacheFilesOffset + kCacheSlotCount * 40;
+
+ScanResult sampleResult(const std::string& sha256) {
+    ScanResult result;
+    result.isMalicious = true;
+    result.confidence = 87;
+    result.threats.add(ThreatId::SuspiciousContent, kKeyword);
+    result.manifest.packageName = "com.evil.app";
+    result.manifest.permissions = {"android.permission.SEND_SMS"};
+    result.digests.sha256 = sha256;
+    result.entryEntropy.push_back({"classes.dex", 7.5, 7.9, 4096});
+    return result;
+}
+
+// Content slot holding a digest, found by looking at every slot
+size_t contentSlotOf(const std::string& image, const std::string& sha256Bytes) {
+    for (size_t i = 0; i < kCacheSlotCount; i++) {
+        if (memcmp(&image[kCacheContentsOffset + i * 48], sha256Bytes.data(), 32) == 0) {
+            return i;
+        }
+    }
+    return kCacheSlotCount;
+}
+
+void testVerdictCache() {
+    TempDir dir;
+    std::mt19937 random(kSeed);
+    std::string path = dir.file("verdicts.wzvc");
+    std::string sha256(64, 'a');
+    std::string sha256Bytes(32, static_cast<char>(0xAA));
+    const FileIdentity identity{1, 2, 3000, 4};
+    const FileIdentity other{1, 9, 3000, 4};
+    const uint64_t signatureVersion = 7;
+
+    {
+        VerdictCache cache;
+        EXPECT(cache.open(path));
+        EXPECT(cache.store(identity, sampleResult(sha256), signatureVersion));
+        EXPECT(!cache.store(identity, sampleResult("not a digest"), signatureVersion));
+    }
+    {
+        VerdictCache cache;
+        EXPECT(cache.open(path));
+        ScanResult result;
+        EXPECT(cache.findByFile(identity, signatureVersion, result));
+        EXPECT(result.confidence == 87 && result.isMalicious);
+        EXPECT(result.threats.size() == 1);
+        EXPECT(result.entryEntropy.size() == 1);
+        EXPECT(!cache.findByFile(identity, signatureVersion + 1, result));
+    }
+    {
+        VerdictCache cache;
+        EXPECT(cache.open(path));
+        ScanResult result;
+        EXPECT(cache.store(identity, sampleResult(sha256), signatureVersion));
+        EXPECT(cache.findByDigest(sha256, other, signatureVersion, result));
+        EXPECT(cache.findByFile(other, signatureVersion, result));
+    }
+    const std::string image = readFile(path);
+    EXPECT(image.size() > kCacheHeapOffset);
+    size_t slot = contentSlotOf(image, sha256Bytes);
+    EXPECT(slot < kCacheSlotCount);
+    if (image.size() <= kCacheHeapOffset || slot >= kCacheSlotCount) {
+        return;
+    }
+    size_t slotOffset = kCacheContentsOffset + slot * 48;
+
+    // Each of these must be a miss, never a read outside the mapping;
+    // damage to the identities alone leaves the lookup by hash working
+    struct Corruption {
+        const char* what;
+        std::function<void(std::string&)> apply;
+        bool onlyIdentities;
+    };
+    const Corruption corruptions[] = {
+        {"truncated", [](std::string& c) { c.resize(c.size() / 2); }, false},
+        {"empty", [](std::string& c) { c.clear(); }, false},
+        {"magic", [](std::string& c) { c[0] ^= 0x20; }, false},
+        {"heap use", [](std::string& c) { store32(c, kCacheHeapUsedOffset, 0xFFFFFF00); }, false},
+        {"payload offset", [&](std::string& c) { store32(c, slotOffset + 32, 0xFFFFFFF0); }, false},
+        {"payload size", [&](std::string& c) { store32(c, slotOffset + 36, 0x7FFFFFFF); }, false},
+        {"payload crc", [&](std::string& c) { store32(c, slotOffset + 40, 0); }, false},
+        {"payload", [&](std::string& c) {
+             c[kCacheHeapOffset + load32(c, slotOffset + 32) + 5] ^= 0x01;
+         }, false},
+        {"content index", [](std::string& c) {
+             for (size_t i = 0; i < kCacheSlotCount; i++) {
+                 store32(c, kCacheFilesOffset + i * 40 + 32, 0xFFFF0000);
+             }
+         }, true},
+    };
+    for (const Corruption& corruption : corruptions) {
+        std::string corrupt = image;
+        corruption.apply(corrupt);
+        EXPECT(writeFile(path, corrupt));
+        VerdictCache cache;
+        EXPECT(cache.open(path));
+        ScanResult result;
+        if (cache.findByFile(identity, signatureVersion, result) ||
+            (!corruption.onlyIdentities && cache.findByDigest(sha256, other, signatureVersion, result))) {
+            fprintf(stderr, "cache with a bad %s served a verdict\n", corruption.what);
+            failures++;
+        }
+        // Still usable afterwards
+        EXPECT(cache.store(identity, sampleResult(sha256), signatureVersion));
+        EXPECT(cache.findByFile(identity, signatureVersion, result));
+    }
+
+    // Slots marked used with counts that do not say so: inserts must still
+    // find room
+    {
+        std::string corrupt = image;
+        for (size_t i = 0; i < kCacheSlotCount; i++) {
+            store32(corrupt, kCacheContentsOffset + i * 48 + 44, 1);
+            store32(corrupt, kCacheFilesOffset + i * 40 + 36, 1);
+        }
+        EXPECT(writeFile(path, corrupt));
+        VerdictCache cache;
+        EXPECT(cache.open(path));
+        ScanResult result;
+        EXPECT(cache.store(FileIdentity{5, 5, 5, 5}, sampleResult(std::string(64, 'b')),
+                           signatureVersion));
+        EXPECT(cache.findByFile(FileIdentity{5, 5, 5, 5}, signatureVersion, result));
+        EXPECT(!cache.findByDigest(std::string(64, 'c'), other, signatureVersion, result));
+    }
+
+    // Random damage to the tables and the start of the heap
+    std::string hot = image.substr(0, kCacheHeapOffset + 4096);
+    for (int i = 0; i < kMutations / 3; i++) {
+        std::string corrupt = mutate(hot, random) + image.substr(hot.size());
+        EXPECT(writeFile(path, corrupt));
+        VerdictCache cache;
+        EXPECT(cache.open(path));
+        ScanResult result;
+        cache.findByFile(identity, signatureVersion, result);
+        cache.findByDigest(sha256, other, signatureVersion, result);
+        cache.storeReputation(sha256, ReputationVerdict(), signatureVersion);
+        cache.store(other, sampleResult(std::string(64, 'b')), signatureVersion);
+    }
+}
+
+// Feed in chunks of random size, the way a download lands
+void feedInChunks(StreamingScan& scan, const std::string& data, std::mt19937& random) {
+    size_t position = 0;
+    while (position < data.size()) {
+        size_t chunk = std::min<size_t>(data.size() - position, 1 + random() % 700);
+        if (!scan.feed(reinterpret_cast<const uint8_t*>(data.data()) + position, chunk)) {
+            break;
+        }
+        position += chunk;
+    }
+    EXPECT(scan.progress().bytesConsumed <= data.size());
+}
+
+void testStreamingScan() {
+    std::mt19937 random(kSeed);
+    FuzzyDigest fuzzy = sampleDigest(random);
+    auto database = SignatureDatabase::compile(sampleDefinitions(fuzzy), 1);
+    std::string apk = sampleApk(random);
+
+    {
+        StreamingScan scan(database);
+        feedInChunks(scan, apk, random);
+        EXPECT(scan.progress().entriesScanned >= 2);
+    }
+
+    for (size_t size = 0; size < apk.size(); size += 1 + size / 6) {
+        StreamingScan scan(database);
+        feedInChunks(scan, apk.substr(0, size), random);
+    }
+    for (int i = 0; i < kMutations; i++) {
+        StreamingScan scan(database);
+        feedInChunks(scan, mutate(apk, random), random);
+    }
+
+    // Local headers claiming huge sizes, names or extra fields
+    const size_t sizeFields[] = {18, 22, 26, 28};
+    for (size_t field : sizeFields) {
+        std::string corrupt = apk;
+        if (field >= 26) {
+            corrupt[field] = static_cast<char>(0xFF);
+            corrupt[field + 1] = static_cast<char>(0xFF);
+        } else {
+            store32(corrupt, field, 0xFFFFFFF0);
+        }
+        StreamingScan scan(database);
+        feedInChunks(scan, corrupt, random);
+    }
+
+    // Something that is not a ZIP at all
+    StreamingScan scan(database);
+    feedInChunks(scan, randomBytes(20000, random), random);
+}
+
+ArchiveKind probeBytes(const std::string& path, const std::string& data) {
+    EXPECT(writeFile(path, data));
+    return probeArchive(path);
+}
+
+void testArchiveProbe() {
+    TempDir dir;
+    std::mt19937 random(kSeed);
+    std::string path = dir.file("probe.bin");
+    std::string apk = sampleApk(random);
+
+    EXPECT(probeBytes(path, apk) == ArchiveKind::Apk);
+    EXPECT(probeBytes(path, buildZip({{"a.txt", "hello", false}})) == ArchiveKind::Zip);
+    EXPECT(probeBytes(path, buildZip({{"base.apk", apk, false}, {"split_config.arm64_v8a.apk", apk, false}})) ==
+           ArchiveKind::ApkBundle);
+    EXPECT(probeBytes(path, buildZip({{"a.txt", "hello", false}}, std::string(0xFFFF, 'c'))) ==
+           ArchiveKind::Zip);
+    EXPECT(probeBytes(path, "") == ArchiveKind::NotArchive);
+    EXPECT(probeBytes(path, "PK\x03\x04") == ArchiveKind::NotArchive);
+    EXPECT(probeBytes(path, randomBytes(100000, random)) == ArchiveKind::NotArchive);
+    EXPECT(probeArchive(dir.file("missing")) == ArchiveKind::NotArchive);
+    EXPECT(probeArchive(-1, 1000) == ArchiveKind::NotArchive);
+
+    // EOCD counts, directory size and offset, and comment length
+    // pointing outside the file
+    size_t eocd = apk.size() - 22;
+    const size_t eocdFields[] = {8, 10, 12, 14, 16, 18, 20};
+    for (size_t field : eocdFields) {
+        std::string corrupt = apk;
+        corrupt[eocd + field] = static_cast<char>(0xFF);
+        corrupt[eocd + field + 1] = static_cast<char>(0xFF);
+        probeBytes(path, corrupt);
+    }
+    // A central directory larger than the tail, garbage included
+    {
+        std::vector<ZipEntry> entries;
+        for (int i = 0; i < 3000; i++) {
+            entries.push_back({"res/raw/entry_" + std::to_string(i) + ".bin", "x", false});
+        }
+        entries.push_back({"AndroidManifest.xml", "m", false});
+        std::string zip = buildZip(entries);
+        EXPECT(probeBytes(path, zip) == ArchiveKind::Apk);
+        for (int i = 0; i < kMutations / 10; i++) {
+            probeBytes(path, mutate(zip, random));
+        }
+    }
+
+    EXPECT(startsWithZipHeader(reinterpret_cast<const uint8_t*>(apk.data()), apk.size()));
+    EXPECT(!startsWithZipHeader(reinterpret_cast<const uint8_t*>(apk.data()), 3));
+    EXPECT(!startsWithZipHeader(nullptr, 0));
+
+    for (size_t size = 0; size < apk.size(); size += 1 + size / 6) {
+        probeBytes(path, apk.substr(0, size));
+        probeBytes(path, apk.substr(apk.size() - size));
+    }
+    for (int i = 0; i < kMutations; i++) {
+        probeBytes(path, mutate(apk, random));
+    }
+}
+
+void testFuzzyIndex() {
+    std::mt19937 random(kSeed);
+    std::vector<FuzzyDigest> digests;
+    for (int i = 0; i < 8; i++) {
+        digests.push_back(sampleDigest(random));
+    }
+
+    std::string hex = digests[0].toHex();
+    EXPECT(hex.size() == FuzzyDigest::kHexSize);
+    FuzzyDigest parsed;
+    EXPECT(FuzzyDigest::fromHex(hex, parsed));
+    EXPECT(fuzzyDistance(parsed, digests[0]) == 0);
+    EXPECT(!FuzzyDigest::fromHex("", parsed));
+    EXPECT(!FuzzyDigest::fromHex(hex.substr(1), parsed));
+    EXPECT(!FuzzyDigest::fromHex(hex + "0", parsed));
+    std::string bad = hex;
+    bad[10] = 'g';
+    EXPECT(!FuzzyDigest::fromHex(bad, parsed));
+    bad[10] = '\0';
+    EXPECT(!FuzzyDigest::fromHex(bad, parsed));
+
+    FuzzyHasher shortInput;
+    shortInput.update(reinterpret_cast<const uint8_t*>("abc"), 3);
+    EXPECT(!shortInput.finish(parsed));
+    FuzzyHasher uniform;
+    std::string zeros(4096, '\0');
+    uniform.update(reinterpret_cast<const uint8_t*>(zeros.data()), zeros.size());
+    EXPECT(!uniform.finish(parsed));
+
+    FuzzyIndex built;
+    for (size_t i = 0; i < digests.size(); i++) {
+        built.add(digests[i], static_cast<uint32_t>(100 + i));
+    }
+    built.build();
+    std::string blob;
+    built.serialize(blob);
+
+    AlignedBlob aligned(blob);
+    FuzzyIndex attached;
+    EXPECT(attached.attach(aligned.data(), aligned.size));
+    FuzzyIndex::Match match;
+    EXPECT(attached.findNearest(digests[3], 0, match) && match.id == 103 && match.distance == 0);
+
+    for (size_t size = 0; size < blob.size(); size++) {
+        FuzzyIndex truncated;
+        EXPECT(!truncated.attach(aligned.data(), size));
+    }
+    FuzzyIndex misaligned;
+    EXPECT(!misaligned.attach(aligned.data() + 1, aligned.size - 4));
+
+    // Flipped counts and postings: rejected, or lookups stay in bounds
+    for (int i = 0; i < kMutations; i++) {
+        AlignedBlob corrupt(mutate(blob, random));
+        FuzzyIndex index;
+        if (index.attach(corrupt.data(), corrupt.size)) {
+            for (const FuzzyDigest& digest : digests) {
+                index.findNearest(digest, 300, match);
+            }
+        }
+    }
+}
+
+struct TestCase {
+    const char* name;
+    void (*run)();
+};
+
+const TestCase kCases[] = {
+    {"signature-pack", testSignaturePack},
+    {"verdict-cache", testVerdictCache},
+    {"streaming-scan", testStreamingScan},
+    {"archive-probe", testArchiveProbe},
+    {"fuzzy-index", testFuzzyIndex},
+};
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::vector<const TestCase*> selected;
+    for (int i = 1; i < argc; i++) {
+        const TestCase* found = nullptr;
+        for (const TestCase& testCase : kCases) {
+            if (strcmp(argv[i], testCase.name) == 0) {
+                found = &testCase;
+            }
+        }
+        if (found == nullptr) {
+            fprintf(stderr, "Unknown test case %s\n", argv[i]);
+            return 2;
+        }
+        selected.push_back(found);
+    }
+    if (selected.empty()) {
+        for (const TestCase& testCase : kCases) {
+            selected.push_back(&testCase);
+        }
+    }
+
+    for (const TestCase* testCase : selected) {
+        int before = failures;
+        testCase->run();
+        printf("%-16s %s\n", testCase->name, failures == before ? "ok" : "FAILED");
+    }
+    return failures == 0 ? 0 : 1;
+}
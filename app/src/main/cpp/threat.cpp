@@ -0,0 +1,116 @@
+#include "threat.h"
+
+namespace {
+
+// Indexed by ThreatId. %s takes the next string argument, %d the value.
+const char* const kThreatFormats[] = {
+    "No threats detected",
+    "File not found or inaccessible",
+    "Suspiciously small APK file",
+    "Unusually large APK file",
+    "Failed to open APK file (corrupted or invalid)",
+    "AndroidManifest.xml not found or corrupted",
+    "Suspicious permission requested: %s",
+    "Known malicious package detected: %s",
+    "Suspicious content detected in APK",
+    "Suspicious API referenced: %s",
+    "Suspicious native symbol: %s",
+    "Packed or encrypted native library: %s",
+    "Encrypted or packed payload: %s",
+    "Similar to known malware %s: %s (distance %d)",
+    "Scan time budget exceeded; content analysis incomplete",
+    "Scan error: %s"
+};
+
+constexpr size_t kThreatCount = sizeof(kThreatFormats) / sizeof(kThreatFormats[0]);
+static_assert(kThreatCount == static_cast<size_t>(ThreatId::ScanError) + 1,
+              "one format per threat");
+
+} // namespace
+
+void ThreatList::add(ThreatId id, std::string_view first, std::string_view second,
+                     int32_t value) {
+    Threat threat;
+    threat.id = id;
+    threat.value = value;
+    threat.argumentsOffset = static_cast<uint32_t>(arguments_.size());
+    arguments_.append(first.data(), first.size());
+    if (!second.empty()) {
+        arguments_ += '\0';
+        arguments_.append(second.data(), second.size());
+    }
+    threat.argumentsSize = static_cast<uint32_t>(arguments_.size()) - threat.argumentsOffset;
+    threats_.push_back(threat);
+}
+
+bool ThreatList::contains(ThreatId id) const {
+    for (const Threat& threat : threats_) {
+        if (threat.id == id) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ThreatList::contains(ThreatId id, std::string_view first) const {
+    for (const Threat& threat : threats_) {
+        if (threat.id == id && argument(threat, 0) == first) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string_view ThreatList::argument(const Threat& threat, size_t index) const {
+    std::string_view rest(arguments_.data() + threat.argumentsOffset, threat.argumentsSize);
+    for (; index > 0; index--) {
+        size_t separator = rest.find('\0');
+        if (separator == std::string_view::npos) {
+            return std::string_view();
+        }
+        rest.remove_prefix(separator + 1);
+    }
+    return rest.substr(0, rest.find('\0'));
+}
+
+void ThreatList::format(size_t index, std::string& out) const {
+    const Threat& threat = threats_[index];
+    out.clear();
+    size_t nextArgument = 0;
+    for (const char* p = kThreatFormats[static_cast<size_t>(threat.id)]; *p != '\0'; p++) {
+        if (p[0] == '%' && p[1] == 's') {
+            std::string_view value = argument(threat, nextArgument++);
+            out.append(value.data(), value.size());
+            p++;
+        } else if (p[0] == '%' && p[1] == 'd') {
+            out += std::to_string(threat.value);
+            p++;
+        } else {
+            out += *p;
+        }
+    }
+}
+
+std::string ThreatList::format(size_t index) const {
+    std::string out;
+    format(index, out);
+    return out;
+}
+
+void ThreatList::clear() {
+    threats_.clear();
+    arguments_.clear();
+}
+
+bool ThreatList::restore(std::vector<Threat> threats, std::string arguments) {
+    for (const Threat& threat : threats) {
+        if (static_cast<size_t>(threat.id) >= kThreatCount ||
+            threat.argumentsOffset > arguments.size() ||
+            threat.argumentsSize > arguments.size() - threat.argumentsOffset) {
+            return false;
+        }
+    }
+    threats_ = std::move(threats);
+    arguments_ = std::move(arguments);
+    return true;
+}
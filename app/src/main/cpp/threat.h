@@ -0,0 +1,74 @@
+#ifndef WHATSZAP_THREAT_H
+#define WHATSZAP_THREAT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// What a scan can report; the text for each is in threat.cpp. Values are
+// stored in the verdict cache, so only append.
+enum class ThreatId : uint16_t {
+    NoThreats = 0,
+    FileNotFound = 1,
+    SmallApk = 2,
+    LargeApk = 3,
+    CorruptArchive = 4,
+    MissingManifest = 5,
+    SuspiciousPermission = 6,   // permission
+    KnownPackage = 7,           // package signature
+    SuspiciousContent = 8,
+    SuspiciousApi = 9,          // dex API signature
+    SuspiciousNativeSymbol = 10,    // ELF symbol signature
+    PackedLibrary = 11,         // entry name
+    EncryptedPayload = 12,      // entry name
+    SimilarToKnownMalware = 13, // family, entry name; value: distance
+    BudgetExceeded = 14,
+    ScanError = 15              // exception message
+};
+
+struct Threat {
+    ThreatId id;
+    int32_t value;
+    // NUL-separated string arguments in the list's argument blob
+    uint32_t argumentsOffset;
+    uint32_t argumentsSize;
+};
+
+// Threats of one scan as IDs plus arguments, which share one blob. Nothing
+// is formatted until the text is needed: at the JNI boundary, or in logs.
+class ThreatList {
+public:
+    void add(ThreatId id, std::string_view first = std::string_view(),
+             std::string_view second = std::string_view(), int32_t value = 0);
+
+    size_t size() const { return threats_.size(); }
+    bool empty() const { return threats_.empty(); }
+    const Threat& operator[](size_t index) const { return threats_[index]; }
+    bool contains(ThreatId id) const;
+    // Same, with `first` as its first argument
+    bool contains(ThreatId id, std::string_view first) const;
+
+    // String argument `index` of a threat, empty if it has none
+    std::string_view argument(const Threat& threat, size_t index) const;
+
+    // User-visible text of threat `index`, replacing the contents of `out`
+    // so one buffer serves a whole list
+    void format(size_t index, std::string& out) const;
+    std::string format(size_t index) const;
+
+    void clear();
+
+    // Raw form, for the verdict cache. restore() checks that every threat's
+    // arguments lie inside the blob.
+    const std::vector<Threat>& threats() const { return threats_; }
+    const std::string& arguments() const { return arguments_; }
+    bool restore(std::vector<Threat> threats, std::string arguments);
+
+private:
+    std::vector<Threat> threats_;
+    std::string arguments_;
+};
+
+#endif // WHATSZAP_THREAT_H
@@ -0,0 +1,666 @@
+#include "verdict_cache.h"
+#include "native-lib.h"
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <zlib.h>
+
+namespace {
+
+constexpr uint32_t kCacheMagic = 0x43565A57;        // "WZVC"
+constexpr uint32_t kCacheFormatVersion = 5;
+
+// Power of two; tables are reset once 3/4 full to keep probe chains short
+constexpr uint32_t kSlotCount = 1024;
+constexpr uint32_t kMaxUsedSlots = kSlotCount / 4 * 3;
+constexpr uint32_t kHeapSize = 2 * 1024 * 1024;
+
+constexpr uint32_t kNoSlot = UINT32_MAX;
+
+uint64_t mix64(uint64_t value) {
+    value ^= value >> 33;
+    value *= 0xff51afd7ed558ccdULL;
+    value ^= value >> 33;
+    value *= 0xc4ceb9fe1a85ec53ULL;
+    value ^= value >> 33;
+    return value;
+}
+
+uint64_t hashIdentity(const FileIdentity& identity) {
+    uint64_t hash = mix64(identity.device);
+    hash = mix64(hash ^ identity.inode);
+    hash = mix64(hash ^ identity.size);
+    return mix64(hash ^ static_cast<uint64_t>(identity.mtimeNs));
+}
+
+bool parseSha256(const std::string& hex, uint8_t digest[32]) {
+    if (hex.size() != 64) {
+        return false;
+    }
+    auto nibble = [](char c) -> int {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    };
+    for (size_t i = 0; i < 32; i++) {
+        int high = nibble(hex[i * 2]);
+        int low = nibble(hex[i * 2 + 1]);
+        if (high < 0 || low < 0) {
+            return false;
+        }
+        digest[i] = static_cast<uint8_t>((high << 4) | low);
+    }
+    return true;
+}
+
+// Little helpers for the serialized ScanResult stored in the heap
+class PayloadWriter {
+public:
+    explicit PayloadWriter(std::string& out) : out_(out) {}
+
+    void u8(uint8_t value) { out_.push_back(static_cast<char>(value)); }
+    void u32(uint32_t value) { out_.append(reinterpret_cast<const char*>(&value), sizeof(value)); }
+    void u64(uint64_t value) { out_.append(reinterpret_cast<const char*>(&value), sizeof(value)); }
+    void f32(float value) { out_.append(reinterpret_cast<const char*>(&value), sizeof(value)); }
+    void f64(double value) { out_.append(reinterpret_cast<const char*>(&value), sizeof(value)); }
+    void string(const std::string& value) {
+        u32(static_cast<uint32_t>(value.size()));
+        out_ += value;
+    }
+    void strings(const std::vector<std::string>& values) {
+        u32(static_cast<uint32_t>(values.size()));
+        for (const auto& value : values) {
+            string(value);
+        }
+    }
+    // IDs and arguments as they are; text is formatted when read back
+    void threats(const ThreatList& list) {
+        u32(static_cast<uint32_t>(list.size()));
+        for (const Threat& threat : list.threats()) {
+            u32(static_cast<uint32_t>(threat.id));
+            u32(static_cast<uint32_t>(threat.value));
+            u32(threat.argumentsOffset);
+            u32(threat.argumentsSize);
+        }
+        string(list.arguments());
+    }
+
+private:
+    std::string& out_;
+};
+
+class PayloadReader {
+public:
+    PayloadReader(const uint8_t* data, size_t size) : data_(data), size_(size), position_(0) {}
+
+    bool u8(uint8_t& value) { return raw(&value, sizeof(value)); }
+    bool u32(uint32_t& value) { return raw(&value, sizeof(value)); }
+    bool u64(uint64_t& value) { return raw(&value, sizeof(value)); }
+    bool f32(float& value) { return raw(&value, sizeof(value)); }
+    bool f64(double& value) { return raw(&value, sizeof(value)); }
+    bool string(std::string& value) {
+        uint32_t length;
+        if (!u32(length) || length > size_ - position_) {
+            return false;
+        }
+        value.assign(reinterpret_cast<const char*>(data_ + position_), length);
+        position_ += length;
+        return true;
+    }
+    bool threats(ThreatList& list) {
+        uint32_t count;
+        if (!u32(count) || count > (size_ - position_) / 16) {
+            return false;
+        }
+        std::vector<Threat> threats(count);
+        for (Threat& threat : threats) {
+            uint32_t id;
+            uint32_t value;
+            if (!u32(id) || id > UINT16_MAX || !u32(value) || !u32(threat.argumentsOffset) ||
+                !u32(threat.argumentsSize)) {
+                return false;
+            }
+            threat.id = static_cast<ThreatId>(id);
+            threat.value = static_cast<int32_t>(value);
+        }
+        std::string arguments;
+        return string(arguments) && list.restore(std::move(threats), std::move(arguments));
+    }
+    bool strings(std::vector<std::string>& values) {
+        uint32_t count;
+        // Every string costs at least its 4-byte length
+        if (!u32(count) || count > (size_ - position_) / 4) {
+            return false;
+        }
+        values.resize(count);
+        for (auto& value : values) {
+            if (!string(value)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    bool raw(void* out, size_t length) {
+        if (length > size_ - position_) {
+            return false;
+        }
+        memcpy(out, data_ + position_, length);
+        position_ += length;
+        return true;
+    }
+
+    const uint8_t* data_;
+    size_t size_;
+    size_t position_;
+};
+
+void serializeResult(const ScanResult& result, std::string& out) {
+    PayloadWriter writer(out);
+    writer.u8(result.isMalicious ? 1 : 0);
+    writer.u32(static_cast<uint32_t>(result.confidence));
+    writer.threats(result.threats);
+
+    writer.string(result.digests.sha256);
+    writer.string(result.digests.sha1);
+    writer.string(result.digests.md5);
+
+    const ManifestInfo& manifest = result.manifest;
+    writer.string(manifest.packageName);
+    writer.string(manifest.versionName);
+    writer.u64(static_cast<uint64_t>(manifest.versionCode));
+    writer.string(manifest.label);
+    writer.u32(static_cast<uint32_t>(manifest.minSdkVersion));
+    writer.u32(static_cast<uint32_t>(manifest.targetSdkVersion));
+    writer.strings(manifest.permissions);
+    writer.u32(static_cast<uint32_t>(manifest.components.size()));
+    for (const auto& component : manifest.components) {
+        writer.u8(static_cast<uint8_t>(component.kind));
+        writer.string(component.name);
+        writer.string(component.permission);
+        writer.strings(component.actions);
+    }
+
+    const AppProfile& app = result.app;
+    writer.strings(app.dangerousPermissions);
+    writer.strings(app.highRiskPermissions);
+    writer.u8(static_cast<uint8_t>((app.suspiciousPackageName ? 1 : 0) | (app.hasManifest ? 2 : 0) |
+                                   (app.hasDex ? 4 : 0) | (app.hasNativeLibraries ? 8 : 0)));
+    writer.u32(app.dexCount);
+    writer.strings(app.suspiciousFiles);
+    writer.u32(static_cast<uint32_t>(app.riskScore));
+    writer.u64(app.fileSize);
+
+    writer.u32(static_cast<uint32_t>(result.entryEntropy.size()));
+    for (const EntryEntropy& entry : result.entryEntropy) {
+        writer.string(entry.name);
+        writer.f64(entry.entropy);
+        writer.f64(entry.peakWindowEntropy);
+        writer.u64(entry.bytesMeasured);
+    }
+
+    // Kept so a newer model can score the verdict again
+    writer.u32(static_cast<uint32_t>(kModelInputCount));
+    for (float value : result.modelInputs.values) {
+        writer.f32(value);
+    }
+
+    const ReputationVerdict& reputation = result.reputation;
+    writer.u8(reputation.isKnown ? 1 : 0);
+    writer.u32(static_cast<uint32_t>(reputation.detections));
+    writer.u32(static_cast<uint32_t>(reputation.engines));
+    writer.strings(reputation.threatNames);
+}
+
+bool deserializeResult(const uint8_t* data, size_t size, ScanResult& result) {
+    PayloadReader reader(data, size);
+    uint8_t flag;
+    uint32_t value32;
+    uint64_t value64;
+
+    if (!reader.u8(flag) || !reader.u32(value32) || !reader.threats(result.threats)) {
+        return false;
+    }
+    result.isMalicious = flag != 0;
+    result.confidence = static_cast<int>(value32);
+
+    if (!reader.string(result.digests.sha256) || !reader.string(result.digests.sha1) ||
+        !reader.string(result.digests.md5)) {
+        return false;
+    }
+
+    ManifestInfo& manifest = result.manifest;
+    if (!reader.string(manifest.packageName) || !reader.string(manifest.versionName) ||
+        !reader.u64(value64)) {
+        return false;
+    }
+    manifest.versionCode = static_cast<long long>(value64);
+    if (!reader.string(manifest.label) || !reader.u32(value32)) {
+        return false;
+    }
+    manifest.minSdkVersion = static_cast<int>(value32);
+    if (!reader.u32(value32) || !reader.strings(manifest.permissions)) {
+        return false;
+    }
+    manifest.targetSdkVersion = static_cast<int>(value32);
+
+    uint32_t componentCount;
+    if (!reader.u32(componentCount) || componentCount > size) {
+        return false;
+    }
+    manifest.components.resize(componentCount);
+    for (auto& component : manifest.components) {
+        if (!reader.u8(flag) || flag > static_cast<uint8_t>(ManifestComponent::Kind::Provider)) {
+            return false;
+        }
+        component.kind = static_cast<ManifestComponent::Kind>(flag);
+        if (!reader.string(component.name) || !reader.string(component.permission) ||
+            !reader.strings(component.actions)) {
+            return false;
+        }
+    }
+
+    AppProfile& app = result.app;
+    if (!reader.strings(app.dangerousPermissions) || !reader.strings(app.highRiskPermissions) ||
+        !reader.u8(flag) || !reader.u32(app.dexCount) || !reader.strings(app.suspiciousFiles) ||
+        !reader.u32(value32) || !reader.u64(app.fileSize)) {
+        return false;
+    }
+    app.suspiciousPackageName = (flag & 1) != 0;
+    app.hasManifest = (flag & 2) != 0;
+    app.hasDex = (flag & 4) != 0;
+    app.hasNativeLibraries = (flag & 8) != 0;
+    app.riskScore = static_cast<int>(value32);
+
+    // Every entry costs at least its name's length and three 8-byte values
+    uint32_t entropyCount;
+    if (!reader.u32(entropyCount) || entropyCount > size / 28) {
+        return false;
+    }
+    result.entryEntropy.resize(entropyCount);
+    for (EntryEntropy& entry : result.entryEntropy) {
+        if (!reader.string(entry.name) || !reader.f64(entry.entropy) ||
+            !reader.f64(entry.peakWindowEntropy) || !reader.u64(entry.bytesMeasured)) {
+            return false;
+        }
+    }
+
+    if (!reader.u32(value32) || value32 != kModelInputCount) {
+        return false;
+    }
+    for (float& value : result.modelInputs.values) {
+        if (!reader.f32(value)) {
+            return false;
+        }
+    }
+
+    ReputationVerdict& reputation = result.reputation;
+    if (!reader.u8(flag) || !reader.u32(value32)) {
+        return false;
+    }
+    reputation.isKnown = flag != 0;
+    reputation.detections = static_cast<int>(value32);
+    if (!reader.u32(value32) || !reader.strings(reputation.threatNames)) {
+        return false;
+    }
+    reputation.engines = static_cast<int>(value32);
+    return true;
+}
+
+} // namespace
+
+struct VerdictCache::Header {
+    uint32_t magic;
+    uint32_t formatVersion;
+    uint64_t signatureVersion;
+    uint32_t slotCount;
+    uint32_t heapSize;
+    uint32_t contentCount;
+    uint32_t fileCount;
+    uint32_t heapUsed;
+    uint32_t reserved[7];
+};
+
+struct VerdictCache::ContentSlot {
+    uint8_t sha256[32];
+    uint32_t payloadOffset;
+    uint32_t payloadSize;
+    uint32_t payloadCrc;
+    uint32_t used;              // written last, so a torn insert stays invisible
+};
+
+struct VerdictCache::FileSlot {
+    uint64_t device;
+    uint64_t inode;
+    uint64_t size;
+    int64_t mtimeNs;
+    uint32_t contentIndex;
+    uint32_t used;
+};
+
+namespace {
+
+constexpr size_t kContentsOffset = 64;
+constexpr size_t kFilesOffset = kContentsOffset + kSlotCount * 48;
+constexpr size_t kHeapOffset = kFilesOffset + kSlotCount * 40;
+constexpr size_t kCacheFileSize = kHeapOffset + kHeapSize;
+
+} // namespace
+
+FileIdentity FileIdentity::fromStat(const struct stat& fileStat) {
+    FileIdentity identity;
+    identity.device = static_cast<uint64_t>(fileStat.st_dev);
+    identity.inode = static_cast<uint64_t>(fileStat.st_ino);
+    identity.size = static_cast<uint64_t>(fileStat.st_size);
+    identity.mtimeNs = static_cast<int64_t>(fileStat.st_mtim.tv_sec) * 1000000000LL +
+                       fileStat.st_mtim.tv_nsec;
+    return identity;
+}
+
+VerdictCache::VerdictCache()
+    : mapping_(nullptr), mappingSize_(0), header_(nullptr), contents_(nullptr),
+      files_(nullptr), heap_(nullptr) {}
+
+VerdictCache::~VerdictCache() {
+    close();
+}
+
+bool VerdictCache::open(const std::string& path) {
+    static_assert(sizeof(Header) == kContentsOffset, "cache header layout");
+    static_assert(sizeof(ContentSlot) == 48, "content slot layout");
+    static_assert(sizeof(FileSlot) == 40, "file slot layout");
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (mapping_ != nullptr) {
+        munmap(mapping_, mappingSize_);
+        mapping_ = nullptr;
+    }
+
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        LOGE("Failed to open verdict cache %s: %s", path.c_str(), strerror(errno));
+        return false;
+    }
+
+    struct stat fileStat;
+    bool fresh = fstat(fd, &fileStat) != 0 ||
+                 static_cast<size_t>(fileStat.st_size) != kCacheFileSize;
+    if (fresh && ftruncate(fd, kCacheFileSize) != 0) {
+        LOGE("Failed to size verdict cache: %s", strerror(errno));
+        ::close(fd);
+        return false;
+    }
+
+    void* mapping = mmap(nullptr, kCacheFileSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        LOGE("Failed to mmap verdict cache: %s", strerror(errno));
+        return false;
+    }
+
+    mapping_ = static_cast<uint8_t*>(mapping);
+    mappingSize_ = kCacheFileSize;
+    header_ = reinterpret_cast<Header*>(mapping_);
+    contents_ = reinterpret_cast<ContentSlot*>(mapping_ + kContentsOffset);
+    files_ = reinterpret_cast<FileSlot*>(mapping_ + kFilesOffset);
+    heap_ = mapping_ + kHeapOffset;
+
+    if (fresh || header_->magic != kCacheMagic || header_->formatVersion != kCacheFormatVersion ||
+        header_->slotCount != kSlotCount || header_->heapSize != kHeapSize ||
+        header_->heapUsed > kHeapSize) {
+        reset(0);
+    }
+    LOGI("Verdict cache opened: %u entries, %u files", header_->contentCount, header_->fileCount);
+    return true;
+}
+
+void VerdictCache::close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (mapping_ != nullptr) {
+        munmap(mapping_, mappingSize_);
+    }
+    mapping_ = nullptr;
+    mappingSize_ = 0;
+    header_ = nullptr;
+    contents_ = nullptr;
+    files_ = nullptr;
+    heap_ = nullptr;
+}
+
+bool VerdictCache::isOpen() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return mapping_ != nullptr;
+}
+
+void VerdictCache::reset(uint64_t signatureVersion) {
+    memset(mapping_, 0, kHeapOffset);
+    header_->magic = kCacheMagic;
+    header_->formatVersion = kCacheFormatVersion;
+    header_->signatureVersion = signatureVersion;
+    header_->slotCount = kSlotCount;
+    header_->heapSize = kHeapSize;
+}
+
+bool VerdictCache::prepare(uint64_t signatureVersion) {
+    if (mapping_ == nullptr) {
+        return false;
+    }
+    if (header_->signatureVersion != signatureVersion) {
+        // Verdicts were reached with other signatures
+        if (header_->contentCount > 0) {
+            LOGI("Signatures changed to v%llu; dropping %u cached verdicts",
+                 static_cast<unsigned long long>(signatureVersion), header_->contentCount);
+        }
+        reset(signatureVersion);
+    }
+    return true;
+}
+
+uint32_t VerdictCache::findContent(const uint8_t digest[32]) const {
+    uint64_t start;
+    memcpy(&start, digest, sizeof(start));
+    for (uint32_t probe = 0; probe < kSlotCount; probe++) {
+        uint32_t index = static_cast<uint32_t>(start + probe) & (kSlotCount - 1);
+        const ContentSlot& slot = contents_[index];
+        if (!slot.used) {
+            return kNoSlot;
+        }
+        if (memcmp(slot.sha256, digest, 32) == 0) {
+            return index;
+        }
+    }
+    return kNoSlot;
+}
+
+uint32_t VerdictCache::findFile(const FileIdentity& identity) const {
+    uint64_t start = hashIdentity(identity);
+    for (uint32_t probe = 0; probe < kSlotCount; probe++) {
+        uint32_t index = static_cast<uint32_t>(start + probe) & (kSlotCount - 1);
+        const FileSlot& slot = files_[index];
+        if (!slot.used) {
+            return kNoSlot;
+        }
+        if (slot.device == identity.device && slot.inode == identity.inode &&
+            slot.size == identity.size && slot.mtimeNs == identity.mtimeNs) {
+            return index;
+        }
+    }
+    return kNoSlot;
+}
+
+bool VerdictCache::readContent(uint32_t contentIndex, ScanResult& out) const {
+    if (contentIndex >= kSlotCount || !contents_[contentIndex].used) {
+        return false;
+    }
+    const ContentSlot& slot = contents_[contentIndex];
+    if (slot.payloadOffset > kHeapSize || slot.payloadSize > kHeapSize - slot.payloadOffset) {
+        return false;
+    }
+    const uint8_t* payload = heap_ + slot.payloadOffset;
+    if (crc32(0L, payload, slot.payloadSize) != slot.payloadCrc) {
+        LOGW("Corrupted verdict cache entry %u", contentIndex);
+        return false;
+    }
+    ScanResult cached;
+    if (!deserializeResult(payload, slot.payloadSize, cached)) {
+        return false;
+    }
+    out = std::move(cached);
+    return true;
+}
+
+uint32_t VerdictCache::putContent(const uint8_t digest[32], const std::string& payload) {
+    if (payload.size() > kHeapSize) {
+        return kNoSlot;
+    }
+    // A full identity table is linkFile's to clear; the contents stay
+    if (header_->contentCount >= kMaxUsedSlots || payload.size() > kHeapSize - header_->heapUsed) {
+        // Full: start over rather than track recency for a few hundred
+        // entries. Identities point at content slots, so they go too.
+        LOGI("Verdict cache full; clearing %u entries", header_->contentCount);
+        reset(header_->signatureVersion);
+    }
+
+    uint32_t index = findContent(digest);
+    bool isNew = index == kNoSlot;
+    if (isNew) {
+        uint64_t start;
+        memcpy(&start, digest, sizeof(start));
+        index = static_cast<uint32_t>(start) & (kSlotCount - 1);
+        for (uint32_t probe = 1; contents_[index].used && probe < kSlotCount; probe++) {
+            index = (index + 1) & (kSlotCount - 1);
+        }
+        if (contents_[index].used) {
+            // No free slot below kMaxUsedSlots: the file was damaged
+            LOGW("Verdict cache slots do not match its counts; clearing it");
+            reset(header_->signatureVersion);
+        }
+    }
+
+    // Payload first, then the slot; `used` flips last for new slots
+    uint32_t offset = header_->heapUsed;
+    memcpy(heap_ + offset, payload.data(), payload.size());
+    header_->heapUsed = offset + static_cast<uint32_t>(payload.size());
+
+    ContentSlot& slot = contents_[index];
+    memcpy(slot.sha256, digest, 32);
+    slot.payloadOffset = offset;
+    slot.payloadSize = static_cast<uint32_t>(payload.size());
+    slot.payloadCrc = static_cast<uint32_t>(
+        crc32(0L, reinterpret_cast<const Bytef*>(payload.data()), slot.payloadSize));
+    if (isNew) {
+        slot.used = 1;
+        header_->contentCount++;
+    }
+    return index;
+}
+
+void VerdictCache::linkFile(const FileIdentity& identity, uint32_t contentIndex) {
+    uint32_t index = findFile(identity);
+    if (index != kNoSlot) {
+        files_[index].contentIndex = contentIndex;
+        return;
+    }
+    if (header_->fileCount >= kMaxUsedSlots) {
+        // Keep the contents; identities are only a shortcut
+        memset(files_, 0, kSlotCount * sizeof(FileSlot));
+        header_->fileCount = 0;
+    }
+    index = static_cast<uint32_t>(hashIdentity(identity)) & (kSlotCount - 1);
+    for (uint32_t probe = 1; files_[index].used && probe < kSlotCount; probe++) {
+        index = (index + 1) & (kSlotCount - 1);
+    }
+    if (files_[index].used) {
+        memset(files_, 0, kSlotCount * sizeof(FileSlot));
+        header_->fileCount = 0;
+    }
+    FileSlot& slot = files_[index];
+    slot.device = identity.device;
+    slot.inode = identity.inode;
+    slot.size = identity.size;
+    slot.mtimeNs = identity.mtimeNs;
+    slot.contentIndex = contentIndex;
+    slot.used = 1;
+    header_->fileCount++;
+}
+
+bool VerdictCache::findByFile(const FileIdentity& identity, uint64_t signatureVersion,
+                              ScanResult& out) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!prepare(signatureVersion)) {
+        return false;
+    }
+    uint32_t index = findFile(identity);
+    return index != kNoSlot && readContent(files_[index].contentIndex, out);
+}
+
+bool VerdictCache::containsFile(const FileIdentity& identity, uint64_t signatureVersion) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return prepare(signatureVersion) && findFile(identity) != kNoSlot;
+}
+
+bool VerdictCache::findByDigest(const std::string& sha256, const FileIdentity& identity,
+                                uint64_t signatureVersion, ScanResult& out) {
+    uint8_t digest[32];
+    if (!parseSha256(sha256, digest)) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!prepare(signatureVersion)) {
+        return false;
+    }
+    uint32_t index = findContent(digest);
+    if (index == kNoSlot || !readContent(index, out)) {
+        return false;
+    }
+    linkFile(identity, index);
+    return true;
+}
+
+bool VerdictCache::store(const FileIdentity& identity, const ScanResult& result,
+                         uint64_t signatureVersion) {
+    uint8_t digest[32];
+    if (!parseSha256(result.digests.sha256, digest)) {
+        return false;
+    }
+    std::string payload;
+    serializeResult(result, payload);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!prepare(signatureVersion)) {
+        return false;
+    }
+    uint32_t index = putContent(digest, payload);
+    if (index == kNoSlot) {
+        return false;
+    }
+    linkFile(identity, index);
+    return true;
+}
+
+bool VerdictCache::storeReputation(const std::string& sha256, const ReputationVerdict& reputation,
+                                   uint64_t signatureVersion) {
+    uint8_t digest[32];
+    if (!parseSha256(sha256, digest)) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!prepare(signatureVersion)) {
+        return false;
+    }
+    ScanResult cached;
+    uint32_t index = findContent(digest);
+    if (index == kNoSlot || !readContent(index, cached)) {
+        return false;
+    }
+    cached.reputation = reputation;
+    std::string payload;
+    serializeResult(cached, payload);
+    // A reset while making room drops the identities; the next sighting
+    // of the file relinks it by hash
+    return putContent(digest, payload) != kNoSlot;
+}
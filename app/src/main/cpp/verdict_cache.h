@@ -0,0 +1,85 @@
+#ifndef WHATSZAP_VERDICT_CACHE_H
+#define WHATSZAP_VERDICT_CACHE_H
+
+#include "scan_result.h"
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <sys/stat.h>
+
+// Identity of a file on disk; a changed size or mtime means changed content
+struct FileIdentity {
+    uint64_t device;
+    uint64_t inode;
+    uint64_t size;
+    int64_t mtimeNs;
+
+    static FileIdentity fromStat(const struct stat& fileStat);
+};
+
+// Persistent cache of scan verdicts in one memory-mapped file:
+//
+//   header    magic "WZVC", format version, signature version, counts
+//   contents  open-addressing table keyed by SHA-256 -> serialized result
+//   files     open-addressing table keyed by FileIdentity -> content slot
+//   heap      append-only area holding the serialized results
+//
+// A re-delivered file is recognized by its identity before it is even
+// opened; a copy under a new path is recognized by its hash and linked to
+// the existing entry. Verdicts depend on the signatures, so the whole
+// cache is dropped when the signature version changes, and also when the
+// contents table or the heap fills up. A full files table only drops the
+// identities, which the next lookup by hash links again.
+class VerdictCache {
+public:
+    VerdictCache();
+    ~VerdictCache();
+
+    VerdictCache(const VerdictCache&) = delete;
+    VerdictCache& operator=(const VerdictCache&) = delete;
+
+    // Map (creating or resetting if needed) the cache file
+    bool open(const std::string& path);
+    void close();
+    bool isOpen() const;
+
+    bool findByFile(const FileIdentity& identity, uint64_t signatureVersion, ScanResult& out);
+    // Same lookup without reading the result
+    bool containsFile(const FileIdentity& identity, uint64_t signatureVersion);
+
+    // Look up by content hash; on a hit `identity` is linked to the entry
+    // so the next lookup for that file needs no hashing
+    bool findByDigest(const std::string& sha256, const FileIdentity& identity,
+                      uint64_t signatureVersion, ScanResult& out);
+
+    // Cache a complete verdict under result.digests.sha256 and identity
+    bool store(const FileIdentity& identity, const ScanResult& result, uint64_t signatureVersion);
+
+    // Attach an online reputation verdict to a cached entry
+    bool storeReputation(const std::string& sha256, const ReputationVerdict& reputation,
+                         uint64_t signatureVersion);
+
+private:
+    struct Header;
+    struct ContentSlot;
+    struct FileSlot;
+
+    bool prepare(uint64_t signatureVersion);
+    void reset(uint64_t signatureVersion);
+    uint32_t findContent(const uint8_t digest[32]) const;
+    uint32_t findFile(const FileIdentity& identity) const;
+    uint32_t putContent(const uint8_t digest[32], const std::string& payload);
+    void linkFile(const FileIdentity& identity, uint32_t contentIndex);
+    bool readContent(uint32_t contentIndex, ScanResult& out) const;
+
+    mutable std::mutex mutex_;
+    uint8_t* mapping_;
+    size_t mappingSize_;
+    Header* header_;
+    ContentSlot* contents_;
+    FileSlot* files_;
+    uint8_t* heap_;
+};
+
+#endif // WHATSZAP_VERDICT_CACHE_H
@@ -0,0 +1,221 @@
+#include "worker_pool.h"
+#include "native-lib.h"
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <algorithm>
+
+namespace {
+
+// Routes submissions made from inside a task to the submitting worker
+thread_local const WorkerPool* tCurrentPool = nullptr;
+thread_local size_t tCurrentWorker = 0;
+// Of the task the thread is running, inherited by the tasks it fans out
+thread_local TaskPriority tCurrentPriority = TaskPriority::Foreground;
+
+long readCpuMaxFrequency(int cpu) {
+    char path[96];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cpufreq/cpuinfo_max_freq", cpu);
+    FILE* file = fopen(path, "re");
+    if (file == nullptr) {
+        return -1;
+    }
+    long frequency = -1;
+    if (fscanf(file, "%ld", &frequency) != 1) {
+        frequency = -1;
+    }
+    fclose(file);
+    return frequency;
+}
+
+} // namespace
+
+std::vector<int> WorkerPool::bigCores() {
+    long cpuCount = sysconf(_SC_NPROCESSORS_CONF);
+    if (cpuCount < 1) {
+        cpuCount = 1;
+    }
+
+    std::vector<long> frequencies(static_cast<size_t>(cpuCount));
+    long lowest = -1;
+    for (int cpu = 0; cpu < cpuCount; cpu++) {
+        frequencies[cpu] = readCpuMaxFrequency(cpu);
+        if (frequencies[cpu] > 0 && (lowest < 0 || frequencies[cpu] < lowest)) {
+            lowest = frequencies[cpu];
+        }
+    }
+
+    // Everything above the slowest cluster: big and prime cores on
+    // big.LITTLE parts, every CPU on symmetric ones
+    std::vector<int> cores;
+    for (int cpu = 0; cpu < cpuCount; cpu++) {
+        if (frequencies[cpu] > lowest) {
+            cores.push_back(cpu);
+        }
+    }
+    if (cores.empty()) {
+        for (int cpu = 0; cpu < cpuCount; cpu++) {
+            cores.push_back(cpu);
+        }
+    }
+    return cores;
+}
+
+WorkerPool::WorkerPool(size_t threadCount) : nextWorker_(0), pending_(0), stopping_(false) {
+    std::vector<int> cpus = bigCores();
+    if (threadCount == 0) {
+        threadCount = cpus.size();
+    }
+    threadCount = std::max<size_t>(threadCount, 1);
+
+    for (size_t i = 0; i < threadCount; i++) {
+        workers_.push_back(std::make_unique<Worker>());
+    }
+    for (size_t i = 0; i < threadCount; i++) {
+        workers_[i]->thread = std::thread(&WorkerPool::workerLoop, this, i, cpus);
+    }
+    LOGI("Worker pool started with %zu threads on %zu big cores", threadCount, cpus.size());
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(idleMutex_);
+        stopping_ = true;
+    }
+    idleCondition_.notify_all();
+    for (auto& worker : workers_) {
+        if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
+    }
+}
+
+void WorkerPool::submit(Task task, TaskPriority priority) {
+    size_t index = tCurrentPool == this
+                       ? tCurrentWorker
+                       : nextWorker_.fetch_add(1, std::memory_order_relaxed) % workers_.size();
+    Worker& worker = *workers_[index];
+    {
+        std::lock_guard<std::mutex> queueLock(worker.mutex);
+        worker.queues[static_cast<int>(priority)].push_back(std::move(task));
+        // Counted under the queue lock so pending_ never lags the queues
+        std::lock_guard<std::mutex> idleLock(idleMutex_);
+        pending_++;
+    }
+    idleCondition_.notify_one();
+}
+
+void WorkerPool::parallelFor(size_t count, const std::function<void(size_t)>& body,
+                             TaskPriority priority) {
+    if (count == 0) {
+        return;
+    }
+    if (count == 1 || workers_.size() == 1) {
+        for (size_t i = 0; i < count; i++) {
+            body(i);
+        }
+        return;
+    }
+
+    // Shared with helper tasks, which may only get to run after this
+    // call returned; by then `next` is past the end and they do nothing
+    struct Loop {
+        const std::function<void(size_t)>* body;
+        size_t count;
+        std::atomic<size_t> next;
+        std::atomic<size_t> remaining;
+        std::mutex mutex;
+        std::condition_variable done;
+
+        void work() {
+            size_t index;
+            while ((index = next.fetch_add(1, std::memory_order_relaxed)) < count) {
+                (*body)(index);
+                if (remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    done.notify_all();
+                }
+            }
+        }
+    };
+    auto loop = std::make_shared<Loop>();
+    loop->body = &body;
+    loop->count = count;
+    loop->next = 0;
+    loop->remaining = count;
+
+    size_t helpers = std::min(count, workers_.size()) - 1;
+    for (size_t i = 0; i < helpers; i++) {
+        submit([loop] { loop->work(); }, priority);
+    }
+    loop->work();
+
+    std::unique_lock<std::mutex> lock(loop->mutex);
+    loop->done.wait(lock, [&] { return loop->remaining.load(std::memory_order_acquire) == 0; });
+}
+
+TaskPriority WorkerPool::currentPriority() {
+    return tCurrentPriority;
+}
+
+bool WorkerPool::takeTask(size_t index, Task& task, TaskPriority& taskPriority) {
+    size_t count = workers_.size();
+    for (int priority = 0; priority < kPriorityCount; priority++) {
+        for (size_t offset = 0; offset < count; offset++) {
+            Worker& worker = *workers_[(index + offset) % count];
+            std::lock_guard<std::mutex> queueLock(worker.mutex);
+            std::deque<Task>& queue = worker.queues[priority];
+            if (queue.empty()) {
+                continue;
+            }
+            // Own work in submission order; steal from the far end
+            if (offset == 0) {
+                task = std::move(queue.front());
+                queue.pop_front();
+            } else {
+                task = std::move(queue.back());
+                queue.pop_back();
+            }
+            taskPriority = static_cast<TaskPriority>(priority);
+            std::lock_guard<std::mutex> idleLock(idleMutex_);
+            pending_--;
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkerPool::workerLoop(size_t index, const std::vector<int>& cpus) {
+    tCurrentPool = this;
+    tCurrentWorker = index;
+
+    char name[16];
+    snprintf(name, sizeof(name), "wz-worker-%zu", index);
+    pthread_setname_np(pthread_self(), name);
+
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    for (int cpu : cpus) {
+        CPU_SET(cpu, &cpuSet);
+    }
+    if (sched_setaffinity(0, sizeof(cpuSet), &cpuSet) != 0) {
+        LOGW("Could not pin %s to big cores", name);
+    }
+
+    while (true) {
+        Task task;
+        TaskPriority priority;
+        if (takeTask(index, task, priority)) {
+            tCurrentPriority = priority;
+            task();
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(idleMutex_);
+        idleCondition_.wait(lock, [this] { return stopping_ || pending_ > 0; });
+        if (stopping_ && pending_ == 0) {
+            break;
+        }
+    }
+    tCurrentPool = nullptr;
+}
@@ -0,0 +1,78 @@
+#ifndef WHATSZAP_WORKER_POOL_H
+#define WHATSZAP_WORKER_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Lower value runs first
+enum class TaskPriority : int {
+    Foreground = 0,     // a file the user is looking at right now
+    Normal = 1,         // freshly detected downloads
+    Background = 2      // rescans and catch-up work
+};
+
+// Fixed set of worker threads pinned to the big cores. Each worker owns a
+// queue per priority; tasks submitted from a worker go to its own queue,
+// others are spread round-robin. An idle worker takes the highest-priority
+// task it can find, from its own queue first and then stealing from the
+// others, so one burst of submissions does not leave cores idle.
+class WorkerPool {
+public:
+    using Task = std::function<void()>;
+
+    // threadCount 0 sizes the pool to the big cores
+    explicit WorkerPool(size_t threadCount = 0);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    void submit(Task task, TaskPriority priority);
+
+    // Run body(0) .. body(count - 1) across the pool and return when all
+    // calls are done. The caller works through indices too, so this is
+    // safe to call from inside a task even when every worker is busy.
+    // Helpers are queued at `priority`, normally currentPriority(), so work
+    // fanned out by a background scan stays behind foreground scans.
+    void parallelFor(size_t count, const std::function<void(size_t)>& body,
+                     TaskPriority priority);
+
+    // Priority of the task running on the calling thread; Foreground off
+    // the pool, where the calling thread itself waits for the result
+    static TaskPriority currentPriority();
+
+    size_t threadCount() const { return workers_.size(); }
+
+    // CPUs of the fastest cluster, from cpufreq; all CPUs when not exposed
+    static std::vector<int> bigCores();
+
+private:
+    static constexpr int kPriorityCount = 3;
+
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Task> queues[kPriorityCount];
+        std::thread thread;
+    };
+
+    void workerLoop(size_t index, const std::vector<int>& cpus);
+    bool takeTask(size_t index, Task& task, TaskPriority& priority);
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::atomic<size_t> nextWorker_;
+
+    // Idle workers sleep here; pending_ counts queued tasks
+    std::mutex idleMutex_;
+    std::condition_variable idleCondition_;
+    size_t pending_;
+    bool stopping_;
+};
+
+#endif // WHATSZAP_WORKER_POOL_H
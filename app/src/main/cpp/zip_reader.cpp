@@ -0,0 +1,362 @@
+#include "zip_reader.h"
+#include "native-lib.h"
+#include "scan_arena.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <algorithm>
+#include <zlib.h>
+
+namespace {
+
+constexpr uint32_t kLocalHeaderSig = 0x04034b50;
+constexpr uint32_t kCentralHeaderSig = 0x02014b50;
+constexpr uint32_t kEndOfCentralDirSig = 0x06054b50;
+constexpr uint32_t kZip64EndOfCentralDirSig = 0x06064b50;
+constexpr uint32_t kZip64LocatorSig = 0x07064b50;
+
+constexpr size_t kLocalHeaderSize = 30;
+constexpr size_t kCentralHeaderSize = 46;
+constexpr size_t kEndOfCentralDirSize = 22;
+constexpr size_t kZip64LocatorSize = 20;
+constexpr size_t kZip64EndOfCentralDirSize = 56;
+constexpr size_t kMaxCommentSize = 0xFFFF;
+
+constexpr uint16_t kZip64ExtraId = 0x0001;
+
+// zlib's inflate state and window come from the thread's arena too
+voidpf arenaAlloc(voidpf opaque, uInt items, uInt size) {
+    return static_cast<ScanArena*>(opaque)->allocate(static_cast<size_t>(items) * size);
+}
+
+void arenaFree(voidpf, voidpf) {}
+
+inline uint16_t readU16(const uint8_t* p) {
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+inline uint32_t readU32(const uint8_t* p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+inline uint64_t readU64(const uint8_t* p) {
+    return static_cast<uint64_t>(readU32(p)) | (static_cast<uint64_t>(readU32(p + 4)) << 32);
+}
+
+} // namespace
+
+void applyZip64Extra(const uint8_t* extra, size_t extraLength, ZipEntry& entry) {
+    size_t pos = 0;
+    while (pos + 4 <= extraLength) {
+        uint16_t id = readU16(extra + pos);
+        uint16_t length = readU16(extra + pos + 2);
+        pos += 4;
+        if (pos + length > extraLength) {
+            return;
+        }
+        if (id == kZip64ExtraId) {
+            const uint8_t* field = extra + pos;
+            size_t remaining = length;
+            if (entry.uncompressedSize == 0xFFFFFFFF && remaining >= 8) {
+                entry.uncompressedSize = readU64(field);
+                field += 8;
+                remaining -= 8;
+            }
+            if (entry.compressedSize == 0xFFFFFFFF && remaining >= 8) {
+                entry.compressedSize = readU64(field);
+                field += 8;
+                remaining -= 8;
+            }
+            if (entry.localHeaderOffset == 0xFFFFFFFF && remaining >= 8) {
+                entry.localHeaderOffset = readU64(field);
+            }
+            return;
+        }
+        pos += length;
+    }
+}
+
+ZipArchive::ZipArchive() : data_(nullptr), size_(0), mapped_(false) {
+}
+
+ZipArchive::~ZipArchive() {
+    close();
+}
+
+bool ZipArchive::open(const std::string& path) {
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        LOGE("Failed to open %s: %s", path.c_str(), strerror(errno));
+        return false;
+    }
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || fileStat.st_size < static_cast<off_t>(kEndOfCentralDirSize)) {
+        ::close(fd);
+        return false;
+    }
+
+    size_t length = static_cast<size_t>(fileStat.st_size);
+    void* mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping keeps its own reference to the file
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        LOGE("Failed to mmap %s: %s", path.c_str(), strerror(errno));
+        return false;
+    }
+
+    data_ = static_cast<const uint8_t*>(mapping);
+    size_ = length;
+    mapped_ = true;
+
+    if (!parseCentralDirectory()) {
+        LOGW("Invalid ZIP central directory: %s", path.c_str());
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool ZipArchive::openMemory(const uint8_t* data, size_t size) {
+    close();
+    if (data == nullptr || size < kEndOfCentralDirSize) {
+        return false;
+    }
+    data_ = data;
+    size_ = size;
+    if (!parseCentralDirectory()) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void ZipArchive::close() {
+    if (data_ != nullptr && mapped_) {
+        munmap(const_cast<uint8_t*>(data_), size_);
+    }
+    data_ = nullptr;
+    size_ = 0;
+    mapped_ = false;
+    entries_.clear();
+}
+
+bool ZipArchive::locateEndOfCentralDirectory(uint64_t& cdOffset, uint64_t& cdSize,
+                                             uint64_t& entryCount) const {
+    // The EOCD record sits in the last 22 + comment bytes; scan backwards
+    size_t searchStart = size_ > kEndOfCentralDirSize + kMaxCommentSize
+                             ? size_ - kEndOfCentralDirSize - kMaxCommentSize
+                             : 0;
+    size_t eocd = SIZE_MAX;
+    for (size_t pos = size_ - kEndOfCentralDirSize + 1; pos-- > searchStart;) {
+        if (readU32(data_ + pos) == kEndOfCentralDirSig) {
+            eocd = pos;
+            break;
+        }
+    }
+    if (eocd == SIZE_MAX) {
+        return false;
+    }
+
+    const uint8_t* record = data_ + eocd;
+    entryCount = readU16(record + 10);
+    cdSize = readU32(record + 12);
+    cdOffset = readU32(record + 16);
+
+    // ZIP64 archives store the real values in a separate record
+    if ((cdOffset == 0xFFFFFFFF || cdSize == 0xFFFFFFFF || entryCount == 0xFFFF) &&
+        eocd >= kZip64LocatorSize) {
+        const uint8_t* locator = data_ + eocd - kZip64LocatorSize;
+        if (readU32(locator) == kZip64LocatorSig) {
+            uint64_t zip64Offset = readU64(locator + 8);
+            if (size_ >= kZip64EndOfCentralDirSize &&
+                zip64Offset <= size_ - kZip64EndOfCentralDirSize &&
+                readU32(data_ + zip64Offset) == kZip64EndOfCentralDirSig) {
+                const uint8_t* zip64 = data_ + zip64Offset;
+                entryCount = readU64(zip64 + 32);
+                cdSize = readU64(zip64 + 40);
+                cdOffset = readU64(zip64 + 48);
+            }
+        }
+    }
+
+    return cdOffset <= size_ && cdSize <= size_ - cdOffset;
+}
+
+bool ZipArchive::parseCentralDirectory() {
+    uint64_t cdOffset = 0;
+    uint64_t cdSize = 0;
+    uint64_t entryCount = 0;
+    if (!locateEndOfCentralDirectory(cdOffset, cdSize, entryCount)) {
+        return false;
+    }
+
+    // Never trust the declared count for the reservation
+    entries_.reserve(static_cast<size_t>(std::min<uint64_t>(entryCount, cdSize / kCentralHeaderSize)));
+
+    const uint8_t* pos = data_ + cdOffset;
+    const uint8_t* end = pos + cdSize;
+    while (pos + kCentralHeaderSize <= end && readU32(pos) == kCentralHeaderSig) {
+        uint16_t nameLength = readU16(pos + 28);
+        uint16_t extraLength = readU16(pos + 30);
+        uint16_t commentLength = readU16(pos + 32);
+        size_t recordSize = kCentralHeaderSize + nameLength + extraLength + commentLength;
+        if (static_cast<size_t>(end - pos) < recordSize) {
+            break;
+        }
+
+        ZipEntry entry;
+        entry.flags = readU16(pos + 8);
+        entry.method = readU16(pos + 10);
+        entry.crc32 = readU32(pos + 16);
+        entry.compressedSize = readU32(pos + 20);
+        entry.uncompressedSize = readU32(pos + 24);
+        entry.localHeaderOffset = readU32(pos + 42);
+        entry.name = std::string_view(reinterpret_cast<const char*>(pos + kCentralHeaderSize),
+                                      nameLength);
+        applyZip64Extra(pos + kCentralHeaderSize + nameLength, extraLength, entry);
+
+        entries_.push_back(entry);
+        pos += recordSize;
+    }
+
+    return !entries_.empty() || entryCount == 0;
+}
+
+const ZipEntry* ZipArchive::findEntry(std::string_view name) const {
+    for (const auto& entry : entries_) {
+        if (entry.name == name) {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+std::string_view ZipArchive::rawData(const ZipEntry& entry) const {
+    if (entry.localHeaderOffset > size_ || size_ - entry.localHeaderOffset < kLocalHeaderSize) {
+        return {};
+    }
+    const uint8_t* header = data_ + entry.localHeaderOffset;
+    if (readU32(header) != kLocalHeaderSig) {
+        return {};
+    }
+
+    // Local name/extra lengths may differ from the central directory copy
+    uint64_t dataOffset = entry.localHeaderOffset + kLocalHeaderSize +
+                          readU16(header + 26) + readU16(header + 28);
+    if (dataOffset > size_ || entry.compressedSize > size_ - dataOffset) {
+        return {};
+    }
+    return std::string_view(reinterpret_cast<const char*>(data_ + dataOffset),
+                            static_cast<size_t>(entry.compressedSize));
+}
+
+bool ZipArchive::readEntry(const ZipEntry& entry, const ZipChunkSink& sink) const {
+    std::string_view raw = rawData(entry);
+    if (raw.data() == nullptr) {
+        return false;
+    }
+    const uint8_t* input = reinterpret_cast<const uint8_t*>(raw.data());
+
+    if (entry.isStored()) {
+        // Zero-copy: hand out the mapping itself
+        for (size_t offset = 0; offset < raw.size(); offset += kChunkSize) {
+            size_t length = std::min(kChunkSize, raw.size() - offset);
+            if (!sink(input + offset, length)) {
+                break;
+            }
+        }
+        return true;
+    }
+
+    if (entry.method != Z_DEFLATED) {
+        LOGW("Unsupported compression method %u for %.*s", entry.method,
+             static_cast<int>(entry.name.size()), entry.name.data());
+        return false;
+    }
+
+    ArenaScope scope(ScanArena::local());
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    stream.zalloc = arenaAlloc;
+    stream.zfree = arenaFree;
+    stream.opaque = &scope.arena();
+    // Negative window bits: raw deflate without a zlib header
+    if (inflateInit2(&stream, -MAX_WBITS) != Z_OK) {
+        return false;
+    }
+
+    uint8_t* window = scope.arena().allocateArray<uint8_t>(kChunkSize);
+    size_t consumed = 0;
+    int status = Z_OK;
+    bool keepGoing = true;
+
+    while (keepGoing && status != Z_STREAM_END) {
+        if (stream.avail_in == 0 && consumed < raw.size()) {
+            // zlib counts in uInt, so feed very large entries in slices
+            size_t slice = std::min<size_t>(raw.size() - consumed, 1u << 30);
+            stream.next_in = const_cast<Bytef*>(input + consumed);
+            stream.avail_in = static_cast<uInt>(slice);
+            consumed += slice;
+        }
+        stream.next_out = window;
+        stream.avail_out = static_cast<uInt>(kChunkSize);
+
+        status = inflate(&stream, Z_NO_FLUSH);
+        if (status != Z_OK && status != Z_STREAM_END) {
+            break;
+        }
+
+        size_t produced = kChunkSize - stream.avail_out;
+        if (produced > 0) {
+            keepGoing = sink(window, produced);
+        } else if (stream.avail_in == 0 && consumed >= raw.size()) {
+            // Truncated stream: no more input and no progress
+            break;
+        }
+    }
+
+    inflateEnd(&stream);
+    return status == Z_STREAM_END || !keepGoing;
+}
+
+bool ZipArchive::extractEntry(const ZipEntry& entry, std::string& out, size_t maxSize) const {
+    out.clear();
+    if (entry.uncompressedSize > maxSize) {
+        return false;
+    }
+    out.reserve(static_cast<size_t>(entry.uncompressedSize));
+
+    bool tooLarge = false;
+    bool ok = readEntry(entry, [&](const uint8_t* data, size_t length) {
+        if (out.size() + length > maxSize) {
+            tooLarge = true;
+            return false;
+        }
+        out.append(reinterpret_cast<const char*>(data), length);
+        return true;
+    });
+    return ok && !tooLarge;
+}
+
+bool ZipArchive::extractEntry(const ZipEntry& entry, uint8_t* out, size_t capacity,
+                              size_t& length) const {
+    length = 0;
+    bool tooLarge = false;
+    bool ok = readEntry(entry, [&](const uint8_t* data, size_t chunkLength) {
+        if (chunkLength > capacity - length) {
+            tooLarge = true;
+            return false;
+        }
+        memcpy(out + length, data, chunkLength);
+        length += chunkLength;
+        return true;
+    });
+    return ok && !tooLarge;
+}
@@ -0,0 +1,89 @@
+#ifndef WHATSZAP_ZIP_READER_H
+#define WHATSZAP_ZIP_READER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// One central-directory record. `name` points into the mapped archive.
+struct ZipEntry {
+    std::string_view name;
+    uint16_t method;            // 0 = stored, 8 = deflated
+    uint16_t flags;
+    uint32_t crc32;
+    uint64_t compressedSize;
+    uint64_t uncompressedSize;
+    uint64_t localHeaderOffset;
+
+    bool isStored() const { return method == 0; }
+    bool isDirectory() const { return !name.empty() && name.back() == '/'; }
+};
+
+// Replace 0xFFFFFFFF placeholders with values from a ZIP64 extra field
+void applyZip64Extra(const uint8_t* extra, size_t extraLength, ZipEntry& entry);
+
+// Receives decompressed bytes of an entry; return false to stop early.
+using ZipChunkSink = std::function<bool(const uint8_t* data, size_t length)>;
+
+// Read-only ZIP reader over a memory-mapped file. Only the End-of-Central-
+// Directory and central directory records are parsed up front; entry data is
+// handed out as views into the mapping (stored) or streamed through a small
+// inflate window (deflated), so the archive itself is never copied.
+class ZipArchive {
+public:
+    ZipArchive();
+    ~ZipArchive();
+
+    ZipArchive(const ZipArchive&) = delete;
+    ZipArchive& operator=(const ZipArchive&) = delete;
+
+    // Map the file and parse its central directory
+    bool open(const std::string& path);
+    // Parse an archive that is already in memory, such as a stored APK
+    // inside a bundle, without copying it; `data` must outlive the archive
+    bool openMemory(const uint8_t* data, size_t size);
+    void close();
+
+    bool isOpen() const { return data_ != nullptr; }
+    size_t size() const { return size_; }
+    // The whole mapped file, e.g. for hashing without another read
+    const uint8_t* data() const { return data_; }
+    const std::vector<ZipEntry>& entries() const { return entries_; }
+
+    const ZipEntry* findEntry(std::string_view name) const;
+
+    // Raw (possibly compressed) bytes of an entry inside the mapping.
+    // Empty if the local header is out of bounds.
+    std::string_view rawData(const ZipEntry& entry) const;
+
+    // Stream the decompressed bytes of an entry in bounded chunks. The
+    // inflate state lives in the calling thread's ScanArena; anything the
+    // sink allocates there is released when this returns.
+    bool readEntry(const ZipEntry& entry, const ZipChunkSink& sink) const;
+
+    // Decompress a (small) entry into `out`, failing if it exceeds maxSize
+    bool extractEntry(const ZipEntry& entry, std::string& out, size_t maxSize) const;
+
+    // Same into a caller buffer, e.g. from a ScanArena; `length` is set to
+    // the decompressed size, and the call fails if it exceeds capacity
+    bool extractEntry(const ZipEntry& entry, uint8_t* out, size_t capacity,
+                      size_t& length) const;
+
+    // Chunk size used when streaming entries
+    static constexpr size_t kChunkSize = 64 * 1024;
+
+private:
+    bool parseCentralDirectory();
+    bool locateEndOfCentralDirectory(uint64_t& cdOffset, uint64_t& cdSize,
+                                     uint64_t& entryCount) const;
+
+    const uint8_t* data_;
+    size_t size_;
+    bool mapped_;               // data_ is our own mapping, unmapped on close
+    std::vector<ZipEntry> entries_;
+};
+
+#endif // WHATSZAP_ZIP_READER_H
@@ -53,7 +53,10 @@ class AlertActivity : ComponentActivity() {
     
     private val scanCompleteReceiver = object : BroadcastReceiver() {
         override fun onReceive(context: Context?, intent: Intent?) {
-            if (intent?.action == "com.example.whatszap.SCAN_COMPLETE") {
+            // Scans of other files broadcast too
+            if (intent?.action == "com.example.whatszap.SCAN_COMPLETE" &&
+                intent.getStringExtra("apk_path") == this@AlertActivity.intent.getStringExtra("apk_path")
+            ) {
                 scanComplete = true
                 checkCanDismiss()
             }
@@ -96,13 +99,7 @@ class AlertActivity : ComponentActivity() {
         
         enableEdgeToEdge()
         
-        val apkPath = intent.getStringExtra("apk_path") ?: "Unknown"
-        
-        setContent {
-            WhatsZapTheme {
-                AlertScreen(apkPath = apkPath, onDismiss = { finish() })
-            }
-        }
+        showAlert()
         
         // Register receiver for scan completion
         if (Build.VERSION.SDK_INT >= Build.VERSION_CODES.TIRAMISU) {
@@ -121,6 +118,42 @@ class AlertActivity : ComponentActivity() {
         }, minDisplayTime)
     }
     
+    // Single top: an alert for another file, or a tapped threat
+    // notification, replaces the one on screen
+    override fun onNewIntent(intent: Intent) {
+        super.onNewIntent(intent)
+        setIntent(intent)
+        showAlert()
+    }
+    
+    private fun showAlert() {
+        val apkPath = intent.getStringExtra("apk_path") ?: "Unknown"
+        // Set when the file was found malicious while still downloading
+        val earlyThreats = if (intent.getBooleanExtra("early_malicious", false)) {
+            intent.getStringArrayExtra("early_threats")?.toList() ?: emptyList()
+        } else {
+            null
+        }
+        val earlyConfidence = intent.getIntExtra("early_confidence", 0)
+        // Set when opened from a threat notification, on a finished scan
+        val result = intent.takeIf { it.getBooleanExtra("scan_complete", false) }
+        scanComplete = result != null
+        
+        setContent {
+            WhatsZapTheme {
+                key(apkPath) {
+                    AlertScreen(
+                        apkPath = apkPath,
+                        earlyThreats = earlyThreats,
+                        earlyConfidence = earlyConfidence,
+                        result = result,
+                        onDismiss = { finish() }
+                    )
+                }
+            }
+        }
+    }
+    
     private fun checkCanDismiss() {
         val elapsed = System.currentTimeMillis() - startTime
         if (scanComplete && elapsed >= minDisplayTime) {
@@ -144,13 +177,23 @@ class AlertActivity : ComponentActivity() {
 }
 
 @Composable
-fun AlertScreen(apkPath: String, onDismiss: () -> Unit) {
-    var scanStatus by remember { mutableStateOf("Initializing scan...") }
+fun AlertScreen(
+    apkPath: String,
+    earlyThreats: List<String>? = null,
+    earlyConfidence: Int = 0,
+    result: Intent? = null,
+    onDismiss: () -> Unit
+) {
+    // An early verdict is already final for isMalicious; the full scan
+    // still fills in the details
+    var scanStatus by remember {
+        mutableStateOf(if (earlyThreats != null) "⚠️ Threat detected while downloading" else "Initializing scan...")
+    }
     var scanProgress by remember { mutableStateOf(0f) }
     var scanComplete by remember { mutableStateOf(false) }
-    var isMalicious by remember { mutableStateOf(false) }
-    var threats by remember { mutableStateOf<List<String>>(emptyList()) }
-    var confidence by remember { mutableStateOf(0) }
+    var isMalicious by remember { mutableStateOf(earlyThreats != null) }
+    var threats by remember { mutableStateOf(earlyThreats ?: emptyList()) }
+    var confidence by remember { mutableStateOf(earlyConfidence) }
     
     // VirusTotal state
     var vtScanned by remember { mutableStateOf(false) }
@@ -188,44 +231,53 @@ fun AlertScreen(apkPath: String, onDismiss: () -> Unit) {
     
     // Listen for scan completion broadcast
     DisposableEffect(Unit) {
+        fun showResult(intent: Intent) {
+            scanComplete = true
+            isMalicious = intent.getBooleanExtra("is_malicious", false)
+            confidence = intent.getIntExtra("confidence", 0)
+            threats = intent.getStringArrayExtra("threats")?.toList() ?: emptyList()
+            
+            // VirusTotal data
+            vtScanned = intent.getBooleanExtra("vt_scanned", false)
+            vtDetections = intent.getIntExtra("vt_detections", 0)
+            vtEngines = intent.getIntExtra("vt_engines", 0)
+            vtLink = intent.getStringExtra("vt_link")
+            vtThreats = intent.getStringArrayExtra("vt_threats")?.toList() ?: emptyList()
+            sha256Hash = intent.getStringExtra("sha256_hash") ?: ""
+            
+            // Static analysis data
+            packageName = intent.getStringExtra("package_name")
+            appLabel = intent.getStringExtra("app_label")
+            riskScore = intent.getIntExtra("risk_score", 0)
+            dangerousPermissions = intent.getStringArrayExtra("dangerous_permissions")?.toList() ?: emptyList()
+            suspiciousPermissions = intent.getStringArrayExtra("suspicious_permissions")?.toList() ?: emptyList()
+            
+            // Context
+            senderContext = intent.getStringExtra("sender_context")
+            fileSize = intent.getLongExtra("file_size", 0)
+            
+            scanProgress = 1f
+            scanStatus = if (isMalicious) {
+                "⚠️ Threats Detected!"
+            } else if (vtDetections > 0) {
+                "⚠️ Suspicious Activity"
+            } else {
+                "✓ Scan Complete"
+            }
+        }
+        
         val receiver = object : BroadcastReceiver() {
             override fun onReceive(context: Context?, intent: Intent?) {
-                if (intent?.action == "com.example.whatszap.SCAN_COMPLETE") {
-                    scanComplete = true
-                    isMalicious = intent.getBooleanExtra("is_malicious", false)
-                    confidence = intent.getIntExtra("confidence", 0)
-                    threats = intent.getStringArrayExtra("threats")?.toList() ?: emptyList()
-                    
-                    // VirusTotal data
-                    vtScanned = intent.getBooleanExtra("vt_scanned", false)
-                    vtDetections = intent.getIntExtra("vt_detections", 0)
-                    vtEngines = intent.getIntExtra("vt_engines", 0)
-                    vtLink = intent.getStringExtra("vt_link")
-                    vtThreats = intent.getStringArrayExtra("vt_threats")?.toList() ?: emptyList()
-                    sha256Hash = intent.getStringExtra("sha256_hash") ?: ""
-                    
-                    // Static analysis data
-                    packageName = intent.getStringExtra("package_name")
-                    appLabel = intent.getStringExtra("app_label")
-                    riskScore = intent.getIntExtra("risk_score", 0)
-                    dangerousPermissions = intent.getStringArrayExtra("dangerous_permissions")?.toList() ?: emptyList()
-                    suspiciousPermissions = intent.getStringArrayExtra("suspicious_permissions")?.toList() ?: emptyList()
-                    
-                    // Context
-                    senderContext = intent.getStringExtra("sender_context")
-                    fileSize = intent.getLongExtra("file_size", 0)
-                    
-                    scanProgress = 1f
-                    scanStatus = if (isMalicious) {
-                        "⚠️ Threats Detected!"
-                    } else if (vtDetections > 0) {
-                        "⚠️ Suspicious Activity"
-                    } else {
-                        "✓ Scan Complete"
-                    }
+                // Every scan broadcasts; only this file's result belongs here
+                if (intent?.action == "com.example.whatszap.SCAN_COMPLETE" &&
+                    intent.getStringExtra("apk_path") == apkPath
+                ) {
+                    showResult(intent)
                 }
             }
         }
+        // Opened on a finished scan
+        result?.let { showResult(it) }
         
         if (Build.VERSION.SDK_INT >= Build.VERSION_CODES.TIRAMISU) {
             context.registerReceiver(
@@ -250,7 +302,9 @@ fun AlertScreen(apkPath: String, onDismiss: () -> Unit) {
             
             for ((status, progress) in stages) {
                 if (scanComplete) break
-                scanStatus = status
+                if (!isMalicious) {
+                    scanStatus = status
+                }
                 scanProgress = progress
                 delay(1500)
             }
@@ -267,7 +321,7 @@ fun AlertScreen(apkPath: String, onDismiss: () -> Unit) {
     }
     
     val backgroundColor = when {
-        scanComplete && isMalicious -> Color(0xFFB71C1C) // Dark red
+        isMalicious -> Color(0xFFB71C1C) // Dark red
         scanComplete && vtDetections > 0 -> Color(0xFFE65100) // Dark orange
         scanComplete -> Color(0xFF1B5E20) // Dark green
         else -> Color(0xFF1A237E) // Dark blue
@@ -313,7 +367,7 @@ fun AlertScreen(apkPath: String, onDismiss: () -> Unit) {
                         .clip(CircleShape)
                         .background(
                             when {
-                                scanComplete && isMalicious -> Color(0xFFFFCDD2)
+                                isMalicious -> Color(0xFFFFCDD2)
                                 scanComplete && vtDetections > 0 -> Color(0xFFFFE0B2)
                                 scanComplete -> Color(0xFFC8E6C9)
                                 else -> Color(0xFFBBDEFB)
@@ -323,14 +377,14 @@ fun AlertScreen(apkPath: String, onDismiss: () -> Unit) {
                 ) {
                     Icon(
                         imageVector = when {
-                            scanComplete && (isMalicious || vtDetections > 0) -> Icons.Default.Warning
+                            isMalicious || (scanComplete && vtDetections > 0) -> Icons.Default.Warning
                             scanComplete -> Icons.Default.CheckCircle
                             else -> Icons.Default.Info
                         },
                         contentDescription = null,
                         modifier = Modifier.size(48.dp),
                         tint = when {
-                            scanComplete && isMalicious -> Color(0xFFB71C1C)
+                            isMalicious -> Color(0xFFB71C1C)
                             scanComplete && vtDetections > 0 -> Color(0xFFE65100)
                             scanComplete -> Color(0xFF1B5E20)
                             else -> Color(0xFF1565C0)
@@ -341,7 +395,7 @@ fun AlertScreen(apkPath: String, onDismiss: () -> Unit) {
                 // Title
                 Text(
                     text = when {
-                        scanComplete && isMalicious -> "🚨 MALWARE DETECTED"
+                        isMalicious -> "🚨 MALWARE DETECTED"
                         scanComplete && vtDetections > 0 -> "⚠️ SUSPICIOUS FILE"
                         scanComplete -> "✅ FILE APPEARS SAFE"
                         else -> "🔍 SECURITY SCAN"
@@ -349,7 +403,7 @@ fun AlertScreen(apkPath: String, onDismiss: () -> Unit) {
                     fontSize = 22.sp,
                     fontWeight = FontWeight.Bold,
                     color = when {
-                        scanComplete && isMalicious -> Color(0xFFB71C1C)
+                        isMalicious -> Color(0xFFB71C1C)
                         scanComplete && vtDetections > 0 -> Color(0xFFE65100)
                         scanComplete -> Color(0xFF1B5E20)
                         else -> MaterialTheme.colorScheme.primary
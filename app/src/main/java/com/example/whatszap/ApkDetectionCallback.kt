@@ -1,6 +1,10 @@
 package com.example.whatszap
 
 interface ApkDetectionCallback {
-    fun onApkDetected(apkPath: String)
+    // Completed APK files, coalesced natively and never repeated for an unchanged file
+    fun onApkBatchDetected(apkPaths: Array<String>)
+    
+    // An APK still being written that is already known to be malicious;
+    // it is reported again through onApkBatchDetected once complete
+    fun onApkEarlyVerdict(apkPath: String, bytesScanned: Long, confidence: Int, threats: Array<String>)
 }
-
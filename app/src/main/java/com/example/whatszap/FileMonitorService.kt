@@ -7,15 +7,35 @@ import android.os.Build
 import android.os.IBinder
 import android.util.Log
 import androidx.core.app.NotificationCompat
+import com.example.whatszap.network.SignatureUpdateRepository
 import com.example.whatszap.network.VirusTotalRepository
 import com.example.whatszap.utils.ApkAnalyzer
-import com.example.whatszap.utils.HashUtils
 import kotlinx.coroutines.*
 import java.io.File
+import java.util.concurrent.atomic.AtomicInteger
 
-class FileMonitorService : Service(), ApkDetectionCallback {
-    private val nativeFileMonitors = mutableListOf<Long>()
+class FileMonitorService : Service(), ApkDetectionCallback, ScanCompletionCallback {
+    // One native watcher for every directory
+    private var nativeFileMonitorHandle: Long = 0
     private var nativeScannerHandle: Long = 0
+    private var nativeSchedulerHandle: Long = 0
+    // Guarded by itself: a fast scan can complete before submit returns
+    private val pendingScans = HashMap<Long, PendingScan>()
+    // Startup walk for APKs that arrived while the service was down, how
+    // many of its scans are unfinished and whether any was cancelled;
+    // guarded by pendingScans
+    private var nativeCatchUpWalkHandle: Long = 0
+    private var catchUpScansRemaining = 0
+    private var isCatchUpIncomplete = false
+    // The walk itself, joined before the scanner it reads is destroyed
+    private var catchUpJob: Job? = null
+    // Files whose alert was already opened by an early verdict; guarded by itself
+    private val earlyAlertedPaths = HashSet<String>()
+    // The file the alert on screen shows; any other file's threat is
+    // notified instead. Guarded by earlyAlertedPaths
+    private var alertScreenPath: String? = null
+    // Keeps each threat notification's pending intent distinct
+    private val threatRequestCodes = AtomicInteger()
     private val serviceScope = CoroutineScope(Dispatchers.IO + SupervisorJob())
     private lateinit var virusTotalRepository: VirusTotalRepository
     
@@ -23,6 +43,35 @@ class FileMonitorService : Service(), ApkDetectionCallback {
         private const val TAG = "FileMonitorService"
         private const val CHANNEL_ID = "FileMonitorChannel"
         private const val NOTIFICATION_ID = 1
+        // Files found malicious or suspicious with no alert on screen, one
+        // notification per path
+        private const val THREAT_CHANNEL_ID = "ThreatChannel"
+        private const val THREAT_NOTIFICATION_ID = 2
+        
+        // Upper bound on native content analysis per APK; the scanner
+        // returns earlier as soon as it has a verdict
+        private const val NATIVE_SCAN_BUDGET_MS = 5000L
+        
+        private const val SIGNATURE_PACK_FILE = "signatures.wzsp"
+        private const val SIGNATURE_DELTA_FILE = "signatures.wzsd"
+        private const val VERDICT_CACHE_FILE = "verdicts.wzvc"
+        private const val CLASSIFIER_MODEL_FILE = "classifier.wzml"
+        private const val CATCH_UP_CHECKPOINT_FILE = "catchup.checkpoint"
+        
+        // Native scan queue; submissions beyond this are retried later
+        private const val MAX_PENDING_SCANS = 32
+        private const val SCAN_RETRY_DELAY_MS = 1000L
+        
+        // Must match TaskPriority in worker_pool.h
+        private const val SCAN_PRIORITY_FOREGROUND = 0
+        private const val SCAN_PRIORITY_NORMAL = 1
+        private const val SCAN_PRIORITY_BACKGROUND = 2
+
+        // Must match kVerdictMaliciousFlag in native-lib.cpp
+        private const val VERDICT_MALICIOUS_FLAG = 0x100
+
+        // How often the native scan and watcher metrics are logged
+        private const val METRICS_LOG_INTERVAL_MS = 15 * 60 * 1000L
         
         init {
             System.loadLibrary("whatszap-native")
@@ -37,11 +86,58 @@ class FileMonitorService : Service(), ApkDetectionCallback {
         callback: ApkDetectionCallback
     ): Boolean
     private external fun nativeStopMonitoring(nativeHandle: Long)
+    private external fun nativeStopMonitoringDirectory(nativeHandle: Long, directory: String): Boolean
+    private external fun nativeSetMonitorScanner(monitorHandle: Long, scannerHandle: Long)
     private external fun nativeDestroyFileMonitor(nativeHandle: Long)
     
     private external fun nativeCreateMalwareScanner(): Long
-    private external fun nativeScanApk(nativeHandle: Long, apkPath: String): ScanResult?
     private external fun nativeDestroyMalwareScanner(nativeHandle: Long)
+    
+    private external fun nativeLoadSignaturePack(nativeHandle: Long, packPath: String): Boolean
+    private external fun nativeApplySignatureDelta(
+        nativeHandle: Long,
+        deltaPath: String,
+        packPath: String
+    ): Boolean
+    private external fun nativeGetSignatureVersion(nativeHandle: Long): Long
+    private external fun nativeLoadClassifier(nativeHandle: Long, modelPath: String): Boolean
+    private external fun nativeCreateScanScheduler(
+        scannerHandle: Long,
+        callback: ScanCompletionCallback,
+        maxPendingJobs: Int
+    ): Long
+    private external fun nativeSubmitScan(
+        schedulerHandle: Long,
+        apkPath: String,
+        priority: Int,
+        budgetMs: Long
+    ): Long
+    private external fun nativeCancelScan(schedulerHandle: Long, jobId: Long): Boolean
+    private external fun nativeGetScanStatus(schedulerHandle: Long, jobId: Long): Int
+    private external fun nativeDestroyScanScheduler(schedulerHandle: Long)
+    private external fun nativeCreateCatchUpWalk(scannerHandle: Long, checkpointPath: String): Long
+    private external fun nativeRunCatchUpWalk(walkHandle: Long, roots: Array<String>): Array<String>?
+    private external fun nativeCancelCatchUpWalk(walkHandle: Long)
+    private external fun nativeCommitCatchUpWalk(walkHandle: Long): Boolean
+    private external fun nativeDestroyCatchUpWalk(walkHandle: Long)
+    private external fun nativeOpenVerdictCache(nativeHandle: Long, cachePath: String): Boolean
+    private external fun nativeRecordReputation(
+        nativeHandle: Long,
+        sha256: String,
+        detections: Int,
+        engines: Int,
+        threatNames: Array<String>
+    ): Boolean
+    private external fun nativeCombineVerdict(
+        scanConfidence: Int,
+        scanMalicious: Boolean,
+        riskScore: Int,
+        vtFound: Boolean,
+        vtMalicious: Boolean,
+        vtDetections: Int,
+        modelScore: Int
+    ): Int
+    private external fun nativeGetMetrics(): String
 
     override fun onCreate() {
         super.onCreate()
@@ -54,6 +150,15 @@ class FileMonitorService : Service(), ApkDetectionCallback {
         
         // Initialize native scanner
         nativeScannerHandle = nativeCreateMalwareScanner()
+        loadSignaturePack()
+        loadClassifier()
+        if (!nativeOpenVerdictCache(nativeScannerHandle, File(filesDir, VERDICT_CACHE_FILE).absolutePath)) {
+            Log.w(TAG, "Verdict cache unavailable; every delivery will be scanned")
+        }
+        nativeSchedulerHandle = nativeCreateScanScheduler(nativeScannerHandle, this, MAX_PENDING_SCANS)
+        serviceScope.launch {
+            updateSignatures()
+        }
         
         // Start monitoring WhatsApp directories
         val whatsappPath = File(
@@ -71,25 +176,111 @@ class FileMonitorService : Service(), ApkDetectionCallback {
             "Android/media/com.whatsapp/WhatsApp/Media/WhatsApp Documents"
         ).absolutePath
         
-        // Create separate monitors for each directory
+        // All directory trees, subdirectories included, share one native watcher thread
+        nativeFileMonitorHandle = nativeCreateFileMonitor()
+        nativeSetMonitorScanner(nativeFileMonitorHandle, nativeScannerHandle)
         startMonitoringDirectory(whatsappPath)
         startMonitoringDirectory(downloadsPath)
         startMonitoringDirectory(whatsappMediaPath)
         
+        // Watches are in place, so anything newer is the monitor's; the
+        // walk runs off the main thread and does not hold up startup
+        nativeCatchUpWalkHandle = nativeCreateCatchUpWalk(
+            nativeScannerHandle,
+            File(filesDir, CATCH_UP_CHECKPOINT_FILE).absolutePath
+        )
+        catchUpJob = serviceScope.launch {
+            catchUpMissedApks(arrayOf(whatsappPath, downloadsPath, whatsappMediaPath))
+        }
+        
+        serviceScope.launch {
+            while (isActive) {
+                delay(METRICS_LOG_INTERVAL_MS)
+                logNativeMetrics()
+            }
+        }
+        
         Log.i(TAG, "Service started with native monitoring and VirusTotal integration")
         Log.i(TAG, "VirusTotal API configured: ${virusTotalRepository.isApiKeyConfigured()}")
     }
     
+    private fun loadSignaturePack() {
+        val packFile = File(filesDir, SIGNATURE_PACK_FILE)
+        if (packFile.exists() && nativeLoadSignaturePack(nativeScannerHandle, packFile.absolutePath)) {
+            Log.i(TAG, "Loaded signature pack v${nativeGetSignatureVersion(nativeScannerHandle)}")
+        }
+    }
+    
+    // Cumulative counters and latency histograms, as JSON; small enough to
+    // upload as is
+    private fun logNativeMetrics() {
+        Log.i(TAG, "Native metrics: ${nativeGetMetrics()}")
+    }
+    
+    // Optional: without a model, scans without VirusTotal rely on the
+    // heuristics alone
+    private fun loadClassifier() {
+        val modelFile = File(filesDir, CLASSIFIER_MODEL_FILE)
+        if (modelFile.exists() && nativeLoadClassifier(nativeScannerHandle, modelFile.absolutePath)) {
+            Log.i(TAG, "Loaded on-device classifier")
+        }
+    }
+    
+    private suspend fun updateSignatures() {
+        val updateRepository = SignatureUpdateRepository.getInstance()
+        if (!updateRepository.isConfigured()) {
+            return
+        }
+        val deltaFile = File(cacheDir, SIGNATURE_DELTA_FILE)
+        val packFile = File(filesDir, SIGNATURE_PACK_FILE)
+        val currentVersion = nativeGetSignatureVersion(nativeScannerHandle)
+        if (updateRepository.downloadDelta(currentVersion, deltaFile)) {
+            // The native side swaps the new pack in without pausing running scans
+            val isApplied = nativeApplySignatureDelta(
+                nativeScannerHandle,
+                deltaFile.absolutePath,
+                packFile.absolutePath
+            )
+            Log.i(TAG, "Signature delta applied: $isApplied, now v${nativeGetSignatureVersion(nativeScannerHandle)}")
+            deltaFile.delete()
+        }
+    }
+    
+    // The walk handle stays valid until this returns: onDestroy cancels the
+    // walk and joins catchUpJob before destroying it
+    private fun catchUpMissedApks(roots: Array<String>) {
+        val walkHandle = synchronized(pendingScans) { nativeCatchUpWalkHandle }
+        if (walkHandle == 0L) {
+            return
+        }
+        // Null once onDestroy cancelled it
+        val missed = nativeRunCatchUpWalk(walkHandle, roots) ?: return
+        if (missed.isEmpty()) {
+            synchronized(pendingScans) {
+                nativeCommitCatchUpWalk(walkHandle)
+                nativeDestroyCatchUpWalk(walkHandle)
+                nativeCatchUpWalkHandle = 0
+            }
+            return
+        }
+        Log.i(TAG, "${missed.size} APK(s) arrived while the service was stopped")
+        synchronized(pendingScans) {
+            catchUpScansRemaining = missed.size
+        }
+        // Behind anything the monitor detects from now on
+        val startTime = System.currentTimeMillis()
+        missed.forEach { apkPath ->
+            submitScan(apkPath, SCAN_PRIORITY_BACKGROUND, startTime, isCatchUp = true)
+        }
+    }
+    
     private fun startMonitoringDirectory(path: String) {
         val dir = File(path)
         if (dir.exists() && dir.isDirectory) {
-            val monitor = nativeCreateFileMonitor()
-            if (nativeStartMonitoring(monitor, path, this)) {
-                nativeFileMonitors.add(monitor)
+            if (nativeStartMonitoring(nativeFileMonitorHandle, path, this)) {
                 Log.i(TAG, "Started monitoring: $path")
             } else {
                 Log.w(TAG, "Failed to start monitoring: $path")
-                nativeDestroyFileMonitor(monitor)
             }
         } else {
             Log.w(TAG, "Directory does not exist: $path")
@@ -105,8 +296,16 @@ class FileMonitorService : Service(), ApkDetectionCallback {
             ).apply {
                 description = "Monitors WhatsApp downloads for APK files"
             }
+            val threatChannel = NotificationChannel(
+                THREAT_CHANNEL_ID,
+                "APK Threats",
+                NotificationManager.IMPORTANCE_HIGH
+            ).apply {
+                description = "Malicious or suspicious APKs found without an alert on screen"
+            }
             val notificationManager = getSystemService(NotificationManager::class.java)
             notificationManager.createNotificationChannel(channel)
+            notificationManager.createNotificationChannel(threatChannel)
         }
     }
 
@@ -124,47 +323,186 @@ class FileMonitorService : Service(), ApkDetectionCallback {
             .setOngoing(true)
             .build()
     }
+    
+    // Tapping it opens the alert on the finished scan
+    private fun notifyThreat(apkPath: String, scanIntent: Intent) {
+        val alertIntent = Intent(this, AlertActivity::class.java).apply {
+            flags = Intent.FLAG_ACTIVITY_NEW_TASK or Intent.FLAG_ACTIVITY_CLEAR_TOP
+            putExtras(scanIntent)
+            putExtra("scan_complete", true)
+        }
+        val pendingIntent = PendingIntent.getActivity(
+            this,
+            threatRequestCodes.incrementAndGet(),
+            alertIntent,
+            PendingIntent.FLAG_UPDATE_CURRENT or PendingIntent.FLAG_IMMUTABLE
+        )
+        val isMalicious = scanIntent.getBooleanExtra("is_malicious", false)
+        val notification = NotificationCompat.Builder(this, THREAT_CHANNEL_ID)
+            .setContentTitle(if (isMalicious) "Malicious APK found" else "Suspicious APK found")
+            .setContentText(File(apkPath).name)
+            .setSmallIcon(android.R.drawable.stat_sys_warning)
+            .setPriority(NotificationCompat.PRIORITY_HIGH)
+            .setContentIntent(pendingIntent)
+            .setAutoCancel(true)
+            .build()
+        getSystemService(NotificationManager::class.java)
+            .notify(apkPath, THREAT_NOTIFICATION_ID, notification)
+    }
 
-    override fun onApkDetected(apkPath: String) {
-        Log.i(TAG, "APK detected via native callback: $apkPath")
+    override fun onApkBatchDetected(apkPaths: Array<String>) {
+        if (apkPaths.isEmpty()) {
+            return
+        }
+        Log.i(TAG, "${apkPaths.size} APK(s) detected via native callback: ${apkPaths.joinToString()}")
+        
+        // Show alert activity immediately; one launch per batch, for the
+        // most recent file not already on screen from an early verdict.
+        // The other files' scans notify if they find anything
+        val alertPath = synchronized(earlyAlertedPaths) {
+            apkPaths.lastOrNull { it !in earlyAlertedPaths }.also { path ->
+                earlyAlertedPaths.removeAll(apkPaths.toSet())
+                if (path != null) {
+                    alertScreenPath = path
+                }
+            }
+        }
+        if (alertPath != null) {
+            val intent = Intent(this, AlertActivity::class.java).apply {
+                flags = Intent.FLAG_ACTIVITY_NEW_TASK or Intent.FLAG_ACTIVITY_CLEAR_TOP
+                putExtra("apk_path", alertPath)
+            }
+            startActivity(intent)
+        }
+        
+        // Queue the native scans; the rest of the analysis continues in
+        // onScanComplete once a worker has finished each
+        val startTime = System.currentTimeMillis()
+        apkPaths.forEach { apkPath ->
+            submitScan(apkPath, SCAN_PRIORITY_FOREGROUND, startTime)
+        }
+    }
+    
+    override fun onApkEarlyVerdict(
+        apkPath: String,
+        bytesScanned: Long,
+        confidence: Int,
+        threats: Array<String>
+    ) {
+        Log.w(TAG, "Malicious APK detected after $bytesScanned bytes, still downloading: $apkPath")
+        synchronized(earlyAlertedPaths) {
+            earlyAlertedPaths.add(apkPath)
+            alertScreenPath = apkPath
+        }
         
-        // Show alert activity immediately
+        // Warn before the download even finishes; the full scan result
+        // replaces this once the file is complete
         val intent = Intent(this, AlertActivity::class.java).apply {
             flags = Intent.FLAG_ACTIVITY_NEW_TASK or Intent.FLAG_ACTIVITY_CLEAR_TOP
             putExtra("apk_path", apkPath)
+            putExtra("early_malicious", true)
+            putExtra("early_confidence", confidence)
+            putExtra("early_threats", threats)
         }
         startActivity(intent)
-        
-        // Start comprehensive scanning in background
+    }
+    
+    private fun submitScan(apkPath: String, priority: Int, startTime: Long, isCatchUp: Boolean = false) {
+        val jobId = synchronized(pendingScans) {
+            if (nativeSchedulerHandle == 0L) {
+                // Service destroyed
+                return
+            }
+            nativeSubmitScan(nativeSchedulerHandle, apkPath, priority, NATIVE_SCAN_BUDGET_MS).also { id ->
+                if (id != 0L) {
+                    pendingScans[id] = PendingScan(apkPath, startTime, isCatchUp)
+                }
+            }
+        }
+        if (jobId == 0L) {
+            // Queue full: back off instead of piling more work onto the workers
+            Log.w(TAG, "Scan queue full, retrying $apkPath in ${SCAN_RETRY_DELAY_MS}ms")
+            serviceScope.launch {
+                delay(SCAN_RETRY_DELAY_MS)
+                submitScan(apkPath, priority, startTime, isCatchUp)
+            }
+            return
+        }
+        Log.i(TAG, "Queued scan $jobId for: $apkPath")
+    }
+    
+    override fun onScanComplete(jobId: Long, result: ScanResult?) {
+        val pending = synchronized(pendingScans) { pendingScans.remove(jobId) } ?: return
+        if (pending.isCatchUp) {
+            finishCatchUpScan(isScanned = result != null)
+        }
+        if (result == null) {
+            Log.i(TAG, "Scan $jobId cancelled: ${pending.apkPath}")
+            return
+        }
         serviceScope.launch {
-            performComprehensiveScan(apkPath)
+            performComprehensiveScan(pending.apkPath, pending.startTime, result)
         }
     }
     
-    private suspend fun performComprehensiveScan(apkPath: String) {
-        val startTime = System.currentTimeMillis()
-        
-        Log.i(TAG, "Starting comprehensive scan for: $apkPath")
+    private fun finishCatchUpScan(isScanned: Boolean) {
+        synchronized(pendingScans) {
+            catchUpScansRemaining--
+            if (!isScanned) {
+                isCatchUpIncomplete = true
+            }
+            if (catchUpScansRemaining > 0 || nativeCatchUpWalkHandle == 0L) {
+                return
+            }
+            // Once everything the walk found is scanned the next start walks
+            // from here; after a cancelled scan it walks the same span again
+            if (!isCatchUpIncomplete) {
+                nativeCommitCatchUpWalk(nativeCatchUpWalkHandle)
+            }
+            nativeDestroyCatchUpWalk(nativeCatchUpWalkHandle)
+            nativeCatchUpWalkHandle = 0
+        }
+    }
+    
+    private suspend fun performComprehensiveScan(
+        apkPath: String,
+        startTime: Long,
+        nativeResult: ScanResult?
+    ) {
+        Log.i(TAG, "Completing comprehensive scan for: $apkPath")
         
-        // Step 1: Calculate SHA-256 hash
-        val sha256 = HashUtils.calculateSha256(apkPath)
+        // Step 1: The native scan has decoded the manifest and hashed the
+        // file in the same pass over the mapping
+        val sha256 = nativeResult?.sha256Hash?.takeIf { it.isNotEmpty() }
         Log.i(TAG, "SHA-256: $sha256")
         
-        // Step 2: Perform static analysis
-        val staticAnalysis = ApkAnalyzer.analyzeApk(this@FileMonitorService, apkPath)
-        Log.i(TAG, "Static analysis complete. Risk score: ${staticAnalysis.riskScore}")
-        
-        // Step 3: Get sender context
+        // Step 2: Get sender context
         val senderContext = ApkAnalyzer.getSenderContext(apkPath)
         
-        // Step 4: Perform native scan (in parallel)
-        val nativeScanDeferred = serviceScope.async {
-            nativeScanApk(nativeScannerHandle, apkPath)
+        // Step 3: Check VirusTotal (if configured), unless the verdict cache
+        // already remembers its answer for this file
+        var vtResult = if (nativeResult != null && nativeResult.isVirusTotalScanned && sha256 != null) {
+            Log.i(TAG, "Using cached VirusTotal verdict")
+            virusTotalRepository.fromCachedVerdict(
+                sha256,
+                nativeResult.virusTotalDetections,
+                nativeResult.virusTotalEngines,
+                nativeResult.virusTotalThreats
+            )
+        } else {
+            virusTotalRepository.checkFileHash(sha256 ?: "").also { result ->
+                if (result.isFound && sha256 != null) {
+                    nativeRecordReputation(
+                        nativeScannerHandle,
+                        sha256,
+                        result.maliciousCount,
+                        result.totalEngines,
+                        result.threatNames.toTypedArray()
+                    )
+                }
+            }
         }
         
-        // Step 5: Check VirusTotal (if configured)
-        var vtResult = virusTotalRepository.checkFileHash(sha256 ?: "")
-        
         // If not found in VT database and API key is configured, try uploading
         if (!vtResult.isFound && virusTotalRepository.isApiKeyConfigured() && sha256 != null) {
             Log.i(TAG, "Hash not found in VirusTotal, uploading file...")
@@ -172,15 +510,24 @@ class FileMonitorService : Service(), ApkDetectionCallback {
             // vtResult = virusTotalRepository.uploadFile(apkPath)
         }
         
-        // Wait for native scan
-        val nativeResult = nativeScanDeferred.await()
+        // Step 4: Static analysis, done by the native scan in the same pass
+        val staticAnalysis = ApkAnalyzer.analyzeApk(nativeResult)
+        Log.i(TAG, "Static analysis complete. Risk score: ${staticAnalysis.riskScore}")
         
         val scanDuration = System.currentTimeMillis() - startTime
         
         // Combine results
-        val isMalicious = vtResult.isMalicious || 
-                         (staticAnalysis.riskScore >= 50) ||
-                         (nativeResult?.isMalicious == true)
+        val verdict = nativeCombineVerdict(
+            nativeResult?.confidence ?: 0,
+            nativeResult?.isMalicious == true,
+            staticAnalysis.riskScore,
+            vtResult.isFound,
+            vtResult.isMalicious,
+            vtResult.maliciousCount,
+            nativeResult?.modelScore ?: -1
+        )
+        val isMalicious = (verdict and VERDICT_MALICIOUS_FLAG) != 0
+        val confidence = verdict and VERDICT_MALICIOUS_FLAG.inv()
         
         val combinedThreats = mutableListOf<String>()
         
@@ -195,15 +542,14 @@ class FileMonitorService : Service(), ApkDetectionCallback {
             combinedThreats.addAll(threats.filter { it != "No threats detected" })
         }
         
-        // Calculate overall confidence
-        val confidence = calculateOverallConfidence(vtResult, staticAnalysis, nativeResult)
-        
         Log.i(TAG, "Comprehensive scan complete:")
         Log.i(TAG, "  - Malicious: $isMalicious")
         Log.i(TAG, "  - Confidence: $confidence")
         Log.i(TAG, "  - VT Detections: ${vtResult.detectionRatio}")
         Log.i(TAG, "  - Static Risk Score: ${staticAnalysis.riskScore}")
-        Log.i(TAG, "  - Duration: ${scanDuration}ms")
+        Log.i(TAG, "  - Model Score: ${nativeResult?.modelScore ?: -1}")
+        Log.i(TAG, "  - Duration: ${scanDuration}ms (native ${nativeResult?.scanDuration}ms" +
+            "${if (nativeResult?.isPartialScan == true) ", partial" else ""})")
         
         // Send broadcast with comprehensive results
         val scanIntent = Intent("com.example.whatszap.SCAN_COMPLETE").apply {
@@ -237,57 +583,79 @@ class FileMonitorService : Service(), ApkDetectionCallback {
         }
         sendBroadcast(scanIntent)
         Log.i(TAG, "Broadcast sent to AlertActivity")
-    }
-    
-    private fun calculateOverallConfidence(
-        vtResult: com.example.whatszap.network.VirusTotalScanResult,
-        staticAnalysis: com.example.whatszap.utils.ApkAnalysisResult,
-        nativeResult: ScanResult?
-    ): Int {
-        var confidence = 0
-        
-        // VT detection confidence (max 50)
-        if (vtResult.isFound) {
-            val vtConfidence = when {
-                vtResult.maliciousCount >= 10 -> 50
-                vtResult.maliciousCount >= 5 -> 40
-                vtResult.maliciousCount >= 1 -> 30
-                else -> 10 // Found but clean
-            }
-            confidence += vtConfidence
-        }
-        
-        // Static analysis confidence (max 30)
-        confidence += (staticAnalysis.riskScore * 0.3).toInt()
         
-        // Native scan confidence (max 20)
-        nativeResult?.let {
-            confidence += (it.confidence * 0.2).toInt()
+        // Only one file's alert is on screen: the rest of a batch, an
+        // alert replaced by a newer one and anything the startup walk
+        // found are notified, one notification per file
+        val isOnScreen = synchronized(earlyAlertedPaths) { apkPath == alertScreenPath }
+        if (!isOnScreen && (isMalicious || vtResult.maliciousCount > 0)) {
+            notifyThreat(apkPath, scanIntent)
         }
-        
-        return minOf(confidence, 100)
     }
-
+    
     override fun onBind(intent: Intent?): IBinder? = null
 
     override fun onDestroy() {
         super.onDestroy()
         
+        // The walk blocks in native code, where coroutine cancellation does
+        // not reach, and reads the scanner's verdict cache: stop it and wait
+        // for it before anything it uses goes away. It stops within a
+        // directory.
+        synchronized(pendingScans) {
+            nativeCancelCatchUpWalk(nativeCatchUpWalkHandle)
+        }
+        runBlocking {
+            catchUpJob?.join()
+        }
+        
         // Cancel all coroutines
         serviceScope.cancel()
         
-        // Stop and destroy all file monitors
-        nativeFileMonitors.forEach { handle ->
-            nativeStopMonitoring(handle)
-            nativeDestroyFileMonitor(handle)
+        // Stop and destroy the file monitor
+        if (nativeFileMonitorHandle != 0L) {
+            nativeStopMonitoring(nativeFileMonitorHandle)
+            nativeDestroyFileMonitor(nativeFileMonitorHandle)
+            nativeFileMonitorHandle = 0
+        }
+        
+        // Cancels running scans at their next entry boundary and joins the
+        // workers before the scanner they use goes away
+        // Zeroed under the lock submitScan takes, so no submit can use the
+        // handle once it is being freed. The scheduler is destroyed outside
+        // the lock: joining its workers waits for onScanComplete, which
+        // takes it too.
+        val schedulerHandle = synchronized(pendingScans) {
+            nativeSchedulerHandle.also { nativeSchedulerHandle = 0 }
+        }
+        if (schedulerHandle != 0L) {
+            nativeDestroyScanScheduler(schedulerHandle)
+        }
+        synchronized(pendingScans) {
+            pendingScans.clear()
+            // Unfinished catch-up scans are walked again on the next start
+            if (nativeCatchUpWalkHandle != 0L) {
+                nativeDestroyCatchUpWalk(nativeCatchUpWalkHandle)
+                nativeCatchUpWalkHandle = 0
+            }
         }
-        nativeFileMonitors.clear()
         
         if (nativeScannerHandle != 0L) {
             nativeDestroyMalwareScanner(nativeScannerHandle)
             nativeScannerHandle = 0
         }
         
+        logNativeMetrics()
         Log.i(TAG, "Service destroyed")
     }
 }
+
+/**
+ * A queued native scan, when its APK was detected, and whether the startup
+ * catch-up walk found it
+ */
+private data class PendingScan(
+    val apkPath: String,
+    val startTime: Long,
+    val isCatchUp: Boolean = false
+)
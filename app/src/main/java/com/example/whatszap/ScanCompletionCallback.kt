@@ -0,0 +1,9 @@
+package com.example.whatszap
+
+interface ScanCompletionCallback {
+    /**
+     * Called on a native scan worker thread. [result] is null when the job
+     * was cancelled before it started.
+     */
+    fun onScanComplete(jobId: Long, result: ScanResult?)
+}
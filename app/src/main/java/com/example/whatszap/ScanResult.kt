@@ -8,9 +8,13 @@ data class ScanResult(
     val confidence: Int,
     val threats: List<String>,
     val scanDuration: Long,
+    val isPartialScan: Boolean = false,
+    val isCachedVerdict: Boolean = false,
     
     // VirusTotal results
     val sha256Hash: String = "",
+    val sha1Hash: String = "",
+    val md5Hash: String = "",
     val virusTotalDetections: Int = 0,
     val virusTotalEngines: Int = 0,
     val virusTotalLink: String? = null,
@@ -20,9 +24,22 @@ data class ScanResult(
     // Static analysis results
     val packageName: String? = null,
     val appLabel: String? = null,
+    val versionName: String? = null,
+    val versionCode: Long = 0,
+    val requestedPermissions: List<String> = emptyList(),
     val riskScore: Int = 0,
     val dangerousPermissions: List<String> = emptyList(),
     val highlySuspiciousPermissions: List<String> = emptyList(),
+    val hasSuspiciousPackageName: Boolean = false,
+    val hasManifest: Boolean = false,
+    val hasDexFiles: Boolean = false,
+    val hasNativeLibraries: Boolean = false,
+    val dexFileCount: Int = 0,
+    val suspiciousFiles: List<String> = emptyList(),
+    val entryEntropy: List<EntryEntropy> = emptyList(),
+    
+    // On-device classifier, 0-100; -1 when no model is installed
+    val modelScore: Int = -1,
     
     // Context
     val senderContext: String? = null,
@@ -31,21 +48,94 @@ data class ScanResult(
 ) {
     companion object {
         /**
-         * Factory method for JNI - creates ScanResult with basic fields
-         * Native code calls this via reflection
+         * Factory method for JNI - creates ScanResult from a native scan
+         *
+         * Parameters come in the native scan's order:
+         * - Verdict: isMalicious, confidence, threats, scanDuration, isPartialScan
+         * - Manifest: packageName through requestedPermissions
+         * - Digests: sha256Hash, sha1Hash, md5Hash
+         * - Cached VirusTotal verdict: isCachedVerdict through virusTotalThreats
+         * - Static analysis: riskScore through suspiciousFiles, then fileSizeBytes
+         * - On-device classifier: modelScore
+         * - Entropy per measured entry: entropyEntryNames and the arrays after
+         *   it, index for index
+         *
+         * Lists arrive as arrays so native code marshals each in one call
          */
         @JvmStatic
         fun createFromNative(
             isMalicious: Boolean,
             confidence: Int,
-            threats: List<String>,
-            scanDuration: Long
+            threats: Array<String>,
+            scanDuration: Long,
+            isPartialScan: Boolean,
+            packageName: String?,
+            versionName: String?,
+            versionCode: Long,
+            appLabel: String?,
+            requestedPermissions: Array<String>,
+            sha256Hash: String,
+            sha1Hash: String,
+            md5Hash: String,
+            isCachedVerdict: Boolean,
+            isVirusTotalScanned: Boolean,
+            virusTotalDetections: Int,
+            virusTotalEngines: Int,
+            virusTotalThreats: Array<String>,
+            riskScore: Int,
+            dangerousPermissions: Array<String>,
+            highlySuspiciousPermissions: Array<String>,
+            hasSuspiciousPackageName: Boolean,
+            hasManifest: Boolean,
+            hasDexFiles: Boolean,
+            hasNativeLibraries: Boolean,
+            dexFileCount: Int,
+            suspiciousFiles: Array<String>,
+            fileSizeBytes: Long,
+            modelScore: Int,
+            entropyEntryNames: Array<String>,
+            entropyValues: DoubleArray,
+            peakWindowEntropyValues: DoubleArray,
+            entropyBytesMeasured: LongArray
         ): ScanResult {
             return ScanResult(
                 isMalicious = isMalicious,
                 confidence = confidence,
-                threats = threats,
-                scanDuration = scanDuration
+                threats = threats.asList(),
+                scanDuration = scanDuration,
+                isPartialScan = isPartialScan,
+                packageName = packageName,
+                appLabel = appLabel,
+                versionName = versionName,
+                versionCode = versionCode,
+                requestedPermissions = requestedPermissions.asList(),
+                sha256Hash = sha256Hash,
+                sha1Hash = sha1Hash,
+                md5Hash = md5Hash,
+                isCachedVerdict = isCachedVerdict,
+                isVirusTotalScanned = isVirusTotalScanned,
+                virusTotalDetections = virusTotalDetections,
+                virusTotalEngines = virusTotalEngines,
+                virusTotalThreats = virusTotalThreats.asList(),
+                riskScore = riskScore,
+                dangerousPermissions = dangerousPermissions.asList(),
+                highlySuspiciousPermissions = highlySuspiciousPermissions.asList(),
+                hasSuspiciousPackageName = hasSuspiciousPackageName,
+                hasManifest = hasManifest,
+                hasDexFiles = hasDexFiles,
+                hasNativeLibraries = hasNativeLibraries,
+                dexFileCount = dexFileCount,
+                suspiciousFiles = suspiciousFiles.asList(),
+                fileSizeBytes = fileSizeBytes,
+                modelScore = modelScore,
+                entryEntropy = entropyEntryNames.indices.map { i ->
+                    EntryEntropy(
+                        entropyEntryNames[i],
+                        entropyValues[i],
+                        peakWindowEntropyValues[i],
+                        entropyBytesMeasured[i]
+                    )
+                }
             )
         }
     }
@@ -101,3 +191,14 @@ data class ScanResult(
      */
     fun hasVirusTotalDetections(): Boolean = virusTotalDetections > 0
 }
+
+/**
+ * Byte entropy of one APK entry, in bits per byte: over the whole entry and
+ * the highest over any 64 KB window
+ */
+data class EntryEntropy(
+    val name: String,
+    val entropy: Double,
+    val peakWindowEntropy: Double,
+    val bytesMeasured: Long
+)
@@ -0,0 +1,83 @@
+package com.example.whatszap.network
+
+import android.util.Log
+import com.example.whatszap.BuildConfig
+import kotlinx.coroutines.Dispatchers
+import kotlinx.coroutines.withContext
+import okhttp3.OkHttpClient
+import okhttp3.Request
+import java.io.File
+import java.util.concurrent.TimeUnit
+
+/**
+ * Repository for signature pack updates
+ * Downloads delta files that the native scanner applies to its current pack
+ */
+class SignatureUpdateRepository private constructor() {
+    
+    companion object {
+        private const val TAG = "SignatureUpdateRepo"
+        private const val HTTP_OK = 200
+        private const val HTTP_NO_CONTENT = 204
+        private const val HTTP_NOT_MODIFIED = 304
+        
+        @Volatile
+        private var instance: SignatureUpdateRepository? = null
+        
+        fun getInstance(): SignatureUpdateRepository {
+            return instance ?: synchronized(this) {
+                instance ?: SignatureUpdateRepository().also { instance = it }
+            }
+        }
+    }
+    
+    private val updateUrl: String = BuildConfig.SIGNATURE_UPDATE_URL
+    
+    private val okHttpClient = OkHttpClient.Builder()
+        .connectTimeout(30, TimeUnit.SECONDS)
+        .readTimeout(60, TimeUnit.SECONDS)
+        .build()
+    
+    /**
+     * Check if an update endpoint is configured
+     */
+    fun isConfigured(): Boolean = updateUrl.isNotBlank()
+    
+    /**
+     * Download the delta from currentVersion to the latest pack into target
+     * @return true if a delta was written, false if up to date or on error
+     */
+    suspend fun downloadDelta(currentVersion: Long, target: File): Boolean = withContext(Dispatchers.IO) {
+        if (!isConfigured()) {
+            return@withContext false
+        }
+        
+        val request = Request.Builder()
+            .url("$updateUrl?from=$currentVersion")
+            .build()
+        
+        try {
+            okHttpClient.newCall(request).execute().use { response ->
+                when (response.code) {
+                    HTTP_OK -> {
+                        val body = response.body ?: return@withContext false
+                        target.outputStream().use { output -> body.byteStream().copyTo(output) }
+                        Log.i(TAG, "Downloaded signature delta from v$currentVersion (${target.length()} bytes)")
+                        true
+                    }
+                    HTTP_NO_CONTENT, HTTP_NOT_MODIFIED -> {
+                        Log.i(TAG, "Signatures up to date at v$currentVersion")
+                        false
+                    }
+                    else -> {
+                        Log.w(TAG, "Signature update failed: ${response.code}")
+                        false
+                    }
+                }
+            }
+        } catch (e: Exception) {
+            Log.e(TAG, "Exception downloading signature delta", e)
+            false
+        }
+    }
+}
@@ -120,6 +120,27 @@ class VirusTotalRepository private constructor() {
         return@withContext VirusTotalScanResult.notFound(sha256)
     }
     
+    /**
+     * Rebuild a result from a verdict remembered by the native verdict cache,
+     * without spending API quota
+     */
+    fun fromCachedVerdict(
+        sha256: String,
+        detections: Int,
+        engines: Int,
+        threatNames: List<String>
+    ): VirusTotalScanResult = VirusTotalScanResult(
+        isFound = true,
+        isMalicious = detections > 0,
+        maliciousCount = detections,
+        totalEngines = engines,
+        detectionRatio = "$detections/$engines",
+        threatNames = threatNames,
+        sha256 = sha256,
+        virusTotalLink = "$VT_GUI_URL$sha256",
+        errorMessage = null
+    )
+    
     /**
      * Upload file to VirusTotal for scanning
      */